@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "assertf.h"
+#include "grid_experiment.h"
+#include "memory_accounting.h"
+
+/**
+ * End-to-end scalability suite: whole experiments (init, learning phase, evaluation phase) swept along one axis
+ *      at a time from a common base workload: environment size, patch size, learnt models, episode length and threads.
+ *
+ * Every configuration runs in its own child process, so that memory peaks (memory_accounting.h and the max RSS)
+ *      are its own, and so that a crash is reported against the configuration rather than taking the suite down.
+ * Measured per configuration (best of repeat rounds over the sweep, 3 by default):
+ *      learning and evaluation steps/s, recognition latency (wall time and steps per evaluation episode,
+ *      which stops at recognition), accuracy, accounted peak bytes (sum of the per-subsystem peaks) and max RSS.
+ *
+ * Results are compared against a baseline file (one line per configuration, see read_baselines): a configuration
+ *      regresses when its steps/s drop, or its latency or accounted peak grow, by more than threshold percent (30 by default),
+ *      or when it recognizes worse: its accuracy drops by more than accuracy_drop (absolute, 0.01 by default)
+ *      or its steps to recognition grow by more than threshold percent. Runs are seeded, so these two only move
+ *      with the code (and with vote timing when columns run on threads): a baseline must never absorb their drops.
+ * The suite exits with 1 when any configuration regressed. Baselines are machine specific: write one per
+ *      reference machine with write=<file>, and compare runs on that machine only. Shared or virtual machines
+ *      have slow spells of a third and more: raise repeat and threshold there.
+ *
+ * usage: scalability [baseline=<file>] [write=<file>] [threshold=<percent>] [accuracy_drop=<f64>] [repeat=<u32>] [axis=<name>]
+ */
+
+#define BENCH_BASE "world=procedural objects=32 rows=64 cols=64 patch=5 noise=3 " \
+    "train_episodes=8 train_steps=1000 eval_episodes=8 eval_steps=400"
+
+typedef struct bench_case_t_ {
+    const char* name;
+    const char* axis;
+    const char* settings; // applied over BENCH_BASE
+} bench_case_t;
+
+static const bench_case_t BENCH_CASES[] = {
+    {"env_32", "env", "rows=32 cols=32"},
+    {"env_64", "env", "rows=64 cols=64"},
+    {"env_128", "env", "rows=128 cols=128"},
+    {"env_256", "env", "rows=256 cols=256"},
+
+    {"patch_3", "patch", "patch=3"},
+    {"patch_7", "patch", "patch=7"},
+    {"patch_11", "patch", "patch=11"},
+    {"patch_15", "patch", "patch=15"},
+
+    {"models_8", "models", "objects=8"},
+    {"models_32", "models", "objects=32"},
+    {"models_128", "models", "objects=128"},
+
+    {"episode_100", "episode", "train_steps=100 eval_steps=100"},
+    {"episode_400", "episode", "train_steps=400 eval_steps=400"},
+    {"episode_1600", "episode", "train_steps=1600 eval_steps=1600"},
+
+    {"threads_1", "threads", "columns=1"},
+    {"threads_2", "threads", "columns=2"},
+    {"threads_4", "threads", "columns=4"},
+    {"threads_pipeline", "threads", "pipeline=1"},
+};
+#define NUM_BENCH_CASES (sizeof(BENCH_CASES) / sizeof(BENCH_CASES[0]))
+
+#define MAX_BENCH_ARGS 32
+#define BENCH_NAME_LENGTH 64
+
+typedef struct bench_result_t_ {
+    f64 learning_steps_per_s;
+    f64 evaluation_steps_per_s;
+    f64 latency_ms; // per evaluation episode
+    f64 steps_to_recognition;
+    f64 accuracy;
+    u64 peak_bytes; // sum of the per-subsystem peaks
+    u64 max_rss_kb;
+} bench_result_t;
+
+typedef struct bench_baseline_t_ {
+    char name[BENCH_NAME_LENGTH];
+    bench_result_t result;
+} bench_baseline_t;
+
+/**
+ * @brief Tokenizes the base then the case settings into an argv and applies it (argv[0] is skipped, as in main)
+ */
+static void bench_config(grid_experiment_config* config, const bench_case_t* bench_case) {
+    char settings[512];
+    snprintf(settings, sizeof(settings), "%s %s", BENCH_BASE, bench_case->settings);
+
+    char* argv[MAX_BENCH_ARGS];
+    int argc = 0;
+    argv[argc++] = "scalability";
+    for(char* token = strtok(settings, " "); token != NULL; token = strtok(NULL, " ")) {
+        assertf(argc < MAX_BENCH_ARGS, "too many settings for %s", bench_case->name);
+        argv[argc++] = token;
+    }
+
+    default_experiment_config(config);
+    parse_experiment_args(config, argc, argv);
+}
+
+// Child side: one whole experiment, its result written to fd
+static void run_case(const bench_case_t* bench_case, int fd) {
+    grid_experiment_config config;
+    bench_config(&config, bench_case);
+
+    grid_experiment_t experiment;
+    init_grid_experiment(&experiment, config);
+    run_learning_phase(&experiment);
+    run_evaluation_phase(&experiment);
+
+    phase_report_t learning = experiment.learning_report;
+    phase_report_t evaluation = experiment.evaluation_report;
+    free_grid_experiment(&experiment);
+
+    bench_result_t result = {
+        .learning_steps_per_s = learning.steps / (learning.seconds > 0 ? learning.seconds : 1e-9),
+        .evaluation_steps_per_s = evaluation.steps / (evaluation.seconds > 0 ? evaluation.seconds : 1e-9),
+        .latency_ms = evaluation.episodes ? evaluation.seconds * 1000 / evaluation.episodes : 0,
+        .steps_to_recognition = evaluation.recognized ? (f64) evaluation.steps_to_recognition / evaluation.recognized : 0,
+        .accuracy = evaluation.episodes ? (f64) evaluation.correct / evaluation.episodes : 0
+    };
+    for(u32 t = 0; t < NUM_MEMORY_TAGS; ++t)
+        result.peak_bytes += get_memory_stats(t).peak;
+
+    assertf(write(fd, &result, sizeof(result)) == sizeof(result), "could not send the result of %s", bench_case->name);
+}
+
+/**
+ * @brief Runs the case in a child process
+ * @returns 0 if the child did not report a result (crashed)
+ */
+static int run_case_isolated(const bench_case_t* bench_case, bench_result_t* result) {
+    int fds[2];
+    assertf(pipe(fds) == 0, "could not create a pipe");
+
+    fflush(stdout);
+    pid_t pid = fork();
+    assertf(pid >= 0, "could not fork");
+
+    if(pid == 0) {
+        close(fds[0]);
+        run_case(bench_case, fds[1]);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    ssize_t received = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    assertf(wait4(pid, &status, 0, &usage) == pid, "could not wait for %s", bench_case->name);
+    result->max_rss_kb = usage.ru_maxrss;
+
+    return received == sizeof(*result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Keeps the best of both runs: highest throughputs, lowest latency and memory
+static void keep_best(bench_result_t* best, const bench_result_t* run) {
+    if(run->learning_steps_per_s > best->learning_steps_per_s) best->learning_steps_per_s = run->learning_steps_per_s;
+    if(run->evaluation_steps_per_s > best->evaluation_steps_per_s) best->evaluation_steps_per_s = run->evaluation_steps_per_s;
+    if(run->latency_ms < best->latency_ms) best->latency_ms = run->latency_ms;
+    if(run->peak_bytes < best->peak_bytes) best->peak_bytes = run->peak_bytes;
+    if(run->max_rss_kb < best->max_rss_kb) best->max_rss_kb = run->max_rss_kb;
+}
+
+/**
+ * @brief Lines are: name learning_steps/s evaluation_steps/s latency_ms steps_to_recognition accuracy peak_bytes max_rss_kb.
+ * Blank lines and lines starting with # are ignored
+ *
+ * @returns the number of baselines read, 0 if there is no such file
+ */
+static u32 read_baselines(const char* filename, bench_baseline_t* baselines, u32 capacity) {
+    FILE* f = fopen(filename, "r");
+    if(f == NULL) return 0;
+
+    char line[256];
+    u32 count = 0;
+    while(fgets(line, sizeof(line), f) != NULL) {
+        if(line[0] == '#' || line[0] == '\n') continue;
+        assertf(count < capacity, "baseline %s has more than %u configurations", filename, capacity);
+
+        bench_baseline_t* b = baselines + count;
+        unsigned long long peak_bytes, max_rss_kb;
+        int fields = sscanf(line, "%63s %lf %lf %lf %lf %lf %llu %llu", b->name,
+            &b->result.learning_steps_per_s, &b->result.evaluation_steps_per_s, &b->result.latency_ms,
+            &b->result.steps_to_recognition, &b->result.accuracy, &peak_bytes, &max_rss_kb);
+        assertf(fields == 8, "malformed line in baseline %s: %s", filename, line);
+
+        b->result.peak_bytes = peak_bytes;
+        b->result.max_rss_kb = max_rss_kb;
+        count += 1;
+    }
+
+    fclose(f);
+    return count;
+}
+
+static const bench_result_t* find_baseline(const bench_baseline_t* baselines, u32 count, const char* name) {
+    for(u32 i = 0; i < count; ++i) {
+        if(strcmp(baselines[i].name, name) == 0) return &baselines[i].result;
+    }
+    return NULL;
+}
+
+// Relative change from base to value, in percents
+static f64 change(f64 value, f64 base) {
+    return base > 0 ? (value - base) * 100 / base : 0;
+}
+
+/**
+ * @brief Prints the deltas against the baseline and flags the regressions (higher is better for throughputs and accuracy)
+ * @returns 1 if the configuration regressed
+ */
+static int compare_to_baseline(const bench_result_t* r, const bench_result_t* base, f64 threshold, f64 accuracy_drop) {
+    f64 learning = change(r->learning_steps_per_s, base->learning_steps_per_s);
+    f64 evaluation = change(r->evaluation_steps_per_s, base->evaluation_steps_per_s);
+    f64 latency = change(r->latency_ms, base->latency_ms);
+    f64 peak = change(r->peak_bytes, base->peak_bytes);
+    f64 steps = change(r->steps_to_recognition, base->steps_to_recognition);
+    f64 accuracy = r->accuracy - base->accuracy;
+
+    int regressed = learning < -threshold || evaluation < -threshold || latency > threshold || peak > threshold
+        || steps > threshold || accuracy < -accuracy_drop;
+    printf("    vs baseline: learning %+.1f%% evaluation %+.1f%% latency %+.1f%% peak %+.1f%% steps %+.1f%% accuracy %+.3f%s\n",
+        learning, evaluation, latency, peak, steps, accuracy, regressed ? "  REGRESSION" : "");
+
+    return regressed;
+}
+
+static int parse_arg(const char* arg, const char* key, const char** value) {
+    size_t length = strlen(key);
+    if(strncmp(arg, key, length) != 0 || arg[length] != '=') return 0;
+
+    *value = arg + length + 1;
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    const char* baseline_file = NULL;
+    const char* write_file = NULL;
+    const char* axis = NULL;
+    f64 threshold = 30;
+    f64 accuracy_drop = 0.01;
+    u32 repeat = 3;
+
+    for(int i = 1; i < argc; ++i) {
+        const char* value;
+        if(parse_arg(argv[i], "baseline", &value)) baseline_file = value;
+        else if(parse_arg(argv[i], "write", &value)) write_file = value;
+        else if(parse_arg(argv[i], "axis", &value)) axis = value;
+        else if(parse_arg(argv[i], "threshold", &value)) threshold = atof(value);
+        else if(parse_arg(argv[i], "accuracy_drop", &value)) accuracy_drop = atof(value);
+        else if(parse_arg(argv[i], "repeat", &value)) repeat = strtoul(value, NULL, 10);
+        else {
+            printf("usage: %s [baseline=<file>] [write=<file>] [threshold=<percent>] [accuracy_drop=<f64>] [repeat=<u32>] [axis=<name>]\n",
+                argv[0]);
+            return 1;
+        }
+    }
+    assertf(repeat >= 1 && threshold > 0 && accuracy_drop >= 0, "repeat at least once, with a positive threshold and accuracy drop");
+
+    bench_baseline_t baselines[NUM_BENCH_CASES];
+    u32 num_baselines = baseline_file != NULL ? read_baselines(baseline_file, baselines, NUM_BENCH_CASES) : 0;
+    if(baseline_file != NULL && num_baselines == 0) printf("no baseline in %s, nothing to compare to\n", baseline_file);
+
+    FILE* out = NULL;
+    if(write_file != NULL) {
+        out = fopen(write_file, "w");
+        assertf(out != NULL, "could not open %s", write_file);
+        fprintf(out, "# base: %s\n", BENCH_BASE);
+        fprintf(out, "# name learning_steps/s evaluation_steps/s latency_ms steps_to_recognition accuracy peak_bytes max_rss_kb\n");
+    }
+
+    printf("base: %s\n", BENCH_BASE);
+
+    // Rounds over the whole sweep rather than back to back repeats, so that the best of a case
+    //      does not depend on a slow spell of the machine
+    bench_result_t best[NUM_BENCH_CASES];
+    int ok[NUM_BENCH_CASES];
+    for(u32 r = 0; r < repeat; ++r) {
+        for(u32 c = 0; c < NUM_BENCH_CASES; ++c) {
+            const bench_case_t* bench_case = BENCH_CASES + c;
+            if((axis != NULL && strcmp(axis, bench_case->axis) != 0) || (r > 0 && !ok[c])) continue;
+
+            bench_result_t run;
+            ok[c] = run_case_isolated(bench_case, r == 0 ? &best[c] : &run);
+            if(r > 0 && ok[c]) keep_best(&best[c], &run);
+        }
+    }
+
+    u32 num_regressions = 0, num_failures = 0;
+    for(u32 c = 0; c < NUM_BENCH_CASES; ++c) {
+        const bench_case_t* bench_case = BENCH_CASES + c;
+        if(axis != NULL && strcmp(axis, bench_case->axis) != 0) continue;
+
+        if(!ok[c]) {
+            printf("[%s] %s: FAILED (no result)\n", bench_case->name, bench_case->settings);
+            num_failures += 1;
+            continue;
+        }
+
+        const bench_result_t* result = best + c;
+        printf("[%s] %s: learning_steps/s=%.0f evaluation_steps/s=%.0f latency=%.3fms steps_to_recognition=%.2f accuracy=%.3f "
+            "peak=%.1fMB max_rss=%.1fMB\n", bench_case->name, bench_case->settings,
+            result->learning_steps_per_s, result->evaluation_steps_per_s, result->latency_ms, result->steps_to_recognition,
+            result->accuracy, result->peak_bytes / 1048576.0, result->max_rss_kb / 1024.0);
+
+        const bench_result_t* base = find_baseline(baselines, num_baselines, bench_case->name);
+        if(base != NULL) num_regressions += compare_to_baseline(result, base, threshold, accuracy_drop);
+        else if(num_baselines > 0) printf("    no baseline\n");
+
+        if(out != NULL) {
+            fprintf(out, "%s %.0f %.0f %.4f %.2f %.3f %llu %llu\n", bench_case->name,
+                result->learning_steps_per_s, result->evaluation_steps_per_s, result->latency_ms, result->steps_to_recognition,
+                result->accuracy, (unsigned long long) result->peak_bytes, (unsigned long long) result->max_rss_kb);
+        }
+    }
+
+    if(out != NULL) fclose(out);
+
+    if(num_baselines > 0)
+        printf("%u configurations regressed by more than %.0f%% (or %.3f accuracy), %u failed\n",
+            num_regressions, threshold, accuracy_drop, num_failures);
+    return num_regressions > 0 || num_failures > 0;
+}
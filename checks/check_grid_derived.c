@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "types.h"
+#include "arena.h"
+#include "distributions.h"
+#include "grid_environment.h"
+#include "grid_derived.h"
+#include "sensor_module.h"
+
+/**
+ * Checks the lazily synced structures of a tracked grid against recomputing them from scratch:
+ *      a random mix of grid_set_cell and grid_write_rect (single cells up to the whole grid) mutates the grid,
+ *      and every round queries each structure or not, so that they fall behind by different numbers of rects,
+ *      past GRID_DIRTY_LOG_CAPACITY too (bursts of set_cell overflow the log every few rounds).
+ * Every level of the depth pyramid is compared to downsampling the depths again, integral image sums of random rects
+ *      (empty, single cells, across tiles) to summing the depths, and the sensor cache's output at every location
+ *      to extract_patch + sensor_module.
+ * The grid's sides are not multiples of GRID_TILE_SIDE nor powers of two, so that partial tiles and odd levels are covered.
+ *
+ * Exits with 1 when any check failed.
+ */
+
+#define ROWS 53
+#define COLS 38
+#define PATCH_SIDELEN 5
+#define NUM_ROUNDS 400
+#define NUM_SUMS 200
+
+static int failures = 0;
+
+static void check(int condition, const char* what, u32 round) {
+    if(!condition) {
+        if(failures < 10) printf("FAILED at round %u: %s\n", round, what);
+        failures += 1;
+    }
+}
+
+static i32 random_i32(i32 min, i32 max) {
+    return min + (i32) unif_rand_u32((u32) (max - min));
+}
+
+// Random rect of the grid, empty ones included
+static grid_rect_t random_rect() {
+    i32 row_min = random_i32(0, ROWS), col_min = random_i32(0, COLS);
+    return (grid_rect_t) {row_min, random_i32(row_min, ROWS), col_min, random_i32(col_min, COLS)};
+}
+
+static void random_mutation(grid_t* env) {
+    static u8 depths[ROWS * COLS];
+    static u32 values[ROWS * COLS];
+
+    if(unif_rand_u32(3) != 0) {
+        grid_set_cell(env, random_i32(0, ROWS - 1), random_i32(0, COLS - 1), unif_rand_u32(UINT8_MAX), unif_rand_u32(7));
+        return;
+    }
+
+    // mostly small rects, sometimes the whole grid
+    grid_rect_t r = unif_rand_u32(7) == 0 ? (grid_rect_t) {0, ROWS, 0, COLS} : random_rect();
+    if(unif_rand_u32(1)) {
+        r.row_max = r.row_min + (r.row_max - r.row_min) % 6;
+        r.col_max = r.col_min + (r.col_max - r.col_min) % 6;
+    }
+    for(u32 i = 0; i < ROWS * COLS; ++i) {
+        depths[i] = unif_rand_u32(UINT8_MAX);
+        values[i] = unif_rand_u32(7);
+    }
+    grid_write_rect(env, r, depths, COLS, values, COLS);
+}
+
+static void check_pyramid(depth_pyramid_t* pyramid, grid_t* env, u32 round) {
+    static u8 below[ROWS * COLS], level[ROWS * COLS];
+
+    u32 rows = env->rows, cols = env->cols;
+    for(u32 i = 0; i < rows * cols; ++i) below[i] = env->depths.data[i];
+
+    for(u32 l = 1; l < pyramid->num_levels; ++l) {
+        u32 level_rows = (rows + 1) / 2, level_cols = (cols + 1) / 2;
+        for(u32 i = 0; i < level_rows; ++i) {
+            for(u32 j = 0; j < level_cols; ++j) {
+                u32 sum = 0, count = 0;
+                for(u32 si = 2 * i; si < 2 * i + 2 && si < rows; ++si)
+                    for(u32 sj = 2 * j; sj < 2 * j + 2 && sj < cols; ++sj) {
+                        sum += below[si * cols + sj];
+                        count += 1;
+                    }
+                level[i * level_cols + j] = sum / count;
+            }
+        }
+
+        mat_u8 synced = depth_pyramid_level(pyramid, l);
+        check(synced.rows == level_rows && synced.cols == level_cols, "pyramid level shape", round);
+        check(memcmp(synced.data, level, level_rows * level_cols) == 0, "pyramid level differs from downsampling the depths", round);
+
+        memcpy(below, level, level_rows * level_cols);
+        rows = level_rows;
+        cols = level_cols;
+    }
+}
+
+static void check_integral(integral_image_t* integral, grid_t* env, u32 round) {
+    for(u32 s = 0; s < NUM_SUMS; ++s) {
+        grid_rect_t r = s == 0 ? (grid_rect_t) {0, ROWS, 0, COLS} : random_rect();
+
+        u64 sum = 0;
+        for(i32 i = r.row_min; i < r.row_max; ++i)
+            for(i32 j = r.col_min; j < r.col_max; ++j)
+                sum += MAT(env->depths, i, j);
+
+        check(integral_image_sum(integral, r) == sum, "integral image sum differs from summing the depths", round);
+    }
+}
+
+static int same_vec3d(vec3d a, vec3d b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static int same_observation(features_t fa, pose_t pa, features_t fb, pose_t pb) {
+    return memcmp(&fa, &fb, sizeof(fa)) == 0
+        && same_vec3d(pa.point_normal, pb.point_normal)
+        && same_vec3d(pa.curvature_direction_1, pb.curvature_direction_1)
+        && same_vec3d(pa.curvature_direction_2, pb.curvature_direction_2)
+        && pa.curvature_direction_1_angle == pb.curvature_direction_1_angle
+        && pa.curvature_direction_2_angle == pb.curvature_direction_2_angle
+        && pa.pose_fully_defined == pb.pose_fully_defined;
+}
+
+// Returns the number of locations compared
+static u32 check_sensor_cache(sensor_cache_t* cache, grid_t* env, grid_t* patch, u32 round) {
+    i32 radius = PATCH_SIDELEN / 2;
+    u32 compared = 0;
+
+    for(i32 x = radius; x < ROWS - radius; ++x) {
+        for(i32 y = radius; y < COLS - radius; ++y) {
+            vec2d location = {.x = x, .y = y};
+            features_t cached_features, features;
+            pose_t cached_pose, pose;
+
+            sensor_cache_get(&cached_features, &cached_pose, cache, location);
+            extract_patch(patch, env, location, PATCH_SIDELEN);
+            sensor_module(&features, &pose, *patch, (vec2d) {.x = radius, .y = radius});
+
+            check(same_observation(cached_features, cached_pose, features, pose), "sensor cache differs from sensing the patch", round);
+            compared += 1;
+        }
+    }
+
+    return compared;
+}
+
+int main() {
+    unif_rand_seed(13);
+    init_integer_math();
+
+    arena_t arena;
+    arena_init(&arena, 64 * ROWS * COLS + 16 * ROWS * COLS * (sizeof(features_t) + sizeof(pose_t)) + (1 << 16));
+
+    grid_t env, patch;
+    init_grid_env(&env, ROWS, COLS, &arena);
+    init_grid_env(&patch, PATCH_SIDELEN, PATCH_SIDELEN, &arena);
+    populate_grid_env_random(&env);
+    track_grid_env(&env, &arena);
+
+    depth_pyramid_t pyramid;
+    integral_image_t integral;
+    sensor_cache_t cache;
+    init_depth_pyramid(&pyramid, &env, &arena);
+    init_integral_image(&integral, &env, &arena);
+    init_sensor_cache(&cache, &env, PATCH_SIDELEN, &arena);
+
+    u32 overflows = 0;
+    u64 num_locations = 0;
+    for(u32 round = 0; round < NUM_ROUNDS; ++round) {
+        u32 num_mutations = round % 8 == 7 ? GRID_DIRTY_LOG_CAPACITY + 1 + unif_rand_u32(16) : unif_rand_u32(12);
+        for(u32 m = 0; m < num_mutations; ++m) random_mutation(&env);
+
+        if(unif_rand_u32(1)) {
+            overflows += grid_dirty_overflowed(&env, pyramid.synced);
+            check_pyramid(&pyramid, &env, round);
+        }
+        if(unif_rand_u32(1)) {
+            overflows += grid_dirty_overflowed(&env, integral.synced);
+            check_integral(&integral, &env, round);
+        }
+        if(unif_rand_u32(2) == 0) {
+            overflows += grid_dirty_overflowed(&env, cache.synced);
+            num_locations += check_sensor_cache(&cache, &env, &patch, round);
+        }
+    }
+    check(overflows > 0, "no structure fell past the dirty log", NUM_ROUNDS);
+
+    printf("check_grid_derived: %u rounds, %llu rects marked, %u overflowed syncs, %llu cached locations compared, %d failures\n",
+        NUM_ROUNDS, (unsigned long long) env.dirty->generation, overflows, (unsigned long long) num_locations, failures);
+
+    arena_free(&arena);
+    return failures > 0;
+}
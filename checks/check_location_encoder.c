@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "types.h"
+#include "arena.h"
+#include "location.h"
+#include "distributions.h"
+#include "encoder.h"
+
+/**
+ * Checks path integration: for random encoders (modules, module sides, bumps, periods), a location code
+ *      moved step by step (location_code_move) by random moves, short and long, keeps exactly the phases
+ *      and the SDR of encoding the reached location from scratch (location_code_set, encode_location),
+ *      walks that go far out of the world and back included (the phases wrap with the u32 overflow).
+ * Every SDR has the announced length and active count, with sorted indices.
+ *
+ * Exits with 1 when any check failed.
+ */
+
+#define NUM_ENCODERS 32
+#define NUM_MOVES 20000
+
+static int failures = 0;
+
+static void check(int condition, const char* what, u32 encoder, u32 move) {
+    if(!condition) {
+        if(failures < 10) printf("FAILED for encoder %u at move %u: %s\n", encoder, move, what);
+        failures += 1;
+    }
+}
+
+static i32 random_i32(i32 min, i32 max) {
+    return min + (i32) unif_rand_u32((u32) (max - min));
+}
+
+int main() {
+    unif_rand_seed(11);
+
+    arena_t arena;
+    arena_init(&arena, 1 << 24);
+
+    static u16 integrated_indices[UINT16_MAX], encoded_indices[UINT16_MAX];
+    u64 num_bits_checked = 0;
+
+    for(u32 e = 0; e < NUM_ENCODERS; ++e) {
+        arena_reset(&arena);
+
+        u32 num_modules = 1 + unif_rand_u32(MAX_GRID_MODULES - 1);
+        u32 side_bits = 2 + unif_rand_u32(3);
+        u32 bump_side = 1 + unif_rand_u32(3);
+        f32 min_period = 2 + unif_rand_f32(10);
+        f32 scale_ratio = 1 + unif_rand_f32(0.6f);
+
+        location_encoder_t encoder;
+        init_location_encoder(&encoder, num_modules, side_bits, bump_side, min_period, scale_ratio, &arena);
+
+        vec2d location = {.x = random_i32(-1000, 1000), .y = random_i32(-1000, 1000)};
+        location_code_t code;
+        location_code_set(&encoder, &code, location);
+
+        spvec_u1 integrated = {.indices = integrated_indices}, encoded = {.indices = encoded_indices};
+
+        for(u32 m = 0; m < NUM_MOVES; ++m) {
+            // mostly the policies' small moves, sometimes a jump across or out of the world
+            vec2d move = unif_rand_u32(15) == 0
+                ? (vec2d) {.x = random_i32(-100000, 100000), .y = random_i32(-100000, 100000)}
+                : (vec2d) {.x = random_i32(-2, 2), .y = random_i32(-2, 2)};
+            location = vec_added(location, move);
+            location_code_move(&encoder, &code, move);
+
+            location_code_t reference;
+            location_code_set(&encoder, &reference, location);
+            check(memcmp(code.phases, reference.phases, num_modules * sizeof(code.phases[0])) == 0,
+                "integrated phases differ from the encoded location's", e, m);
+
+            location_code_sdr(&encoder, &code, &integrated);
+            encode_location(&encoder, location, &encoded);
+
+            check(integrated.length == location_sdr_length(&encoder) && integrated.non_null_count == location_sdr_active(&encoder),
+                "SDR length or active count", e, m);
+            check(integrated.length == encoded.length && integrated.non_null_count == encoded.non_null_count
+                && memcmp(integrated.indices, encoded.indices, encoded.non_null_count * sizeof(u16)) == 0,
+                "integrated SDR differs from the encoded location's", e, m);
+            for(u32 i = 1; i < integrated.non_null_count; ++i)
+                check(integrated.indices[i - 1] < integrated.indices[i], "SDR indices are not sorted", e, m);
+
+            num_bits_checked += integrated.non_null_count;
+        }
+    }
+
+    printf("check_location_encoder: %u encoders, %u moves each, %llu active bits compared, %d failures\n",
+        NUM_ENCODERS, NUM_MOVES, (unsigned long long) num_bits_checked, failures);
+
+    arena_free(&arena);
+    return failures > 0;
+}
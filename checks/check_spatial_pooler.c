@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "types.h"
+#include "arena.h"
+#include "distributions.h"
+#include "spatial_pooler.h"
+#include "encoder.h"
+
+/**
+ * Checks the spatial pooler (overlaps through fan_out, counting k-winners) against a dense recount:
+ *      every column's overlap from its pool, then the num_active_columns highest ones, ties to the lowest column ids.
+ * Inputs are random feature SDRs (encode_features of random features), so that many columns tie.
+ * With learning, the winners' permanences are checked against a dense update of a copy,
+ *      and both copies of the pools (by column and fan_out, through mirror) must stay in sync.
+ *
+ * Exits with 1 when any check failed.
+ */
+
+#define NUM_COLUMNS 2048
+#define NUM_STEPS 1000
+
+static int failures = 0;
+
+static void check(int condition, const char* what, u32 step) {
+    if(!condition) {
+        if(failures < 10) printf("FAILED at step %u: %s\n", step, what);
+        failures += 1;
+    }
+}
+
+static features_t random_features() {
+    return (features_t) {
+        .value = unif_rand_u32(FEATURE_SDR_VALUE_CATEGORIES * 2),
+        .mean_depth = unif_rand_u32(UINT16_MAX),
+        .principal_curvature_1_fp = (i32) unif_rand_u32(6 << CURVATURE_FRACTIONAL_BITS) - (3 << CURVATURE_FRACTIONAL_BITS),
+        .principal_curvature_2_fp = (i32) unif_rand_u32(6 << CURVATURE_FRACTIONAL_BITS) - (3 << CURVATURE_FRACTIONAL_BITS)
+    };
+}
+
+static u8 saturate(i32 permanence) {
+    return permanence < 0 ? 0 : permanence > UINT8_MAX ? UINT8_MAX : permanence;
+}
+
+int main() {
+    unif_rand_seed(5);
+
+    spatial_pooler_config_t config;
+    default_spatial_pooler_config(&config, FEATURE_SDR_LENGTH, NUM_COLUMNS);
+
+    arena_t arena;
+    arena_init(&arena, spatial_pooler_arena_bytes(&config));
+    spatial_pooler_t sp;
+    init_spatial_pooler(&sp, config, &arena);
+
+    size_t entries = sp.pools.length;
+    u8* reference = malloc(entries);
+    u8* active_inputs = calloc(config.input_bits, 1);
+    u32* overlaps = malloc(NUM_COLUMNS * sizeof(u32));
+    u8* won = malloc(NUM_COLUMNS);
+
+    u16 input_indices[FEATURE_SDR_ACTIVE];
+    u16 winner_indices[NUM_COLUMNS];
+    spvec_u1 input = {.indices = input_indices}, winners = {.indices = winner_indices};
+    u64 num_winners = 0;
+
+    for(u32 step = 0; step < NUM_STEPS; ++step) {
+        int learning = step % 2 == 0;
+        encode_features(&input, random_features());
+        memcpy(reference, sp.pools.data, entries);
+
+        spatial_pooler_compute(&sp, &input, learning, &winners);
+
+        memset(active_inputs, 0, config.input_bits);
+        for(u32 i = 0; i < input.non_null_count; ++i) active_inputs[input.indices[i]] = 1;
+
+        u32 num_candidates = 0;
+        for(u32 c = 0; c < NUM_COLUMNS; ++c) {
+            overlaps[c] = 0;
+            for(u32 e = sp.pools.rows[c]; e < sp.pools.rows[c + 1]; ++e)
+                overlaps[c] += active_inputs[sp.pools.cols[e]] && reference[e] >= config.connected_permanence;
+            num_candidates += overlaps[c] >= config.stimulus_threshold;
+        }
+
+        // dense k-winners: the highest overlap first, then the lowest column
+        memset(won, 0, NUM_COLUMNS);
+        u32 k = num_candidates < config.num_active_columns ? num_candidates : config.num_active_columns;
+        for(u32 w = 0; w < k; ++w) {
+            i64 best = -1;
+            for(u32 c = 0; c < NUM_COLUMNS; ++c) {
+                if(won[c] || overlaps[c] < config.stimulus_threshold) continue;
+                if(best < 0 || overlaps[c] > overlaps[best]) best = c;
+            }
+            won[best] = 1;
+        }
+
+        check(winners.length == NUM_COLUMNS, "output length", step);
+        check(winners.non_null_count == k, "number of winners", step);
+        u32 count = 0;
+        for(u32 c = 0; c < NUM_COLUMNS; ++c) {
+            if(!won[c]) continue;
+            check(count < winners.non_null_count && winners.indices[count] == c, "winner missing or out of order", step);
+            count += 1;
+        }
+        num_winners += count;
+
+        for(u32 c = 0; c < NUM_COLUMNS; ++c) {
+            for(u32 e = sp.pools.rows[c]; e < sp.pools.rows[c + 1]; ++e) {
+                u8 expected = reference[e];
+                if(learning && won[c])
+                    expected = active_inputs[sp.pools.cols[e]]
+                        ? saturate(expected + config.permanence_increment)
+                        : saturate(expected - config.permanence_decrement);
+                check(sp.pools.data[e] == expected, "permanence differs from the dense update", step);
+
+                u32 f = sp.mirror[e];
+                check(sp.fan_out.data[f] == sp.pools.data[e] && sp.fan_out.cols[f] == c
+                    && f >= sp.fan_out.rows[sp.pools.cols[e]] && f < sp.fan_out.rows[sp.pools.cols[e] + 1],
+                    "fan_out entry out of sync with its pool entry", step);
+            }
+        }
+    }
+
+    printf("check_spatial_pooler: %u steps, %u columns, %.1f winners per step, %d failures\n",
+        NUM_STEPS, NUM_COLUMNS, (f64) num_winners / NUM_STEPS, failures);
+
+    free(reference); free(active_inputs); free(overlaps); free(won);
+    arena_free(&arena);
+    return failures > 0;
+}
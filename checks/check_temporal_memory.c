@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "types.h"
+#include "arena.h"
+#include "bitset.h"
+#include "distributions.h"
+#include "temporal_memory.h"
+
+/**
+ * Checks htm_lm's overlaps, counted through the synapse lists of the active inputs,
+ *      against a brute-force recount over every segment slot and synapse slot.
+ * Random sequences of location and feature SDRs are learnt, replaying a few of them so that segments
+ *      become active, grow, get punished and get recycled. After every prediction:
+ *      - every segment's connected and potential overlaps equal the recount (0 for the untouched ones)
+ *      - the active and matching segment lists are exactly the segments over the thresholds, in order
+ *      - the predicted columns are the columns of the active segments
+ *      - the synapse lists hold exactly the used slots, and the connected masks match the permanences
+ *
+ * Exits with 1 when any check failed.
+ */
+
+#define NUM_COLUMNS 256
+#define LOCATION_BITS 512
+#define FEATURE_ACTIVE 12
+#define LOCATION_ACTIVE 24
+#define NUM_SEQUENCES 8
+#define SEQUENCE_LENGTH 16
+#define NUM_STEPS 2000
+
+static int failures = 0;
+
+static void check(int condition, const char* what, u32 step) {
+    if(!condition) {
+        if(failures < 10) printf("FAILED at step %u: %s\n", step, what);
+        failures += 1;
+    }
+}
+
+// count distinct sorted indices below length
+static void random_sdr(spvec_u1* sdr, u16* indices, u32 length, u32 count) {
+    u64 drawn[BITSET_WORDS(LOCATION_BITS)] = {0};
+    for(u32 k = 0; k < count;) {
+        u32 i = unif_rand_u32(length - 1);
+        if(bitset_test(drawn, i)) continue;
+        bitset_set(drawn, i);
+        k += 1;
+    }
+
+    u32 k = 0;
+    for(u32 i = 0; i < length; ++i)
+        if(bitset_test(drawn, i)) indices[k++] = i;
+
+    sdr->indices = indices;
+    sdr->length = length;
+    sdr->non_null_count = count;
+}
+
+static void check_overlaps(const htm_lm* lm, const spvec_u1* location, const u32* previous_cells, u32 num_previous, u32 step) {
+    const htm_lm_config_t* config = &lm->config;
+    u32 num_segments = config->num_columns * config->cells_per_column * config->segments_per_cell;
+
+    static u8 active_inputs[LOCATION_BITS + NUM_COLUMNS * 64];
+    memset(active_inputs, 0, lm->num_inputs);
+    for(u32 i = 0; i < location->non_null_count; ++i) active_inputs[location->indices[i]] = 1;
+    for(u32 i = 0; i < num_previous; ++i) active_inputs[config->location_bits + previous_cells[i]] = 1;
+
+    u32 a = 0, m = 0;
+    u64 used_slots = 0;
+    for(u32 s = 0; s < num_segments; ++s) {
+        u32 connected = 0, potential = 0;
+        for(u32 slot = 0; slot < config->synapses_per_segment; ++slot) {
+            if(!((lm->used[s] >> slot) & 1)) {
+                check(!((lm->connected[s] >> slot) & 1), "an unused slot is connected", step);
+                continue;
+            }
+            size_t synapse = (size_t) s * config->synapses_per_segment + slot;
+            int is_connected = lm->permanences[synapse] >= config->connected_permanence;
+            check(is_connected == (int) ((lm->connected[s] >> slot) & 1), "connected mask and permanence disagree", step);
+
+            used_slots += 1;
+            if(!active_inputs[lm->presynaptic[synapse]]) continue;
+            potential += 1;
+            connected += is_connected;
+        }
+
+        check(lm->connected_overlaps[s] == connected, "connected overlap differs from the recount", step);
+        check(lm->potential_overlaps[s] == potential, "potential overlap differs from the recount", step);
+
+        if(connected >= config->activation_threshold) {
+            check(a < lm->num_active_segments && lm->active_segments[a] == s, "active segment missing or out of order", step);
+            a += 1;
+        }
+        if(potential >= config->learning_threshold) {
+            check(m < lm->num_matching_segments && lm->matching_segments[m] == s, "matching segment missing or out of order", step);
+            m += 1;
+        }
+    }
+    check(a == lm->num_active_segments, "extra active segments", step);
+    check(m == lm->num_matching_segments, "extra matching segments", step);
+    check(used_slots == htm_lm_num_synapses(lm), "synapse lists and used slots disagree", step);
+
+    static u16 predicted_indices[NUM_COLUMNS];
+    spvec_u1 predicted = {.indices = predicted_indices};
+    htm_lm_predicted_columns((htm_lm*) lm, &predicted);
+    u32 count = 0;
+    for(u32 c = 0; c < config->num_columns; ++c) {
+        u32 segments_per_column = config->cells_per_column * config->segments_per_cell;
+        int any = 0;
+        for(u32 s = c * segments_per_column; s < (c + 1) * segments_per_column; ++s)
+            any |= lm->connected_overlaps[s] >= config->activation_threshold;
+        if(!any) continue;
+        check(count < predicted.non_null_count && predicted.indices[count] == c, "predicted column missing or out of order", step);
+        count += 1;
+    }
+    check(count == predicted.non_null_count, "extra predicted columns", step);
+}
+
+int main() {
+    unif_rand_seed(7);
+
+    htm_lm_config_t config;
+    default_htm_lm_config(&config, NUM_COLUMNS, LOCATION_BITS);
+    config.cells_per_column = 4;
+    config.segments_per_cell = 3; // few, so that segments get recycled
+    config.activation_threshold = 6;
+    config.learning_threshold = 4;
+    config.max_new_synapses = 12;
+
+    arena_t arena;
+    arena_init(&arena, htm_lm_arena_bytes(&config));
+    htm_lm lm;
+    init_htm_lm(&lm, config, &arena);
+
+    static u16 location_indices[NUM_SEQUENCES][SEQUENCE_LENGTH][LOCATION_ACTIVE];
+    static u16 feature_indices[NUM_SEQUENCES][SEQUENCE_LENGTH][FEATURE_ACTIVE];
+    spvec_u1 locations[NUM_SEQUENCES][SEQUENCE_LENGTH], features[NUM_SEQUENCES][SEQUENCE_LENGTH];
+    for(u32 q = 0; q < NUM_SEQUENCES; ++q) {
+        for(u32 t = 0; t < SEQUENCE_LENGTH; ++t) {
+            random_sdr(&locations[q][t], location_indices[q][t], LOCATION_BITS, LOCATION_ACTIVE);
+            random_sdr(&features[q][t], feature_indices[q][t], NUM_COLUMNS, FEATURE_ACTIVE);
+        }
+    }
+
+    static u32 previous_cells[NUM_COLUMNS * 64];
+    static u16 noise_indices[FEATURE_ACTIVE];
+    for(u32 step = 0; step < NUM_STEPS; ++step) {
+        u32 q = (step / SEQUENCE_LENGTH) % NUM_SEQUENCES, t = step % SEQUENCE_LENGTH;
+        if(t == 0) htm_lm_new_episode(&lm);
+
+        u32 num_previous = lm.num_active_cells;
+        memcpy(previous_cells, lm.active_cells, num_previous * sizeof(u32));
+
+        htm_lm_predict(&lm, &locations[q][t]);
+        check_overlaps(&lm, &locations[q][t], previous_cells, num_previous, step);
+
+        // one observation in 8 is noise, so that segments predicting the sequence get punished
+        spvec_u1 observed = features[q][t];
+        if(unif_rand_u32(7) == 0) random_sdr(&observed, noise_indices, NUM_COLUMNS, FEATURE_ACTIVE);
+        htm_lm_observe(&lm, &observed, step < NUM_STEPS * 3 / 4);
+    }
+
+    print_htm_lm_stats("check_temporal_memory", lm.stats);
+    printf("check_temporal_memory: %u steps, %llu synapses, %d failures\n", NUM_STEPS,
+        (unsigned long long) htm_lm_num_synapses(&lm), failures);
+
+    arena_free(&arena);
+    return failures > 0;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "types.h"
+#include "arena.h"
+#include "distributions.h"
+#include "grid_environment.h"
+#include "object_generator.h"
+#include "voxel_environment.h"
+
+/**
+ * Checks the brick map against a dense volume: random set_voxel (overwrites included) in a world whose sides
+ *      are not multiples of VOXEL_BRICK_SIDE, then get_voxel of every voxel, and of voxels out of the world, must agree.
+ * Then voxelizes random, procedural and full depth range grids: every cell's column of voxels must go from its top
+ *      down to one above its lowest neighbour, and grid_surface_bricks must bound the bricks it takes.
+ *      Each grid is sensed top-down (rays straight down -z from the top of the world, one per cell, as world=voxel does):
+ *      every patch must match the source grid exactly, values as they are and depths as the distance
+ *      from the top of the world to the top of the cell's voxel, in 1/VOXEL_DEPTH_SUBDIVISIONS of a voxel.
+ *
+ * Exits with 1 when any check failed.
+ */
+
+#define DENSE_SIDE 37
+#define NUM_SETS 4000
+
+#define GRID_ROWS 45
+#define GRID_COLS 30
+#define PATCH_SIDELEN 5
+#define NUM_GRIDS 9
+
+static int failures = 0;
+
+static void check(int condition, const char* what, u32 grid) {
+    if(!condition) {
+        if(failures < 10) printf("FAILED on grid %u: %s\n", grid, what);
+        failures += 1;
+    }
+}
+
+static void check_brick_map(arena_t* arena) {
+    u32* dense = calloc(DENSE_SIDE * DENSE_SIDE * DENSE_SIDE, sizeof(u32)); // value + 1, 0 when empty
+    u32 bricks_per_side = (DENSE_SIDE + VOXEL_BRICK_SIDE - 1) / VOXEL_BRICK_SIDE;
+
+    voxel_env_t env;
+    init_voxel_env(&env, DENSE_SIDE, DENSE_SIDE, DENSE_SIDE, bricks_per_side * bricks_per_side * bricks_per_side, arena);
+
+    for(u32 s = 0; s < NUM_SETS; ++s) {
+        vec3d p = {.x = unif_rand_u32(DENSE_SIDE - 1), .y = unif_rand_u32(DENSE_SIDE - 1), .z = unif_rand_u32(DENSE_SIDE - 1)};
+        u32 value = unif_rand_u32(1000);
+        set_voxel(&env, p, value);
+        dense[(p.z * DENSE_SIDE + p.y) * DENSE_SIDE + p.x] = value + 1;
+    }
+
+    u8* brick_used = calloc(bricks_per_side * bricks_per_side * bricks_per_side, 1);
+    u32 num_bricks = 0;
+    for(i32 z = -1; z <= DENSE_SIDE; ++z) {
+        for(i32 y = -1; y <= DENSE_SIDE; ++y) {
+            for(i32 x = -1; x <= DENSE_SIDE; ++x) {
+                vec3d p = {.x = x, .y = y, .z = z};
+                u32 value = UINT32_MAX;
+                int occupied = get_voxel(&env, p, &value);
+
+                int inside = x >= 0 && y >= 0 && z >= 0 && x < DENSE_SIDE && y < DENSE_SIDE && z < DENSE_SIDE;
+                u32 expected = inside ? dense[(z * DENSE_SIDE + y) * DENSE_SIDE + x] : 0;
+                check(occupied == (expected != 0), "occupancy differs from the dense volume", 0);
+                check(!occupied || value == expected - 1, "value differs from the dense volume", 0);
+
+                if(expected != 0) {
+                    u32 brick = ((z >> VOXEL_BRICK_BITS) * bricks_per_side + (y >> VOXEL_BRICK_BITS)) * bricks_per_side + (x >> VOXEL_BRICK_BITS);
+                    num_bricks += !brick_used[brick];
+                    brick_used[brick] = 1;
+                }
+            }
+        }
+    }
+    check(env.num_bricks == num_bricks, "allocated bricks are not the occupied ones", 0);
+
+    free(brick_used);
+    free(dense);
+}
+
+// Returns the number of patches compared
+static u32 check_top_down(grid_t* grid, u32 z_offset, u32 g, arena_t* arena) {
+    u32 size_z = UINT8_MAX + 1 + z_offset;
+    u32 max_bricks = grid_surface_bricks(grid, z_offset);
+
+    voxel_env_t env;
+    init_voxel_env(&env, grid->rows, grid->cols, size_z, max_bricks, arena);
+    voxelize_grid_surface(&env, grid, z_offset);
+    check(env.num_bricks <= max_bricks, "grid_surface_bricks is not a bound", g);
+
+    for(i32 i = 0; i < (i32) grid->rows; ++i) {
+        for(i32 j = 0; j < (i32) grid->cols; ++j) {
+            i32 top = MAT(grid->depths, i, j) + z_offset, bottom = top;
+            for(i32 ni = i - 1; ni <= i + 1; ++ni) {
+                for(i32 nj = j - 1; nj <= j + 1; ++nj) {
+                    int neighbour = (ni == i) != (nj == j) && ni >= 0 && nj >= 0 && ni < (i32) grid->rows && nj < (i32) grid->cols;
+                    if(neighbour && MAT(grid->depths, ni, nj) + (i32) z_offset + 1 < bottom) bottom = MAT(grid->depths, ni, nj) + z_offset + 1;
+                }
+            }
+
+            int same = 1;
+            for(i32 z = 0; z < (i32) size_z; ++z) {
+                u32 value;
+                int occupied = get_voxel(&env, (vec3d) {.x = i, .y = j, .z = z}, &value);
+                same &= occupied == (z >= bottom && z <= top);
+                same &= !occupied || value == MAT(grid->values, i, j);
+            }
+            check(same, "a cell's column of voxels is not its top down to its lowest neighbour", g);
+        }
+    }
+
+    grid_u16_t patch;
+    init_grid_env_u16(&patch, PATCH_SIDELEN, PATCH_SIDELEN, arena);
+    i32 radius = PATCH_SIDELEN / 2;
+
+    u32 compared = 0;
+    for(i32 x = radius; x < (i32) grid->rows - radius; ++x) {
+        for(i32 y = radius; y < (i32) grid->cols - radius; ++y) {
+            voxel_view_t view = {
+                .origin = {x + 0.5f, y + 0.5f, size_z},
+                .direction = {0, 0, -1},
+                .spacing = 1,
+                .max_range = size_z
+            };
+            sense_voxel_patch(&patch, &env, view);
+
+            int same = 1;
+            for(i32 i = 0; i < PATCH_SIDELEN; ++i) {
+                for(i32 j = 0; j < PATCH_SIDELEN; ++j) {
+                    u32 depth = MAT(grid->depths, x - radius + i, y - radius + j);
+                    same &= MAT(patch.depths, i, j) == (size_z - z_offset - depth - 1) * VOXEL_DEPTH_SUBDIVISIONS;
+                    same &= MAT(patch.values, i, j) == MAT(grid->values, x - radius + i, y - radius + j);
+                }
+            }
+            check(same, "top-down patch differs from the source grid", g);
+            compared += 1;
+        }
+    }
+
+    return compared;
+}
+
+int main() {
+    unif_rand_seed(17);
+
+    arena_t arena;
+    arena_init(&arena, 64 << 20);
+
+    check_brick_map(&arena);
+
+    generator_config_t generator;
+    default_generator_config(&generator, GRID_ROWS, GRID_COLS);
+
+    grid_t grid;
+    init_grid_env(&grid, GRID_ROWS, GRID_COLS, &arena);
+    size_t grid_mark = arena_mark(&arena);
+
+    u32 num_patches = 0;
+    for(u32 g = 0; g < NUM_GRIDS; ++g) {
+        arena_rewind(&arena, grid_mark);
+        if(g % 3 == 0) populate_grid_env_random(&grid);
+        else if(g % 3 == 1) generate_object(&grid, &generator, 17, g);
+        else {
+            // steep walls everywhere: long columns below the cells, across many bricks
+            for(u32 i = 0; i < GRID_ROWS * GRID_COLS; ++i) grid.depths.data[i] = unif_rand_u32(UINT8_MAX);
+        }
+
+        num_patches += check_top_down(&grid, unif_rand_u32(20), g, &arena);
+    }
+
+    printf("check_voxel_environment: %u voxels set, %u grids, %u top-down patches compared, %d failures\n",
+        NUM_SETS, NUM_GRIDS, num_patches, failures);
+
+    arena_free(&arena);
+    return failures > 0;
+}
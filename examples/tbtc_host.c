@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "tbtc.h"
+
+/**
+ * Minimal host of tbtc.so: learns a few random objects from frames it owns, through the public API only,
+ *      then checks that each of them is recognized, and that the save / map round trip recognizes them too.
+ * Library errors (unwritable path, garbage file, library of another config) must come back as statuses.
+ * Then the same with 16 bits depth frames, of depths past the u8 range.
+ *
+ * Exits with 1 when any check failed.
+ *
+ * usage: tbtc_host [library file, default tbtc_host.library]
+ */
+
+#define ROWS 32
+#define COLS 32
+#define NUM_OBJECTS 4
+#define MARGIN 4 // keeps every sensor's patch in the frame
+
+typedef struct frame_buffers_t_ {
+    uint8_t depths[ROWS * COLS];
+    uint16_t depths_u16[ROWS * COLS];
+    uint32_t values[ROWS * COLS];
+    uint32_t depth_bytes; // of the frames made
+} frame_buffers_t;
+
+static int failures = 0;
+
+static void check(int condition, const char* what) {
+    if(!condition) {
+        printf("FAILED: %s\n", what);
+        failures += 1;
+    }
+}
+
+static tbtc_frame_t make_frame(frame_buffers_t* buffers, uint32_t seed) {
+    srand(seed);
+    for(uint32_t i = 0; i < ROWS * COLS; ++i) {
+        buffers->depths[i] = rand() % 64;
+        buffers->depths_u16[i] = 1000 + rand() % 4096;
+        buffers->values[i] = rand() % 8;
+    }
+
+    int wide = buffers->depth_bytes == sizeof(uint16_t);
+    return (tbtc_frame_t) {
+        .depths = wide ? (const void*) buffers->depths_u16 : (const void*) buffers->depths,
+        .depth_stride = COLS * buffers->depth_bytes,
+        .values = buffers->values,
+        .value_stride = COLS * sizeof(uint32_t),
+        .depth_bytes = buffers->depth_bytes
+    };
+}
+
+// Every location of the frame the sensors fit around, row-major
+static uint32_t frame_locations(tbtc_location_t* locations) {
+    uint32_t count = 0;
+    for(int32_t row = MARGIN; row < ROWS - MARGIN; ++row)
+        for(int32_t col = MARGIN; col < COLS - MARGIN; ++col)
+            locations[count++] = (tbtc_location_t) {row, col};
+    return count;
+}
+
+// Matches every object along a pseudo-random walk over its frame, checks it comes out as itself
+static void check_recognition(tbtc_context_t* context, frame_buffers_t* buffers, const char* what) {
+    tbtc_location_t walk[64];
+    tbtc_match_result_t results[64];
+
+    for(uint32_t id = 0; id < NUM_OBJECTS; ++id) {
+        tbtc_frame_t frame = make_frame(buffers, id + 1);
+
+        srand(1000 + id);
+        for(uint32_t i = 0; i < 64; ++i)
+            walk[i] = (tbtc_location_t) {MARGIN + rand() % (ROWS - 2 * MARGIN), MARGIN + rand() % (COLS - 2 * MARGIN)};
+
+        uint32_t num_matched = 0;
+        check(tbtc_begin_episode(context) == TBTC_OK, "begin a matching episode");
+        check(tbtc_match(context, &frame, walk, 64, results, &num_matched) == TBTC_OK, "match");
+
+        int32_t recognized = num_matched > 0 ? results[num_matched - 1].recognized_id : TBTC_NOT_RECOGNIZED;
+        printf("%s: object %u recognized as %d after %u steps\n", what, id, recognized, num_matched);
+        check(recognized == (int32_t) id, what);
+    }
+}
+
+// Learns the objects, checks their recognition, saves the library and checks it again once mapped by a new context
+static void learn_and_match(const tbtc_config_t* config, frame_buffers_t* buffers, const char* library_file, const char* garbage_file) {
+    static tbtc_location_t locations[ROWS * COLS];
+    uint32_t num_locations = frame_locations(locations);
+
+    tbtc_context_t* context = tbtc_create(config);
+    check(context != NULL, "create");
+    if(context == NULL) return;
+
+    tbtc_location_t outside = {0, 0};
+    tbtc_frame_t frame = make_frame(buffers, 1);
+    check(tbtc_explore(context, &frame, &outside, 1) == TBTC_OUT_OF_BOUNDS, "a patch out of the frame is refused");
+
+    tbtc_observation_t observation;
+    check(tbtc_sense(context, &frame, locations, 1, &observation) == TBTC_OK, "sense");
+    check(buffers->depth_bytes != sizeof(uint16_t) || observation.mean_depth > UINT8_MAX, "u16 depths keep their range");
+
+    for(uint32_t id = 0; id < NUM_OBJECTS; ++id) {
+        frame = make_frame(buffers, id + 1);
+        check(tbtc_begin_episode(context) == TBTC_OK, "begin an exploration episode");
+        check(tbtc_explore(context, &frame, locations, num_locations) == TBTC_OK, "explore");
+        check(tbtc_store_object(context, id) == TBTC_OK, "store");
+    }
+    check(tbtc_store_object(context, NUM_OBJECTS) == TBTC_LIBRARY_FULL, "objects past max_objects are refused");
+
+    uint32_t num_matched;
+    tbtc_match_result_t result;
+    check(tbtc_match(context, &frame, locations, 1, &result, &num_matched) == TBTC_NOT_FINALIZED, "matching before finalize");
+
+    check(tbtc_finalize(context) == TBTC_OK, "finalize");
+    check_recognition(context, buffers, "learnt");
+
+    check(tbtc_save_library(context, "no/such/dir/library") == TBTC_IO_ERROR, "an unwritable library is reported");
+    check(tbtc_save_library(context, library_file) == TBTC_OK, "save the library");
+    tbtc_destroy(context);
+
+    context = tbtc_create(config);
+    check(context != NULL, "create a serving context");
+    if(context == NULL) return;
+    check(tbtc_map_library(context, "no/such/library") == TBTC_NO_SUCH_FILE, "a missing library is reported");
+    check(tbtc_map_library(context, garbage_file) == TBTC_INVALID_LIBRARY, "a file that is not a library is reported");
+
+    tbtc_config_t other = *config;
+    other.rows = other.cols = ROWS / 2;
+    tbtc_context_t* other_context = tbtc_create(&other);
+    check(tbtc_map_library(other_context, library_file) == TBTC_INVALID_LIBRARY, "a library of another config is reported");
+    tbtc_destroy(other_context);
+
+    check(tbtc_map_library(context, library_file) == TBTC_OK, "map the library");
+    check_recognition(context, buffers, "mapped");
+    tbtc_destroy(context);
+
+    remove(library_file);
+}
+
+int main(int argc, char* argv[]) {
+    const char* library_file = argc > 1 ? argv[1] : "tbtc_host.library";
+
+    tbtc_config_t config;
+    tbtc_default_config(&config);
+    check(tbtc_create(&config) == NULL, "a config without a frame size is rejected");
+
+    config.rows = ROWS;
+    config.cols = COLS;
+    config.max_objects = NUM_OBJECTS;
+    config.patch_sidelen = 4;
+    check(tbtc_create(&config) == NULL, "an even patch is rejected");
+    config.patch_sidelen = 3;
+
+    // library errors are statuses: none of them aborts this process
+    char garbage_file[1024];
+    snprintf(garbage_file, sizeof(garbage_file), "%s.garbage", library_file);
+    FILE* garbage = fopen(garbage_file, "wb");
+    for(uint32_t i = 0; i < 10000; ++i) fputc(i * 7919 % 251, garbage);
+    fclose(garbage);
+
+    frame_buffers_t* buffers = malloc(sizeof(*buffers));
+
+    printf("u8 depths\n");
+    buffers->depth_bytes = sizeof(uint8_t);
+    learn_and_match(&config, buffers, library_file, garbage_file);
+
+    printf("u16 depths\n");
+    buffers->depth_bytes = sizeof(uint16_t);
+    learn_and_match(&config, buffers, library_file, garbage_file);
+
+    free(buffers);
+    remove(garbage_file);
+
+    printf(failures ? "%d checks failed\n" : "all checks passed\n", failures);
+    return failures != 0;
+}
@@ -1,10 +1,12 @@
 #include "algorithms.h"
 
+#include <string.h>
+
 #include "assertf.h"
 
 #define SWAP_IMPLEMENTATION(symbol) \
     void swap_##symbol(symbol* a, symbol* b) { \
-        int temp = *a; \
+        symbol temp = *a; \
         *a = *b; \
         *b = temp; \
     }
@@ -45,3 +47,160 @@ u32 quickselect(u8* array, u32 left, u32 right, u32 k) {
     else 
         return quickselect(array, pivotIndex + 1, right, k); // Recur on the right subarray
 }
+
+/**
+ * @brief 256 bins histogram of a u8 buffer.
+ * Runs of equal values make a single histogram serialize on the same counter (load-increment-store),
+ *      so 4 interleaved sub-histograms are filled and summed at the end, the summing loop being vectorized.
+ *
+ * @param histogram HISTOGRAM_BINS counters, overwritten
+ */
+void histogram_u8(u32* histogram, u8* array, u32 length) {
+    u32 sub_histograms[4][HISTOGRAM_BINS] = {0};
+
+    u32 i = 0;
+    for(; i + 4 <= length; i += 4) {
+        sub_histograms[0][array[i]] += 1;
+        sub_histograms[1][array[i + 1]] += 1;
+        sub_histograms[2][array[i + 2]] += 1;
+        sub_histograms[3][array[i + 3]] += 1;
+    }
+    for(; i < length; ++i)
+        sub_histograms[0][array[i]] += 1;
+
+    for(u32 b = 0; b < HISTOGRAM_BINS; ++b)
+        histogram[b] = sub_histograms[0][b] + sub_histograms[1][b] + sub_histograms[2][b] + sub_histograms[3][b];
+}
+
+/**
+ * @brief Walks the cumulative histogram once for all the ranks, which do not need to be sorted
+ *      (their order is sorted on the side)
+ */
+void histogram_ranks_u8(u8* out, u32* histogram, u32* ks, u32 num_ks) {
+    assertf(num_ks <= MAX_SELECT_RANKS, "at most %d ranks can be selected at once", MAX_SELECT_RANKS);
+
+    u32 order[MAX_SELECT_RANKS];
+    for(u32 r = 0; r < num_ks; ++r) {
+        u32 j = r;
+        for(; j > 0 && ks[order[j - 1]] > ks[r]; --j)
+            order[j] = order[j - 1];
+        order[j] = r;
+    }
+
+    u32 cumulative = histogram[0];
+    u32 b = 0;
+    for(u32 i = 0; i < num_ks; ++i) {
+        u32 k = ks[order[i]];
+        while(cumulative <= k && b < HISTOGRAM_BINS - 1)
+            cumulative += histogram[++b];
+        out[order[i]] = b;
+    }
+}
+
+void histogram_select_many_u8(u8* out, u8* array, u32 length, u32* ks, u32 num_ks) {
+    for(u32 r = 0; r < num_ks; ++r)
+        assertf(ks[r] < length, "rank %u out of [0, %u)", ks[r], length);
+
+    u32 histogram[HISTOGRAM_BINS];
+    histogram_u8(histogram, array, length);
+
+    histogram_ranks_u8(out, histogram, ks, num_ks);
+}
+
+u8 histogram_select_u8(u8* array, u32 length, u32 k) {
+    u8 out;
+    histogram_select_many_u8(&out, array, length, &k, 1);
+    return out;
+}
+
+/**
+ * @brief Finds the bin of the cumulative histogram that contains rank k
+ *
+ * @param below set to the number of elements in the bins before it
+ */
+static u32 bin_of_rank(u32* histogram, u32 k, u32* below) {
+    u32 cumulative = 0;
+    for(u32 b = 0; b < HISTOGRAM_BINS; ++b) {
+        if(cumulative + histogram[b] > k) {
+            *below = cumulative;
+            return b;
+        }
+        cumulative += histogram[b];
+    }
+    assertf(0, "rank %u is past the histogram", k);
+    return HISTOGRAM_BINS - 1;
+}
+
+/**
+ * @brief Two passes radix selection.
+ * The first pass histograms the high bytes and finds, for every rank, its high byte.
+ * The second pass histograms the low bytes, but only of the elements whose high byte is one of those,
+ *      with one low histogram per distinct high byte (at most num_ks of them)
+ */
+void histogram_select_many_u16(u16* out, u16* array, u32 length, u32* ks, u32 num_ks) {
+    assertf(num_ks <= MAX_SELECT_RANKS, "at most %d ranks can be selected at once", MAX_SELECT_RANKS);
+
+    u32 high_histogram[HISTOGRAM_BINS] = {0};
+    for(u32 i = 0; i < length; ++i)
+        high_histogram[array[i] >> 8] += 1;
+
+    // slot_of_high[h] is the low histogram of high byte h, or -1 when no rank falls in it
+    i8 slot_of_high[HISTOGRAM_BINS];
+    memset(slot_of_high, -1, sizeof(slot_of_high));
+
+    u32 high_of_rank[MAX_SELECT_RANKS], below_of_rank[MAX_SELECT_RANKS];
+    u32 num_slots = 0;
+    for(u32 r = 0; r < num_ks; ++r) {
+        assertf(ks[r] < length, "rank %u out of [0, %u)", ks[r], length);
+
+        high_of_rank[r] = bin_of_rank(high_histogram, ks[r], below_of_rank + r);
+        if(slot_of_high[high_of_rank[r]] < 0) slot_of_high[high_of_rank[r]] = num_slots++;
+    }
+
+    u32 low_histograms[MAX_SELECT_RANKS][HISTOGRAM_BINS];
+    memset(low_histograms, 0, num_slots * sizeof(*low_histograms));
+
+    for(u32 i = 0; i < length; ++i) {
+        i8 slot = slot_of_high[array[i] >> 8];
+        if(slot >= 0) low_histograms[(u32) slot][array[i] & 0xff] += 1;
+    }
+
+    for(u32 r = 0; r < num_ks; ++r) {
+        u32* low_histogram = low_histograms[(u32) slot_of_high[high_of_rank[r]]];
+        u32 unused;
+        u32 low = bin_of_rank(low_histogram, ks[r] - below_of_rank[r], &unused);
+
+        out[r] = (u16) ((high_of_rank[r] << 8) | low);
+    }
+}
+
+u16 histogram_select_u16(u16* array, u32 length, u32 k) {
+    u16 out;
+    histogram_select_many_u16(&out, array, length, &k, 1);
+    return out;
+}
+
+#define INSTANTIATE_SELECT_MANY(symbol) \
+    void select_many_##symbol(symbol* out, symbol* array, u32 length, u32* ks, u32 num_ks) { \
+        if(length > SMALL_SELECTION_LENGTH) { \
+            histogram_select_many_##symbol(out, array, length, ks, num_ks); \
+            return; \
+        } \
+        \
+        symbol sorted[SMALL_SELECTION_LENGTH]; \
+        for(u32 i = 0; i < length; ++i) { \
+            symbol v = array[i]; \
+            u32 j = i; \
+            for(; j > 0 && sorted[j - 1] > v; --j) \
+                sorted[j] = sorted[j - 1]; \
+            sorted[j] = v; \
+        } \
+        \
+        for(u32 r = 0; r < num_ks; ++r) { \
+            assertf(ks[r] < length, "rank %u out of [0, %u)", ks[r], length); \
+            out[r] = sorted[ks[r]]; \
+        } \
+    }
+
+INSTANTIATE_SELECT_MANY(u16)
+INSTANTIATE_SELECT_MANY(u8)
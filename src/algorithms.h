@@ -14,6 +14,40 @@
 // Quickselect function to find the k-th smallest element
 u32 quickselect(u8* arr, u32 low, u32 high, u32 k);
 
+/**
+ * Counting selection: O(n) whatever the distribution of values, and at its best on the many-duplicates data
+ *      (depths) where quickselect degrades.
+ * All the k (0-based ranks) are answered from the same histogram: one pass over u8 data, two over u16 data
+ *      (high byte, then low byte restricted to the buckets that contain a requested rank)
+ */
+#define HISTOGRAM_BINS 256
+#define MAX_SELECT_RANKS 16
+
+void histogram_u8(u32* histogram, u8* array, u32 length);
+
+u8 histogram_select_u8(u8* array, u32 length, u32 k);
+void histogram_select_many_u8(u8* out, u8* array, u32 length, u32* ks, u32 num_ks);
+// Same as histogram_select_many_u8 on an already computed histogram
+void histogram_ranks_u8(u8* out, u32* histogram, u32* ks, u32 num_ks);
+
+u16 histogram_select_u16(u16* array, u32 length, u32 k);
+void histogram_select_many_u16(u16* out, u16* array, u32 length, u32* ks, u32 num_ks);
+
+// Below that length, sorting a copy is cheaper than clearing and walking 256 bins (e.g. 3x3 patches)
+#define SMALL_SELECTION_LENGTH 32
+
+// Picks insertion sort or the histogram depending on length
+#define DEFINE_SELECT_MANY(symbol) \
+    void select_many_##symbol(symbol* out, symbol* array, u32 length, u32* ks, u32 num_ks)
+
+DEFINE_SELECT_MANY(u16);
+DEFINE_SELECT_MANY(u8);
+
+// Rank of the p-th percentile (p in [0, 100]) among length elements
+static inline u32 percentile_rank(u32 p, u32 length) {
+    return (p * (length - 1) + 50) / 100;
+}
+
 #define DEFINE_SWAP(symbol) \
     void swap_##symbol(symbol* a, symbol* b)
 
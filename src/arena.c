@@ -0,0 +1,117 @@
+#include "arena.h"
+
+#include <string.h>
+
+#include "assertf.h"
+
+/**
+ * @brief Allocates the backing block of the arena.
+ * The block comes from calloc: big blocks are mmap-ed by the libc, so pages are only
+ *      committed (and zeroed by the OS) when they are first touched.
+ *
+ * @param arena
+ * @param capacity in bytes
+ */
+void arena_init(arena_t* arena, size_t capacity) {
+    assertf(arena_try_init(arena, capacity), "could not allocate arena of %zu bytes", ARENA_ALIGN_UP(capacity));
+}
+
+/**
+ * @brief arena_init for callers that cannot abort (library entry points)
+ * @returns 0 when the block could not be allocated, the arena is then empty
+ */
+int arena_try_init(arena_t* arena, size_t capacity) {
+    arena->block = capacity <= SIZE_MAX - 2 * ARENA_ALIGNMENT ? calloc(ARENA_ALIGN_UP(capacity) + ARENA_ALIGNMENT, 1) : NULL;
+    capacity = arena->block != NULL ? ARENA_ALIGN_UP(capacity) : 0;
+
+    arena->base = (u8*) ARENA_ALIGN_UP((uintptr_t) arena->block);
+    arena->capacity = capacity;
+    arena->offset = 0;
+    arena->high_water = 0;
+    memset(arena->tag_bytes, 0, sizeof(arena->tag_bytes));
+
+    return arena->block != NULL;
+}
+
+// Gives back to the memory accounting everything handed out since the last reset
+static void release_tag_bytes(arena_t* arena) {
+    for(u32 t = 0; t < NUM_MEMORY_TAGS; ++t) {
+        if(arena->tag_bytes[t] != 0) memory_account_free(t, arena->tag_bytes[t]);
+        arena->tag_bytes[t] = 0;
+    }
+}
+
+void arena_free(arena_t* arena) {
+    release_tag_bytes(arena);
+    free(arena->block);
+
+    arena->block = NULL;
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->offset = 0;
+    arena->high_water = 0;
+}
+
+void* arena_alloc(arena_t* arena, size_t count, size_t size) {
+    memory_tag tag = get_memory_tag();
+    assertf(size == 0 || count <= (SIZE_MAX - ARENA_ALIGNMENT) / size, "allocation of %zu x %zu bytes overflows", count, size);
+
+    if(arena == NULL) {
+        memory_account_alloc(tag, count * size);
+        return malloc(count * size);
+    }
+
+    size_t bytes = ARENA_ALIGN_UP(count * size);
+    assertf(bytes <= arena->capacity - arena->offset,
+        "arena out of memory: requested %zu bytes with %zu/%zu used", bytes, arena->offset, arena->capacity);
+
+    void* ptr = arena->base + arena->offset;
+    arena->offset += bytes;
+    if(arena->offset > arena->high_water) arena->high_water = arena->offset;
+
+    arena->tag_bytes[tag] += bytes;
+    memory_account_alloc(tag, bytes);
+
+    return ptr;
+}
+
+void* arena_calloc(arena_t* arena, size_t count, size_t size) {
+    if(arena == NULL) {
+        assertf(size == 0 || count <= SIZE_MAX / size, "allocation of %zu x %zu bytes overflows", count, size);
+        memory_account_alloc(get_memory_tag(), count * size);
+        return calloc(count, size);
+    }
+
+    size_t start = arena->offset;
+    size_t dirty_end = arena->high_water;
+    u8* ptr = arena_alloc(arena, count, size);
+
+    // Only the part that was already handed out once can be dirty
+    if(start < dirty_end) {
+        size_t end = arena->offset < dirty_end ? arena->offset : dirty_end;
+        memset(ptr, 0, end - start);
+    }
+
+    return ptr;
+}
+
+void arena_reset(arena_t* arena) {
+    release_tag_bytes(arena);
+    arena->offset = 0;
+}
+
+size_t arena_mark(arena_t* arena) {
+    return arena->offset;
+}
+
+void arena_rewind(arena_t* arena, size_t mark) {
+    assertf(mark <= arena->offset, "cannot rewind arena forward (mark %zu, offset %zu)", mark, arena->offset);
+
+    memory_tag tag = get_memory_tag();
+    size_t released = arena->offset - mark;
+    assertf(released <= arena->tag_bytes[tag], "rewinding %zu bytes not allocated under tag %s", released, memory_tag_name(tag));
+    arena->tag_bytes[tag] -= released;
+    memory_account_free(tag, released);
+
+    arena->offset = mark;
+}
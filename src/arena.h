@@ -0,0 +1,56 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "types.h"
+#include "memory_accounting.h"
+
+// Every buffer handed out by an arena starts on a 64 bytes boundary (one cache line, one AVX-512 register)
+#define ARENA_ALIGNMENT 64
+
+#define ARENA_ALIGN_UP(n) (((n) + (ARENA_ALIGNMENT - 1)) & ~((size_t) ARENA_ALIGNMENT - 1))
+
+/**
+ * Bump allocator.
+ *
+ * An arena owns one contiguous block and hands out aligned slices of it by bumping an offset.
+ * Nothing is freed individually: the whole arena is reset in O(1).
+ *
+ * We typically keep two of them:
+ *      - an experiment arena for everything that lives as long as the experiment (env, lm, learnt models, policy)
+ *      - an episode (scratch) arena that is reset between episodes (working buffer, ...)
+ *
+ * high_water keeps track of the furthest offset ever handed out.
+ * Everything past it has never been touched since the block was (lazily) zeroed by the OS,
+ *      so arena_calloc only needs to clear the part of a slice that lies below high_water.
+ */
+typedef struct arena_t_ {
+    u8* base;
+    u8* block; // unaligned pointer returned by calloc, kept for free
+    size_t capacity;
+    size_t offset;
+    size_t high_water;
+    size_t tag_bytes[NUM_MEMORY_TAGS]; // bytes handed out since the last reset, per memory tag
+} arena_t;
+
+void arena_init(arena_t* arena, size_t capacity);
+// Same as arena_init, but returns 0 instead of aborting when the block cannot be allocated
+int arena_try_init(arena_t* arena, size_t capacity);
+void arena_free(arena_t* arena);
+
+// Returns uninitialized memory. A NULL arena falls back to malloc (accounted, but never given back: the caller owns it).
+void* arena_alloc(arena_t* arena, size_t count, size_t size);
+// Returns zeroed memory. A NULL arena falls back to calloc.
+void* arena_calloc(arena_t* arena, size_t count, size_t size);
+
+void arena_reset(arena_t* arena);
+
+// Marks allow to release everything allocated after a given point (nested scratch usage).
+// What is released is accounted to the current tag: mark and rewind under the tag the slices were allocated with
+size_t arena_mark(arena_t* arena);
+void arena_rewind(arena_t* arena, size_t mark);
+
+#endif // ARENA_H
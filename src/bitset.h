@@ -0,0 +1,39 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "sparse.h"
+
+/**
+ * Bit-packed sets: one bit per element, 64 per u64 word.
+ *
+ * A set of up to 65536 elements (any spvec index) is at most 8 KB: it stays in L1 while it is tested against
+ *      long lists of indices. Walking the set bits word by word (ctz, then clear the lowest bit)
+ *      visits the elements in increasing order, skipping 64 absent ones at a time.
+ */
+
+#define BITSET_WORDS(num_bits) (((num_bits) + 63) / 64)
+
+static inline void bitset_clear(u64* bits, u32 num_bits) {
+    memset(bits, 0, BITSET_WORDS(num_bits) * sizeof(u64));
+}
+
+static inline void bitset_set(u64* bits, u32 i) {
+    bits[i >> 6] |= (u64) 1 << (i & 63);
+}
+
+static inline u32 bitset_test(const u64* bits, u32 i) {
+    return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+// Sets the bits of the sdr's indices, shifted by offset (sets of several sdrs side by side)
+static inline void bitset_set_sdr(u64* bits, const spvec_u1* sdr, u32 offset) {
+    for(u32 i = 0; i < sdr->non_null_count; ++i)
+        bitset_set(bits, offset + sdr->indices[i]);
+}
+
+#endif // BITSET_H
@@ -0,0 +1,176 @@
+#include "checkpoint.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "assertf.h"
+#include "io.h"
+#include "distributions.h"
+
+// Snapshots are written in big sequential chunks
+#define CHECKPOINT_BUFFER_SIZE (1 << 20)
+
+static u32 max_u32(u32 a, u32 b) {
+    return a > b ? a : b;
+}
+
+static u32 experiment_max_steps(const grid_experiment_config* config) {
+    return max_u32(config->train_steps, config->eval_max_steps);
+}
+
+static size_t model_cells(const grid_lm* lm) {
+    return (size_t) lm->buffer.rows * lm->buffer.cols;
+}
+
+void save_experiment_checkpoint(grid_experiment_t* experiment, const char* filename) {
+    grid_experiment_config* config = &experiment->config;
+    grid_lm* first_lm = &experiment->columns[0].lm;
+
+    char tmp_filename[CONFIG_PATH_LENGTH + 8];
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+
+    FILE* f = fopen(tmp_filename, "wb");
+    assertf(f != NULL, "could not open checkpoint %s", tmp_filename);
+    setvbuf(f, NULL, _IOFBF, CHECKPOINT_BUFFER_SIZE);
+
+    checkpoint_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CHECKPOINT_MAGIC;
+    header.version = CHECKPOINT_VERSION;
+    header.cell_bytes = sizeof(model_cell_t);
+    header.config = *config;
+    header.num_columns = config->num_columns;
+    header.model_rows = first_lm->buffer.rows;
+    header.model_cols = first_lm->buffer.cols;
+    header.max_steps = experiment_max_steps(config);
+    header.learnt_episodes = experiment->learnt_episodes;
+    header.motor_current_step = experiment->motor_policy.current_step;
+    header.rng_state = get_unif_rand_state();
+    header.learning_report = experiment->learning_report;
+    FWRITE_CHECK(&header, sizeof(header), 1, f);
+
+    FWRITE_CHECK(experiment->motor_policy.pregenerated_movements, sizeof(vec2d), header.max_steps, f);
+
+    for(u32 c = 0; c < config->num_columns; ++c) {
+        grid_lm* lm = &experiment->columns[c].lm;
+        size_t cells = model_cells(lm);
+
+        checkpoint_column_t column = {
+            .num_learnt_models = lm->num_learnt_models,
+            .num_buffered_observations = lm->num_buffered_observations
+        };
+        FWRITE_CHECK(&column, sizeof(column), 1, f);
+
+        FWRITE_CHECK(lm->buffer.data, sizeof(model_cell_t), cells, f);
+        for(u32 m = 0; m < lm->num_learnt_models; ++m)
+            FWRITE_CHECK(lm->learnt_models[m].data, sizeof(model_cell_t), cells, f);
+    }
+
+    assertf(fflush(f) == 0 && fsync(fileno(f)) == 0, "could not write checkpoint %s", tmp_filename);
+    fclose(f);
+
+    assertf(rename(tmp_filename, filename) == 0, "could not move checkpoint %s to %s", tmp_filename, filename);
+}
+
+/**
+ * @brief Everything that shapes the learnt state has to match: the worlds, the episodes and the learning modules.
+ * Evaluation settings, threading and checkpointing itself may change between the runs.
+ */
+static int same_learning_workload(const grid_experiment_config* a, const grid_experiment_config* b) {
+    return a->seed == b->seed
+        && a->env_rows == b->env_rows && a->env_cols == b->env_cols
+        && a->patch_sidelen == b->patch_sidelen
+        && a->model_scale == b->model_scale
+        && a->num_objects == b->num_objects
+        && a->world == b->world
+        && a->generator.max_depth == b->generator.max_depth
+        && a->generator.max_curvature == b->generator.max_curvature
+        && a->generator.noise == b->generator.noise
+        && a->generator.num_labels == b->generator.num_labels
+        && a->generator.max_label_regions == b->generator.max_label_regions
+        && strcmp(a->dataset, b->dataset) == 0
+        && a->train_episodes_per_object == b->train_episodes_per_object
+        && a->train_steps == b->train_steps
+        && experiment_max_steps(a) == experiment_max_steps(b)
+        && a->policy == b->policy
+        && a->num_orientations == b->num_orientations
+        && a->num_columns == b->num_columns
+        && a->column_spacing == b->column_spacing
+        && a->num_sensors == b->num_sensors
+        && a->sensor_spacing == b->sensor_spacing;
+}
+
+// Moves *cursor past size bytes of the mapping and returns where they start
+static const u8* take(const u8** cursor, const u8* end, size_t size, const char* filename) {
+    assertf((size_t) (end - *cursor) >= size, "checkpoint %s is truncated", filename);
+
+    const u8* bytes = *cursor;
+    *cursor += size;
+    return bytes;
+}
+
+int restore_experiment_checkpoint(grid_experiment_t* experiment, const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0 && errno == ENOENT) return 0;
+    assertf(fd >= 0, "could not open checkpoint %s", filename);
+
+    struct stat st;
+    assertf(fstat(fd, &st) == 0, "could not stat checkpoint %s", filename);
+    size_t size = st.st_size;
+    assertf(size >= sizeof(checkpoint_header_t), "checkpoint %s is truncated", filename);
+
+    const u8* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    assertf(mapping != MAP_FAILED, "could not map checkpoint %s", filename);
+    close(fd);
+    madvise((void*) mapping, size, MADV_SEQUENTIAL);
+
+    const u8* cursor = mapping;
+    const u8* end = mapping + size;
+
+    checkpoint_header_t header;
+    memcpy(&header, take(&cursor, end, sizeof(header), filename), sizeof(header));
+
+    grid_experiment_config* config = &experiment->config;
+    grid_lm* first_lm = &experiment->columns[0].lm;
+    assertf(header.magic == CHECKPOINT_MAGIC, "%s is not a checkpoint", filename);
+    assertf(header.version == CHECKPOINT_VERSION, "checkpoint %s is version %u, expected %u", filename, header.version, CHECKPOINT_VERSION);
+    assertf(header.cell_bytes == sizeof(model_cell_t), "checkpoint %s has %u bytes model cells, this build %zu",
+        filename, header.cell_bytes, sizeof(model_cell_t));
+    assertf(same_learning_workload(&header.config, config), "checkpoint %s was taken on another workload", filename);
+    assertf(header.model_rows == first_lm->buffer.rows && header.model_cols == first_lm->buffer.cols,
+        "checkpoint %s has (%u, %u) models, expected (%u, %u)", filename,
+        header.model_rows, header.model_cols, first_lm->buffer.rows, first_lm->buffer.cols);
+
+    memcpy(experiment->motor_policy.pregenerated_movements,
+        take(&cursor, end, header.max_steps * sizeof(vec2d), filename), header.max_steps * sizeof(vec2d));
+    experiment->motor_policy.current_step = header.motor_current_step;
+
+    for(u32 c = 0; c < config->num_columns; ++c) {
+        grid_lm* lm = &experiment->columns[c].lm;
+        size_t model_bytes = model_cells(lm) * sizeof(model_cell_t);
+
+        checkpoint_column_t column;
+        memcpy(&column, take(&cursor, end, sizeof(column), filename), sizeof(column));
+        assertf(column.num_learnt_models <= lm->max_learnt_models, "checkpoint %s has %u models, at most %u expected",
+            filename, column.num_learnt_models, lm->max_learnt_models);
+
+        memcpy(lm->buffer.data, take(&cursor, end, model_bytes, filename), model_bytes);
+        lm->num_buffered_observations = column.num_buffered_observations;
+
+        assertf(lm->num_learnt_models == 0, "checkpoints are restored into a fresh experiment");
+        for(u32 m = 0; m < column.num_learnt_models; ++m)
+            learning_module_load_model(lm, (const model_cell_t*) take(&cursor, end, model_bytes, filename));
+    }
+    assertf(cursor == end, "checkpoint %s has trailing bytes", filename);
+
+    experiment->learnt_episodes = header.learnt_episodes;
+    experiment->learning_report = header.learning_report;
+    set_unif_rand_state(header.rng_state);
+
+    munmap((void*) mapping, size);
+    return 1;
+}
@@ -0,0 +1,64 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "grid_experiment.h"
+
+/**
+ * Snapshots of a learning phase, to resume it after the process was killed (e.g. on a preemptible node).
+ *
+ * Snapshots are taken between two learning episodes, where the whole state of a run is:
+ *      the learning modules' working buffers and learnt models, the motor policy, the uniform random stream
+ *      (get_unif_rand_state), the number of learning episodes done and the learning report.
+ * Objects are not saved: init_grid_experiment rebuilds them from the config before the random stream is restored.
+ * A resumed run goes on bit-identically to one that was never interrupted (timings aside).
+ *
+ * A checkpoint file is a checkpoint_header_t followed by
+ *      vec2d movements[max_steps]                  the motor policy's pregenerated movements
+ *      then for every column:
+ *          checkpoint_column_t
+ *          model_cell_t buffer[model cells]
+ *          model_cell_t learnt[num_learnt_models][model cells]
+ * It is written sequentially to <file>.tmp, synced and renamed over <file>: a kill while writing leaves the previous
+ *      snapshot in place. It is read back through mmap.
+ */
+
+#define CHECKPOINT_MAGIC 0x4b434254 // "TBCK"
+#define CHECKPOINT_VERSION 1
+
+typedef struct checkpoint_header_t_ {
+    u32 magic;
+    u32 version;
+    u32 cell_bytes; // sizeof(model_cell_t): packed and unpacked builds cannot read each other's checkpoints
+
+    grid_experiment_config config; // must describe the same workload as the resuming run's
+
+    u32 num_columns;
+    u32 model_rows;
+    u32 model_cols;
+    u32 max_steps;
+
+    u32 learnt_episodes;
+    u32 motor_current_step;
+    u64 rng_state;
+    phase_report_t learning_report;
+} checkpoint_header_t;
+
+typedef struct checkpoint_column_t_ {
+    u32 num_learnt_models;
+    u32 num_buffered_observations;
+} checkpoint_column_t;
+
+void save_experiment_checkpoint(grid_experiment_t* experiment, const char* filename);
+/**
+ * Brings a freshly initialized experiment to the state of the snapshot.
+ *
+ * @returns 0 (and leaves the experiment untouched) if there is no such file
+ */
+int restore_experiment_checkpoint(grid_experiment_t* experiment, const char* filename);
+
+#endif // CHECKPOINT_H
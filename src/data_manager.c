@@ -37,6 +37,7 @@ void read_dataset_partial(const char* filename, mat_u8* dataset, u32 num_samples
 
 DEFINE_READ_MATRIX(u8)
 DEFINE_READ_MATRIX(u16)
+DEFINE_READ_MATRIX(u32)
 
 #define DEFINE_READ_TENSOR(type) \
     void read_tensor_##type(FILE* f, tensor_##type* tensor, u32 size) { \
@@ -73,6 +74,7 @@ void write_dataset(const char* filename, mat_u8* dataset, u32 num_samples, u32 s
     }
 DEFINE_WRITE_MATRIX(u8)
 DEFINE_WRITE_MATRIX(u16)
+DEFINE_WRITE_MATRIX(u32)
 
 #define DEFINE_WRITE_TENSOR(type) \
     void write_tensor_##type(FILE* f, tensor_##type* tensor, u32 size) { \
@@ -84,3 +86,37 @@ DEFINE_WRITE_MATRIX(u16)
     }
 DEFINE_WRITE_TENSOR(u8)
 DEFINE_WRITE_TENSOR(u16)
+
+FILE* open_object_dataset_writer(const char* filename, u32 num_objects, u32 rows, u32 cols) {
+    FILE* f = fopen(filename, "w");
+    assert(f != NULL);
+
+    SAVE_VAR(num_objects, f);
+    SAVE_VAR(rows, f);
+    SAVE_VAR(cols, f);
+
+    return f;
+}
+
+void write_object(FILE* f, grid_t* object) {
+    write_matrix_u8(f, &object->depths, object->rows * object->cols);
+    write_matrix_u32(f, &object->values, object->rows * object->cols);
+}
+
+FILE* open_object_dataset_reader(const char* filename, u32* num_objects, u32* rows, u32* cols) {
+    FILE* f = fopen(filename, "r");
+    assert(f != NULL);
+
+    READ_PTR(num_objects, f);
+    READ_PTR(rows, f);
+    READ_PTR(cols, f);
+
+    return f;
+}
+
+void read_object(FILE* f, grid_t* object) {
+    read_matrix_u8(f, &object->depths, object->rows * object->cols);
+    read_matrix_u32(f, &object->values, object->rows * object->cols);
+
+    assert(object->depths.rows == object->rows && object->depths.cols == object->cols);
+}
@@ -10,6 +10,7 @@
 #include "types.h"
 #include "tensor.h"
 #include "io.h"
+#include "grid_environment.h"
 
 void read_dataset(const char* filename, mat_u8* dataset, u32* num_samples, u32* sample_size);
 void read_dataset_partial(const char* filename, mat_u8* dataset, u32 num_samples_to_fetch, u32* num_samples_total, u32* sample_size);
@@ -18,6 +19,7 @@ void read_dataset_partial(const char* filename, mat_u8* dataset, u32 num_samples
     void read_matrix_##type(FILE* f, mat_##type* matrix, u32 size);
 DECLARE_READ_MATRIX(u8)
 DECLARE_READ_MATRIX(u16)
+DECLARE_READ_MATRIX(u32)
 
 #define DECLARE_READ_TENSOR(type) \
     void read_tensor_##type(FILE* f, tensor_##type* tensor, u32 size);
@@ -30,10 +32,23 @@ void write_dataset(const char* filename, mat_u8* dataset, u32 num_samples, u32 s
     void write_matrix_##type(FILE* f, mat_##type* matrix, u32 size);
 DECLARE_WRITE_MATRIX(u8)
 DECLARE_WRITE_MATRIX(u16)
+DECLARE_WRITE_MATRIX(u32)
 
 #define DECLARE_WRITE_TENSOR(type) \
     void write_tensor_##type(FILE* f, tensor_##type* tensor, u32 size);
 DECLARE_WRITE_TENSOR(u8)
 DECLARE_WRITE_TENSOR(u16)
 
+/**
+ * Object datasets are streamed one object at a time, so that libraries bigger than memory can be written/read:
+ *      u32 num_objects, u32 rows, u32 cols
+ *      then for every object: matrix_u8 depths, matrix_u32 values (as written by write_matrix_*)
+ */
+FILE* open_object_dataset_writer(const char* filename, u32 num_objects, u32 rows, u32 cols);
+void write_object(FILE* f, grid_t* object);
+
+FILE* open_object_dataset_reader(const char* filename, u32* num_objects, u32* rows, u32* cols);
+// object must be pre-allocated with the dataset's shape
+void read_object(FILE* f, grid_t* object);
+
 #endif // DATA_MANAGER_H
@@ -1,16 +1,23 @@
 #include "distributions.h"
 
 /************* UNIFORM ***********/
-// return a random number between 0 and max inclusive.
-u32 unif_rand_u32(u32 max) {
-    u32 divisor = RAND_MAX / (max + 1);
-    u32 retval;
+static rng_t unif_rng = {.state = 1};
 
-    do { 
-        retval = rand() / divisor;
-    } while (retval > max);
+void unif_rand_seed(u64 seed) {
+    rng_seed(&unif_rng, seed);
+}
+
+u64 get_unif_rand_state(void) {
+    return unif_rng.state;
+}
 
-    return retval;
+void set_unif_rand_state(u64 state) {
+    unif_rng.state = state;
+}
+
+// return a random number between 0 and max inclusive.
+u32 unif_rand_u32(u32 max) {
+    return rng_range_u32(&unif_rng, 0, max);
 }
 
 u32 unif_rand_range_u32(u32 min, u32 max) {
@@ -19,7 +26,7 @@ u32 unif_rand_range_u32(u32 min, u32 max) {
 
 
 f32 unif_rand_f32(f32 max) {
-    return max * ((f32) rand()) / ((f32) RAND_MAX);
+    return rng_range_f32(&unif_rng, 0, max);
 }
 
 f32 unif_rand_range_f32(f32 min, f32 max) {
@@ -38,6 +45,29 @@ SHUFFLE_ARRAY_IMPLEMENTATION(u32)
 SHUFFLE_ARRAY_IMPLEMENTATION(u16)
 SHUFFLE_ARRAY_IMPLEMENTATION(u8)
 
+/************* SEEDED GENERATOR ***********/
+void rng_seed(rng_t* rng, u64 seed) {
+    rng->state = seed;
+}
+
+// https://prng.di.unimi.it/splitmix64.c
+u64 rng_next(rng_t* rng) {
+    u64 z = (rng->state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+u32 rng_range_u32(rng_t* rng, u32 min, u32 max) {
+    u64 span = (u64) max - min + 1;
+    return min + (u32) ((rng_next(rng) >> 32) * span >> 32);
+}
+
+f32 rng_range_f32(rng_t* rng, f32 min, f32 max) {
+    f32 unit = (f32) (rng_next(rng) >> 40) / (f32) ((1ULL << 24) - 1);
+    return min + unit * (max - min);
+}
+
 /************* GAUSSIAN ***********/
 // From TAOCP Knuth
 double gauss_rand() {
@@ -15,6 +15,12 @@
 #endif
 
 /************* UNIFORM ***********/
+// Draws from a single global stream (a rng_t, see below) rather than rand(): its whole state is one u64,
+//      which experiment checkpoints save and restore
+void unif_rand_seed(u64 seed);
+u64 get_unif_rand_state(void);
+void set_unif_rand_state(u64 state);
+
 f32 unif_rand_f32(f32 max); // inclusive
 u32 unif_rand_u32(u32 max); // inclusive
 
@@ -28,6 +34,19 @@ SHUFFLE_ARRAY_DEFINITION(u8);
 SHUFFLE_ARRAY_DEFINITION(u16);
 SHUFFLE_ARRAY_DEFINITION(u32);
 
+/************* SEEDED GENERATOR ***********/
+// Small explicit-state generator (splitmix64): unlike rand(), two streams seeded the same way
+//      give the same numbers regardless of what else was drawn in between
+typedef struct rng_t_ {
+    u64 state;
+} rng_t;
+
+void rng_seed(rng_t* rng, u64 seed);
+u64 rng_next(rng_t* rng);
+
+u32 rng_range_u32(rng_t* rng, u32 min, u32 max); // inclusive
+f32 rng_range_f32(rng_t* rng, f32 min, f32 max); // inclusive
+
 /************* GAUSSIAN ***********/
 // Returns a random number sampled from N(0,1)
 double gauss_rand();
@@ -1,5 +1,9 @@
 #include "encoder.h"
 
+#include <string.h>
+
+#include "assertf.h"
+
 /**
  * @brief 
  * 
@@ -27,3 +31,143 @@ void encode_integer(u8* output, u32 input, pair_u32 range, u32 num_bits, u32 num
         output[j] = j >= i && j < i + num_active_bits;
     }
 }
+
+u32 encode_integer_indices(u16* indices, u32 offset, i32 input, i32 min, i32 max, u32 num_bits, u32 num_active_bits) {
+    u32 num_buckets = num_bits - num_active_bits + 1;
+
+    i32 clamped = input < min ? min : input > max ? max : input;
+    u32 i = ((u64) num_buckets * (u32) (clamped - min)) / ((u32) (max - min) + 1);
+
+    for(u32 k = 0; k < num_active_bits; ++k)
+        indices[k] = offset + i + k;
+
+    return num_active_bits;
+}
+
+void encode_features(spvec_u1* sdr, features_t features) {
+    i32 max_curvature_fp = FEATURE_SDR_MAX_CURVATURE << CURVATURE_FRACTIONAL_BITS;
+    u32 offset = 0, k = 0;
+
+    u32 category = features.value % FEATURE_SDR_VALUE_CATEGORIES;
+    k += encode_integer_indices(sdr->indices + k, offset + category * FEATURE_SDR_ACTIVE_PER_FIELD, 0, 0, 0,
+        FEATURE_SDR_ACTIVE_PER_FIELD, FEATURE_SDR_ACTIVE_PER_FIELD);
+    offset += FEATURE_SDR_VALUE_BITS;
+
+    k += encode_integer_indices(sdr->indices + k, offset, features.mean_depth, 0, FEATURE_SDR_MAX_DEPTH,
+        FEATURE_SDR_DEPTH_BITS, FEATURE_SDR_ACTIVE_PER_FIELD);
+    offset += FEATURE_SDR_DEPTH_BITS;
+
+    k += encode_integer_indices(sdr->indices + k, offset, features.principal_curvature_1_fp, -max_curvature_fp, max_curvature_fp,
+        FEATURE_SDR_CURVATURE_BITS, FEATURE_SDR_ACTIVE_PER_FIELD);
+    offset += FEATURE_SDR_CURVATURE_BITS;
+
+    k += encode_integer_indices(sdr->indices + k, offset, features.principal_curvature_2_fp, -max_curvature_fp, max_curvature_fp,
+        FEATURE_SDR_CURVATURE_BITS, FEATURE_SDR_ACTIVE_PER_FIELD);
+
+    sdr->length = FEATURE_SDR_LENGTH;
+    sdr->non_null_count = k;
+}
+
+// One period in phase units
+#define PHASE_PERIOD 4294967296.0
+
+static void sort_bits(u16* bits, u32 length) {
+    for(u32 i = 1; i < length; ++i) {
+        u16 v = bits[i];
+        u32 j = i;
+        for(; j > 0 && bits[j - 1] > v; --j) bits[j] = bits[j - 1];
+        bits[j] = v;
+    }
+}
+
+void init_location_encoder(location_encoder_t* encoder, u32 num_modules, u32 side_bits, u32 bump_side,
+    f32 min_period, f32 scale_ratio, arena_t* arena) {
+    assertf(num_modules >= 1 && num_modules <= MAX_GRID_MODULES, "between 1 and %d grid modules", MAX_GRID_MODULES);
+    assertf(bump_side >= 1 && bump_side <= (1u << side_bits), "bump of %u cells does not fit a %u cells module", bump_side, 1 << side_bits);
+    assertf(min_period > 1 && scale_ratio >= 1, "periods must be above a cell, and grow");
+
+    u32 side = 1 << side_bits;
+    encoder->num_modules = num_modules;
+    encoder->side_bits = side_bits;
+    encoder->cells_per_module = side * side;
+    encoder->bump_side = bump_side;
+    encoder->active_per_module = bump_side * bump_side;
+    assertf((u64) num_modules * encoder->cells_per_module <= UINT16_MAX, "location codes are at most %d bits", UINT16_MAX);
+
+    f64 period = min_period;
+    for(u32 m = 0; m < num_modules; ++m) {
+        f64 orientation = (m + 0.5) / num_modules * M_PI / 3;
+
+        // phase along a lattice axis = projection on the axis / period, in phase units
+        for(u32 a = 0; a < 2; ++a) {
+            f64 axis = orientation + a * M_PI / 3;
+            encoder->step_x[m][a] = (u32) (i64) llround(cos(axis) / period * PHASE_PERIOD);
+            encoder->step_y[m][a] = (u32) (i64) llround(sin(axis) / period * PHASE_PERIOD);
+        }
+
+        period *= scale_ratio;
+    }
+
+    u32 num_bits = encoder->num_modules * encoder->cells_per_module * encoder->active_per_module;
+    encoder->bits = arena_alloc(arena, num_bits, sizeof(*encoder->bits));
+
+    // the bump starts bump_side / 2 cells before the phase's cell, on both axes
+    for(u32 m = 0; m < num_modules; ++m) {
+        for(u32 bin = 0; bin < encoder->cells_per_module; ++bin) {
+            u32 row = bin >> side_bits, col = bin & (side - 1);
+            u16* bits = encoder->bits + (m * encoder->cells_per_module + bin) * encoder->active_per_module;
+
+            u32 k = 0;
+            for(u32 i = 0; i < bump_side; ++i) {
+                for(u32 j = 0; j < bump_side; ++j) {
+                    u32 r = (row + side + i - bump_side / 2) & (side - 1);
+                    u32 c = (col + side + j - bump_side / 2) & (side - 1);
+                    bits[k++] = m * encoder->cells_per_module + r * side + c;
+                }
+            }
+            sort_bits(bits, k);
+        }
+    }
+}
+
+u16 location_sdr_length(const location_encoder_t* encoder) {
+    return encoder->num_modules * encoder->cells_per_module;
+}
+
+u16 location_sdr_active(const location_encoder_t* encoder) {
+    return encoder->num_modules * encoder->active_per_module;
+}
+
+// Phases are linear in the location, modulo 2^32: the unsigned overflow is the wrapping of the lattice
+void location_code_set(const location_encoder_t* encoder, location_code_t* code, vec2d location) {
+    for(u32 m = 0; m < encoder->num_modules; ++m) {
+        for(u32 a = 0; a < 2; ++a)
+            code->phases[m][a] = (u32) location.x * encoder->step_x[m][a] + (u32) location.y * encoder->step_y[m][a];
+    }
+}
+
+void location_code_move(const location_encoder_t* encoder, location_code_t* code, vec2d movement) {
+    for(u32 m = 0; m < encoder->num_modules; ++m) {
+        for(u32 a = 0; a < 2; ++a)
+            code->phases[m][a] += (u32) movement.x * encoder->step_x[m][a] + (u32) movement.y * encoder->step_y[m][a];
+    }
+}
+
+void location_code_sdr(const location_encoder_t* encoder, const location_code_t* code, spvec_u1* sdr) {
+    u32 shift = 32 - encoder->side_bits;
+    u32 active = encoder->active_per_module;
+
+    for(u32 m = 0; m < encoder->num_modules; ++m) {
+        u32 bin = (code->phases[m][0] >> shift) << encoder->side_bits | code->phases[m][1] >> shift;
+        memcpy(sdr->indices + m * active, encoder->bits + (m * encoder->cells_per_module + bin) * active, active * sizeof(u16));
+    }
+
+    sdr->length = location_sdr_length(encoder);
+    sdr->non_null_count = location_sdr_active(encoder);
+}
+
+void encode_location(const location_encoder_t* encoder, vec2d location, spvec_u1* sdr) {
+    location_code_t code;
+    location_code_set(encoder, &code, location);
+    location_code_sdr(encoder, &code, sdr);
+}
@@ -8,7 +8,94 @@
 #include "math.h"
 
 #include "types.h"
+#include "location.h"
+#include "sparse.h"
+#include "arena.h"
+#include "interfaces.h"
 
 void encode_integer(u8* output, u32 input, pair_u32 range, u32 num_bits, u32 num_active_bits);
 
+/**
+ * Same bucketing as encode_integer, written as the num_active_bits sorted indices of the active bits (plus offset).
+ * Inputs outside of [min, max] are clamped.
+ *
+ * @returns the number of indices written
+ */
+u32 encode_integer_indices(u16* indices, u32 offset, i32 input, i32 min, i32 max, u32 num_bits, u32 num_active_bits);
+
+/**
+ * Feature SDR: value (as a category), mean depth and both principal curvatures, in consecutive blocks.
+ * Close depths and curvatures share bits, values share none.
+ */
+#define FEATURE_SDR_ACTIVE_PER_FIELD 8
+#define FEATURE_SDR_VALUE_CATEGORIES 32
+#define FEATURE_SDR_VALUE_BITS (FEATURE_SDR_VALUE_CATEGORIES * FEATURE_SDR_ACTIVE_PER_FIELD)
+#define FEATURE_SDR_DEPTH_BITS 256
+#define FEATURE_SDR_CURVATURE_BITS 128
+// curvatures are clamped to +-FEATURE_SDR_MAX_CURVATURE (in units, not fixed-point)
+#define FEATURE_SDR_MAX_CURVATURE 2
+// depths span the whole range of features_t depths (u16), whether they were sensed from u8 or u16 frames
+#define FEATURE_SDR_MAX_DEPTH UINT16_MAX
+#define FEATURE_SDR_LENGTH (FEATURE_SDR_VALUE_BITS + FEATURE_SDR_DEPTH_BITS + 2 * FEATURE_SDR_CURVATURE_BITS)
+#define FEATURE_SDR_ACTIVE (4 * FEATURE_SDR_ACTIVE_PER_FIELD)
+
+// sdr->indices must have room for FEATURE_SDR_ACTIVE indices
+void encode_features(spvec_u1* sdr, features_t features);
+
+/**
+ * Location encoder made of grid cell modules: every module tiles the plane periodically, at its own scale and orientation,
+ *      and a location activates a bump of cells around its phase in every module.
+ * Nearby locations share most of their active cells, and the combination of modules of different periods
+ *      tells apart locations much further than any single period.
+ *
+ * A module's phase is a pair of u32 fixed-point fractions of its period, along two lattice axes 60 degrees apart
+ *      (a rhombic lattice, as in grid cell models): the lattice wraps with the integer overflow.
+ * Moving by one cell along x (or y) adds a constant to both phases, precomputed per module:
+ *      a location code is updated by path integration (location_code_move) in O(modules),
+ *      and gives exactly the same phases as encoding the new location from scratch.
+ * Each module has a precomputed table from phase bin to its active bits (global, sorted indices),
+ *      so emitting the code is one lookup and copy per module.
+ */
+#define MAX_GRID_MODULES 16
+
+typedef struct location_encoder_t_ {
+    u32 num_modules;
+    u32 side_bits; // a module is a (2^side_bits, 2^side_bits) sheet of cells, one per phase bin
+    u32 cells_per_module;
+    u32 bump_side; // a location activates a (bump_side, bump_side) block of cells, wrapping around the sheet
+    u32 active_per_module;
+
+    // phase added to [lattice axis] when moving one cell along x, resp. y
+    u32 step_x[MAX_GRID_MODULES][2];
+    u32 step_y[MAX_GRID_MODULES][2];
+
+    // bits[(module * cells_per_module + phase bin) * active_per_module + k]
+    u16* bits;
+} location_encoder_t;
+
+// State of path integration: every module's phase
+typedef struct location_code_t_ {
+    u32 phases[MAX_GRID_MODULES][2];
+} location_code_t;
+
+/**
+ * Module m has a period of min_period * scale_ratio^m cells, and its lattice is rotated by m / num_modules of 60 degrees
+ *      (plus a small offset, so that no two modules share an axis with the grid).
+ * The code has num_modules * 2^(2 side_bits) bits, num_modules * bump_side^2 of them active.
+ */
+void init_location_encoder(location_encoder_t* encoder, u32 num_modules, u32 side_bits, u32 bump_side,
+    f32 min_period, f32 scale_ratio, arena_t* arena);
+
+u16 location_sdr_length(const location_encoder_t* encoder);
+u16 location_sdr_active(const location_encoder_t* encoder);
+
+void location_code_set(const location_encoder_t* encoder, location_code_t* code, vec2d location);
+// Path integration
+void location_code_move(const location_encoder_t* encoder, location_code_t* code, vec2d movement);
+
+// sdr->indices must have room for location_sdr_active indices. They come out sorted
+void location_code_sdr(const location_encoder_t* encoder, const location_code_t* code, spvec_u1* sdr);
+// location_code_set + location_code_sdr
+void encode_location(const location_encoder_t* encoder, vec2d location, spvec_u1* sdr);
+
 #endif // ENCODER_H
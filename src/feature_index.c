@@ -0,0 +1,113 @@
+#include "feature_index.h"
+
+#include <string.h>
+
+#include "assertf.h"
+
+static inline u32 curvature_sign(i32 k_fp) {
+    // anything below one unit of curvature is considered flat
+    i32 k = k_fp >> CURVATURE_FRACTIONAL_BITS;
+    return k > 0 ? 2 : (k < 0 ? 0 : 1);
+}
+
+// value | depth bucket (14 bits for u16 depths) | curvature signs (4 bits)
+u64 feature_key(features_t features) {
+    return ((u64) features.value << 32)
+        | ((u64) (features.mean_depth >> DEPTH_BUCKET_SHIFT) << 4)
+        | (curvature_sign(features.principal_curvature_1_fp) << 2)
+        | curvature_sign(features.principal_curvature_2_fp);
+}
+
+// splitmix64 finalizer
+static inline u32 hash_key(u64 key) {
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return (u32) (key ^ (key >> 31));
+}
+
+static u32 num_slots_for(u32 max_keys) {
+    u32 num_slots = 16;
+    while(num_slots < 2 * max_keys) num_slots <<= 1;
+    return num_slots;
+}
+
+size_t feature_index_bytes(u32 max_postings) {
+    u32 num_slots = num_slots_for(max_postings);
+    return ARENA_ALIGN_UP(num_slots * sizeof(u64))
+        + 2 * ARENA_ALIGN_UP(num_slots * sizeof(u32))
+        + 2 * ARENA_ALIGN_UP(max_postings * sizeof(u32));
+}
+
+// Returns the slot of key, or the empty slot where it should be inserted
+static inline u32 find_slot(feature_index_t* index, u64 key) {
+    u32 mask = index->num_slots - 1;
+    u32 slot = hash_key(key) & mask;
+    while(index->keys[slot] != key && index->keys[slot] != EMPTY_FEATURE_KEY)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+/**
+ * @brief Two passes over the learnt cells: the first counts the postings of every key,
+ *      the second writes them at their place, so that each key's postings end up contiguous.
+ */
+void build_feature_index(feature_index_t* index, u32 num_models, u32 cells_per_model,
+    int (*get_cell_features)(void* context, u32 model_id, u32 cell, features_t* features), void* context,
+    arena_t* arena) {
+
+    features_t f;
+
+    u32 num_postings = 0;
+    for(u32 m = 0; m < num_models; ++m)
+        for(u32 c = 0; c < cells_per_model; ++c)
+            num_postings += get_cell_features(context, m, c, &f);
+
+    index->num_slots = num_slots_for(num_postings);
+    index->keys = arena_alloc(arena, index->num_slots, sizeof(*index->keys));
+    memset(index->keys, 0xff, index->num_slots * sizeof(*index->keys)); // EMPTY_FEATURE_KEY
+    index->offsets = arena_calloc(arena, index->num_slots, sizeof(*index->offsets));
+    index->lengths = arena_calloc(arena, index->num_slots, sizeof(*index->lengths));
+
+    index->num_postings = num_postings;
+    index->model_ids = arena_alloc(arena, num_postings, sizeof(*index->model_ids));
+    index->cells = arena_alloc(arena, num_postings, sizeof(*index->cells));
+
+    for(u32 m = 0; m < num_models; ++m) {
+        for(u32 c = 0; c < cells_per_model; ++c) {
+            if(!get_cell_features(context, m, c, &f)) continue;
+
+            u64 key = feature_key(f);
+            u32 slot = find_slot(index, key);
+            index->keys[slot] = key;
+            index->lengths[slot] += 1;
+        }
+    }
+
+    u32 offset = 0;
+    for(u32 s = 0; s < index->num_slots; ++s) {
+        index->offsets[s] = offset;
+        offset += index->lengths[s];
+        index->lengths[s] = 0; // becomes the write cursor of the second pass
+    }
+
+    for(u32 m = 0; m < num_models; ++m) {
+        for(u32 c = 0; c < cells_per_model; ++c) {
+            if(!get_cell_features(context, m, c, &f)) continue;
+
+            u32 slot = find_slot(index, feature_key(f));
+            u32 p = index->offsets[slot] + index->lengths[slot];
+            index->model_ids[p] = m;
+            index->cells[p] = c;
+            index->lengths[slot] += 1;
+        }
+    }
+}
+
+u32 feature_index_lookup(feature_index_t* index, u64 key, u32** model_ids, u32** cells) {
+    u32 slot = find_slot(index, key);
+    if(index->keys[slot] == EMPTY_FEATURE_KEY) return 0;
+
+    *model_ids = index->model_ids + index->offsets[slot];
+    *cells = index->cells + index->offsets[slot];
+    return index->lengths[slot];
+}
@@ -0,0 +1,51 @@
+#ifndef FEATURE_INDEX_H
+#define FEATURE_INDEX_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "arena.h"
+#include "interfaces.h"
+
+/**
+ * Inverted index from quantized features to the learnt cells that hold them.
+ *
+ * Keys are (value, depth bucket, sign of both principal curvatures) packed in a u64.
+ * The table is open-addressed (linear probing) and every slot points to a contiguous range of postings.
+ * Postings are stored as two parallel compact u32 arrays: model ids and cell indices (row * cols + col in the model)
+ */
+
+// mean depths are bucketed by 2^DEPTH_BUCKET_SHIFT
+#define DEPTH_BUCKET_SHIFT 2
+
+#define EMPTY_FEATURE_KEY UINT64_MAX
+
+typedef struct feature_index_t_ {
+    u32 num_slots; // power of two
+    u64* keys;
+    u32* offsets;
+    u32* lengths;
+
+    u32 num_postings;
+    u32* model_ids;
+    u32* cells;
+} feature_index_t;
+
+u64 feature_key(features_t features);
+
+// Upper bound of the memory taken by an index with that many postings (for arena sizing)
+size_t feature_index_bytes(u32 max_postings);
+
+/**
+ * @param get_cell_features returns 0 when the cell (model_id, cell) is empty, else sets *features
+ */
+void build_feature_index(feature_index_t* index, u32 num_models, u32 cells_per_model,
+    int (*get_cell_features)(void* context, u32 model_id, u32 cell, features_t* features), void* context,
+    arena_t* arena);
+
+// Returns the number of postings for the key, which start at (*model_ids, *cells)
+u32 feature_index_lookup(feature_index_t* index, u64 key, u32** model_ids, u32** cells);
+
+#endif
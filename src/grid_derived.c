@@ -0,0 +1,210 @@
+#include "grid_derived.h"
+
+#include <string.h>
+
+#include "assertf.h"
+#include "sensor_module.h"
+
+static i32 min_i32(i32 a, i32 b) { return a < b ? a : b; }
+static i32 max_i32(i32 a, i32 b) { return a > b ? a : b; }
+
+static grid_rect_t whole_grid(const grid_t* env) {
+    return (grid_rect_t) {0, env->rows, 0, env->cols};
+}
+
+/**
+ * @brief Calls update on every rect marked since *synced (or once on the whole grid, if the log overflowed)
+ *      and catches *synced up with the log.
+ */
+static void sync_dirty(grid_t* env, u64* synced, void (*update)(void* derived, grid_rect_t r), void* derived) {
+    u64 generation = env->dirty->generation;
+    if(*synced == generation) return;
+
+    if(grid_dirty_overflowed(env, *synced)) {
+        update(derived, whole_grid(env));
+    } else {
+        for(u64 g = *synced; g < generation; ++g)
+            update(derived, grid_dirty_rect(env, g));
+    }
+
+    *synced = generation;
+}
+
+/**
+ * @brief Recomputes the cells of level that cover r (a rect of the level below)
+ * @returns the recomputed rect of level
+ */
+static grid_rect_t downsample_rect(depth_pyramid_t* pyramid, u32 level, grid_rect_t r) {
+    mat_u8 src = pyramid->levels[level - 1];
+    mat_u8 dst = pyramid->levels[level];
+    i32 src_rows = level == 1 ? (i32) pyramid->env->rows : (i32) src.rows;
+    i32 src_cols = level == 1 ? (i32) pyramid->env->cols : (i32) src.cols;
+
+    grid_rect_t out = {r.row_min / 2, (r.row_max + 1) / 2, r.col_min / 2, (r.col_max + 1) / 2};
+
+    for(i32 i = out.row_min; i < out.row_max; ++i) {
+        for(i32 j = out.col_min; j < out.col_max; ++j) {
+            u32 sum = 0, count = 0;
+            for(i32 si = 2 * i; si < min_i32(2 * i + 2, src_rows); ++si) {
+                for(i32 sj = 2 * j; sj < min_i32(2 * j + 2, src_cols); ++sj) {
+                    sum += MAT(src, si, sj);
+                    count += 1;
+                }
+            }
+            MAT(dst, i, j) = sum / count;
+        }
+    }
+
+    return out;
+}
+
+static void update_depth_pyramid(void* derived, grid_rect_t r) {
+    depth_pyramid_t* pyramid = derived;
+    for(u32 level = 1; level < pyramid->num_levels; ++level)
+        r = downsample_rect(pyramid, level, r);
+}
+
+void init_depth_pyramid(depth_pyramid_t* pyramid, grid_t* env, arena_t* arena) {
+    assertf(env->dirty != NULL, "derived structures need a tracked grid");
+
+    pyramid->env = env;
+    pyramid->synced = env->dirty->generation;
+    pyramid->levels[0] = env->depths;
+    pyramid->num_levels = 1;
+
+    u32 rows = env->rows, cols = env->cols;
+    while((rows > 1 || cols > 1) && pyramid->num_levels < MAX_PYRAMID_LEVELS) {
+        rows = (rows + 1) / 2;
+        cols = (cols + 1) / 2;
+        matrix_u8_init(pyramid->levels + pyramid->num_levels, rows, cols, arena);
+        pyramid->num_levels += 1;
+    }
+
+    update_depth_pyramid(pyramid, whole_grid(env));
+}
+
+mat_u8 depth_pyramid_level(depth_pyramid_t* pyramid, u32 level) {
+    assertf(level < pyramid->num_levels, "level %u of a %u levels pyramid", level, pyramid->num_levels);
+
+    sync_dirty(pyramid->env, &pyramid->synced, update_depth_pyramid, pyramid);
+    return pyramid->levels[level];
+}
+
+#define TILE_TOTALS(integral, ti, tj) ((integral)->tile_totals[(ti) * ((integral)->tile_cols + 1) + (tj)])
+
+/**
+ * @brief Recomputes the local tables of the tiles r touches, then the running totals of their tile rows
+ *      from the first touched tile on (tile totals are the bottom right corners of their local tables)
+ */
+static void update_integral_tiles(void* derived, grid_rect_t r) {
+    integral_image_t* integral = derived;
+    grid_t* env = integral->env;
+    i32 first_tile_col = r.col_min >> GRID_TILE_BITS;
+
+    for(i32 ti = r.row_min >> GRID_TILE_BITS; ti <= (r.row_max - 1) >> GRID_TILE_BITS; ++ti) {
+        i32 row_min = ti << GRID_TILE_BITS, row_max = min_i32(row_min + GRID_TILE_SIDE, env->rows);
+
+        for(i32 tj = first_tile_col; tj <= (r.col_max - 1) >> GRID_TILE_BITS; ++tj) {
+            i32 col_min = tj << GRID_TILE_BITS, col_max = min_i32(col_min + GRID_TILE_SIDE, env->cols);
+
+            for(i32 i = row_min; i < row_max; ++i) {
+                u32 row_sum = 0;
+                for(i32 j = col_min; j < col_max; ++j) {
+                    row_sum += MAT(env->depths, i, j);
+                    MAT(integral->local, i, j) = row_sum + (i > row_min ? MAT(integral->local, i - 1, j) : 0);
+                }
+            }
+        }
+
+        for(i32 tj = first_tile_col; tj < (i32) integral->tile_cols; ++tj) {
+            i32 last_col = min_i32((tj + 1) << GRID_TILE_BITS, env->cols) - 1;
+            TILE_TOTALS(integral, ti, tj + 1) = TILE_TOTALS(integral, ti, tj) + MAT(integral->local, row_max - 1, last_col);
+        }
+    }
+}
+
+void init_integral_image(integral_image_t* integral, grid_t* env, arena_t* arena) {
+    assertf(env->dirty != NULL, "derived structures need a tracked grid");
+
+    integral->env = env;
+    integral->synced = env->dirty->generation;
+
+    matrix_u32_init(&integral->local, env->rows, env->cols, arena);
+    integral->tile_rows = (env->rows + GRID_TILE_SIDE - 1) >> GRID_TILE_BITS;
+    integral->tile_cols = (env->cols + GRID_TILE_SIDE - 1) >> GRID_TILE_BITS;
+    integral->tile_totals = arena_calloc(arena, integral->tile_rows * (integral->tile_cols + 1), sizeof(u64));
+
+    update_integral_tiles(integral, whole_grid(env));
+}
+
+/**
+ * @brief Sum over [0, rows) x [0, cols): the whole tiles above and left (a running total per tile row),
+ *      then the partial tiles of the last tile row and the last tile col, read off their local tables
+ */
+static u64 integral_prefix(const integral_image_t* integral, i32 rows, i32 cols) {
+    if(rows == 0 || cols == 0) return 0;
+
+    i32 i = rows - 1, j = cols - 1;
+    i32 ti = i >> GRID_TILE_BITS, tj = j >> GRID_TILE_BITS;
+
+    u64 sum = MAT(integral->local, i, j);
+    for(i32 k = 0; k < ti; ++k) sum += TILE_TOTALS(integral, k, tj);
+    for(i32 k = 0; k < tj; ++k) sum += MAT(integral->local, i, (k << GRID_TILE_BITS) + GRID_TILE_SIDE - 1);
+    for(i32 k = 0; k < ti; ++k) sum += MAT(integral->local, (k << GRID_TILE_BITS) + GRID_TILE_SIDE - 1, j);
+
+    return sum;
+}
+
+u64 integral_image_sum(integral_image_t* integral, grid_rect_t r) {
+    grid_t* env = integral->env;
+    assertf(r.row_min >= 0 && r.col_min >= 0 && r.row_min <= r.row_max && r.col_min <= r.col_max
+        && r.row_max <= (i32) env->rows && r.col_max <= (i32) env->cols, "rect does not fit in the grid");
+
+    sync_dirty(env, &integral->synced, update_integral_tiles, integral);
+
+    return integral_prefix(integral, r.row_max, r.col_max) - integral_prefix(integral, r.row_min, r.col_max)
+        - integral_prefix(integral, r.row_max, r.col_min) + integral_prefix(integral, r.row_min, r.col_min);
+}
+
+// Every location whose patch overlaps r
+static void invalidate_sensor_cache(void* derived, grid_rect_t r) {
+    sensor_cache_t* cache = derived;
+    grid_t* env = cache->env;
+    i32 radius = cache->patch_sidelen / 2;
+
+    i32 row_min = max_i32(r.row_min - radius, 0), row_max = min_i32(r.row_max + radius, env->rows);
+    i32 col_min = max_i32(r.col_min - radius, 0), col_max = min_i32(r.col_max + radius, env->cols);
+
+    for(i32 i = row_min; i < row_max; ++i)
+        memset(cache->valid + i * env->cols + col_min, 0, col_max - col_min);
+}
+
+void init_sensor_cache(sensor_cache_t* cache, grid_t* env, u32 patch_sidelen, arena_t* arena) {
+    assertf(env->dirty != NULL, "derived structures need a tracked grid");
+
+    init_integer_math();
+
+    cache->env = env;
+    cache->synced = env->dirty->generation;
+    cache->patch_sidelen = patch_sidelen;
+    init_grid_env(&cache->patch, patch_sidelen, patch_sidelen, arena);
+
+    cache->features = arena_alloc(arena, env->rows * env->cols, sizeof(*cache->features));
+    cache->poses = arena_alloc(arena, env->rows * env->cols, sizeof(*cache->poses));
+    cache->valid = arena_calloc(arena, env->rows * env->cols, sizeof(*cache->valid));
+}
+
+void sensor_cache_get(features_t* features, pose_t* pose, sensor_cache_t* cache, vec2d location) {
+    sync_dirty(cache->env, &cache->synced, invalidate_sensor_cache, cache);
+
+    u32 index = location.x * cache->env->cols + location.y;
+    if(!cache->valid[index]) {
+        i32 radius = cache->patch_sidelen / 2;
+        extract_patch(&cache->patch, cache->env, location, cache->patch_sidelen);
+        sensor_module(cache->features + index, cache->poses + index, cache->patch, (vec2d) {.x = radius, .y = radius});
+        cache->valid[index] = 1;
+    }
+
+    *features = cache->features[index];
+    *pose = cache->poses[index];
+}
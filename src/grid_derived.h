@@ -0,0 +1,84 @@
+#ifndef GRID_DERIVED_H
+#define GRID_DERIVED_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "tensor.h"
+#include "arena.h"
+#include "grid_environment.h"
+#include "interfaces.h"
+
+/**
+ * Structures computed from a tracked grid (track_grid_env), kept in sync lazily:
+ *      mutations only log dirty rects, and every query first replays the rects marked since the structure's last sync,
+ *      recomputing what they cover. A small update costs O(changed area), not O(world),
+ *      and a burst of updates between two queries costs nothing until the next query.
+ * When a structure fell more than GRID_DIRTY_LOG_CAPACITY rects behind, it is rebuilt from scratch.
+ *
+ * Each structure is bound to the grid it was initialized on.
+ */
+
+#define MAX_PYRAMID_LEVELS 16
+
+/**
+ * Level 0 is the grid's depths, level l + 1 halves level l (rounding up):
+ *      every cell is the floored mean of the (up to) 2x2 cells below it.
+ */
+typedef struct depth_pyramid_t_ {
+    grid_t* env;
+    u64 synced; // generation of env's dirty log the levels are up to date with
+
+    u32 num_levels;
+    mat_u8 levels[MAX_PYRAMID_LEVELS];
+} depth_pyramid_t;
+
+void init_depth_pyramid(depth_pyramid_t* pyramid, grid_t* env, arena_t* arena);
+mat_u8 depth_pyramid_level(depth_pyramid_t* pyramid, u32 level);
+
+/**
+ * Summed-area table of the depths, cut in GRID_TILE_SIDE tiles so that an update does not ripple through the whole table:
+ *      every tile has its own local table, and every tile row keeps the running totals of its tiles, left to right.
+ * An update recomputes the local tables of the tiles it touches, plus the running totals of their tile rows
+ *      from the first touched tile on (O(cols / GRID_TILE_SIDE) per touched tile row), never the whole world.
+ * A rect sum costs O((rows + cols) / GRID_TILE_SIDE) instead of O(1).
+ */
+#define GRID_TILE_BITS 4
+#define GRID_TILE_SIDE (1 << GRID_TILE_BITS)
+
+typedef struct integral_image_t_ {
+    grid_t* env;
+    u64 synced;
+
+    mat_u32 local; // sum of the depths from the tile's corner to (i, j), inclusive
+    u32 tile_rows;
+    u32 tile_cols;
+    u64* tile_totals; // tile_rows x (tile_cols + 1): sum of the tiles of tile row ti left of tj, exclusive
+} integral_image_t;
+
+void init_integral_image(integral_image_t* integral, grid_t* env, arena_t* arena);
+u64 integral_image_sum(integral_image_t* integral, grid_rect_t r);
+
+/**
+ * sensor_module's output at every location a patch fits around, computed on first query and kept until
+ *      a dirty rect comes within the patch radius.
+ */
+typedef struct sensor_cache_t_ {
+    grid_t* env;
+    u64 synced;
+
+    u32 patch_sidelen;
+    grid_t patch; // scratch
+
+    features_t* features; // rows x cols
+    pose_t* poses;
+    u8* valid;
+} sensor_cache_t;
+
+void init_sensor_cache(sensor_cache_t* cache, grid_t* env, u32 patch_sidelen, arena_t* arena);
+// Same as extract_patch + sensor_module at location
+void sensor_cache_get(features_t* features, pose_t* pose, sensor_cache_t* cache, vec2d location);
+
+#endif // GRID_DERIVED_H
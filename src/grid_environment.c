@@ -2,31 +2,107 @@
 
 #include "assertf.h"
 #include "distributions.h"
+#include "orientation.h"
 
-void init_grid_env(grid_t* env, u32 rows, u32 cols) {
-    matrix_u8_init(&env->depths, rows, cols);
-    matrix_u32_init(&env->values, rows, cols);
+void init_grid_env(grid_t* env, u32 rows, u32 cols, arena_t* arena) {
+    matrix_u8_init(&env->depths, rows, cols, arena);
+    matrix_u32_init(&env->values, rows, cols, arena);
 
     env->rows = rows;
     env->cols = cols;
+    env->dirty = NULL;
+}
+
+void init_grid_env_u16(grid_u16_t* env, u32 rows, u32 cols, arena_t* arena) {
+    matrix_u16_init(&env->depths, rows, cols, arena);
+    matrix_u32_init(&env->values, rows, cols, arena);
+
+    env->rows = rows;
+    env->cols = cols;
+}
+
+void view_grid_env(grid_t* view, u8* depths, u32 depth_stride, u32* values, u32 value_stride, u32 rows, u32 cols) {
+    assertf(depth_stride >= cols && value_stride >= cols, "strides (%u, %u) shorter than a row of %u", depth_stride, value_stride, cols);
+
+    view->depths = (mat_u8) {.rows = rows, .cols = depth_stride, .data = depths};
+    view->values = (mat_u32) {.rows = rows, .cols = value_stride, .data = values};
+
+    view->rows = rows;
+    view->cols = cols;
+    view->dirty = NULL;
+}
+
+void view_grid_env_u16(grid_u16_t* view, u16* depths, u32 depth_stride, u32* values, u32 value_stride, u32 rows, u32 cols) {
+    assertf(depth_stride >= cols && value_stride >= cols, "strides (%u, %u) shorter than a row of %u", depth_stride, value_stride, cols);
+
+    view->depths = (mat_u16) {.rows = rows, .cols = depth_stride, .data = depths};
+    view->values = (mat_u32) {.rows = rows, .cols = value_stride, .data = values};
+
+    view->rows = rows;
+    view->cols = cols;
 }
 
 void populate_grid_env_random(grid_t* env) {
     for(u32 i = 0; i < env->rows; ++i) {
-        for(u32 j = 0; j < env->rows; ++j) {
+        for(u32 j = 0; j < env->cols; ++j) {
             MAT(env->depths, i, j) = unif_rand_range_u32(0, 4);
             MAT(env->values, i, j) = unif_rand_range_u32(10, 50);
         }
     }
 }
 
+void track_grid_env(grid_t* env, arena_t* arena) {
+    env->dirty = arena_calloc(arena, 1, sizeof(*env->dirty));
+}
+
+static i32 clamp_i32(i32 v, i32 min, i32 max) {
+    return v < min ? min : (v > max ? max : v);
+}
+
+void grid_mark_dirty(grid_t* env, grid_rect_t r) {
+    assertf(env->dirty != NULL, "grid is not tracked");
+
+    r.row_min = clamp_i32(r.row_min, 0, env->rows);
+    r.row_max = clamp_i32(r.row_max, 0, env->rows);
+    r.col_min = clamp_i32(r.col_min, 0, env->cols);
+    r.col_max = clamp_i32(r.col_max, 0, env->cols);
+    if(r.row_min >= r.row_max || r.col_min >= r.col_max) return;
+
+    grid_dirty_log_t* log = env->dirty;
+    log->rects[log->generation % GRID_DIRTY_LOG_CAPACITY] = r;
+    log->generation += 1;
+}
+
+void grid_set_cell(grid_t* env, i32 row, i32 col, u8 depth, u32 value) {
+    MAT(env->depths, row, col) = depth;
+    MAT(env->values, row, col) = value;
+    grid_mark_dirty(env, (grid_rect_t) {row, row + 1, col, col + 1});
+}
+
+void grid_write_rect(grid_t* env, grid_rect_t r, const u8* depths, u32 depth_stride, const u32* values, u32 value_stride) {
+    assertf(r.row_min >= 0 && r.col_min >= 0 && r.row_max <= (i32) env->rows && r.col_max <= (i32) env->cols,
+        "rect does not fit in the grid");
+
+    for(i32 row = r.row_min; row < r.row_max; ++row) {
+        const u8* depth_row = depths + (row - r.row_min) * depth_stride;
+        const u32* value_row = values + (row - r.row_min) * value_stride;
+        for(i32 col = r.col_min; col < r.col_max; ++col) {
+            MAT(env->depths, row, col) = depth_row[col - r.col_min];
+            MAT(env->values, row, col) = value_row[col - r.col_min];
+        }
+    }
+
+    grid_mark_dirty(env, r);
+}
+
+// Bounds are inclusive: a patch centered on max_x still fits in the environment
 bounds_t get_bounds(u32 env_size_x, u32 env_size_y, u32 patch_size_x, u32 patch_size_y) {
     return (bounds_t) {
         .min_x = patch_size_x / 2,
-        .max_x = env_size_x - patch_size_x / 2,
+        .max_x = env_size_x - patch_size_x / 2 - 1,
 
         .min_y = patch_size_y / 2,
-        .max_y = env_size_y - patch_size_y / 2
+        .max_y = env_size_y - patch_size_y / 2 - 1
     };
 }
 
@@ -56,6 +132,36 @@ void extract_patch(grid_t* patch, grid_t* env, vec2d location, u32 patch_sidelen
     }
 }
 
+void extract_patch_u16(grid_u16_t* patch, grid_u16_t* env, vec2d location, u32 patch_sidelen) {
+    assertf(patch_sidelen == patch->rows && patch_sidelen == patch->cols,
+        "mismatch between patch_radius and actually allocated patch shape");
+    assertf(patch_sidelen % 2 != 0, "patch cannot be of even sidelength");
+
+    u32 patch_radius = patch_sidelen / 2;
+    u32 start_row = location.x - patch_radius;
+    u32 start_col = location.y - patch_radius;
+
+    for(u32 row = 0; row < patch->rows; ++row) {
+        for(u32 col = 0; col < patch->cols; ++col) {
+            MAT(patch->values, row, col) = MAT(env->values, start_row + row, start_col + col);
+            MAT(patch->depths, row, col) = MAT(env->depths, start_row + row, start_col + col);
+        }
+    }
+}
+
+void orient_grid_env(grid_t* out, grid_t* in, u32 orientation) {
+    vec2d size = {.x = in->rows, .y = in->cols};
+    vec2d out_size = oriented_size(size, orientation);
+    assertf(out->rows == (u32) out_size.x && out->cols == (u32) out_size.y, "oriented grid has the wrong shape");
+
+    for(i32 i = 0; i < size.x; ++i) {
+        for(i32 j = 0; j < size.y; ++j) {
+            vec2d l = orient_location((vec2d) {.x = i, .y = j}, size, orientation);
+            MAT(out->depths, l.x, l.y) = MAT(in->depths, i, j);
+            MAT(out->values, l.x, l.y) = MAT(in->values, i, j);
+        }
+    }
+}
 
 void print_grid(grid_t* env) {
     printf("depths:\n");
@@ -11,6 +11,25 @@
 #include "tensor.h"
 #include "location.h"
 #include "bounds.h"
+#include "arena.h"
+
+// Rows [row_min, row_max) and cols [col_min, col_max) of a grid
+typedef struct grid_rect_t_ {
+    i32 row_min, row_max;
+    i32 col_min, col_max;
+} grid_rect_t;
+
+/**
+ * What changed in a tracked grid, for the structures derived from it to catch up lazily (see grid_derived.h).
+ * Rect g (the g-th ever marked) is at rects[g % GRID_DIRTY_LOG_CAPACITY]: a structure last synced at generation s
+ *      replays rects [s, generation), or recomputes everything when it fell more than the capacity behind.
+ */
+#define GRID_DIRTY_LOG_CAPACITY 64
+
+typedef struct grid_dirty_log_t_ {
+    u64 generation; // number of rects ever marked
+    grid_rect_t rects[GRID_DIRTY_LOG_CAPACITY];
+} grid_dirty_log_t;
 
 typedef struct grid_t_ {
     mat_u32 values;
@@ -18,14 +37,61 @@ typedef struct grid_t_ {
 
     u32 rows;
     u32 cols;
+
+    grid_dirty_log_t* dirty; // NULL unless tracked (track_grid_env)
 } grid_t;
 
-void init_grid_env(grid_t* env, u32 rows, u32 cols);
+/**
+ * Same as grid_t with 16 bits depths (e.g. millimetres from a depth camera), sensed by sensor_module_u16.
+ * Worlds and learning run on grid_t: this is the input side only.
+ */
+typedef struct grid_u16_t_ {
+    mat_u32 values;
+    mat_u16 depths;
+
+    u32 rows;
+    u32 cols;
+} grid_u16_t;
+
+void init_grid_env(grid_t* env, u32 rows, u32 cols, arena_t* arena);
+void init_grid_env_u16(grid_u16_t* env, u32 rows, u32 cols, arena_t* arena);
+/**
+ * Wraps buffers owned by someone else, without copying them.
+ * A grid's mats are indexed with MAT, whose row pitch is the mat's cols:
+ *      a view's mats have the strides (in elements) as cols, and the grid's rows/cols are the logical shape.
+ * Only the functions that go through MAT and the grid's rows/cols (sensing, extract_patch) accept views.
+ */
+void view_grid_env(grid_t* view, u8* depths, u32 depth_stride, u32* values, u32 value_stride, u32 rows, u32 cols);
+void view_grid_env_u16(grid_u16_t* view, u16* depths, u32 depth_stride, u32* values, u32 value_stride, u32 rows, u32 cols);
 void populate_grid_env_random(grid_t* env);
 
+/**
+ * Mutations of a tracked grid. Writes go through these (or are followed by grid_mark_dirty)
+ *      so that derived structures only recompute what changed.
+ */
+void track_grid_env(grid_t* env, arena_t* arena);
+// Clips r to the grid and logs it, unless it is empty
+void grid_mark_dirty(grid_t* env, grid_rect_t r);
+void grid_set_cell(grid_t* env, i32 row, i32 col, u8 depth, u32 value);
+// Copies r's rows from depths/values (row strides in elements) into the grid, then marks r
+void grid_write_rect(grid_t* env, grid_rect_t r, const u8* depths, u32 depth_stride, const u32* values, u32 value_stride);
+
+// 1 when rects [since, generation) are no longer all in the log: everything has to be recomputed
+static inline int grid_dirty_overflowed(const grid_t* env, u64 since) {
+    return env->dirty->generation - since > GRID_DIRTY_LOG_CAPACITY;
+}
+
+static inline grid_rect_t grid_dirty_rect(const grid_t* env, u64 g) {
+    return env->dirty->rects[g % GRID_DIRTY_LOG_CAPACITY];
+}
+
 bounds_t get_bounds(u32 env_size_x, u32 env_size_y, u32 patch_size_x, u32 patch_size_y);
 
+// out must be allocated with the oriented shape (see oriented_size)
+void orient_grid_env(grid_t* out, grid_t* in, u32 orientation);
+
 void extract_patch(grid_t* patch, grid_t* env, vec2d location, u32 patch_sidelen);
+void extract_patch_u16(grid_u16_t* patch, grid_u16_t* env, vec2d location, u32 patch_sidelen);
 
 void print_grid(grid_t* env);
 
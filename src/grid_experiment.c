@@ -0,0 +1,1347 @@
+#include "grid_experiment.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "assertf.h"
+#include "distributions.h"
+#include "sensor_module.h"
+#include "checkpoint.h"
+#include "model_library.h"
+#include "data_manager.h"
+
+void default_experiment_config(grid_experiment_config* config) {
+    config->seed = 42;
+
+    config->env_rows = 10;
+    config->env_cols = 10;
+    config->patch_sidelen = 3;
+    config->model_scale = 1;
+
+    config->num_objects = 4;
+    config->world = WORLD_RANDOM;
+    default_generator_config(&config->generator, config->env_rows, config->env_cols);
+    config->dataset[0] = '\0';
+    config->tracked = 0;
+    config->world_updates = 0;
+
+    config->train_episodes_per_object = 2;
+    config->train_steps = 50;
+    config->eval_episodes_per_object = 5;
+    config->eval_max_steps = 50;
+
+    config->policy = MOTOR_POLICY_RANDOM;
+    config->lm = LM_GRID;
+    config->pooler = 0;
+
+    config->num_orientations = 1;
+    config->rotate_eval = 0;
+
+    config->num_columns = 1;
+    config->column_spacing = 2;
+
+    config->num_sensors = 1;
+    config->sensor_spacing = 2;
+
+    config->pipeline = 0;
+    config->pipeline_depth = 16;
+
+    config->trace[0] = '\0';
+
+    config->checkpoint[0] = '\0';
+    config->checkpoint_every = 16;
+
+    config->library[0] = '\0';
+    config->from_library[0] = '\0';
+
+    config->verbose = 0;
+}
+
+static int parse_u32(u32* out, const char* value) {
+    char* end;
+    unsigned long parsed = strtoul(value, &end, 10);
+    if(end == value || *end != '\0') return 0;
+
+    *out = (u32) parsed;
+    return 1;
+}
+
+static int parse_f32(f32* out, const char* value) {
+    char* end;
+    f32 parsed = strtof(value, &end);
+    if(end == value || *end != '\0') return 0;
+
+    *out = parsed;
+    return 1;
+}
+
+#define CONFIG_U32_KEY(name, field) \
+    if(strcmp(key, name) == 0) return parse_u32(&config->field, value)
+#define CONFIG_F32_KEY(name, field) \
+    if(strcmp(key, name) == 0) return parse_f32(&config->field, value)
+
+int set_experiment_config(grid_experiment_config* config, const char* key, const char* value) {
+    CONFIG_U32_KEY("seed", seed);
+    CONFIG_U32_KEY("rows", env_rows);
+    CONFIG_U32_KEY("cols", env_cols);
+    CONFIG_U32_KEY("patch", patch_sidelen);
+    CONFIG_U32_KEY("scale", model_scale);
+    CONFIG_U32_KEY("objects", num_objects);
+    CONFIG_U32_KEY("train_episodes", train_episodes_per_object);
+    CONFIG_U32_KEY("train_steps", train_steps);
+    CONFIG_U32_KEY("eval_episodes", eval_episodes_per_object);
+    CONFIG_U32_KEY("eval_steps", eval_max_steps);
+    CONFIG_U32_KEY("verbose", verbose);
+    CONFIG_U32_KEY("orientations", num_orientations);
+    CONFIG_U32_KEY("rotate_eval", rotate_eval);
+    CONFIG_U32_KEY("columns", num_columns);
+    CONFIG_U32_KEY("column_spacing", column_spacing);
+    CONFIG_U32_KEY("sensors", num_sensors);
+    CONFIG_U32_KEY("sensor_spacing", sensor_spacing);
+    CONFIG_U32_KEY("pipeline", pipeline);
+    CONFIG_U32_KEY("pipeline_depth", pipeline_depth);
+    CONFIG_U32_KEY("pooler", pooler);
+    CONFIG_U32_KEY("tracked", tracked);
+    CONFIG_U32_KEY("world_updates", world_updates);
+    CONFIG_U32_KEY("checkpoint_every", checkpoint_every);
+    CONFIG_U32_KEY("max_depth", generator.max_depth);
+    CONFIG_F32_KEY("curvature", generator.max_curvature);
+    CONFIG_U32_KEY("noise", generator.noise);
+    CONFIG_U32_KEY("labels", generator.num_labels);
+    CONFIG_U32_KEY("label_regions", generator.max_label_regions);
+
+    if(strcmp(key, "trace") == 0) {
+        if(strlen(value) >= CONFIG_PATH_LENGTH) return 0;
+        strcpy(config->trace, value);
+        return 1;
+    }
+    if(strcmp(key, "checkpoint") == 0) {
+        if(strlen(value) >= CONFIG_PATH_LENGTH) return 0;
+        strcpy(config->checkpoint, value);
+        return 1;
+    }
+    if(strcmp(key, "library") == 0) {
+        if(strlen(value) >= CONFIG_PATH_LENGTH) return 0;
+        strcpy(config->library, value);
+        return 1;
+    }
+    if(strcmp(key, "from_library") == 0) {
+        if(strlen(value) >= CONFIG_PATH_LENGTH) return 0;
+        strcpy(config->from_library, value);
+        return 1;
+    }
+    if(strcmp(key, "dataset") == 0) {
+        if(strlen(value) >= CONFIG_PATH_LENGTH) return 0;
+        strcpy(config->dataset, value);
+        return 1;
+    }
+
+    if(strcmp(key, "world") == 0) {
+        if(strcmp(value, "random") == 0) config->world = WORLD_RANDOM;
+        else if(strcmp(value, "procedural") == 0) config->world = WORLD_PROCEDURAL;
+        else if(strcmp(value, "dataset") == 0) config->world = WORLD_DATASET;
+        else if(strcmp(value, "voxel") == 0) config->world = WORLD_VOXEL;
+        else return 0;
+        return 1;
+    }
+
+    if(strcmp(key, "policy") == 0) {
+        if(strcmp(value, "random") == 0) config->policy = MOTOR_POLICY_RANDOM;
+        else if(strcmp(value, "scan") == 0) config->policy = MOTOR_POLICY_SCAN;
+        else return 0;
+        return 1;
+    }
+
+    if(strcmp(key, "lm") == 0) {
+        if(strcmp(value, "grid") == 0) config->lm = LM_GRID;
+        else if(strcmp(value, "htm") == 0) config->lm = LM_HTM;
+        else return 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Splits "key=value" in place and applies it
+ */
+static void apply_key_value(grid_experiment_config* config, char* key_value) {
+    char* separator = strchr(key_value, '=');
+    if(separator == NULL) {
+        LOG_ERROR("expected key=value, got '%s'", key_value);
+        exit(1);
+    }
+    *separator = '\0';
+
+    char* key = key_value;
+    char* value = separator + 1;
+
+    if(strcmp(key, "config") == 0) {
+        load_experiment_config_file(config, value);
+    } else if(!set_experiment_config(config, key, value)) {
+        LOG_ERROR("unknown key or invalid value: %s=%s", key, value);
+        exit(1);
+    }
+}
+
+/**
+ * @brief One key=value per line. Blank lines and lines starting with # are ignored
+ */
+void load_experiment_config_file(grid_experiment_config* config, const char* filename) {
+    FILE* f = fopen(filename, "r");
+    if(f == NULL) {
+        LOG_ERROR("could not open config file %s", filename);
+        exit(1);
+    }
+
+    char line[256];
+    while(fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '\0' || line[0] == '#') continue;
+
+        apply_key_value(config, line);
+    }
+
+    fclose(f);
+}
+
+void parse_experiment_args(grid_experiment_config* config, int argc, char* argv[]) {
+    char key_value[256];
+    for(int i = 1; i < argc; ++i) {
+        strncpy(key_value, argv[i], sizeof(key_value) - 1);
+        key_value[sizeof(key_value) - 1] = '\0';
+
+        apply_key_value(config, key_value);
+    }
+
+    config->generator.rows = config->env_rows;
+    config->generator.cols = config->env_cols;
+}
+
+static const char* world_name(world_kind world) {
+    switch(world) {
+        case WORLD_RANDOM: return "random";
+        case WORLD_PROCEDURAL: return "procedural";
+        case WORLD_DATASET: return "dataset";
+        case WORLD_VOXEL: return "voxel";
+    }
+    return "?";
+}
+
+void print_experiment_config(grid_experiment_config* config) {
+    printf("config: seed=%u rows=%u cols=%u patch=%u scale=%u objects=%u world=%s tracked=%u world_updates=%u train_episodes=%u train_steps=%u eval_episodes=%u eval_steps=%u policy=%s lm=%s pooler=%u orientations=%u rotate_eval=%u columns=%u column_spacing=%u sensors=%u sensor_spacing=%u pipeline=%u pipeline_depth=%u\n",
+        config->seed,
+        config->env_rows, config->env_cols,
+        config->patch_sidelen,
+        config->model_scale,
+        config->num_objects,
+        world_name(config->world), config->tracked, config->world_updates,
+        config->train_episodes_per_object, config->train_steps,
+        config->eval_episodes_per_object, config->eval_max_steps,
+        config->policy == MOTOR_POLICY_RANDOM ? "random" : "scan",
+        config->lm == LM_GRID ? "grid" : "htm", config->pooler,
+        config->num_orientations, config->rotate_eval,
+        config->num_columns, config->column_spacing,
+        config->num_sensors, config->sensor_spacing,
+        config->pipeline, config->pipeline_depth
+    );
+}
+
+static f64 now_seconds() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (f64) t.tv_sec + (f64) t.tv_nsec * 1e-9;
+}
+
+static u32 max_u32(u32 a, u32 b) {
+    return a > b ? a : b;
+}
+
+static void* column_worker(void* arg);
+static void* sense_worker(void* arg);
+
+/**
+ * @brief Whether the policy's movements are known before the episode starts (pregenerated),
+ *      which is what lets sensing run ahead of learning
+ */
+static int is_open_loop_policy(motor_policy_kind policy) {
+    switch(policy) {
+        case MOTOR_POLICY_RANDOM:
+        case MOTOR_POLICY_SCAN:
+            return 1;
+    }
+    return 0;
+}
+
+static u32 next_power_of_two(u32 n) {
+    u32 p = 1;
+    while(p < n) p <<= 1;
+    return p;
+}
+
+void init_grid_experiment(grid_experiment_t* experiment, grid_experiment_config config) {
+    FILE* dataset = NULL;
+    if(config.world == WORLD_DATASET) {
+        dataset = open_object_dataset_reader(config.dataset, &config.num_objects, &config.env_rows, &config.env_cols);
+        config.generator.rows = config.env_rows;
+        config.generator.cols = config.env_cols;
+    }
+
+    assertf(config.env_rows % config.model_scale == 0 && config.env_cols % config.model_scale == 0,
+        "environment (%u, %u) is not a multiple of the model scale %u", config.env_rows, config.env_cols, config.model_scale);
+    assertf(config.patch_sidelen % 2 != 0, "patch cannot be of even sidelength");
+    assertf(config.num_columns >= 1 && config.num_columns <= MAX_COLUMNS, "between 1 and %d columns", MAX_COLUMNS);
+    assertf(config.pipeline_depth >= 1, "the pipeline needs room for at least one step");
+    assertf(config.trace[0] == '\0' || config.num_columns == 1, "traces are recorded for a single column");
+    assertf(config.trace[0] == '\0' || (config.env_rows <= INT16_MAX && config.env_cols <= INT16_MAX),
+        "traces store locations as i16: the environment is at most %d by %d", INT16_MAX, INT16_MAX);
+    assertf(config.trace[0] == '\0' || config.checkpoint[0] == '\0', "a resumed run cannot record a trace");
+    assertf(config.checkpoint_every >= 1, "checkpoints are at least one episode apart");
+    assertf(config.from_library[0] == '\0' || (config.checkpoint[0] == '\0' && config.library[0] == '\0' && config.trace[0] == '\0'),
+        "a run matching against a library learns nothing to snapshot, write or trace");
+    assertf(config.lm == LM_GRID || (config.num_columns == 1 && config.num_sensors == 1 && !config.pipeline),
+        "lm=htm runs a single column with a single sensor, without pipeline");
+    assertf(config.lm == LM_GRID || (config.checkpoint[0] == '\0' && config.library[0] == '\0' && config.from_library[0] == '\0'
+        && config.trace[0] == '\0'), "checkpoints, libraries and traces hold grid_lm models (lm=grid)");
+    assertf(config.world != WORLD_VOXEL || !config.rotate_eval, "voxel objects are voxelized once, in their own orientation");
+    assertf(!config.tracked || (config.num_columns == 1 && !config.pipeline && config.world != WORLD_VOXEL),
+        "a sensor cache is read and updated by a single thread: tracked runs a single column, without pipeline, on grids");
+    assertf(config.world_updates == 0 || (config.tracked && config.checkpoint[0] == '\0'),
+        "world updates go to tracked objects, which a resumed run would regenerate without them");
+
+    experiment->config = config;
+    memset(&experiment->learning_report, 0, sizeof(experiment->learning_report));
+    memset(&experiment->evaluation_report, 0, sizeof(experiment->evaluation_report));
+
+    unif_rand_seed(config.seed);
+    init_integer_math();
+
+    // location.x indexes rows (see extract_patch), so the world is (rows, cols) along (x, y)
+    vec2d world_size = {.x = config.env_rows, .y = config.env_cols};
+    vec2d model_size = vec_divided_u32(world_size, config.model_scale);
+    u32 max_steps = max_u32(config.train_steps, config.eval_max_steps);
+
+    size_t env_bytes = ARENA_ALIGN_UP((size_t) config.env_rows * config.env_cols * sizeof(u8))
+        + ARENA_ALIGN_UP((size_t) config.env_rows * config.env_cols * sizeof(u32));
+    size_t lm_bytes = config.lm == LM_GRID
+        ? learning_module_arena_bytes(model_size, config.num_objects, config.num_orientations)
+        : htm_recognizer_arena_bytes(config.num_objects, config.pooler);
+    size_t tracked_bytes = ARENA_ALIGN_UP(sizeof(grid_dirty_log_t)) + ARENA_ALIGN_UP(sizeof(sensor_cache_t))
+        + ARENA_ALIGN_UP((size_t) config.env_rows * config.env_cols * sizeof(features_t))
+        + ARENA_ALIGN_UP((size_t) config.env_rows * config.env_cols * sizeof(pose_t))
+        + ARENA_ALIGN_UP((size_t) config.env_rows * config.env_cols * sizeof(u8))
+        + ARENA_ALIGN_UP((size_t) config.patch_sidelen * config.patch_sidelen * (sizeof(u8) + sizeof(u32))) + 4 * ARENA_ALIGNMENT;
+    size_t column_bytes = lm_bytes
+        + ARENA_ALIGN_UP((size_t) config.patch_sidelen * config.patch_sidelen * (sizeof(u16) + sizeof(u32))) + ARENA_ALIGNMENT // voxel patch
+        + ARENA_ALIGN_UP(VOTE_RING_CAPACITY * sizeof(lm_vote_t))
+        + ARENA_ALIGN_UP((size_t) model_size.x * model_size.y * sizeof(model_cell_t)); // library scratch
+
+    arena_init(&experiment->arena,
+        config.num_objects * (env_bytes + ARENA_ALIGN_UP(sizeof(grid_t)) + 2 * ARENA_ALIGNMENT + (config.tracked ? tracked_bytes : 0))
+        + config.num_columns * column_bytes
+        + ARENA_ALIGN_UP(config.num_columns * sizeof(learning_column_t))
+        + ARENA_ALIGN_UP((size_t) max_steps * sizeof(vec2d))
+        + ARENA_ALIGN_UP((size_t) next_power_of_two(config.pipeline_depth) * sizeof(sensed_step_t))
+        + (1 << 16));
+    arena_init(&experiment->episode_arena, config.num_columns * learning_module_episode_bytes(model_size) + env_bytes + (1 << 16));
+
+    memory_tag previous_tag = set_memory_tag(MEMORY_ENVIRONMENT);
+    experiment->objects = arena_alloc(&experiment->arena, config.num_objects, sizeof(*experiment->objects));
+    for(u32 o = 0; o < config.num_objects; ++o) {
+        grid_t* object = experiment->objects + o;
+        init_grid_env(object, config.env_rows, config.env_cols, &experiment->arena);
+
+        switch(config.world) {
+            case WORLD_RANDOM: populate_grid_env_random(object); break;
+            case WORLD_PROCEDURAL:
+            case WORLD_VOXEL: generate_object(object, &experiment->config.generator, config.seed, o); break;
+            case WORLD_DATASET: read_object(dataset, object); break;
+        }
+    }
+    if(dataset != NULL) fclose(dataset);
+
+    // the world is the height of the deepest cell: rays start on its top, right above the highest cells
+    experiment->voxel_objects = NULL;
+    if(config.world == WORLD_VOXEL) {
+        size_t voxel_bytes = ARENA_ALIGN_UP(config.num_objects * sizeof(voxel_env_t)) + (1 << 16);
+        for(u32 o = 0; o < config.num_objects; ++o)
+            voxel_bytes += voxel_env_bytes(grid_surface_bricks(experiment->objects + o, 0)) + 3 * ARENA_ALIGNMENT;
+
+        arena_init(&experiment->voxel_arena, voxel_bytes);
+        experiment->voxel_objects = arena_alloc(&experiment->voxel_arena, config.num_objects, sizeof(*experiment->voxel_objects));
+        for(u32 o = 0; o < config.num_objects; ++o) {
+            grid_t* object = experiment->objects + o;
+            voxel_env_t* voxels = experiment->voxel_objects + o;
+            init_voxel_env(voxels, object->rows, object->cols, config.generator.max_depth + 1, grid_surface_bricks(object, 0),
+                &experiment->voxel_arena);
+            voxelize_grid_surface(voxels, object, 0);
+        }
+    }
+
+    experiment->caches = NULL;
+    if(config.tracked) {
+        experiment->caches = arena_alloc(&experiment->arena, config.num_objects, sizeof(*experiment->caches));
+        for(u32 o = 0; o < config.num_objects; ++o) {
+            track_grid_env(experiment->objects + o, &experiment->arena);
+            init_sensor_cache(experiment->caches + o, experiment->objects + o, config.patch_sidelen, &experiment->arena);
+        }
+    }
+
+    experiment->sensor_margin = config.num_columns > 1 ? config.column_spacing : 0;
+
+    set_memory_tag(MEMORY_COLUMNS);
+    experiment->columns = arena_calloc(&experiment->arena, config.num_columns, sizeof(*experiment->columns));
+    for(u32 c = 0; c < config.num_columns; ++c) {
+        learning_column_t* column = experiment->columns + c;
+        column->id = c;
+        column->sensor_offset = vec_multiplied_u32(LAYOUT_OFFSETS[c], config.column_spacing);
+        column->experiment = experiment;
+
+        init_sensor_array(&column->sensors, config.num_sensors, config.sensor_spacing, config.patch_sidelen);
+        if(config.lm == LM_GRID)
+            init_learning_module(&column->lm, model_size, world_size, config.num_objects, config.num_orientations, &experiment->arena, &experiment->episode_arena);
+        else init_htm_recognizer(&column->htm, config.num_objects, config.pooler, &experiment->arena);
+        if(config.world == WORLD_VOXEL) init_grid_env_u16(&column->voxel_patch, config.patch_sidelen, config.patch_sidelen, &experiment->arena);
+        spsc_ring_init(&column->votes, VOTE_RING_CAPACITY, sizeof(lm_vote_t), &experiment->arena);
+
+        // every column decodes into its own scratch, on its own thread
+        if(config.from_library[0] != '\0') {
+            set_memory_tag(MEMORY_LIBRARY);
+            open_model_library(&column->library, config.from_library, &experiment->arena);
+            learning_module_attach_library(&column->lm, &column->library);
+            set_memory_tag(MEMORY_COLUMNS);
+        }
+    }
+
+    experiment->sensor_margin += sensor_array_reach(&experiment->columns[0].sensors) - config.patch_sidelen / 2;
+
+    bounds_t bounds = get_bounds(config.env_rows, config.env_cols, config.patch_sidelen, config.patch_sidelen);
+    vec2d start = {.x = bounds.min_x, .y = bounds.min_y};
+    set_memory_tag(MEMORY_MOTOR_POLICY);
+    init_random_motor_policy(&experiment->motor_policy, start, bounds, max_steps, &experiment->arena);
+
+    experiment->generation = 0;
+    experiment->quit = 0;
+    pthread_mutex_init(&experiment->mutex, NULL);
+    pthread_cond_init(&experiment->episode_started, NULL);
+    wakeup_init(&experiment->main_wakeup);
+    wakeup_init(&experiment->sense_wakeup);
+    wakeup_init(&experiment->column_wakeup);
+
+    // Columns already run on their own threads, and closed-loop policies need the learnt state before moving:
+    //      both fall back to lockstep
+    experiment->pipelined = config.pipeline && config.num_columns == 1 && is_open_loop_policy(config.policy);
+    if(config.pipeline && !experiment->pipelined)
+        printf("pipeline: falling back to lockstep (needs a single column and an open-loop policy)\n");
+
+    if(config.num_columns > 1) {
+        for(u32 c = 0; c < config.num_columns; ++c)
+            pthread_create(&experiment->columns[c].thread, NULL, column_worker, experiment->columns + c);
+    }
+
+    experiment->learnt_episodes = 0;
+
+    experiment->trace = NULL;
+    if(config.trace[0] != '\0') {
+        trace_header_t header = {
+            .env_rows = config.env_rows,
+            .env_cols = config.env_cols,
+            .model_scale = config.model_scale,
+            .num_objects = config.num_objects,
+            .num_orientations = config.num_orientations
+        };
+        experiment->trace = open_trace_writer(config.trace, header);
+    }
+
+    if(experiment->pipelined) {
+        set_memory_tag(MEMORY_PATCHES);
+        spsc_ring_init(&experiment->sensed_steps, next_power_of_two(config.pipeline_depth), sizeof(sensed_step_t), &experiment->arena);
+        pthread_create(&experiment->sense_thread, NULL, sense_worker, experiment);
+    }
+
+    set_memory_tag(previous_tag);
+
+    if(config.checkpoint[0] != '\0' && restore_experiment_checkpoint(experiment, config.checkpoint))
+        printf("checkpoint: resumed from %s after %u learning episodes\n", config.checkpoint, experiment->learnt_episodes);
+}
+
+void free_grid_experiment(grid_experiment_t* experiment) {
+    pthread_mutex_lock(&experiment->mutex);
+    experiment->quit = 1;
+    pthread_cond_broadcast(&experiment->episode_started);
+    pthread_mutex_unlock(&experiment->mutex);
+
+    if(experiment->config.num_columns > 1) {
+        for(u32 c = 0; c < experiment->config.num_columns; ++c)
+            pthread_join(experiment->columns[c].thread, NULL);
+    }
+    if(experiment->pipelined) pthread_join(experiment->sense_thread, NULL);
+
+    if(experiment->trace != NULL) close_trace(experiment->trace);
+
+    if(experiment->config.from_library[0] != '\0') {
+        for(u32 c = 0; c < experiment->config.num_columns; ++c)
+            close_model_library(&experiment->columns[c].library);
+    }
+
+    pthread_cond_destroy(&experiment->episode_started);
+    pthread_mutex_destroy(&experiment->mutex);
+    wakeup_destroy(&experiment->main_wakeup);
+    wakeup_destroy(&experiment->sense_wakeup);
+    wakeup_destroy(&experiment->column_wakeup);
+
+    if(experiment->config.world == WORLD_VOXEL) arena_free(&experiment->voxel_arena);
+    arena_free(&experiment->episode_arena);
+    arena_free(&experiment->arena);
+}
+
+/**
+ * @brief Resets the scratch state and picks the environment of the episode:
+ *      the object itself, or a copy of it in a random orientation (in the episode arena) when rotate is set
+ *
+ * @param learning whether the episode learns the object (an htm_recognizer_t learns it online)
+ */
+static grid_t* start_episode(grid_experiment_t* experiment, u32 object_id, int learning, int rotate) {
+    arena_reset(&experiment->episode_arena);
+    for(u32 c = 0; c < experiment->config.num_columns; ++c) {
+        learning_column_t* column = experiment->columns + c;
+        if(experiment->config.lm == LM_GRID) learning_module_new_episode(&column->lm, &experiment->episode_arena);
+        else htm_recognizer_new_episode(&column->htm, learning ? (i32) object_id : NOT_RECOGNIZED);
+    }
+
+    grid_t* object = experiment->objects + object_id;
+    if(!rotate) return object;
+
+    u32 orientation = unif_rand_u32(NUM_ORIENTATIONS - 1);
+    vec2d size = oriented_size((vec2d) {.x = object->rows, .y = object->cols}, orientation);
+
+    memory_tag previous_tag = set_memory_tag(MEMORY_ENVIRONMENT);
+    grid_t* oriented = arena_alloc(&experiment->episode_arena, 1, sizeof(*oriented));
+    init_grid_env(oriented, size.x, size.y, &experiment->episode_arena);
+    set_memory_tag(previous_tag);
+
+    orient_grid_env(oriented, object, orientation);
+
+    return oriented;
+}
+
+/**
+ * @brief Draws a start location and pregenerates the policy's movements.
+ * The agent's bounds leave room for the sensors of every column.
+ *
+ * @returns the start location
+ */
+static vec2d start_walk(grid_experiment_t* experiment, grid_t* env, u32 steps) {
+    u32 patch = experiment->config.patch_sidelen;
+    u32 margin = experiment->sensor_margin;
+
+    bounds_t b = get_bounds(env->rows, env->cols, patch, patch);
+    b.min_x += margin; b.max_x -= margin;
+    b.min_y += margin; b.max_y -= margin;
+    assertf(b.min_x <= b.max_x && b.min_y <= b.max_y, "environment too small for the patch and the sensors' spacing");
+
+    vec2d start = {
+        .x = unif_rand_range_u32(b.min_x, b.max_x),
+        .y = unif_rand_range_u32(b.min_y, b.max_y)
+    };
+
+    if(experiment->config.policy == MOTOR_POLICY_SCAN)
+        reset_scan_motor_policy(&experiment->motor_policy, start, b, steps);
+    else
+        reset_random_motor_policy(&experiment->motor_policy, start, b, steps);
+
+    return start;
+}
+
+/**
+ * @brief Feeds the observations of the column's sensor array (centered on location) to its learning module
+ */
+static void column_learn(learning_column_t* column, vec2d location, int learning, features_t* f, pose_t* p) {
+    if(column->experiment->config.lm == LM_HTM) {
+        htm_recognizer_step(&column->htm, f[0], vec_added(location, column->sensors.offsets[0]));
+        return;
+    }
+
+    for(u32 s = 0; s < column->sensors.num_sensors; ++s) {
+        vec2d sensor_location = vec_added(location, column->sensors.offsets[s]);
+        if(learning) learning_module_explore(&column->lm, f[s], p[s], sensor_location);
+        else learning_module_match(&column->lm, f[s], p[s], sensor_location);
+    }
+}
+
+// Returns the model the column's learning module recognized or NOT_RECOGNIZED
+static i32 column_recognized(learning_column_t* column) {
+    if(column->experiment->config.lm == LM_HTM) return htm_recognizer_recognized(&column->htm);
+    return learning_module_recognized(&column->lm);
+}
+
+/**
+ * @brief Observations of the column's sensors around location: rays looking straight down on the voxelized object
+ *      (world=voxel), the object's sensor cache when it is tracked, or one batch read off the grid
+ *      (rotated copies are never tracked nor voxelized)
+ *
+ * @param f one per sensor of the column
+ * @param p one per sensor of the column
+ */
+static void sense_column(learning_column_t* column, grid_t* env, vec2d location, features_t* f, pose_t* p) {
+    grid_experiment_t* experiment = column->experiment;
+
+    if(experiment->voxel_objects != NULL) {
+        voxel_env_t* voxels = experiment->voxel_objects + (env - experiment->objects);
+        i32 radius = column->voxel_patch.rows / 2;
+        for(u32 s = 0; s < column->sensors.num_sensors; ++s) {
+            vec2d sensor_location = vec_added(location, column->sensors.offsets[s]);
+            voxel_view_t view = {
+                .origin = {sensor_location.x + 0.5f, sensor_location.y + 0.5f, voxels->size_z},
+                .direction = {0, 0, -1},
+                .spacing = 1,
+                .max_range = voxels->size_z
+            };
+            sense_voxel_patch(&column->voxel_patch, voxels, view);
+            sensor_module_u16(f + s, p + s, column->voxel_patch, (vec2d) {.x = radius, .y = radius});
+        }
+    } else if(env->dirty != NULL) {
+        sensor_cache_t* cache = experiment->caches + (env - experiment->objects);
+        for(u32 s = 0; s < column->sensors.num_sensors; ++s)
+            sensor_cache_get(f + s, p + s, cache, vec_added(location, column->sensors.offsets[s]));
+    } else {
+        sensor_module_batch(f, p, env, location, &column->sensors);
+    }
+}
+
+/**
+ * @brief Senses all the patches of the column and feeds them to its learning module
+ *
+ * @param f one per sensor of the column
+ * @param p one per sensor of the column
+ */
+static void column_step(learning_column_t* column, grid_t* env, vec2d agent_location, int learning, features_t* f, pose_t* p) {
+    vec2d location = vec_added(agent_location, column->sensor_offset);
+    sense_column(column, env, location, f, p);
+
+    column_learn(column, location, learning, f, p);
+}
+
+/**
+ * @brief Records the observations of a step, when recording a trace
+ *
+ * @param location of the column's sensor array
+ */
+static void record_step(grid_experiment_t* experiment, u32 step, vec2d location, features_t* f, pose_t* p) {
+    if(experiment->trace == NULL) return;
+
+    sensor_array_t* sensors = &experiment->columns[0].sensors;
+    vec2d movement = experiment->motor_policy.pregenerated_movements[step];
+
+    for(u32 s = 0; s < sensors->num_sensors; ++s)
+        trace_write_observation(experiment->trace, step, s, s == sensors->num_sensors - 1,
+            vec_added(location, sensors->offsets[s]), movement, f[s], p[s]);
+}
+
+static void print_step(u32 step, vec2d agent_location, u32 num_sensors, features_t* f, pose_t* p) {
+    printf("--- step %u: agent at location (%d, %d)\n", step, agent_location.x, agent_location.y);
+    for(u32 s = 0; s < num_sensors; ++s) {
+        print_features(f[s]);
+        print_pose(p[s]);
+    }
+}
+
+/**
+ * @brief Streams config.world_updates depth updates into a tracked object: random cells move one depth unit up or down
+ *      (their values stay). They go through grid_set_cell, so that the sensor cache only resenses around them.
+ */
+static void update_world(grid_experiment_t* experiment, grid_t* env) {
+    if(env->dirty == NULL) return;
+
+    for(u32 u = 0; u < experiment->config.world_updates; ++u) {
+        i32 row = unif_rand_u32(env->rows - 1), col = unif_rand_u32(env->cols - 1);
+        i32 depth = (i32) MAT(env->depths, row, col) + (unif_rand_u32(1) ? 1 : -1);
+        depth = depth < 0 ? 0 : (depth > UINT8_MAX ? UINT8_MAX : depth);
+        grid_set_cell(env, row, col, depth, MAT(env->values, row, col));
+    }
+}
+
+/**
+ * @brief Single column episode, run on the calling thread.
+ *
+ * @param recognized_id set to the recognized model (or NOT_RECOGNIZED), only when matching
+ * @returns the number of steps taken
+ */
+static u32 run_inline_episode(grid_experiment_t* experiment, grid_t* env, vec2d agent_location, u32 max_steps, int learning, i32* recognized_id) {
+    learning_column_t* column = experiment->columns;
+
+    features_t f[MAX_SENSORS];
+    pose_t p[MAX_SENSORS];
+
+    u32 step = 0;
+    while(step < max_steps) {
+        update_world(experiment, env);
+        column_step(column, env, agent_location, learning, f, p);
+        record_step(experiment, step, vec_added(agent_location, column->sensor_offset), f, p);
+
+        if(experiment->config.verbose) print_step(step, agent_location, column->sensors.num_sensors, f, p);
+
+        step += 1;
+
+        if(!learning) {
+            *recognized_id = column_recognized(column);
+            if(*recognized_id != NOT_RECOGNIZED) break;
+        }
+
+        vec2d movement = random_motor_policy(&experiment->motor_policy, f[0], p[0]);
+        agent_location.x += movement.x;
+        agent_location.y += movement.y;
+    }
+
+    return step;
+}
+
+/**
+ * @brief A column's side of an episode: it follows the pregenerated movements on its own,
+ *      publishing a vote per step (sleeping while the ring is full, so that it never runs far ahead of the voting stage)
+ *      until the voting stage stops it or the steps run out. Every vote wakes the voting stage if it sleeps.
+ */
+static void run_column_episode(learning_column_t* column) {
+    grid_experiment_t* experiment = column->experiment;
+    vec2d agent_location = experiment->episode_start;
+    vec2d* movements = experiment->motor_policy.pregenerated_movements;
+
+    features_t f[MAX_SENSORS];
+    pose_t p[MAX_SENSORS];
+    lm_vote_t vote;
+
+    for(u32 step = 0; step < experiment->episode_max_steps; ++step) {
+        if(atomic_load_explicit(&experiment->stop, memory_order_relaxed)) break;
+
+        column_step(column, experiment->episode_env, agent_location, experiment->episode_learning, f, p);
+
+        if(!experiment->episode_learning) {
+            learning_module_vote(&column->lm, step, &vote);
+            for(;;) {
+                u32 epoch = wakeup_prepare(&experiment->column_wakeup);
+                if(spsc_ring_try_push(&column->votes, &vote)) break;
+                if(atomic_load_explicit(&experiment->stop, memory_order_relaxed)) return;
+                wakeup_wait(&experiment->column_wakeup, epoch);
+            }
+            wakeup_notify(&experiment->main_wakeup);
+        }
+
+        agent_location.x += movements[step].x;
+        agent_location.y += movements[step].y;
+    }
+}
+
+/**
+ * @brief Blocks a worker until the next episode is published
+ *
+ * @param seen_generation the last episode the worker ran, updated
+ * @returns 0 when the experiment is over instead
+ */
+static int wait_for_episode(grid_experiment_t* experiment, u32* seen_generation) {
+    pthread_mutex_lock(&experiment->mutex);
+    while(experiment->generation == *seen_generation && !experiment->quit)
+        pthread_cond_wait(&experiment->episode_started, &experiment->mutex);
+    *seen_generation = experiment->generation;
+    int quit = experiment->quit;
+    pthread_mutex_unlock(&experiment->mutex);
+
+    return !quit;
+}
+
+static void* column_worker(void* arg) {
+    learning_column_t* column = arg;
+    grid_experiment_t* experiment = column->experiment;
+
+    u32 seen_generation = 0;
+    while(wait_for_episode(experiment, &seen_generation)) {
+        run_column_episode(column);
+        atomic_fetch_add_explicit(&experiment->num_finished, 1, memory_order_release);
+        wakeup_notify(&experiment->main_wakeup);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Sense (and act) stage of the pipeline: follows the pregenerated movements and pushes
+ *      every sensed step to the learn stage, sleeping while the ring is full (back-pressure)
+ *      until the learn stage stops it or the steps run out.
+ */
+static void run_sense_stage(grid_experiment_t* experiment) {
+    learning_column_t* column = experiment->columns;
+    vec2d agent_location = experiment->episode_start;
+    vec2d* movements = experiment->motor_policy.pregenerated_movements;
+
+    sensed_step_t sensed;
+    for(u32 step = 0; step < experiment->episode_max_steps; ++step) {
+        sensed.step = step;
+        sensed.location = vec_added(agent_location, column->sensor_offset);
+        sense_column(column, experiment->episode_env, sensed.location, sensed.features, sensed.poses);
+
+        for(;;) {
+            u32 epoch = wakeup_prepare(&experiment->sense_wakeup);
+            if(spsc_ring_try_push(&experiment->sensed_steps, &sensed)) break;
+            if(atomic_load_explicit(&experiment->stop, memory_order_relaxed)) return;
+            wakeup_wait(&experiment->sense_wakeup, epoch);
+        }
+        wakeup_notify(&experiment->main_wakeup);
+
+        agent_location = vec_added(agent_location, movements[step]);
+    }
+}
+
+static void* sense_worker(void* arg) {
+    grid_experiment_t* experiment = arg;
+
+    u32 seen_generation = 0;
+    while(wait_for_episode(experiment, &seen_generation)) {
+        run_sense_stage(experiment);
+        atomic_fetch_add_explicit(&experiment->num_finished, 1, memory_order_release);
+        wakeup_notify(&experiment->main_wakeup);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Publishes the episode to the worker threads
+ */
+static void start_workers(grid_experiment_t* experiment, grid_t* env, vec2d agent_location, u32 max_steps, int learning) {
+    experiment->episode_env = env;
+    experiment->episode_start = agent_location;
+    experiment->episode_max_steps = max_steps;
+    experiment->episode_learning = learning;
+    atomic_store(&experiment->stop, 0);
+    atomic_store(&experiment->num_finished, 0);
+
+    pthread_mutex_lock(&experiment->mutex);
+    experiment->generation += 1;
+    pthread_cond_broadcast(&experiment->episode_started);
+    pthread_mutex_unlock(&experiment->mutex);
+}
+
+static void wait_for_workers(grid_experiment_t* experiment, u32 num_workers) {
+    for(;;) {
+        u32 epoch = wakeup_prepare(&experiment->main_wakeup);
+        if(atomic_load_explicit(&experiment->num_finished, memory_order_acquire) == num_workers) return;
+        wakeup_wait(&experiment->main_wakeup, epoch);
+    }
+}
+
+/**
+ * @brief Single column episode, with sensing running ahead on the sense thread: this thread is the learn stage
+ *
+ * @param recognized_id set to the recognized model (or NOT_RECOGNIZED), only when matching
+ * @returns the number of steps taken
+ */
+static u32 run_pipelined_episode(grid_experiment_t* experiment, grid_t* env, vec2d agent_location, u32 max_steps, int learning, i32* recognized_id) {
+    learning_column_t* column = experiment->columns;
+
+    spsc_ring_reset(&experiment->sensed_steps);
+    start_workers(experiment, env, agent_location, max_steps, learning);
+
+    sensed_step_t sensed;
+    u32 step = 0;
+    while(step < max_steps) {
+        u32 epoch = wakeup_prepare(&experiment->main_wakeup);
+        if(!spsc_ring_try_pop(&experiment->sensed_steps, &sensed)) {
+            wakeup_wait(&experiment->main_wakeup, epoch);
+            continue;
+        }
+        wakeup_notify(&experiment->sense_wakeup);
+
+        column_learn(column, sensed.location, learning, sensed.features, sensed.poses);
+        record_step(experiment, step, sensed.location, sensed.features, sensed.poses);
+
+        if(experiment->config.verbose)
+            print_step(step, vec_added(sensed.location, (vec2d) {-column->sensor_offset.x, -column->sensor_offset.y}),
+                column->sensors.num_sensors, sensed.features, sensed.poses);
+
+        step += 1;
+
+        if(!learning) {
+            *recognized_id = learning_module_recognized(&column->lm);
+            if(*recognized_id != NOT_RECOGNIZED) break;
+        }
+    }
+
+    // the movements are pregenerated: keep the policy's step in sync with the lockstep path
+    experiment->motor_policy.current_step = step;
+
+    atomic_store_explicit(&experiment->stop, 1, memory_order_relaxed);
+    wakeup_notify(&experiment->sense_wakeup);
+    wait_for_workers(experiment, 1);
+
+    return step;
+}
+
+/**
+ * @brief Voting stage: step r is decided as soon as one column has published its vote for r
+ *      and every other column has at least published r - 1 (a column one step behind votes with its last vote).
+ *
+ * @returns the number of steps it took to recognize, or max_steps
+ */
+static u32 vote_until_recognized(grid_experiment_t* experiment, u32 max_steps, i32* recognized_id) {
+    u32 num_columns = experiment->config.num_columns;
+
+    lm_vote_t latest[MAX_COLUMNS];
+    i64 latest_step[MAX_COLUMNS];
+    for(u32 c = 0; c < num_columns; ++c) {
+        latest[c].num_models = 0;
+        latest_step[c] = -1;
+    }
+
+    u32 round = 0;
+    while(round < max_steps) {
+        // prepared before looking at the rings: a vote published after the drain wakes the wait below
+        u32 epoch = wakeup_prepare(&experiment->main_wakeup);
+        // read before draining: once every column is finished, the drain below sees all their votes
+        int finished = atomic_load_explicit(&experiment->num_finished, memory_order_acquire) == num_columns;
+
+        int ahead = 0, behind = 0, drained = 0;
+        for(u32 c = 0; c < num_columns; ++c) {
+            while(spsc_ring_try_pop(&experiment->columns[c].votes, latest + c)) {
+                latest_step[c] = latest[c].step;
+                drained = 1;
+            }
+
+            if(latest_step[c] >= round) ahead = 1;
+            if(latest_step[c] + 1 < round) behind = 1;
+        }
+        if(drained) wakeup_notify(&experiment->column_wakeup);
+
+        if(!ahead) {
+            if(finished) break;
+            wakeup_wait(&experiment->main_wakeup, epoch);
+            continue;
+        }
+        if(behind && !finished) {
+            wakeup_wait(&experiment->main_wakeup, epoch);
+            continue;
+        }
+
+        round += 1;
+
+        *recognized_id = combine_votes(latest, num_columns);
+        if(*recognized_id != NOT_RECOGNIZED) break;
+    }
+
+    atomic_store_explicit(&experiment->stop, 1, memory_order_relaxed);
+    wakeup_notify(&experiment->column_wakeup);
+    return round;
+}
+
+/**
+ * @brief Multi-column episode: the column threads run it while this thread votes (when matching)
+ */
+static u32 run_threaded_episode(grid_experiment_t* experiment, grid_t* env, vec2d agent_location, u32 max_steps, int learning, i32* recognized_id) {
+    for(u32 c = 0; c < experiment->config.num_columns; ++c)
+        spsc_ring_reset(&experiment->columns[c].votes);
+
+    start_workers(experiment, env, agent_location, max_steps, learning);
+
+    u32 steps = learning ? max_steps : vote_until_recognized(experiment, max_steps, recognized_id);
+
+    wait_for_workers(experiment, experiment->config.num_columns);
+
+    return steps;
+}
+
+/**
+ * @brief Runs one episode on an object, either exploring it or matching it against the learnt models.
+ *
+ * @param recognized_id set to the recognized model (or NOT_RECOGNIZED), only when matching
+ * @returns the number of steps taken
+ */
+static u32 run_episode(grid_experiment_t* experiment, u32 object_id, u32 max_steps, int learning, i32* recognized_id) {
+    grid_t* env = start_episode(experiment, object_id, learning, !learning && experiment->config.rotate_eval);
+    vec2d agent_location = start_walk(experiment, env, max_steps);
+
+    i32 recognized = NOT_RECOGNIZED;
+    if(recognized_id == NULL) recognized_id = &recognized;
+    *recognized_id = NOT_RECOGNIZED;
+
+    if(experiment->trace != NULL) trace_write_episode_begin(experiment->trace, object_id, learning);
+
+    u32 steps;
+    if(experiment->pipelined)
+        steps = run_pipelined_episode(experiment, env, agent_location, max_steps, learning, recognized_id);
+    else if(experiment->config.num_columns == 1)
+        steps = run_inline_episode(experiment, env, agent_location, max_steps, learning, recognized_id);
+    else
+        steps = run_threaded_episode(experiment, env, agent_location, max_steps, learning, recognized_id);
+
+    if(experiment->trace != NULL) trace_write_episode_end(experiment->trace, steps, *recognized_id);
+
+    return steps;
+}
+
+static void report_evaluation_episode(phase_report_t* report, u32 object_id, u32 steps, i32 recognized_id) {
+    report->steps += steps;
+    report->episodes += 1;
+
+    if(recognized_id != NOT_RECOGNIZED) {
+        report->recognized += 1;
+        report->steps_to_recognition += steps;
+        report->correct += (u32) recognized_id == object_id;
+    }
+}
+
+void run_learning_phase(grid_experiment_t* experiment) {
+    grid_experiment_config* c = &experiment->config;
+    phase_report_t* report = &experiment->learning_report;
+
+    // the columns match against the library they were given at init
+    if(c->from_library[0] != '\0') {
+        printf("library: matching against the %u models of %s, decoded on demand\n",
+            experiment->columns[0].lm.num_learnt_models, c->from_library);
+        return;
+    }
+
+    f64 start = now_seconds();
+
+    // objects in order, train_episodes_per_object each: a resumed run picks up after the episodes it already learnt
+    u32 num_episodes = c->num_objects * c->train_episodes_per_object;
+    while(experiment->learnt_episodes < num_episodes) {
+        u32 o = experiment->learnt_episodes / c->train_episodes_per_object;
+
+        report->steps += run_episode(experiment, o, c->train_steps, 1, NULL);
+        report->episodes += 1;
+
+        for(u32 col = 0; col < c->num_columns && c->lm == LM_GRID; ++col)
+            learning_module_store_model(&experiment->columns[col].lm, o);
+        experiment->learnt_episodes += 1;
+
+        if(c->checkpoint[0] != '\0'
+            && (experiment->learnt_episodes % c->checkpoint_every == 0 || experiment->learnt_episodes == num_episodes)) {
+            // snapshots are not learning time
+            report->seconds += now_seconds() - start;
+            save_experiment_checkpoint(experiment, c->checkpoint);
+            start = now_seconds();
+        }
+    }
+
+    if(c->library[0] != '\0') {
+        grid_lm* lm = &experiment->columns[0].lm;
+        size_t raw_bytes = (size_t) lm->num_learnt_models * lm->buffer.rows * lm->buffer.cols * sizeof(model_cell_t);
+        size_t bytes = write_model_library(c->library, lm);
+        check_model_library(c->library, lm);
+        printf("library: %u models, %zu bytes raw, %zu bytes written to %s, read back identical\n",
+            lm->num_learnt_models, raw_bytes, bytes, c->library);
+    }
+
+    for(u32 col = 0; col < c->num_columns && c->lm == LM_GRID; ++col)
+        learning_module_finalize(&experiment->columns[col].lm);
+
+    if(experiment->trace != NULL) trace_write_finalize(experiment->trace);
+
+    report->seconds += now_seconds() - start;
+}
+
+void run_evaluation_phase(grid_experiment_t* experiment) {
+    grid_experiment_config* c = &experiment->config;
+    phase_report_t* report = &experiment->evaluation_report;
+    report->matching = 1;
+
+    f64 start = now_seconds();
+
+    for(u32 o = 0; o < c->num_objects; ++o) {
+        for(u32 e = 0; e < c->eval_episodes_per_object; ++e) {
+            i32 recognized_id;
+            u32 steps = run_episode(experiment, o, c->eval_max_steps, 0, &recognized_id);
+
+            report_evaluation_episode(report, o, steps, recognized_id);
+        }
+    }
+
+    report->seconds += now_seconds() - start;
+}
+
+void print_phase_report(const char* name, phase_report_t report) {
+    f64 seconds = report.seconds > 0 ? report.seconds : 1e-9;
+
+    printf("[%s] episodes=%u steps=%llu time=%.3fs steps/s=%.0f episodes/s=%.1f",
+        name,
+        report.episodes,
+        (unsigned long long) report.steps,
+        report.seconds,
+        report.steps / seconds,
+        report.episodes / seconds
+    );
+
+    if(report.matching) {
+        printf(" accuracy=%.3f recognized=%u/%u mean_steps_to_recognition=%.2f",
+            report.episodes ? (f64) report.correct / report.episodes : 0.0,
+            report.recognized, report.episodes,
+            report.recognized ? (f64) report.steps_to_recognition / report.recognized : 0.0
+        );
+    }
+
+    printf("\n");
+}
+
+// An observation of a buffered evaluation episode (batch replay)
+typedef struct replay_observation_t_ {
+    features_t features;
+    pose_t pose;
+    vec2d location;
+    int end_of_step;
+} replay_observation_t;
+
+// An evaluation episode of the trace, buffered until its batch is full
+typedef struct replay_episode_t_ {
+    u32 object_id;
+    u32 first_observation; // in replay_buffer_t.observations
+    u32 num_observations;
+    u32 recorded_steps;
+    i32 recorded_id;
+} replay_episode_t;
+
+typedef struct replay_buffer_t_ {
+    replay_episode_t* episodes; // batch_size of them
+    u32 num_episodes;
+
+    replay_observation_t* observations; // grows as needed
+    u32 num_observations;
+    u32 observations_capacity;
+
+    // per sequence state of the batch being matched
+    u32* cursors;
+    u32* steps;
+    i32* recognized_ids;
+    features_t* features;
+    pose_t* poses;
+    vec2d* locations;
+} replay_buffer_t;
+
+static void buffer_observation(replay_buffer_t* buffer, trace_record_t* record) {
+    if(buffer->num_observations == buffer->observations_capacity) {
+        u32 capacity = buffer->observations_capacity ? 2 * buffer->observations_capacity : 4096;
+        memory_account_free(MEMORY_REPLAY, buffer->observations_capacity * sizeof(*buffer->observations));
+        memory_account_alloc(MEMORY_REPLAY, capacity * sizeof(*buffer->observations));
+
+        buffer->observations_capacity = capacity;
+        buffer->observations = realloc(buffer->observations, buffer->observations_capacity * sizeof(*buffer->observations));
+        assertf(buffer->observations != NULL, "could not grow the replay buffer to %u observations", buffer->observations_capacity);
+    }
+
+    buffer->observations[buffer->num_observations++] = (replay_observation_t) {
+        .features = record->features,
+        .pose = record->pose,
+        .location = record->location,
+        .end_of_step = record->end_of_step
+    };
+}
+
+/**
+ * @brief Matches the buffered evaluation episodes in lockstep, one observation of every episode per batch call,
+ *      each one stopping at its recognition or at the end of its observations, like in replay_trace
+ */
+static void replay_buffered_episodes(grid_lm* lm, match_batch_t* batch, replay_buffer_t* buffer, phase_report_t* evaluation, u32* num_divergent) {
+    u32 n = buffer->num_episodes;
+    if(n == 0) return;
+
+    f64 start = now_seconds();
+
+    for(u32 s = 0; s < n; ++s) {
+        match_batch_begin_sequence(batch, s);
+        buffer->cursors[s] = 0;
+        buffer->steps[s] = 0;
+        buffer->recognized_ids[s] = NOT_RECOGNIZED;
+    }
+
+    u32 num_active = n;
+    while(num_active > 0) {
+        for(u32 s = 0; s < n; ++s) {
+            if(!batch->active[s]) continue;
+
+            replay_episode_t* e = buffer->episodes + s;
+            if(buffer->cursors[s] == e->num_observations) {
+                match_batch_end_sequence(batch, s);
+                num_active -= 1;
+                continue;
+            }
+
+            replay_observation_t* o = buffer->observations + e->first_observation + buffer->cursors[s];
+            buffer->features[s] = o->features;
+            buffer->poses[s] = o->pose;
+            buffer->locations[s] = o->location;
+        }
+        if(num_active == 0) break;
+
+        learning_module_match_batch(lm, batch, buffer->features, buffer->poses, buffer->locations);
+
+        for(u32 s = 0; s < n; ++s) {
+            if(!batch->active[s]) continue;
+
+            replay_episode_t* e = buffer->episodes + s;
+            replay_observation_t* o = buffer->observations + e->first_observation + buffer->cursors[s]++;
+            if(!o->end_of_step) continue;
+            buffer->steps[s] += 1;
+
+            buffer->recognized_ids[s] = match_batch_recognized(lm, batch, s, NULL);
+            if(buffer->recognized_ids[s] != NOT_RECOGNIZED) {
+                match_batch_end_sequence(batch, s);
+                num_active -= 1;
+            }
+        }
+    }
+
+    for(u32 s = 0; s < n; ++s) {
+        replay_episode_t* e = buffer->episodes + s;
+        report_evaluation_episode(evaluation, e->object_id, buffer->steps[s], buffer->recognized_ids[s]);
+        *num_divergent += buffer->steps[s] != e->recorded_steps || buffer->recognized_ids[s] != e->recorded_id;
+    }
+    evaluation->seconds += now_seconds() - start;
+
+    buffer->num_episodes = 0;
+    buffer->num_observations = 0;
+}
+
+static void init_replay_buffer(replay_buffer_t* buffer, u32 batch_size, arena_t* arena) {
+    memset(buffer, 0, sizeof(*buffer));
+
+    buffer->episodes = arena_alloc(arena, batch_size, sizeof(*buffer->episodes));
+    buffer->cursors = arena_alloc(arena, batch_size, sizeof(*buffer->cursors));
+    buffer->steps = arena_alloc(arena, batch_size, sizeof(*buffer->steps));
+    buffer->recognized_ids = arena_alloc(arena, batch_size, sizeof(*buffer->recognized_ids));
+    buffer->features = arena_alloc(arena, batch_size, sizeof(*buffer->features));
+    buffer->poses = arena_alloc(arena, batch_size, sizeof(*buffer->poses));
+    buffer->locations = arena_alloc(arena, batch_size, sizeof(*buffer->locations));
+}
+
+static size_t replay_buffer_bytes(u32 batch_size) {
+    return ARENA_ALIGN_UP((size_t) batch_size * sizeof(replay_episode_t))
+        + 3 * ARENA_ALIGN_UP((size_t) batch_size * sizeof(u32))
+        + ARENA_ALIGN_UP((size_t) batch_size * sizeof(features_t))
+        + ARENA_ALIGN_UP((size_t) batch_size * sizeof(pose_t))
+        + ARENA_ALIGN_UP((size_t) batch_size * sizeof(vec2d));
+}
+
+/**
+ * Replay keeps the recorded episode boundaries: an evaluation episode ends at the step the replayed lm recognizes
+ *      (later observations of the trace are skipped) or when the trace's episode ends.
+ * With batch_size > 1, evaluation episodes are buffered and matched batch_size at a time (see replay_buffered_episodes).
+ */
+u32 replay_trace(const char* filename, phase_report_t* learning, phase_report_t* evaluation, u32 batch_size) {
+    trace_header_t header;
+    FILE* f = open_trace_reader(filename, &header);
+
+    init_integer_math();
+    memset(learning, 0, sizeof(*learning));
+    memset(evaluation, 0, sizeof(*evaluation));
+    evaluation->matching = 1;
+
+    vec2d world_size = {.x = header.env_rows, .y = header.env_cols};
+    vec2d model_size = vec_divided_u32(world_size, header.model_scale);
+
+    arena_t arena, episode_arena;
+    arena_init(&arena, learning_module_arena_bytes(model_size, header.num_objects, header.num_orientations) + (1 << 16));
+    arena_init(&episode_arena, learning_module_episode_bytes(model_size) + (1 << 16));
+
+    grid_lm lm;
+    init_learning_module(&lm, model_size, world_size, header.num_objects, header.num_orientations, &arena, &episode_arena);
+
+    // allocated at finalize, once the library's size is known
+    int batched = batch_size > 1;
+    arena_t batch_arena = {0};
+    match_batch_t batch;
+    replay_buffer_t buffer;
+
+    u32 num_divergent = 0;
+    u32 object_id = 0, steps = 0;
+    int episode_learning = 0, done = 0;
+    i32 recognized_id = NOT_RECOGNIZED;
+    f64 episode_start = 0;
+
+    trace_record_t record;
+    while(trace_read_record(f, &record)) {
+        switch(record.kind) {
+            case TRACE_EPISODE_BEGIN:
+                arena_reset(&episode_arena);
+                learning_module_new_episode(&lm, &episode_arena);
+
+                object_id = record.object_id;
+                episode_learning = record.learning;
+                steps = 0;
+                done = 0;
+                recognized_id = NOT_RECOGNIZED;
+                episode_start = now_seconds();
+
+                if(batched && lm.finalized && !episode_learning) {
+                    buffer.episodes[buffer.num_episodes] = (replay_episode_t) {
+                        .object_id = object_id,
+                        .first_observation = buffer.num_observations
+                    };
+                }
+                break;
+
+            case TRACE_OBSERVATION:
+                if(batched && lm.finalized && !episode_learning) {
+                    buffer_observation(&buffer, &record);
+                    break;
+                }
+                if(done) break;
+
+                if(episode_learning) learning_module_explore(&lm, record.features, record.pose, record.location);
+                else learning_module_match(&lm, record.features, record.pose, record.location);
+
+                if(!record.end_of_step) break;
+                steps += 1;
+
+                if(!episode_learning) {
+                    recognized_id = learning_module_recognized(&lm);
+                    done = recognized_id != NOT_RECOGNIZED;
+                }
+                break;
+
+            case TRACE_EPISODE_END:
+                if(batched && lm.finalized && !episode_learning) {
+                    replay_episode_t* e = buffer.episodes + buffer.num_episodes++;
+                    e->num_observations = buffer.num_observations - e->first_observation;
+                    e->recorded_steps = record.steps;
+                    e->recorded_id = record.recognized_id;
+
+                    if(buffer.num_episodes == batch_size) replay_buffered_episodes(&lm, &batch, &buffer, evaluation, &num_divergent);
+                } else if(episode_learning) {
+                    learning_module_store_model(&lm, object_id);
+                    learning->steps += steps;
+                    learning->episodes += 1;
+                    learning->seconds += now_seconds() - episode_start;
+                } else {
+                    report_evaluation_episode(evaluation, object_id, steps, recognized_id);
+                    evaluation->seconds += now_seconds() - episode_start;
+                    num_divergent += steps != record.steps || recognized_id != record.recognized_id;
+                }
+                break;
+
+            case TRACE_FINALIZE: {
+                f64 start = now_seconds();
+                learning_module_finalize(&lm);
+                learning->seconds += now_seconds() - start;
+
+                if(batched) {
+                    memory_tag previous_tag = set_memory_tag(MEMORY_REPLAY);
+                    arena_init(&batch_arena, match_batch_bytes(&lm, batch_size) + replay_buffer_bytes(batch_size));
+                    init_match_batch(&batch, &lm, batch_size, &batch_arena);
+                    init_replay_buffer(&buffer, batch_size, &batch_arena);
+                    set_memory_tag(previous_tag);
+                }
+                break;
+            }
+        }
+    }
+
+    if(batched && lm.finalized) {
+        replay_buffered_episodes(&lm, &batch, &buffer, evaluation, &num_divergent);
+        memory_account_free(MEMORY_REPLAY, buffer.observations_capacity * sizeof(*buffer.observations));
+        free(buffer.observations);
+        arena_free(&batch_arena);
+    }
+
+    fclose(f);
+    arena_free(&episode_arena);
+    arena_free(&arena);
+
+    return num_divergent;
+}
@@ -4,12 +4,215 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "math.h"
 
 #include "types.h"
 #include "tensor.h"
+#include "arena.h"
+#include "bounds.h"
+#include "grid_environment.h"
+#include "grid_derived.h"
+#include "voxel_environment.h"
+#include "learning_module.h"
+#include "motor_policy.h"
+#include "sensor_module.h"
+#include "object_generator.h"
+#include "spsc_ring.h"
+#include "wakeup.h"
+#include "voting.h"
+#include "trace.h"
+#include "model_library.h"
+#include "htm_recognizer.h"
 
+typedef enum motor_policy_kind_ {
+    MOTOR_POLICY_RANDOM,
+    MOTOR_POLICY_SCAN
+} motor_policy_kind;
 
+typedef enum world_kind_ {
+    WORLD_RANDOM, // uniform noise (populate_grid_env_random)
+    WORLD_PROCEDURAL, // parametric objects (generate_object)
+    WORLD_DATASET, // objects read from an object dataset, which sets rows, cols and objects
+    WORLD_VOXEL // parametric objects voxelized (voxelize_grid_surface), sensed by rays looking straight down (sense_voxel_patch)
+} world_kind;
+
+typedef enum lm_kind_ {
+    LM_GRID, // grid_lm: learnt models as grids of features, matched by evidence over hypotheses
+    LM_HTM // htm_recognizer_t: one htm_lm per object, matched by how well it predicts (single column, single sensor)
+} lm_kind;
+
+#define CONFIG_PATH_LENGTH 256
+
+#define MAX_COLUMNS 8
+// votes a column can be ahead of the voting stage before it waits for it
+#define VOTE_RING_CAPACITY 64
+
+/**
+ * Describes a whole workload, so that two builds can be compared on the exact same run.
+ * Set from the command line as key=value pairs, or from a file with one key=value per line (see parse_experiment_args)
+ */
+typedef struct grid_experiment_config_ {
+    u32 seed;
+
+    u32 env_rows;
+    u32 env_cols;
+    u32 patch_sidelen;
+    u32 model_scale; // world cells per model cell
+
+    u32 num_objects;
+    world_kind world;
+    generator_config_t generator; // rows and cols are kept in sync with env_rows and env_cols
+    char dataset[CONFIG_PATH_LENGTH];
+    u32 tracked; // objects are tracked grids, sensed through a sensor cache each (single column, without pipeline)
+    u32 world_updates; // depth updates streamed into a tracked object every step of an episode (they stay in the object)
+
+    u32 train_episodes_per_object;
+    u32 train_steps; // length of a learning episode
+    u32 eval_episodes_per_object;
+    u32 eval_max_steps; // an evaluation episode stops at recognition or after that many steps
+
+    motor_policy_kind policy;
+    lm_kind lm;
+    u32 pooler; // with lm=htm, the models learn spatial pooler columns rather than the feature SDR
+
+    u32 num_orientations; // orientations every learnt model is matched in: 1 or NUM_ORIENTATIONS
+    u32 rotate_eval; // evaluation objects are presented in a random orientation
+
+    u32 num_columns; // learning modules, each with its own sensor
+    u32 column_spacing; // distance between the sensors of neighbouring columns
+
+    u32 num_sensors; // patches every column senses per step (all fed to its learning module)
+    u32 sensor_spacing; // distance between neighbouring patches of a column
+
+    u32 pipeline; // sense on a separate thread, ahead of learning (single column, open-loop policies only)
+    u32 pipeline_depth; // steps sensing can be ahead of learning (rounded up to a power of two)
+
+    char trace[CONFIG_PATH_LENGTH]; // when set, every observation is recorded there (single column only)
+
+    char checkpoint[CONFIG_PATH_LENGTH]; // when set, the learning phase is snapshotted there, and resumed from it if it exists
+    u32 checkpoint_every; // learning episodes between two snapshots
+
+    char library[CONFIG_PATH_LENGTH]; // when set, the first column's learnt models are written there (see model_library.h)
+    char from_library[CONFIG_PATH_LENGTH]; // when set, nothing is learnt: every column matches against that library
+
+    u32 verbose;
+} grid_experiment_config;
+
+typedef struct phase_report_t_ {
+    int matching; // recognition stats are only meaningful when matching
+
+    u32 episodes;
+    u64 steps;
+
+    u32 recognized; // episodes that ended with a recognition, right or wrong
+    u32 correct;
+    u64 steps_to_recognition; // summed over the recognized episodes
+
+    f64 seconds;
+} phase_report_t;
+
+struct grid_experiment_t_;
+
+/**
+ * A learning module with its own sensor array, at a fixed offset from the agent.
+ * With more than one column, every column runs the episode on its own thread:
+ *      the (open-loop) movements are known in advance, so columns never wait for each other,
+ *      and each one publishes a vote per step in its own ring for the voting stage.
+ */
+typedef struct learning_column_t_ {
+    u32 id;
+    vec2d sensor_offset;
+    sensor_array_t sensors;
+    grid_lm lm; // with lm=grid
+    htm_recognizer_t htm; // with lm=htm
+    grid_u16_t voxel_patch; // with world=voxel: what the rays of a sensor hit (scratch)
+    model_library_t library; // open when the lm matches against a library (config.from_library)
+
+    spsc_ring_t votes;
+    pthread_t thread;
+    struct grid_experiment_t_* experiment;
+} learning_column_t;
+
+// What the sense stage hands to the learn stage for one step
+typedef struct sensed_step_t_ {
+    u32 step;
+    vec2d location; // of the column's sensor array
+    features_t features[MAX_SENSORS];
+    pose_t poses[MAX_SENSORS];
+} sensed_step_t;
+
+typedef struct grid_experiment_t_ {
+    grid_experiment_config config;
+
+    arena_t arena; // lives as long as the experiment
+    arena_t episode_arena; // reset at the start of every episode
+
+    grid_t* objects;
+    sensor_cache_t* caches; // one per object when tracked, NULL otherwise
+    voxel_env_t* voxel_objects; // one per object with world=voxel, NULL otherwise
+    arena_t voxel_arena; // the voxel objects' bricks, sized once the objects are generated
+    u32 sensor_margin; // the agent stays that far from the bounds so that every sensor fits
+
+    learning_column_t* columns;
+    random_motor_policy_t motor_policy;
+
+    // pipelined mode: the sense stage runs on its own thread and feeds the learn stage through this ring
+    int pipelined;
+    spsc_ring_t sensed_steps;
+    pthread_t sense_thread;
+
+    FILE* trace; // NULL when not recording
+
+    u32 learnt_episodes; // learning episodes done so far, all objects together (see checkpoint.h)
+
+    // the episode the column threads run, published under mutex by bumping generation
+    grid_t* episode_env;
+    vec2d episode_start;
+    u32 episode_max_steps;
+    int episode_learning;
+    u32 generation;
+    int quit;
+    pthread_mutex_t mutex;
+    pthread_cond_t episode_started;
+    _Atomic int stop; // set by the voting (or learn) stage on recognition
+    _Atomic u32 num_finished;
+    // the main thread (voting or learn stage) sleeps on main_wakeup until a worker published a vote,
+    //      a sensed step or its end, the sense stage on sense_wakeup and the columns on column_wakeup while their ring is full
+    wakeup_t main_wakeup;
+    wakeup_t sense_wakeup;
+    wakeup_t column_wakeup;
+
+    phase_report_t learning_report;
+    phase_report_t evaluation_report;
+} grid_experiment_t;
+
+void default_experiment_config(grid_experiment_config* config);
+// Returns 0 if the key is unknown or the value is invalid
+int set_experiment_config(grid_experiment_config* config, const char* key, const char* value);
+void load_experiment_config_file(grid_experiment_config* config, const char* filename);
+// Every argument is a key=value pair. The special key config=<file> loads a file at that point
+void parse_experiment_args(grid_experiment_config* config, int argc, char* argv[]);
+void print_experiment_config(grid_experiment_config* config);
+
+void init_grid_experiment(grid_experiment_t* experiment, grid_experiment_config config);
+void free_grid_experiment(grid_experiment_t* experiment);
+
+void run_learning_phase(grid_experiment_t* experiment);
+void run_evaluation_phase(grid_experiment_t* experiment);
+
+void print_phase_report(const char* name, phase_report_t report);
+
+/**
+ * Feeds a recorded trace straight into a learning module (no environment, no sensor):
+ *      learning episodes are explored and stored, evaluation episodes matched.
+ * With batch_size > 1, evaluation episodes are matched batch_size at a time, in lockstep (see match_batch_t):
+ *      same outcomes, one pass over the library per step of the batch instead of per step of every episode.
+ *
+ * @returns the number of evaluation episodes whose outcome (recognized model or steps) differs from the recorded one
+ */
+u32 replay_trace(const char* filename, phase_report_t* learning, phase_report_t* evaluation, u32 batch_size);
 
 #endif
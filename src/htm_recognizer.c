@@ -0,0 +1,141 @@
+#include "htm_recognizer.h"
+
+#include <string.h>
+
+#include "assertf.h"
+#include "memory_accounting.h"
+
+void default_htm_recognizer_lm_config(htm_lm_config_t* config, u32 location_bits, int pooled) {
+    default_htm_lm_config(config, pooled ? HTM_FEATURE_COLUMNS : FEATURE_SDR_LENGTH, location_bits);
+
+    // one htm_lm per object: fewer cells and segments than a module learning every object
+    config->cells_per_column = 4;
+    config->segments_per_cell = 4;
+}
+
+static u32 location_bits() {
+    return HTM_LOCATION_MODULES << (2 * HTM_LOCATION_SIDE_BITS);
+}
+
+size_t htm_recognizer_arena_bytes(u32 num_models, int pooled) {
+    htm_lm_config_t config;
+    default_htm_recognizer_lm_config(&config, location_bits(), pooled);
+    spatial_pooler_config_t pooler_config;
+    default_spatial_pooler_config(&pooler_config, FEATURE_SDR_LENGTH, HTM_FEATURE_COLUMNS);
+    u32 location_active = HTM_LOCATION_MODULES * HTM_LOCATION_BUMP * HTM_LOCATION_BUMP;
+
+    return ARENA_ALIGN_UP((size_t) location_bits() * location_active * sizeof(u16))
+        + (pooled ? spatial_pooler_arena_bytes(&pooler_config) + ARENA_ALIGN_UP(pooler_config.num_active_columns * sizeof(u16)) : 0)
+        + ARENA_ALIGN_UP((size_t) num_models * sizeof(htm_lm)) + num_models * htm_lm_arena_bytes(&config)
+        + ARENA_ALIGN_UP((size_t) num_models * sizeof(i32))
+        + ARENA_ALIGN_UP(location_active * sizeof(u16)) + ARENA_ALIGN_UP(FEATURE_SDR_ACTIVE * sizeof(u16));
+}
+
+void init_htm_recognizer(htm_recognizer_t* recognizer, u32 num_models, int pooled, arena_t* arena) {
+    memory_tag previous_tag = set_memory_tag(MEMORY_MODEL_BUFFER);
+    init_location_encoder(&recognizer->encoder, HTM_LOCATION_MODULES, HTM_LOCATION_SIDE_BITS, HTM_LOCATION_BUMP,
+        HTM_LOCATION_MIN_PERIOD, HTM_LOCATION_SCALE_RATIO, arena);
+    recognizer->location_sdr.indices = arena_alloc(arena, location_sdr_active(&recognizer->encoder), sizeof(u16));
+    recognizer->feature_sdr.indices = arena_alloc(arena, FEATURE_SDR_ACTIVE, sizeof(u16));
+    recognizer->margin = FEATURE_SDR_ACTIVE;
+
+    recognizer->pooled = pooled;
+    if(pooled) {
+        spatial_pooler_config_t pooler_config;
+        default_spatial_pooler_config(&pooler_config, FEATURE_SDR_LENGTH, HTM_FEATURE_COLUMNS);
+        init_spatial_pooler(&recognizer->pooler, pooler_config, arena);
+        set_memory_tag(MEMORY_MODEL_BUFFER);
+        recognizer->feature_columns.indices = arena_alloc(arena, pooler_config.num_active_columns, sizeof(u16));
+        recognizer->margin = pooler_config.num_active_columns;
+    }
+
+    set_memory_tag(MEMORY_LIBRARY);
+    htm_lm_config_t config;
+    default_htm_recognizer_lm_config(&config, location_sdr_length(&recognizer->encoder), pooled);
+
+    recognizer->num_models = num_models;
+    recognizer->models = arena_alloc(arena, num_models, sizeof(*recognizer->models));
+    for(u32 m = 0; m < num_models; ++m)
+        init_htm_lm(recognizer->models + m, config, arena);
+    recognizer->evidence = arena_calloc(arena, num_models, sizeof(*recognizer->evidence));
+    set_memory_tag(previous_tag);
+
+    recognizer->learnt_model = NOT_RECOGNIZED;
+    recognizer->located = 0;
+}
+
+void htm_recognizer_new_episode(htm_recognizer_t* recognizer, i32 learnt_model) {
+    assertf(learnt_model == NOT_RECOGNIZED || (u32) learnt_model < recognizer->num_models,
+        "model %d out of the %u models", learnt_model, recognizer->num_models);
+
+    recognizer->learnt_model = learnt_model;
+    recognizer->located = 0;
+    for(u32 m = 0; m < recognizer->num_models; ++m) {
+        htm_lm_new_episode(recognizer->models + m);
+        recognizer->evidence[m] = 0;
+    }
+}
+
+void htm_recognizer_step(htm_recognizer_t* recognizer, features_t features, vec2d location) {
+    if(!recognizer->located) location_code_set(&recognizer->encoder, &recognizer->code, location);
+    else location_code_move(&recognizer->encoder, &recognizer->code, vec_subtracted(location, recognizer->code_location));
+    recognizer->code_location = location;
+    recognizer->located = 1;
+    location_code_sdr(&recognizer->encoder, &recognizer->code, &recognizer->location_sdr);
+    encode_features(&recognizer->feature_sdr, features);
+    spvec_u1* observed = &recognizer->feature_sdr;
+    if(recognizer->pooled) {
+        spatial_pooler_compute(&recognizer->pooler, &recognizer->feature_sdr, 0, &recognizer->feature_columns);
+        observed = &recognizer->feature_columns;
+    }
+
+    if(recognizer->learnt_model != NOT_RECOGNIZED) {
+        htm_lm* lm = recognizer->models + recognizer->learnt_model;
+        htm_lm_new_episode(lm);
+        htm_lm_step(lm, &recognizer->location_sdr, observed, 1);
+        return;
+    }
+
+    for(u32 m = 0; m < recognizer->num_models; ++m) {
+        htm_lm* lm = recognizer->models + m;
+        htm_lm_new_episode(lm);
+        u32 predicted = htm_lm_predict(lm, &recognizer->location_sdr);
+
+        u64 correct_before = lm->stats.correct_columns;
+        htm_lm_observe(lm, observed, 0);
+        u32 correct = lm->stats.correct_columns - correct_before;
+
+        recognizer->evidence[m] += (i32) correct - (i32) (predicted - correct);
+    }
+}
+
+i32 htm_recognizer_recognized(const htm_recognizer_t* recognizer) {
+    if(recognizer->num_models == 0) return NOT_RECOGNIZED;
+
+    u32 best = 0;
+    for(u32 m = 1; m < recognizer->num_models; ++m)
+        if(recognizer->evidence[m] > recognizer->evidence[best]) best = m;
+
+    i64 second = recognizer->num_models == 1 ? 0 : INT32_MIN;
+    for(u32 m = 0; m < recognizer->num_models; ++m)
+        if(m != best && recognizer->evidence[m] > second) second = recognizer->evidence[m];
+
+    return recognizer->evidence[best] - second >= recognizer->margin ? (i32) best : NOT_RECOGNIZED;
+}
+
+void print_htm_recognizer_stats(const htm_recognizer_t* recognizer) {
+    htm_lm_stats_t total = {0};
+    u64 synapses = 0;
+    for(u32 m = 0; m < recognizer->num_models; ++m) {
+        htm_lm_stats_t stats = recognizer->models[m].stats;
+        total.observations += stats.observations;
+        total.active_columns += stats.active_columns;
+        total.predicted_columns += stats.predicted_columns;
+        total.correct_columns += stats.correct_columns;
+        total.bursting_columns += stats.bursting_columns;
+        synapses += htm_lm_num_synapses(recognizer->models + m);
+    }
+
+    print_htm_lm_stats("[htm]", total);
+    printf("[htm] %u models, %llu synapses\n", recognizer->num_models, (unsigned long long) synapses);
+}
@@ -0,0 +1,86 @@
+#ifndef HTM_RECOGNIZER_H
+#define HTM_RECOGNIZER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "arena.h"
+#include "sparse.h"
+#include "interfaces.h"
+#include "location.h"
+#include "encoder.h"
+#include "temporal_memory.h"
+#include "spatial_pooler.h"
+#include "learning_module.h" // NOT_RECOGNIZED
+
+/**
+ * Object recognition with htm_lm models, the learning module of a column when lm=htm (see grid_experiment.h).
+ *
+ * Every object gets its own htm_lm, which learns the (location SDR, feature SDR) pairs of its learning episodes:
+ *      where the sensor is (encoded by the grid modules of the location encoder) and what it senses there (encode_features).
+ * When pooled, the feature SDR goes through a spatial pooler shared by all models, into HTM_FEATURE_COLUMNS columns.
+ *      The pooler does not learn: a column drifting to other inputs would change the codes the models learnt before,
+ *      its random pools are the stable code.
+ * The location code is set at the first step of an episode, then path integrated (location_code_move) by the sensor's moves.
+ * When matching, every model predicts the features of each step before observing them (without learning),
+ *      and earns evidence for its right predictions, minus its wrong ones:
+ *      the object is recognized once a model leads every other one by a step's worth of active columns.
+ *
+ * The location SDR is the only context of a prediction: the models forget the previous observation before every step.
+ *      A random walk does not retrace the paths it learnt, so the cells of the previous observation only made
+ *      predictions fail (on 16 random objects of 32 by 32, accuracy went from 0.16 with them to 0.49 without).
+ */
+
+// Columns of the spatial pooler, hence of the models when pooled (2% active)
+#define HTM_FEATURE_COLUMNS 1024
+
+// Grid modules of the location SDR: 8 modules of 16 by 16 cells, 3 by 3 active each (2048 bits, 72 active),
+//      periods from 5 cells up, growing by 1.4
+#define HTM_LOCATION_MODULES 8
+#define HTM_LOCATION_SIDE_BITS 4
+#define HTM_LOCATION_BUMP 3
+#define HTM_LOCATION_MIN_PERIOD 5.0f
+#define HTM_LOCATION_SCALE_RATIO 1.4f
+
+typedef struct htm_recognizer_t_ {
+    location_encoder_t encoder;
+    spatial_pooler_t pooler;
+    location_code_t code;
+    vec2d code_location; // where the code is, valid once located
+    int located; // the code was set this episode
+
+    htm_lm* models;
+    u32 num_models;
+    i32* evidence; // per model, over the current matching episode
+
+    i32 learnt_model; // the model learning this episode, NOT_RECOGNIZED when matching
+    u32 margin; // evidence the best model must lead every other by
+
+    spvec_u1 location_sdr;
+    int pooled;
+    spvec_u1 feature_sdr; // encode_features' output, the models' input unless pooled
+    spvec_u1 feature_columns; // the pooler's output, the models' input when pooled
+} htm_recognizer_t;
+
+void default_htm_recognizer_lm_config(htm_lm_config_t* config, u32 location_bits, int pooled);
+
+// Upper bound of what init_htm_recognizer takes from the arena
+size_t htm_recognizer_arena_bytes(u32 num_models, int pooled);
+// pooled: the models learn the spatial pooler's columns rather than the feature SDR
+void init_htm_recognizer(htm_recognizer_t* recognizer, u32 num_models, int pooled, arena_t* arena);
+
+// learnt_model is the object learnt this episode, or NOT_RECOGNIZED for a matching episode
+void htm_recognizer_new_episode(htm_recognizer_t* recognizer, i32 learnt_model);
+
+// One observation of the sensor at location: the learnt model learns it, or every model is matched against it
+void htm_recognizer_step(htm_recognizer_t* recognizer, features_t features, vec2d location);
+
+// Returns the recognized model id or NOT_RECOGNIZED
+i32 htm_recognizer_recognized(const htm_recognizer_t* recognizer);
+
+// Prediction quality of every model, over everything they learnt and matched
+void print_htm_recognizer_stats(const htm_recognizer_t* recognizer);
+
+#endif // HTM_RECOGNIZER_H
@@ -0,0 +1,95 @@
+#include "integer_math.h"
+
+#include <math.h>
+#include <pthread.h>
+
+static lookup_table_u8 sqrt_table;
+static lookup_table_u16 atan_table;
+static pthread_once_t tables_built = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief sqrt_table[i] = floor(sqrt(i)), which fits in a u8 for i < 2^16
+ *      atan_table[i] = atan(i / 2^ATAN_TABLE_BITS) as a binary angle, at most an eighth of a turn
+ */
+static void build_tables(void) {
+    memory_tag previous_tag = set_memory_tag(MEMORY_TABLES);
+
+    lut_u8_init(&sqrt_table, 0, SQRT_TABLE_LENGTH, NULL);
+    u32 root = 0;
+    for(u32 i = 0; i < SQRT_TABLE_LENGTH; ++i) {
+        while((root + 1) * (root + 1) <= i) root += 1;
+        sqrt_table.data[i] = root;
+    }
+
+    lut_u16_init(&atan_table, 0, ATAN_TABLE_LENGTH, NULL);
+    for(u32 i = 0; i < ATAN_TABLE_LENGTH; ++i) {
+        f64 angle = atan((f64) i / (1 << ATAN_TABLE_BITS));
+        atan_table.data[i] = (u16) lround(angle / (2 * M_PI) * 65536.0);
+    }
+
+    set_memory_tag(previous_tag);
+}
+
+void init_integer_math(void) {
+    pthread_once(&tables_built, build_tables);
+}
+
+/**
+ * @brief Small n are looked up. Larger n are shifted down (by an even amount) into the table,
+ *      which gives the root to within 1%, then one Newton step and a final correction of a unit or two.
+ */
+u32 isqrt_u32(u32 n) {
+    if(n < SQRT_TABLE_LENGTH) return sqrt_table.data[n];
+
+    u32 shift = 0;
+    while((n >> (2 * shift)) >= SQRT_TABLE_LENGTH) shift += 1;
+
+    // (n >> 2 shift) >= 2^14: its root is at least 128, so the estimate is at most 1/128 below the true root
+    u32 root = (u32) sqrt_table.data[n >> (2 * shift)] << shift;
+    root = (root + n / root) >> 1;
+
+    // Newton from below lands above the root, by a small amount
+    while((u64) root * root > n) root -= 1;
+    while((u64) (root + 1) * (root + 1) <= n) root += 1;
+
+    return root;
+}
+
+/**
+ * @brief Same scheme as isqrt_u32: the top 32 bits (shifted by an even amount) give an estimate
+ *      that is at least 2^15, which one Newton step and the fixups make exact
+ */
+u32 isqrt_u64(u64 n) {
+    if(n <= UINT32_MAX) return isqrt_u32(n);
+
+    u32 shift = 0;
+    while((n >> (2 * shift)) > UINT32_MAX) shift += 1;
+
+    u64 root = (u64) isqrt_u32(n >> (2 * shift)) << shift;
+    root = (root + n / root) >> 1;
+    if(root > UINT32_MAX) root = UINT32_MAX;
+
+    while(root * root > n) root -= 1;
+    while(root < UINT32_MAX && (root + 1) * (root + 1) <= n) root += 1;
+
+    return root;
+}
+
+/**
+ * @brief Reduces (x, y) to the first octant (0 <= y <= x), looks the angle up there, and maps it back
+ */
+u16 atan2_angle_u16(i32 y, i32 x) {
+    if(x == 0 && y == 0) return 0;
+
+    u32 ax = x < 0 ? -(i64) x : x;
+    u32 ay = y < 0 ? -(i64) y : y;
+
+    u32 angle;
+    if(ay <= ax) angle = atan_table.data[((u64) ay << ATAN_TABLE_BITS) / ax];
+    else angle = BINARY_ANGLE_HALF_TURN / 2 - atan_table.data[((u64) ax << ATAN_TABLE_BITS) / ay];
+
+    if(x < 0) angle = BINARY_ANGLE_HALF_TURN - angle;
+    if(y < 0) angle = 2 * BINARY_ANGLE_HALF_TURN - angle;
+
+    return (u16) angle;
+}
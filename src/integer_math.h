@@ -0,0 +1,39 @@
+#ifndef INTEGER_MATH_H
+#define INTEGER_MATH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "lookup_table.h"
+
+/**
+ * Table-driven integer square root and arctangent.
+ *
+ * The tables are built once by init_integer_math (thread-safe, any number of calls),
+ *      which has to run before the first isqrt_u32 / atan2_angle_u16.
+ *
+ * Angles are binary angles: a full turn is 2^16, so that they wrap with u16 arithmetic.
+ */
+
+// isqrt_u32 answers n < SQRT_TABLE_LENGTH with a single lookup
+#define SQRT_TABLE_BITS 16
+#define SQRT_TABLE_LENGTH (1 << SQRT_TABLE_BITS)
+
+// atan is tabulated over one octant, on the ratio of the smallest to the largest coordinate
+#define ATAN_TABLE_BITS 8
+#define ATAN_TABLE_LENGTH ((1 << ATAN_TABLE_BITS) + 1)
+
+#define BINARY_ANGLE_HALF_TURN 32768
+
+void init_integer_math(void);
+
+// floor(sqrt(n))
+u32 isqrt_u32(u32 n);
+// floor(sqrt(n)), for the discriminants of u16 depth maps
+u32 isqrt_u64(u64 n);
+
+// atan2(y, x) as a binary angle, 0 for (0, 0)
+u16 atan2_angle_u16(i32 y, i32 x);
+
+#endif // INTEGER_MATH_H
@@ -9,11 +9,28 @@
 #define CURVATURE_FRACTIONAL_BITS 8
 static const u32 PC1_IS_PC2_THRESHOLD_FP = (1 << CURVATURE_FRACTIONAL_BITS) - 1;
 
+// Robust depth statistics (p10/median/p90), computed on the selection path together with min/max.
+// Build with -DDEPTH_PERCENTILE_FEATURES=0 to leave them at 0 and keep the plain min/max/mean reductions
+#ifndef DEPTH_PERCENTILE_FEATURES
+#define DEPTH_PERCENTILE_FEATURES 1
+#endif
+
+// Principal directions are also given as the quantized angle of their axis (d and -d are the same direction):
+//      DIRECTION_ANGLE_BINS bins over a half turn. Build with -DDIRECTION_ANGLE_BITS=6 for 64 bins
+#ifndef DIRECTION_ANGLE_BITS
+#define DIRECTION_ANGLE_BITS 8
+#endif
+#define DIRECTION_ANGLE_BINS (1 << DIRECTION_ANGLE_BITS)
+
+// Depth statistics are u16 so that 16 bits depth maps (sensor_module_u16) keep their resolution
 typedef struct features_t_ {
     u32 value;
-    u8 min_depth;
-    u8 max_depth;
-    u8 mean_depth;
+    u16 min_depth;
+    u16 max_depth;
+    u16 mean_depth;
+    u16 p10_depth;
+    u16 median_depth;
+    u16 p90_depth;
 
     i32 principal_curvature_1_fp; // fixed-point with CURVATURE_FRACTIONAL_BITS bits
     i32 principal_curvature_2_fp; // fixed-point with CURVATURE_FRACTIONAL_BITS bits
@@ -25,8 +42,16 @@ typedef struct pose_t_ {
     vec3d point_normal;
     vec3d curvature_direction_1;
     vec3d curvature_direction_2;
+    u8 curvature_direction_1_angle; // in [0, DIRECTION_ANGLE_BINS)
+    u8 curvature_direction_2_angle;
 
     int pose_fully_defined;
 } pose_t;
 
+// Distance between two direction angles, in bins (at most DIRECTION_ANGLE_BINS / 2)
+static inline u32 direction_angle_distance(u8 a, u8 b) {
+    u32 diff = (u32) (a - b) & (DIRECTION_ANGLE_BINS - 1);
+    return diff <= DIRECTION_ANGLE_BINS / 2 ? diff : DIRECTION_ANGLE_BINS - diff;
+}
+
 #endif
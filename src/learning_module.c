@@ -1,5 +1,12 @@
 #include "learning_module.h"
 
+#include <string.h>
+#include <sys/mman.h>
+
+#include "assertf.h"
+#include "sensor_module.h"
+#include "model_library.h"
+
 /**
  * Learning modules create a sensorimotor model of the objects/environment they learn
  * 
@@ -24,48 +31,683 @@
  *      2. How wrong were we about our predicted features
  */
 
- void init_object_model_mat(object_model_mat* object_model, vec2d model_size) {
+ void init_object_model_mat(object_model_mat* object_model, vec2d model_size, arena_t* arena) {
     object_model->rows = model_size.y;
     object_model->cols = model_size.x;
 
-    object_model->data = calloc(model_size.x * model_size.y, sizeof(*object_model->data));
+    object_model->data = arena_calloc(arena, model_size.x * model_size.y, sizeof(*object_model->data));
  }
 
-void init_learning_module(grid_lm* lm, vec2d model_size, vec2d world_size) {
-    init_object_model_mat(&lm->buffer, model_size);
+size_t learning_module_arena_bytes(vec2d model_size, u32 max_learnt_models, u32 num_orientations) {
+    size_t model_bytes = learning_module_episode_bytes(model_size);
+    u32 num_hypotheses = max_learnt_models * num_orientations;
+
+    return num_hypotheses * (model_bytes + ARENA_ALIGNMENT)
+        + feature_index_bytes(max_learnt_models * model_size.x * model_size.y)
+        + 2 * ARENA_ALIGN_UP((size_t) num_hypotheses * sizeof(i32))
+        + 2 * ARENA_ALIGN_UP((size_t) num_hypotheses * sizeof(object_model_mat));
+}
+
+size_t learning_module_episode_bytes(vec2d model_size) {
+    return ARENA_ALIGN_UP((size_t) model_size.x * model_size.y * sizeof(model_cell_t));
+}
+
+void init_learning_module(grid_lm* lm, vec2d model_size, vec2d world_size, u32 max_learnt_models, u32 num_orientations, arena_t* arena, arena_t* episode_arena) {
+    assertf(num_orientations == 1 || num_orientations == NUM_ORIENTATIONS, "models are matched in 1 or %d orientations", NUM_ORIENTATIONS);
+
+    memory_tag previous_tag = set_memory_tag(MEMORY_MODEL_BUFFER);
+    init_object_model_mat(&lm->buffer, model_size, episode_arena);
     lm->num_buffered_observations = 0;
 
+    set_memory_tag(MEMORY_LIBRARY);
     lm->num_learnt_models = 0;
-    lm->learnt_models = NULL;
+    lm->max_learnt_models = max_learnt_models;
+    lm->arena = arena;
+    lm->learnt_models = arena_calloc(arena, max_learnt_models, sizeof(*lm->learnt_models));
+
+    lm->num_orientations = num_orientations;
+    lm->oriented_models = NULL;
+    lm->finalized = 0;
+
+    lm->evidence = arena_calloc(arena, max_learnt_models * num_orientations, sizeof(*lm->evidence));
+    lm->hypotheses = arena_calloc(arena, max_learnt_models * num_orientations, sizeof(*lm->hypotheses));
+    lm->recognized_orientation = 0;
+    lm->num_hypotheses = 0;
+    lm->num_matched_observations = 0;
+
+    lm->mapping = NULL;
+    lm->mapping_size = 0;
+    lm->mapped_model_stride = 0;
+    lm->release_pruned = 0;
+    lm->library = NULL;
 
     lm->grid_size = model_size;
     lm->scale = world_size.x / model_size.x;
 
-    assert(world_size.x / model_size.x == world_size.y / model_size.y, "model/world size incorrect");
+    set_memory_tag(previous_tag);
+
+    assertf(world_size.x / model_size.x == world_size.y / model_size.y, "model/world size incorrect");
+}
+
+/**
+ * @brief Gives the lm a fresh (zeroed) working buffer.
+ * The episode arena is expected to have been reset by the caller, so this is O(1) in allocations
+ * Hypotheses are only seeded by the first observation (see seed)
+ *
+ * @param lm
+ * @param episode_arena
+ */
+void learning_module_new_episode(grid_lm* lm, arena_t* episode_arena) {
+    memory_tag previous_tag = set_memory_tag(MEMORY_MODEL_BUFFER);
+    init_object_model_mat(&lm->buffer, lm->grid_size, episode_arena);
+    set_memory_tag(previous_tag);
+    lm->num_buffered_observations = 0;
+
+    lm->num_hypotheses = 0;
+    lm->num_matched_observations = 0;
 }
 
 u32 incremental_average(u32 last_average, u32 next_element, u32 count) {
     return (count * next_element + last_average) / (count + 1);
 }
 
+static inline u32 abs_diff_i32(i32 a, i32 b) {
+    return a > b ? (u32) (a - b) : (u32) (b - a);
+}
+
+/**
+ * Everything the lm does with a cell goes through these, for either cell layout (see PACKED_MODEL_CELLS)
+ */
+#if PACKED_MODEL_CELLS
+
+static inline u32 cell_count(const model_cell_t* c) {
+    return c->count;
+}
+
+static inline void cell_init(model_cell_t* c, features_t features, pose_t pose, vec2d world_location) {
+    (void) world_location; // packed cells do not keep it
+    encode_packed_cell(c, 1, features, pose);
+}
+
+static inline void cell_add_count(model_cell_t* c, u32 count) {
+    packed_cell_add_count(c, count);
+}
+
+static inline void cell_features(const model_cell_t* c, features_t* features) {
+    decode_packed_features(c, features);
+}
+
+static inline void orient_cell(model_cell_t* c, u32 orientation) {
+    orient_packed_cell(c, orientation);
+}
+
+/**
+ * @brief Same test as features_distance + poses_agree, straight on the packed fields
+ *      (the observation's curvatures are clamped like the stored ones)
+ */
+static inline int cell_matches(const model_cell_t* c, features_t features, pose_t pose) {
+    u32 distance = abs_diff_i32(c->value, features.value)
+        + abs_diff_i32(c->mean_depth, features.mean_depth)
+        + abs_diff_i32(c->curvature_1, clamp_i8(features.principal_curvature_1_fp >> CURVATURE_FRACTIONAL_BITS))
+        + abs_diff_i32(c->curvature_2, clamp_i8(features.principal_curvature_2_fp >> CURVATURE_FRACTIONAL_BITS));
+    if(distance > FEATURES_MATCH_TOLERANCE) return 0;
+
+    if(!(c->flags & PACKED_CELL_POSE_FULLY_DEFINED) || !pose.pose_fully_defined) return 1;
+    return direction_angle_distance(c->direction_1_angle, pose.curvature_direction_1_angle) <= POSE_ANGLE_TOLERANCE;
+}
+
+#else
+
+/**
+ * @brief L1 distance between two observations, with curvatures brought back to integer precision
+ */
+static inline u32 features_distance(features_t a, features_t b) {
+    return abs_diff_i32(a.value, b.value)
+        + abs_diff_i32(a.mean_depth, b.mean_depth)
+        + abs_diff_i32(a.principal_curvature_1_fp >> CURVATURE_FRACTIONAL_BITS, b.principal_curvature_1_fp >> CURVATURE_FRACTIONAL_BITS)
+        + abs_diff_i32(a.principal_curvature_2_fp >> CURVATURE_FRACTIONAL_BITS, b.principal_curvature_2_fp >> CURVATURE_FRACTIONAL_BITS);
+}
+
+/**
+ * @brief Two poses agree when their first curvature directions are parallel (up to sign, within POSE_ANGLE_TOLERANCE),
+ *      compared on their quantized angles.
+ * Poses that are not fully defined always agree.
+ */
+static inline int poses_agree(pose_t a, pose_t b) {
+    if(!a.pose_fully_defined || !b.pose_fully_defined) return 1;
+
+    return direction_angle_distance(a.curvature_direction_1_angle, b.curvature_direction_1_angle) <= POSE_ANGLE_TOLERANCE;
+}
+
+static inline u32 cell_count(const model_cell_t* c) {
+    return c->count;
+}
+
+static inline void cell_init(model_cell_t* c, features_t features, pose_t pose, vec2d world_location) {
+    c->count = 1;
+    c->average_location = world_location;
+    c->average_pose = pose;
+    c->average_features = features;
+}
+
+static inline void cell_add_count(model_cell_t* c, u32 count) {
+    c->count += count;
+}
+
+static inline void cell_features(const model_cell_t* c, features_t* features) {
+    *features = c->average_features;
+}
+
+static inline void orient_cell(model_cell_t* c, u32 orientation) {
+    pose_t* pose = &c->average_pose;
+    pose->point_normal = orient_pose_vector(pose->point_normal, orientation);
+    pose->curvature_direction_1 = orient_pose_vector(pose->curvature_direction_1, orientation);
+    pose->curvature_direction_2 = orient_pose_vector(pose->curvature_direction_2, orientation);
+    pose->curvature_direction_1_angle = get_direction_angle(pose->curvature_direction_1);
+    pose->curvature_direction_2_angle = get_direction_angle(pose->curvature_direction_2);
+}
+
+static inline int cell_matches(const model_cell_t* c, features_t features, pose_t pose) {
+    return features_distance(c->average_features, features) <= FEATURES_MATCH_TOLERANCE
+        && poses_agree(c->average_pose, pose);
+}
+
+#endif
+
 void learning_module_explore(grid_lm* lm, features_t features, pose_t pose, vec2d world_location) {
     vec2d l = {
         .x = world_location.x / lm->scale,
         .y = world_location.y / lm->scale
     };
 
-    if(MAT(lm->buffer, l.y, l.x).count == 0) {
-        MAT(lm->buffer, l.y, l.x).count = 1;
-        MAT(lm->buffer, l.y, l.x).average_location = world_location;
-        
-        MAT(lm->buffer, l.y, l.x).average_pose = pose;
-        MAT(lm->buffer, l.y, l.x).average_features = features;
-    } else {
-        MAT(lm->buffer, l.y, l.x).count += 1;
+    model_cell_t* c = MATP(lm->buffer, l.y, l.x);
+    if(cell_count(c) == 0) cell_init(c, features, pose, world_location);
+    else cell_add_count(c, 1);
+
+    lm->num_buffered_observations += 1;
+}
+
+/**
+ * @brief Merges the working buffer into a learnt model.
+ * Cells only seen in the buffer are copied, cells seen in both only see their count increase.
+ *
+ * @param lm
+ * @param model_id either an already learnt model or num_learnt_models to learn a new one
+ */
+void learning_module_store_model(grid_lm* lm, u32 model_id) {
+    assertf(!lm->finalized, "cannot learn once the library is finalized");
+    assertf(model_id <= lm->num_learnt_models, "model %u cannot be stored, only %u models learnt", model_id, lm->num_learnt_models);
+
+    if(model_id == lm->num_learnt_models) {
+        assertf(lm->num_learnt_models < lm->max_learnt_models, "cannot learn more than %u models", lm->max_learnt_models);
+
+        memory_tag previous_tag = set_memory_tag(MEMORY_LIBRARY);
+        init_object_model_mat(lm->learnt_models + model_id, lm->grid_size, lm->arena);
+        set_memory_tag(previous_tag);
+        lm->num_learnt_models += 1;
+    }
+
+    object_model_mat model = lm->learnt_models[model_id];
+    for(u32 i = 0; i < model.rows * model.cols; ++i) {
+        model_cell_t* from = lm->buffer.data + i;
+        model_cell_t* to = model.data + i;
+
+        if(cell_count(from) == 0) continue;
+
+        if(cell_count(to) == 0) *to = *from;
+        else cell_add_count(to, cell_count(from));
+    }
+}
+
+void learning_module_load_model(grid_lm* lm, const model_cell_t* cells) {
+    assertf(!lm->finalized, "cannot learn once the library is finalized");
+    assertf(lm->num_learnt_models < lm->max_learnt_models, "cannot learn more than %u models", lm->max_learnt_models);
+
+    object_model_mat* model = lm->learnt_models + lm->num_learnt_models;
+    memory_tag previous_tag = set_memory_tag(MEMORY_LIBRARY);
+    init_object_model_mat(model, lm->grid_size, lm->arena);
+    set_memory_tag(previous_tag);
+
+    memcpy(model->data, cells, (size_t) model->rows * model->cols * sizeof(*model->data));
+    lm->num_learnt_models += 1;
+}
+
+/**
+ * @brief Copies a learnt model into another orientation, moving every cell and rotating its pose
+ */
+static void orient_object_model(object_model_mat* out, object_model_mat* in, vec2d size, u32 orientation, arena_t* arena) {
+    init_object_model_mat(out, oriented_size(size, orientation), arena);
+
+    for(i32 x = 0; x < size.x; ++x) {
+        for(i32 y = 0; y < size.y; ++y) {
+            model_cell_t cell = MAT(*in, y, x);
+            if(cell_count(&cell) == 0) continue;
+
+            orient_cell(&cell, orientation);
+
+            vec2d l = orient_location((vec2d) {.x = x, .y = y}, size, orientation);
+            MAT(*out, l.y, l.x) = cell;
+        }
+    }
+}
+
+/**
+ * @brief Cells of a learnt model, decoded into the library's scratch when it comes from an attached library:
+ *      valid until another model is looked up, so lookups go model by model
+ */
+static inline const model_cell_t* learnt_cells(grid_lm* lm, u32 model_id) {
+#if PACKED_MODEL_CELLS
+    if(lm->library != NULL) return model_library_get(lm->library, model_id);
+#endif
+    return lm->learnt_models[model_id].data;
+}
+
+static int get_learnt_cell_features(void* context, u32 model_id, u32 cell, features_t* features) {
+    grid_lm* lm = context;
+    const model_cell_t* c = learnt_cells(lm, model_id) + cell;
+
+    if(cell_count(c) == 0) return 0;
+    cell_features(c, features);
+    return 1;
+}
+
+/**
+ * @brief Pays once, in memory, for orientation invariance: every model is copied in every orientation
+ *      so that matching never rotates anything.
+ * Features do not depend on the orientation: the feature index is over the learnt cells, and seeding finds
+ *      the orientations that bring them to the observed cell (see seed_from_index).
+ */
+void learning_module_finalize(grid_lm* lm) {
+    memory_tag previous_tag = set_memory_tag(MEMORY_LIBRARY);
+
+    u32 num_hypotheses = lm->num_learnt_models * lm->num_orientations;
+    lm->oriented_models = arena_alloc(lm->arena, num_hypotheses, sizeof(*lm->oriented_models));
+
+    for(u32 m = 0; m < lm->num_learnt_models; ++m) {
+        lm->oriented_models[m * lm->num_orientations] = lm->learnt_models[m];
+
+        for(u32 o = 1; o < lm->num_orientations; ++o)
+            orient_object_model(lm->oriented_models + m * lm->num_orientations + o, lm->learnt_models + m, lm->grid_size, o, lm->arena);
+    }
+
+    build_feature_index(&lm->index, lm->num_learnt_models, lm->grid_size.x * lm->grid_size.y,
+        get_learnt_cell_features, lm, lm->arena);
+    lm->finalized = 1;
+
+    set_memory_tag(previous_tag);
+}
+
+/**
+ * @brief Matches straight from a compressed library instead of learnt models in memory:
+ *      only the feature index is built (one pass decoding every model) and no oriented copy is made.
+ * Matching then decodes every live model once per observation (hypotheses go model by model),
+ *      trading decoding time for the memory of the raw models.
+ */
+void learning_module_attach_library(grid_lm* lm, model_library_t* library) {
+#if PACKED_MODEL_CELLS
+    model_library_header_t* header = &library->header;
+    assertf(header->model_rows == lm->buffer.rows && header->model_cols == lm->buffer.cols,
+        "library of (%u, %u) models, the learning module has (%u, %u) models",
+        header->model_rows, header->model_cols, lm->buffer.rows, lm->buffer.cols);
+    assertf(header->num_models <= lm->max_learnt_models, "library of %u models, at most %u expected",
+        header->num_models, lm->max_learnt_models);
+    assertf(lm->num_learnt_models == 0 && !lm->finalized, "libraries are attached to a fresh learning module");
+
+    memory_tag previous_tag = set_memory_tag(MEMORY_LIBRARY);
+
+    // descriptors only: cells come from the library
+    for(u32 m = 0; m < header->num_models; ++m)
+        lm->learnt_models[m] = (object_model_mat) {.rows = header->model_rows, .cols = header->model_cols, .data = NULL};
+    lm->num_learnt_models = header->num_models;
+    lm->library = library;
+    lm->oriented_models = NULL;
+
+    build_feature_index(&lm->index, lm->num_learnt_models, lm->grid_size.x * lm->grid_size.y,
+        get_learnt_cell_features, lm, lm->arena);
+    lm->finalized = 1;
+
+    set_memory_tag(previous_tag);
+#else
+    assertf(0, "model libraries store packed cells (PACKED_MODEL_CELLS)");
+#endif
+}
+
+/**
+ * @brief Cell of hypothesis at l, NULL when l is outside of the oriented model or the cell is empty.
+ * Without oriented copies (mapped or attached library), the learnt cell l comes from is oriented into scratch
+ */
+static inline const model_cell_t* hypothesis_cell(grid_lm* lm, u32 hypothesis, vec2d l, model_cell_t* scratch) {
+    if(lm->oriented_models != NULL) {
+        object_model_mat* model = lm->oriented_models + hypothesis;
+        if((u32) l.x >= model->cols || (u32) l.y >= model->rows) return NULL;
+
+        model_cell_t* c = MATP(*model, l.y, l.x);
+        return cell_count(c) != 0 ? c : NULL;
+    }
+
+    u32 o = hypothesis % lm->num_orientations;
+    vec2d size = oriented_size(lm->grid_size, o);
+    if((u32) l.x >= (u32) size.x || (u32) l.y >= (u32) size.y) return NULL;
+
+    vec2d learnt = unorient_location(l, lm->grid_size, o);
+    *scratch = learnt_cells(lm, hypothesis / lm->num_orientations)[learnt.y * lm->grid_size.x + learnt.x];
+    if(cell_count(scratch) == 0) return NULL;
+
+    if(o != 0) orient_cell(scratch, o);
+    return scratch;
+}
+
+/**
+ * @brief Residency hint for the pages of a mapped learnt model (nothing when the library is in memory)
+ * @param advice MADV_WILLNEED or MADV_DONTNEED
+ */
+static inline void advise_model(grid_lm* lm, u32 model_id, int advice) {
+    if(lm->mapping == NULL) return;
+    madvise((void*) lm->learnt_models[model_id].data, lm->mapped_model_stride, advice);
+}
 
+/**
+ * @brief Hypotheses whose oriented model holds the observed (quantized) features at the observed cell l:
+ *      the learnt cells of the key's postings, in every orientation that brings them to l.
+ * O(postings of that key) instead of O(learnt models x orientations).
+ *
+ * @param hypotheses written in increasing order
+ * @returns their number
+ */
+static u32 seed_from_index(grid_lm* lm, features_t features, vec2d l, u32* hypotheses) {
+    // the learnt cell every orientation brings to l, if any
+    u32 sources[NUM_ORIENTATIONS];
+    for(u32 o = 0; o < lm->num_orientations; ++o) {
+        vec2d size = oriented_size(lm->grid_size, o);
+        if((u32) l.x >= (u32) size.x || (u32) l.y >= (u32) size.y) {
+            sources[o] = UINT32_MAX;
+            continue;
+        }
+
+        vec2d learnt = unorient_location(l, lm->grid_size, o);
+        sources[o] = learnt.y * lm->grid_size.x + learnt.x;
+    }
+
+    u32 *model_ids, *cells;
+    u32 num_postings = feature_index_lookup(&lm->index, feature_key(features), &model_ids, &cells);
+
+    // postings come by model: only the orientations of a model can come out of order
+    u32 count = 0;
+    for(u32 p = 0; p < num_postings; ++p) {
+        for(u32 o = 0; o < lm->num_orientations; ++o) {
+            if(sources[o] != cells[p]) continue;
+
+            u32 h = model_ids[p] * lm->num_orientations + o;
+            u32 i = count++;
+            for(; i > 0 && hypotheses[i - 1] > h; --i) hypotheses[i] = hypotheses[i - 1];
+            hypotheses[i] = h;
+        }
     }
+
+    return count;
 }
 
+/**
+ * @brief Seeds hypotheses (evidence 0) from the first observation of an episode (see seed_from_index).
+ * When nothing matches (e.g. noise moved the observation to another key), every hypothesis is live,
+ *      except for a mapped library: that would page the whole file in, so nothing is seeded
+ *      and the next observation seeds instead. Mapped models are paged in ahead of matching.
+ *
+ * @returns the number of hypotheses, written in increasing order
+ */
+static u32 seed(grid_lm* lm, features_t features, vec2d l, u32* hypotheses, i32* evidence) {
+    u32 num_hypotheses = seed_from_index(lm, features, l, hypotheses);
+
+    if(num_hypotheses == 0 && lm->mapping == NULL) {
+        num_hypotheses = lm->num_learnt_models * lm->num_orientations;
+        for(u32 h = 0; h < num_hypotheses; ++h) hypotheses[h] = h;
+    }
+
+    for(u32 i = 0; i < num_hypotheses; ++i) {
+        u32 h = hypotheses[i];
+        evidence[h] = 0;
+
+        u32 model_id = h / lm->num_orientations;
+        if(i == 0 || hypotheses[i - 1] / lm->num_orientations != model_id) advise_model(lm, model_id, MADV_WILLNEED);
+    }
+
+    return num_hypotheses;
+}
+
+/**
+ * @brief Accumulates evidence for every hypothesis then prunes the ones that fall too far behind.
+ * Cells never observed during learning bring no evidence either way.
+ *
+ * @param lm
+ * @param features
+ * @param pose its curvature direction must agree with the oriented model's one
+ * @param world_location
+ */
 void learning_module_match(grid_lm* lm, features_t features, pose_t pose, vec2d world_location) {
     if(lm->num_learnt_models == 0) return;
+    assertf(lm->finalized, "the library must be finalized before matching");
+
+    vec2d l = vec_divided_u32(world_location, lm->scale);
+
+    if(lm->num_matched_observations == 0) {
+        lm->num_hypotheses = seed(lm, features, l, lm->hypotheses, lm->evidence);
+        if(lm->num_hypotheses == 0) return;
+    }
+
+    model_cell_t scratch;
+    i32 best = INT32_MIN;
+    for(u32 i = 0; i < lm->num_hypotheses; ++i) {
+        u32 h = lm->hypotheses[i];
+
+        const model_cell_t* c = hypothesis_cell(lm, h, l, &scratch);
+        if(c != NULL) lm->evidence[h] += cell_matches(c, features, pose) ? EVIDENCE_MATCH : EVIDENCE_MISMATCH;
+
+        if(lm->evidence[h] > best) best = lm->evidence[h];
+    }
+
+    // hypotheses are in increasing order, so a model's orientations are next to each other:
+    //      its pages are released once none of them survived
+    u32 num_kept = 0;
+    u32 group_model = UINT32_MAX;
+    int group_kept = 0;
+    for(u32 i = 0; i < lm->num_hypotheses; ++i) {
+        u32 h = lm->hypotheses[i];
+
+        if(h / lm->num_orientations != group_model) {
+            if(lm->release_pruned && group_model != UINT32_MAX && !group_kept) advise_model(lm, group_model, MADV_DONTNEED);
+            group_model = h / lm->num_orientations;
+            group_kept = 0;
+        }
+
+        if(lm->evidence[h] >= best - PRUNE_MARGIN) {
+            lm->hypotheses[num_kept++] = h;
+            group_kept = 1;
+        }
+    }
+    if(lm->release_pruned && group_model != UINT32_MAX && !group_kept) advise_model(lm, group_model, MADV_DONTNEED);
+    lm->num_hypotheses = num_kept;
+
+    lm->num_matched_observations += 1;
+}
+
+/**
+ * @brief The best hypothesis must lead every hypothesis of another model:
+ *      a symmetric object can keep several of its orientations alive without blocking its recognition.
+ * The one recognition rule of both the lm and the batched sequences
+ *
+ * @param orientation set to the best hypothesis' orientation, recognized or not
+ */
+static i32 recognize(const i32* evidence, const u32* live, u32 num_live, u32 num_orientations, u32* orientation) {
+    if(num_live == 0) return NOT_RECOGNIZED;
+
+    u32 best_h = live[0];
+    for(u32 i = 1; i < num_live; ++i)
+        if(evidence[live[i]] > evidence[best_h]) best_h = live[i];
+
+    u32 best_model = best_h / num_orientations;
+    i32 best = evidence[best_h];
+
+    i32 second = INT32_MIN;
+    for(u32 i = 0; i < num_live; ++i) {
+        u32 h = live[i];
+        if(h / num_orientations != best_model && evidence[h] > second) second = evidence[h];
+    }
+
+    *orientation = best_h % num_orientations;
+
+    if(second == INT32_MIN && best > 0) return best_model;
+    if(second != INT32_MIN && best - second >= RECOGNITION_MARGIN) return best_model;
+
+    return NOT_RECOGNIZED;
+}
+
+i32 learning_module_recognized(grid_lm* lm) {
+    return recognize(lm->evidence, lm->hypotheses, lm->num_hypotheses, lm->num_orientations, &lm->recognized_orientation);
+}
+
+size_t match_batch_bytes(grid_lm* lm, u32 max_sequences) {
+    size_t num_hypotheses = lm->num_learnt_models * lm->num_orientations;
+
+    return 3 * ARENA_ALIGN_UP(num_hypotheses * max_sequences * sizeof(u32))
+        + ARENA_ALIGN_UP((num_hypotheses + 1) * sizeof(u32))
+        + 2 * ARENA_ALIGN_UP((size_t) max_sequences * sizeof(u32))
+        + ARENA_ALIGN_UP((size_t) max_sequences * sizeof(u8))
+        + ARENA_ALIGN_UP((size_t) max_sequences * sizeof(vec2d))
+        + ARENA_ALIGN_UP((size_t) lm->num_learnt_models * sizeof(u8));
+}
+
+void init_match_batch(match_batch_t* batch, grid_lm* lm, u32 max_sequences, arena_t* arena) {
+    assertf(lm->finalized, "the library must be finalized before matching");
+
+    batch->max_sequences = max_sequences;
+    batch->num_hypotheses = lm->num_learnt_models * lm->num_orientations;
+
+    size_t num_pairs = (size_t) batch->num_hypotheses * max_sequences;
+    batch->evidence = arena_alloc(arena, num_pairs, sizeof(*batch->evidence));
+    batch->hypotheses = arena_alloc(arena, num_pairs, sizeof(*batch->hypotheses));
+    batch->num_live = arena_calloc(arena, max_sequences, sizeof(*batch->num_live));
+
+    batch->active = arena_calloc(arena, max_sequences, sizeof(*batch->active));
+    batch->num_matched_observations = arena_calloc(arena, max_sequences, sizeof(*batch->num_matched_observations));
+
+    batch->cells = arena_alloc(arena, max_sequences, sizeof(*batch->cells));
+    batch->group_offsets = arena_alloc(arena, batch->num_hypotheses + 1, sizeof(*batch->group_offsets));
+    batch->pair_sequences = arena_alloc(arena, num_pairs, sizeof(*batch->pair_sequences));
+    batch->model_states = arena_alloc(arena, lm->num_learnt_models, sizeof(*batch->model_states));
+}
+
+void match_batch_begin_sequence(match_batch_t* batch, u32 sequence) {
+    assertf(sequence < batch->max_sequences, "sequence %u out of a batch of %u", sequence, batch->max_sequences);
+
+    batch->active[sequence] = 1;
+    batch->num_live[sequence] = 0;
+    batch->num_matched_observations[sequence] = 0;
+}
+
+void match_batch_end_sequence(match_batch_t* batch, u32 sequence) {
+    batch->active[sequence] = 0;
+}
+
+// What became of a learnt model's hypotheses during a batch call, over all the sequences
+enum { MODEL_UNUSED, MODEL_PRUNED, MODEL_KEPT };
+
+// Same as learning_module_match's seeding, for one sequence of the batch
+static void seed_batch_sequence(grid_lm* lm, match_batch_t* batch, u32 sequence, features_t features, vec2d l) {
+    i32* evidence = batch->evidence + (size_t) sequence * batch->num_hypotheses;
+    u32* live = batch->hypotheses + (size_t) sequence * batch->num_hypotheses;
+
+    batch->num_live[sequence] = seed(lm, features, l, live, evidence);
+}
+
+/**
+ * @brief Seeds the new sequences, groups the live (sequence, hypothesis) pairs by hypothesis (counting sort),
+ *      updates the evidence one oriented model at a time, then prunes every sequence like learning_module_match.
+ */
+void learning_module_match_batch(grid_lm* lm, match_batch_t* batch, const features_t* features, const pose_t* poses, const vec2d* world_locations) {
+    if(lm->num_learnt_models == 0) return;
+
+    u32 num_hypotheses = batch->num_hypotheses;
+    u32* offsets = batch->group_offsets;
+    memset(offsets, 0, (num_hypotheses + 1) * sizeof(*offsets));
+
+    for(u32 s = 0; s < batch->max_sequences; ++s) {
+        if(!batch->active[s]) continue;
+
+        batch->cells[s] = vec_divided_u32(world_locations[s], lm->scale);
+        if(batch->num_matched_observations[s] == 0) seed_batch_sequence(lm, batch, s, features[s], batch->cells[s]);
+
+        u32* live = batch->hypotheses + (size_t) s * num_hypotheses;
+        for(u32 i = 0; i < batch->num_live[s]; ++i) offsets[live[i] + 1] += 1;
+    }
+
+    for(u32 h = 0; h < num_hypotheses; ++h) offsets[h + 1] += offsets[h];
+
+    // offsets[h] is used as the write cursor of group h, and ends up at the start of group h + 1
+    for(u32 s = 0; s < batch->max_sequences; ++s) {
+        if(!batch->active[s]) continue;
+
+        u32* live = batch->hypotheses + (size_t) s * num_hypotheses;
+        for(u32 i = 0; i < batch->num_live[s]; ++i) batch->pair_sequences[offsets[live[i]]++] = s;
+    }
+
+    model_cell_t scratch;
+    u32 group_start = 0;
+    for(u32 h = 0; h < num_hypotheses; ++h) {
+        u32 group_end = offsets[h];
+
+        for(u32 p = group_start; p < group_end; ++p) {
+            u32 s = batch->pair_sequences[p];
+
+            const model_cell_t* c = hypothesis_cell(lm, h, batch->cells[s], &scratch);
+            if(c != NULL)
+                batch->evidence[(size_t) s * num_hypotheses + h] += cell_matches(c, features[s], poses[s]) ? EVIDENCE_MATCH : EVIDENCE_MISMATCH;
+        }
+
+        group_start = group_end;
+    }
+
+    // mapped models that no sequence considers any more are released, like learning_module_match does
+    //      (offsets[h] is now the end of group h)
+    if(lm->release_pruned) {
+        memset(batch->model_states, MODEL_UNUSED, lm->num_learnt_models);
+        for(u32 h = 0; h < num_hypotheses; ++h)
+            if(offsets[h] > (h > 0 ? offsets[h - 1] : 0)) batch->model_states[h / lm->num_orientations] = MODEL_PRUNED;
+    }
+
+    for(u32 s = 0; s < batch->max_sequences; ++s) {
+        if(!batch->active[s]) continue;
+
+        i32* evidence = batch->evidence + (size_t) s * num_hypotheses;
+        u32* live = batch->hypotheses + (size_t) s * num_hypotheses;
+
+        i32 best = INT32_MIN;
+        for(u32 i = 0; i < batch->num_live[s]; ++i)
+            if(evidence[live[i]] > best) best = evidence[live[i]];
+
+        u32 num_kept = 0;
+        for(u32 i = 0; i < batch->num_live[s]; ++i)
+            if(evidence[live[i]] >= best - PRUNE_MARGIN) live[num_kept++] = live[i];
+        batch->num_live[s] = num_kept;
+
+        // a sequence that seeded nothing seeds again from its next observation
+        if(num_kept > 0) batch->num_matched_observations[s] += 1;
+
+        if(lm->release_pruned)
+            for(u32 i = 0; i < num_kept; ++i) batch->model_states[live[i] / lm->num_orientations] = MODEL_KEPT;
+    }
+
+    if(lm->release_pruned) {
+        for(u32 m = 0; m < lm->num_learnt_models; ++m)
+            if(batch->model_states[m] == MODEL_PRUNED) advise_model(lm, m, MADV_DONTNEED);
+    }
+}
+
+i32 match_batch_recognized(grid_lm* lm, match_batch_t* batch, u32 sequence, u32* orientation) {
+    u32 best_orientation;
+    i32 recognized = recognize(batch->evidence + (size_t) sequence * batch->num_hypotheses,
+        batch->hypotheses + (size_t) sequence * batch->num_hypotheses, batch->num_live[sequence],
+        lm->num_orientations, &best_orientation);
+
+    if(orientation != NULL && batch->num_live[sequence] > 0) *orientation = best_orientation;
+    return recognized;
 }
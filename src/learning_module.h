@@ -13,6 +13,15 @@
 #include "grid_environment.h"
 #include "location.h"
 #include "interfaces.h"
+#include "arena.h"
+#include "feature_index.h"
+#include "orientation.h"
+#include "packed_cell.h"
+
+// Model cells (learnt models and the working buffer) are packed_cell_t unless built with -DPACKED_MODEL_CELLS=0
+#ifndef PACKED_MODEL_CELLS
+#define PACKED_MODEL_CELLS 1
+#endif
 
 typedef struct object_model_cell_ {
     u32 count;
@@ -21,12 +30,20 @@ typedef struct object_model_cell_ {
     features_t average_features;
 } object_model_cell;
 
+#if PACKED_MODEL_CELLS
+typedef packed_cell_t model_cell_t;
+#else
+typedef object_model_cell model_cell_t;
+#endif
+
 typedef struct object_model_mat_ {
     u32 rows;
     u32 cols;
-    object_model_cell* data;
+    model_cell_t* data;
 } object_model_mat;
 
+struct model_library_t_; // see model_library.h
+
 typedef struct grid_lm_ {
     vec2d grid_size;
     u32 scale;
@@ -36,11 +53,115 @@ typedef struct grid_lm_ {
     // long-term object memory that models all learnt objects for matching
     object_model_mat* learnt_models;
     u32 num_learnt_models;
+    u32 max_learnt_models;
+    arena_t* arena; // learnt models are allocated from it
+    // every learnt model in every orientation, built by learning_module_finalize:
+    //      oriented_models[model_id * num_orientations + orientation], orientation 0 shares the learnt model's cells
+    // a hypothesis is an index in oriented_models. NULL for a mapped library: cells are then oriented as they are looked up
+    u32 num_orientations; // 1 (no rotation) or NUM_ORIENTATIONS
+    object_model_mat* oriented_models;
+    // index of the learnt cells by quantized features, built by learning_module_finalize
+    feature_index_t index;
+    int finalized;
+    // matching state: one evidence score per hypothesis and the list of hypotheses still alive
+    // hypotheses that fall too far behind the best one are pruned
+    i32* evidence;
+    u32* hypotheses;
+    u32 num_hypotheses;
+    u32 num_matched_observations;
+    u32 recognized_orientation; // set by learning_module_recognized
+    // set when the finalized library is a read-only mapping of a file (see learning_module_map_library):
+    //      every learnt model then starts on a page and is mapped_model_stride bytes long,
+    //      and matching tells the kernel which ones it needs (models of the seeded hypotheses)
+    //      and, with release_pruned, which ones it no longer does (models whose hypotheses were all pruned)
+    const u8* mapping;
+    size_t mapping_size;
+    size_t mapped_model_stride;
+    // dropping pruned models costs page faults when the next episodes seed them again: only worth it when
+    //      the library does not fit in memory (learning_module_map_library sets it from the file and RAM sizes)
+    int release_pruned;
+    // set when the learnt models are read from a compressed library (see learning_module_attach_library):
+    //      learnt_models then has no cells, and every model is decoded on demand as matching looks it up
+    struct model_library_t_* library;
 } grid_lm;
 
-void init_learning_module(grid_lm* lm, vec2d model_size, vec2d world_size);
+// Evidence update for one observation
+#define EVIDENCE_MATCH 1
+#define EVIDENCE_MISMATCH -1
+// Max distance (see features_distance) for an observation to be considered a match
+#define FEATURES_MATCH_TOLERANCE 2
+// Max distance between the first curvature directions of two agreeing poses, in angle bins (~14 degrees)
+#define POSE_ANGLE_TOLERANCE (DIRECTION_ANGLE_BINS / 13)
+// A model is pruned when it is PRUNE_MARGIN behind the best one
+#define PRUNE_MARGIN 3
+// Recognition happens when a single model is alive or when the best one leads every other model by RECOGNITION_MARGIN
+#define RECOGNITION_MARGIN 5
+
+#define NOT_RECOGNIZED -1
+
+void init_object_model_mat(object_model_mat* object_model, vec2d model_size, arena_t* arena);
+
+// Upper bounds of what a learning module takes from the experiment arena (init, learning and finalize)
+//      and from the episode arena (per episode), for arena sizing
+size_t learning_module_arena_bytes(vec2d model_size, u32 max_learnt_models, u32 num_orientations);
+size_t learning_module_episode_bytes(vec2d model_size);
+
+// The working buffer is allocated from the episode (scratch) arena, learnt models from the experiment arena
+void init_learning_module(grid_lm* lm, vec2d model_size, vec2d world_size, u32 max_learnt_models, u32 num_orientations, arena_t* arena, arena_t* episode_arena);
+void learning_module_new_episode(grid_lm* lm, arena_t* episode_arena);
 
 void learning_module_explore(grid_lm* lm, features_t features, pose_t pose, vec2d location);
 void learning_module_match(grid_lm* lm, features_t features, pose_t pose, vec2d location);
 
+// Commits the working buffer to the learnt model model_id (new model if model_id == num_learnt_models)
+void learning_module_store_model(grid_lm* lm, u32 model_id);
+// Appends a learnt model with these cells (grid_size of them), e.g. restored from a checkpoint
+void learning_module_load_model(grid_lm* lm, const model_cell_t* cells);
+// Builds the oriented models and the feature index over them: no model can be learnt after that, and matching needs it
+void learning_module_finalize(grid_lm* lm);
+// Returns the recognized model id (its orientation goes to lm->recognized_orientation) or NOT_RECOGNIZED
+i32 learning_module_recognized(grid_lm* lm);
+
+/**
+ * Matching state of many observation sequences against the same finalized library (offline evaluation).
+ *
+ * Every sequence keeps its own evidence and list of live hypotheses, exactly like a grid_lm, and evolves exactly as it
+ *      would through learning_module_match (same seeding, pruning and recognition).
+ * learning_module_match_batch takes one observation per sequence, groups the (sequence, hypothesis) pairs
+ *      by hypothesis, and walks the hypotheses once: every oriented model's cells are looked up once per call and compared to
+ *      the observations of all the sequences that still consider it, instead of once per sequence.
+ */
+typedef struct match_batch_t_ {
+    u32 max_sequences;
+    u32 num_hypotheses; // learnt models x orientations
+
+    // per sequence, num_hypotheses entries each
+    i32* evidence;
+    u32* hypotheses; // live hypotheses, in increasing order
+    u32* num_live;
+
+    u8* active;
+    u32* num_matched_observations;
+
+    // per call scratch: the sequences of every hypothesis (pair_sequences[group_offsets[h]..group_offsets[h + 1]])
+    vec2d* cells;
+    u32* group_offsets;
+    u32* pair_sequences;
+    u8* model_states; // per learnt model, for releasing the mapped models no sequence considers any more
+} match_batch_t;
+
+size_t match_batch_bytes(grid_lm* lm, u32 max_sequences);
+// The library must be finalized
+void init_match_batch(match_batch_t* batch, grid_lm* lm, u32 max_sequences, arena_t* arena);
+
+// Starts a new sequence in that slot: it is seeded by its next observation
+void match_batch_begin_sequence(match_batch_t* batch, u32 sequence);
+// Stops matching the sequence (e.g. once recognized)
+void match_batch_end_sequence(match_batch_t* batch, u32 sequence);
+
+// One observation per sequence, only read for the active ones
+void learning_module_match_batch(grid_lm* lm, match_batch_t* batch, const features_t* features, const pose_t* poses, const vec2d* world_locations);
+// Same as learning_module_recognized, for one sequence. orientation can be NULL
+i32 match_batch_recognized(grid_lm* lm, match_batch_t* batch, u32 sequence, u32* orientation);
+
 #endif
@@ -32,4 +32,24 @@ inline static vec2d vec_multiplied_u32(vec2d v, u32 d) {
     };
 }
 
+inline static vec2d vec_added(vec2d a, vec2d b) {
+    return (vec2d) {
+        .x = a.x + b.x,
+        .y = a.y + b.y
+    };
+}
+
+inline static vec2d vec_subtracted(vec2d a, vec2d b) {
+    return (vec2d) {
+        .x = a.x - b.x,
+        .y = a.y - b.y
+    };
+}
+
+// Layout of things placed around a point (sensors, columns): the point itself, its 4 neighbours, then 3 diagonals
+#define NUM_LAYOUT_OFFSETS 8
+static const vec2d LAYOUT_OFFSETS[NUM_LAYOUT_OFFSETS] = {
+    {0, 0}, {0, 1}, {1, 0}, {0, -1}, {-1, 0}, {1, 1}, {-1, -1}, {1, -1}
+};
+
 #endif
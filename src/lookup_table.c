@@ -1,12 +1,13 @@
 #include "lookup_table.h"
 
 #define INSTANTIATE_LUT_INIT(symbol) \
-    void lut_##symbol##_init(LUT_TYPE(symbol)* t, symbol default_value, u32 length) { \
+    void lut_##symbol##_init(LUT_TYPE(symbol)* t, symbol default_value, u32 length, arena_t* arena) { \
         t->default_value = default_value; \
         t->length = length; \
-        t->data = (symbol*) calloc(length, sizeof(*t->data)); \
+        t->data = (symbol*) arena_calloc(arena, length, sizeof(*t->data)); \
     }
 
+INSTANTIATE_LUT_INIT(u16);
 INSTANTIATE_LUT_INIT(u8);
 INSTANTIATE_LUT_INIT(i8);
 
@@ -16,6 +17,7 @@ INSTANTIATE_LUT_INIT(i8);
         return t->default_value; \
     } 
 
+INSTANTIATE_LUT_LOOKUP(u16);
 INSTANTIATE_LUT_LOOKUP(u8);
 INSTANTIATE_LUT_LOOKUP(i8);
 
@@ -4,6 +4,7 @@
 #include "stdlib.h"
 
 #include "types.h"
+#include "arena.h"
 
 #define LUT_TYPE_(symbol) lookup_table_##symbol##_
 #define LUT_TYPE(symbol) lookup_table_##symbol
@@ -15,18 +16,21 @@
         symbol* data; \
     } LUT_TYPE(symbol)
 
+DEFINE_LUT_STRUCT(u16);
 DEFINE_LUT_STRUCT(u8);
 DEFINE_LUT_STRUCT(i8);
 
 #define DEFINE_LUT_INIT(symbol) \
-    void lut_##symbol##_init(LUT_TYPE(symbol)* t, symbol default_value, u32 length);
+    void lut_##symbol##_init(LUT_TYPE(symbol)* t, symbol default_value, u32 length, arena_t* arena);
 
+DEFINE_LUT_INIT(u16);
 DEFINE_LUT_INIT(u8);
 DEFINE_LUT_INIT(i8);
 
 #define DEFINE_LUT_LOOKUP(symbol) \
     symbol lut_##symbol##_lookup(LUT_TYPE(symbol)* t, u32 index);
 
+DEFINE_LUT_LOOKUP(u16);
 DEFINE_LUT_LOOKUP(u8);
 DEFINE_LUT_LOOKUP(i8);
 
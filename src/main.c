@@ -3,75 +3,105 @@
 #include <string.h>
 #include <stdint.h>
 
-#include <unistd.h> // For sleep function
-
-#include "grid_environment.h"
-#include "sensor_module.h"
-#include "learning_module.h"
-#include "motor_policy.h"
+#include "assertf.h"
+#include "grid_experiment.h"
 
 int main(int argc, char *argv[]) {  
 
 // Put the error message in a char array:
-    const char error_message[] = "Error: usage: %s X\n\t \
-        0 is for training from scratch\n";
-
+    const char error_message[] = "usage: %s [key=value ...]\n\
+    config=<file>        file with one key=value per line\n\
+    seed=<u32>           seed of the whole run\n\
+    rows=<u32> cols=<u32> environment (object) size\n\
+    patch=<u32>          patch sidelength (odd)\n\
+    scale=<u32>          world cells per model cell\n\
+    objects=<u32>        number of objects\n\
+    train_episodes=<u32> train_steps=<u32>\n\
+    eval_episodes=<u32>  eval_steps=<u32>\n\
+    policy=random|scan\n\
+    lm=grid|htm          learning module: grid models matched by evidence, or one HTM temporal memory per object\n\
+                         (htm: single column and sensor, no pipeline, checkpoint, library nor trace)\n\
+    pooler=0|1           with lm=htm, features go through a spatial pooler before the temporal memories\n\
+    orientations=1|8     orientations every learnt model is matched in\n\
+    rotate_eval=0|1      evaluation objects are presented in a random orientation\n\
+    columns=<1..8>       learning modules, each with its own sensor and thread, voting together\n\
+    column_spacing=<u32> distance between neighbouring columns\n\
+    sensors=<1..8>       patches sensed per step by every column, in one batched call\n\
+    sensor_spacing=<u32> distance between neighbouring patches of a column\n\
+    pipeline=0|1         sense on its own thread, ahead of learning (single column, open-loop policy)\n\
+    pipeline_depth=<u32> steps sensing can run ahead of learning\n\
+    world=random|procedural|dataset|voxel\n\
+                         (voxel: procedural objects voxelized and sensed by rays looking straight down, no rotate_eval)\n\
+    dataset=<file>       object dataset used by world=dataset\n\
+    tracked=0|1          objects are tracked grids, sensed through a sensor cache each (single column, no pipeline)\n\
+    world_updates=<u32>  depth updates streamed into a tracked object every step (random cells, one unit up or down)\n\
+    max_depth=<u32> curvature=<f32> noise=<u32> labels=<u32> label_regions=<u32>\n\
+                         procedural objects parameters\n\
+    trace=<file>         records every observation to a binary trace (single column)\n\
+    checkpoint=<file>    snapshots the learning phase there, and resumes from it when it exists\n\
+    checkpoint_every=<u32> learning episodes between two snapshots\n\
+    library=<file>       writes the learnt models to a compressed model library, and checks it reads back\n\
+    from_library=<file>  learns nothing: matches against a model library, decoding models on demand\n\
+    generate=<file>      (last argument) only writes the procedural objects to an object dataset\n\
+    replay=<file> [batch=<u32>]\n\
+                         (only arguments) replays a trace into a learning module, without environment nor sensor,\n\
+                         matching evaluation episodes batch at a time in lockstep\n\
+    verbose=0|1\n";
 
     /* Error Checking */
-    if(argc < 0) {
+    if(argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
         printf(error_message, argv[0]);
         exit(1);
     }
 
-    u32 num_step = 10;
-
-    grid_t env;
-    u32 env_sidelen = 10;
-    init_grid_env(&env, env_sidelen, env_sidelen);
-    populate_grid_env_random(&env);
-
-    grid_t patch; // grid_t is an ugly abstraction for the patch
-    u32 patch_sidelen = 3;
-    init_grid_env(&patch, patch_sidelen, patch_sidelen);
-    vec2d patch_center = (vec2d) {.x = patch_sidelen / 2, .y = patch_sidelen / 2};
-
-    bounds_t bounds = get_bounds(env_sidelen, env_sidelen, patch_sidelen, patch_sidelen);
-
-    vec2d agent_location = {.x = 5, .y = 1}; // start location
-
-    random_motor_policy_t motor_policy;
-    init_random_motor_policy(&motor_policy, agent_location, bounds, num_step);
+    grid_experiment_config config;
+    default_experiment_config(&config);
 
-    features_t f;
-    pose_t p;
+    // generate=<file> is handled here rather than as a config key: it turns the run into a dataset generation
+    if(argc > 1 && strncmp(argv[argc - 1], "generate=", strlen("generate=")) == 0) {
+        const char* filename = argv[argc - 1] + strlen("generate=");
+        parse_experiment_args(&config, argc - 1, argv);
 
-    grid_lm lm;
-    init_learning_module(&lm);
-
-    vec2d movement;
-
-    print_grid(&env);
-
-    for(u32 step = 0; step < num_step; ++step) {
-        printf("--- step %u: agent at location (%u, %u)\n", step, agent_location.x, agent_location.y);
-        extract_patch(&patch, &env, agent_location, patch_sidelen);
-
-        print_grid(&patch);
+        generate_object_dataset(filename, &config.generator, config.seed, config.num_objects);
+        printf("wrote %u objects of shape (%u, %u) to %s\n", config.num_objects, config.env_rows, config.env_cols, filename);
+        print_memory_stats();
+        return 0;
+    }
 
-        sensor_module(&f, &p, patch, patch_center);
+    if((argc == 2 || argc == 3) && strncmp(argv[1], "replay=", strlen("replay=")) == 0) {
+        u32 batch_size = 1;
+        if(argc == 3) {
+            char* end;
+            assertf(strncmp(argv[2], "batch=", strlen("batch=")) == 0, "usage: replay=<file> [batch=<u32>]");
+            batch_size = strtoul(argv[2] + strlen("batch="), &end, 10);
+            assertf(*end == '\0' && batch_size >= 1, "invalid batch size %s", argv[2] + strlen("batch="));
+        }
+
+        phase_report_t learning, evaluation;
+        u32 num_divergent = replay_trace(argv[1] + strlen("replay="), &learning, &evaluation, batch_size);
+
+        print_phase_report("replay learning", learning);
+        print_phase_report("replay evaluation", evaluation);
+        printf("replay: %u evaluation episodes diverged from the trace\n", num_divergent);
+        print_memory_stats();
+        return 0;
+    }
 
-        print_features(f);
-        print_pose(p);
+    parse_experiment_args(&config, argc, argv);
 
-        learning_module_explore(&lm, f, p); // TODO: during matching, the lm should override the motor_policy's movements
+    grid_experiment_t experiment;
+    init_grid_experiment(&experiment, config);
+    print_experiment_config(&experiment.config); // a dataset may have overridden the shape and number of objects
 
-        movement = random_motor_policy(&motor_policy, f, p);
+    run_learning_phase(&experiment);
+    print_phase_report("learning", experiment.learning_report);
 
-        agent_location.x += movement.x;
-        agent_location.y += movement.y;
+    run_evaluation_phase(&experiment);
+    print_phase_report("evaluation", experiment.evaluation_report);
+    if(experiment.config.lm == LM_HTM) print_htm_recognizer_stats(&experiment.columns[0].htm);
 
-        printf("\n");
-    }
+    free_grid_experiment(&experiment);
+    print_memory_stats();
 
     return 0;
 }
@@ -0,0 +1,82 @@
+#include "memory_accounting.h"
+
+#include <stdio.h>
+#include <stdatomic.h>
+
+#include "assertf.h"
+
+typedef struct memory_counters_t_ {
+    _Atomic size_t current;
+    _Atomic size_t peak;
+    _Atomic u64 allocations;
+} memory_counters_t;
+
+static memory_counters_t counters[NUM_MEMORY_TAGS];
+
+static _Thread_local memory_tag current_tag = MEMORY_OTHER;
+
+static const char* tag_names[NUM_MEMORY_TAGS] = {
+    [MEMORY_OTHER] = "other",
+    [MEMORY_ENVIRONMENT] = "environment",
+    [MEMORY_PATCHES] = "patches",
+    [MEMORY_MODEL_BUFFER] = "model_buffer",
+    [MEMORY_LIBRARY] = "library",
+    [MEMORY_MOTOR_POLICY] = "motor_policy",
+    [MEMORY_DATASET] = "dataset",
+    [MEMORY_COLUMNS] = "columns",
+    [MEMORY_TABLES] = "tables",
+    [MEMORY_REPLAY] = "replay"
+};
+
+memory_tag set_memory_tag(memory_tag tag) {
+    memory_tag previous = current_tag;
+    current_tag = tag;
+    return previous;
+}
+
+memory_tag get_memory_tag(void) {
+    return current_tag;
+}
+
+void memory_account_alloc(memory_tag tag, size_t bytes) {
+    memory_counters_t* c = counters + tag;
+
+    size_t current = atomic_fetch_add_explicit(&c->current, bytes, memory_order_relaxed) + bytes;
+    atomic_fetch_add_explicit(&c->allocations, 1, memory_order_relaxed);
+
+    size_t peak = atomic_load_explicit(&c->peak, memory_order_relaxed);
+    while(current > peak && !atomic_compare_exchange_weak_explicit(&c->peak, &peak, current, memory_order_relaxed, memory_order_relaxed));
+}
+
+void memory_account_free(memory_tag tag, size_t bytes) {
+    size_t previous = atomic_fetch_sub_explicit(&counters[tag].current, bytes, memory_order_relaxed);
+    assertf(previous >= bytes, "%s: freeing %zu bytes with only %zu accounted", tag_names[tag], bytes, previous);
+}
+
+memory_stats_t get_memory_stats(memory_tag tag) {
+    return (memory_stats_t) {
+        .current = atomic_load_explicit(&counters[tag].current, memory_order_relaxed),
+        .peak = atomic_load_explicit(&counters[tag].peak, memory_order_relaxed),
+        .allocations = atomic_load_explicit(&counters[tag].allocations, memory_order_relaxed)
+    };
+}
+
+const char* memory_tag_name(memory_tag tag) {
+    return tag_names[tag];
+}
+
+void print_memory_stats(void) {
+    size_t total_current = 0, total_peak = 0;
+
+    for(u32 t = 0; t < NUM_MEMORY_TAGS; ++t) {
+        memory_stats_t s = get_memory_stats(t);
+        if(s.allocations == 0) continue;
+
+        printf("[memory] %-12s current=%zu peak=%zu allocations=%llu\n",
+            tag_names[t], s.current, s.peak, (unsigned long long) s.allocations);
+        total_current += s.current;
+        total_peak += s.peak;
+    }
+
+    printf("[memory] total current=%zu sum_of_peaks=%zu\n", total_current, total_peak);
+}
@@ -0,0 +1,54 @@
+#ifndef MEMORY_ACCOUNTING_H
+#define MEMORY_ACCOUNTING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "types.h"
+
+/**
+ * Bytes handed out per subsystem: current, peak and number of allocations.
+ *
+ * Every arena allocation is accounted to the calling thread's current tag (set_memory_tag),
+ *      and given back when its arena is reset or freed.
+ * Subsystems that mix several kinds of memory (the learning module) tag their own allocations,
+ *      otherwise the owner of the memory (experiment, replay, C API) tags around the calls it makes.
+ * Counters are atomic: they can be updated and queried from any thread.
+ *
+ * Figures are the aligned sizes of the slices, not the arenas' capacities: that is what an arena needs to be sized to.
+ */
+typedef enum memory_tag_ {
+    MEMORY_OTHER,
+    MEMORY_ENVIRONMENT, // objects, oriented copies, voxel worlds
+    MEMORY_PATCHES, // sensed observations in flight (pipeline)
+    MEMORY_MODEL_BUFFER, // learning modules' working buffers
+    MEMORY_LIBRARY, // learnt and oriented models, feature index, matching state
+    MEMORY_MOTOR_POLICY,
+    MEMORY_DATASET, // dataset generation
+    MEMORY_COLUMNS, // columns and their vote rings
+    MEMORY_TABLES, // lookup tables
+    MEMORY_REPLAY, // trace replay buffers and batch matching
+    NUM_MEMORY_TAGS
+} memory_tag;
+
+typedef struct memory_stats_t_ {
+    size_t current;
+    size_t peak;
+    u64 allocations;
+} memory_stats_t;
+
+// Sets the current tag of the calling thread and returns the previous one, to restore it
+memory_tag set_memory_tag(memory_tag tag);
+memory_tag get_memory_tag(void);
+
+void memory_account_alloc(memory_tag tag, size_t bytes);
+void memory_account_free(memory_tag tag, size_t bytes);
+
+memory_stats_t get_memory_stats(memory_tag tag);
+const char* memory_tag_name(memory_tag tag);
+
+// One line per tag that ever allocated
+void print_memory_stats(void);
+
+#endif // MEMORY_ACCOUNTING_H
@@ -0,0 +1,445 @@
+#include "model_library.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "assertf.h"
+#include "io.h"
+
+// Libraries are written in big sequential chunks
+#define MODEL_LIBRARY_BUFFER_SIZE (1 << 20)
+
+// Largest encoding of a cell: value 5, count 3, depths 3 x 3, curvatures 2 x 2, angle 2 and flags 1 bytes
+#define MAX_ENCODED_CELL_BYTES 24
+#define MAX_VARINT_BYTES 10
+
+static inline u32 zigzag(i32 v) {
+    return ((u32) v << 1) ^ (u32) (v >> 31);
+}
+
+static inline i32 unzigzag(u32 v) {
+    return (i32) (v >> 1) ^ -(i32) (v & 1);
+}
+
+static inline u8* put_varint(u8* out, u64 v) {
+    while(v >= 0x80) {
+        *out++ = (u8) v | 0x80;
+        v >>= 7;
+    }
+    *out++ = (u8) v;
+    return out;
+}
+
+static inline const u8* get_varint(const u8* in, const u8* end, u64* v) {
+    u64 result = 0;
+    for(u32 shift = 0; shift < 64; shift += 7) {
+        assertf(in < end, "model library: truncated varint");
+        u8 byte = *in++;
+        result |= (u64) (byte & 0x7f) << shift;
+        if(!(byte & 0x80)) {
+            *v = result;
+            return in;
+        }
+    }
+    assertf(0, "model library: varint too long");
+    return in;
+}
+
+static inline int is_empty_cell(const packed_cell_t* cell) {
+    return cell->count == 0;
+}
+
+static u8* encode_cell(u8* out, const packed_cell_t* cell, const packed_cell_t* previous) {
+    out = put_varint(out, zigzag((i32) (cell->value - previous->value)));
+    out = put_varint(out, cell->count);
+    out = put_varint(out, zigzag((i32) cell->mean_depth - previous->mean_depth));
+    out = put_varint(out, zigzag((i32) cell->min_depth - previous->min_depth));
+    out = put_varint(out, zigzag((i32) cell->max_depth - previous->max_depth));
+    out = put_varint(out, zigzag((i32) cell->median_depth - previous->median_depth));
+    out = put_varint(out, zigzag((i32) cell->p10_depth - previous->p10_depth));
+    out = put_varint(out, zigzag((i32) cell->p90_depth - previous->p90_depth));
+    out = put_varint(out, zigzag((i32) cell->curvature_1 - previous->curvature_1));
+    out = put_varint(out, zigzag((i32) cell->curvature_2 - previous->curvature_2));
+    out = put_varint(out, zigzag((i32) cell->normal_x - previous->normal_x));
+    out = put_varint(out, zigzag((i32) cell->normal_y - previous->normal_y));
+    out = put_varint(out, zigzag((i32) cell->direction_1_angle - previous->direction_1_angle));
+    *out++ = cell->flags;
+    return out;
+}
+
+static const u8* decode_cell(const u8* in, const u8* end, packed_cell_t* cell, const packed_cell_t* previous) {
+    u64 v;
+    in = get_varint(in, end, &v); cell->value = previous->value + (u32) unzigzag(v);
+    in = get_varint(in, end, &v); cell->count = v;
+    in = get_varint(in, end, &v); cell->mean_depth = previous->mean_depth + unzigzag(v);
+    in = get_varint(in, end, &v); cell->min_depth = previous->min_depth + unzigzag(v);
+    in = get_varint(in, end, &v); cell->max_depth = previous->max_depth + unzigzag(v);
+    in = get_varint(in, end, &v); cell->median_depth = previous->median_depth + unzigzag(v);
+    in = get_varint(in, end, &v); cell->p10_depth = previous->p10_depth + unzigzag(v);
+    in = get_varint(in, end, &v); cell->p90_depth = previous->p90_depth + unzigzag(v);
+    in = get_varint(in, end, &v); cell->curvature_1 = previous->curvature_1 + unzigzag(v);
+    in = get_varint(in, end, &v); cell->curvature_2 = previous->curvature_2 + unzigzag(v);
+    in = get_varint(in, end, &v); cell->normal_x = previous->normal_x + unzigzag(v);
+    in = get_varint(in, end, &v); cell->normal_y = previous->normal_y + unzigzag(v);
+    in = get_varint(in, end, &v); cell->direction_1_angle = previous->direction_1_angle + unzigzag(v);
+    assertf(in < end, "model library: truncated cell");
+    cell->flags = *in++;
+    memset(cell->reserved, 0, sizeof(cell->reserved));
+    return in;
+}
+
+/**
+ * @brief Alternating runs of empty and non-empty cells, until all the cells are covered
+ * @returns the end of the encoding
+ */
+static u8* encode_model(u8* out, const packed_cell_t* cells, u32 num_cells) {
+    packed_cell_t previous;
+    memset(&previous, 0, sizeof(previous));
+
+    u32 i = 0;
+    while(i < num_cells) {
+        u32 empty = i;
+        while(empty < num_cells && is_empty_cell(cells + empty)) ++empty;
+        u32 full = empty;
+        while(full < num_cells && !is_empty_cell(cells + full)) ++full;
+
+        out = put_varint(out, empty - i);
+        out = put_varint(out, full - empty);
+        for(u32 c = empty; c < full; ++c) {
+            out = encode_cell(out, cells + c, &previous);
+            previous = cells[c];
+        }
+
+        i = full;
+    }
+
+    return out;
+}
+
+static void decode_model(packed_cell_t* cells, u32 num_cells, const u8* in, const u8* end) {
+    packed_cell_t previous;
+    memset(&previous, 0, sizeof(previous));
+
+    u32 i = 0;
+    while(i < num_cells) {
+        u64 num_empty, num_full;
+        in = get_varint(in, end, &num_empty);
+        in = get_varint(in, end, &num_full);
+        assertf(num_empty + num_full <= num_cells - i, "model library: runs overflow the model");
+        assertf(num_empty + num_full > 0, "model library: empty runs");
+
+        memset(cells + i, 0, num_empty * sizeof(*cells));
+        i += num_empty;
+
+        for(u32 c = 0; c < num_full; ++c, ++i) {
+            in = decode_cell(in, end, cells + i, &previous);
+            previous = cells[i];
+        }
+    }
+    assertf(in == end, "model library: trailing bytes in a model");
+}
+
+size_t write_model_library(const char* filename, grid_lm* lm) {
+#if PACKED_MODEL_CELLS
+    FILE* f = fopen(filename, "wb");
+    assertf(f != NULL, "could not open model library %s", filename);
+    setvbuf(f, NULL, _IOFBF, MODEL_LIBRARY_BUFFER_SIZE);
+
+    model_library_header_t header = {
+        .magic = MODEL_LIBRARY_MAGIC,
+        .version = MODEL_LIBRARY_VERSION,
+        .model_rows = lm->buffer.rows,
+        .model_cols = lm->buffer.cols,
+        .num_models = lm->num_learnt_models
+    };
+    FWRITE_CHECK(&header, sizeof(header), 1, f);
+
+    u32 num_cells = header.model_rows * header.model_cols;
+    size_t offsets_bytes = (header.num_models + 1) * sizeof(u64);
+    size_t encoded_bytes = 2 * MAX_VARINT_BYTES + (size_t) num_cells * (MAX_ENCODED_CELL_BYTES + 2 * MAX_VARINT_BYTES);
+
+    memory_tag previous_tag = set_memory_tag(MEMORY_LIBRARY);
+    arena_t arena;
+    arena_init(&arena, ARENA_ALIGN_UP(offsets_bytes) + ARENA_ALIGN_UP(encoded_bytes) + 2 * ARENA_ALIGNMENT);
+
+    // offsets are only known once the models are encoded: written last, in place
+    u64* offsets = arena_calloc(&arena, header.num_models + 1, sizeof(*offsets));
+    long offsets_position = ftell(f);
+    FWRITE_CHECK(offsets, sizeof(*offsets), header.num_models + 1, f);
+
+    u8* encoded = arena_alloc(&arena, encoded_bytes, sizeof(*encoded));
+
+    for(u32 m = 0; m < header.num_models; ++m) {
+        size_t length = encode_model(encoded, lm->learnt_models[m].data, num_cells) - encoded;
+        if(length > 0) FWRITE_CHECK(encoded, 1, length, f);
+        offsets[m + 1] = offsets[m] + length;
+    }
+
+    size_t size = ftell(f);
+    fseek(f, offsets_position, SEEK_SET);
+    FWRITE_CHECK(offsets, sizeof(*offsets), header.num_models + 1, f);
+    fclose(f);
+
+    arena_free(&arena);
+    set_memory_tag(previous_tag);
+    return size;
+#else
+    assertf(0, "model libraries store packed cells (PACKED_MODEL_CELLS)");
+    return 0;
+#endif
+}
+
+void open_model_library(model_library_t* library, const char* filename, arena_t* arena) {
+    int fd = open(filename, O_RDONLY);
+    assertf(fd >= 0, "could not open model library %s", filename);
+
+    struct stat st;
+    assertf(fstat(fd, &st) == 0, "could not stat model library %s", filename);
+    library->size = st.st_size;
+    assertf(library->size >= sizeof(model_library_header_t), "model library %s is truncated", filename);
+
+    library->mapping = mmap(NULL, library->size, PROT_READ, MAP_SHARED, fd, 0);
+    assertf(library->mapping != MAP_FAILED, "could not map model library %s", filename);
+    close(fd);
+
+    memcpy(&library->header, library->mapping, sizeof(library->header));
+    model_library_header_t* h = &library->header;
+    assertf(h->magic == MODEL_LIBRARY_MAGIC, "%s is not a model library", filename);
+    assertf(h->version == MODEL_LIBRARY_VERSION, "model library %s is version %u, expected %u", filename, h->version, MODEL_LIBRARY_VERSION);
+
+    size_t index_end = sizeof(*h) + (h->num_models + 1) * sizeof(u64);
+    assertf(library->size >= index_end, "model library %s is truncated", filename);
+    library->offsets = (const u64*) (library->mapping + sizeof(*h));
+    library->models = library->mapping + index_end;
+    assertf(library->offsets[h->num_models] == library->size - index_end, "model library %s is truncated", filename);
+    for(u32 m = 0; m < h->num_models; ++m)
+        assertf(library->offsets[m] <= library->offsets[m + 1], "model library %s: model %u has a negative length", filename, m);
+
+    library->scratch = arena_alloc(arena, h->model_rows * h->model_cols, sizeof(*library->scratch));
+    library->scratch_model = -1;
+}
+
+void close_model_library(model_library_t* library) {
+    munmap((void*) library->mapping, library->size);
+    library->mapping = NULL;
+}
+
+const packed_cell_t* model_library_get(model_library_t* library, u32 model_id) {
+    assertf(model_id < library->header.num_models, "model %u of a %u models library", model_id, library->header.num_models);
+
+    if(library->scratch_model != model_id) {
+        const u8* begin = library->models + library->offsets[model_id];
+        const u8* end = library->models + library->offsets[model_id + 1];
+        decode_model(library->scratch, library->header.model_rows * library->header.model_cols, begin, end);
+        library->scratch_model = model_id;
+    }
+
+    return library->scratch;
+}
+
+void check_model_library(const char* filename, grid_lm* lm) {
+#if PACKED_MODEL_CELLS
+    memory_tag previous_tag = set_memory_tag(MEMORY_LIBRARY);
+    arena_t arena;
+    arena_init(&arena, ARENA_ALIGN_UP((size_t) lm->buffer.rows * lm->buffer.cols * sizeof(packed_cell_t)) + ARENA_ALIGNMENT);
+
+    model_library_t library;
+    open_model_library(&library, filename, &arena);
+    assertf(library.header.num_models == lm->num_learnt_models && library.header.model_rows == lm->buffer.rows
+        && library.header.model_cols == lm->buffer.cols, "model library %s does not hold the learnt models", filename);
+
+    size_t model_bytes = (size_t) lm->buffer.rows * lm->buffer.cols * sizeof(packed_cell_t);
+    for(u32 m = 0; m < lm->num_learnt_models; ++m)
+        assertf(memcmp(model_library_get(&library, m), lm->learnt_models[m].data, model_bytes) == 0,
+            "model %u of model library %s does not decode to the learnt model", m, filename);
+
+    close_model_library(&library);
+    arena_free(&arena);
+    set_memory_tag(previous_tag);
+#else
+    assertf(0, "model libraries store packed cells (PACKED_MODEL_CELLS)");
+#endif
+}
+
+static u64 align_up_u64(u64 n, u64 alignment) {
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+// fwrite that remembers the first failure instead of aborting (mapped libraries are written for hosts)
+static void write_or_fail(FILE* f, const void* data, size_t size, size_t count, int* failed) {
+    if(*failed || count == 0) return;
+    if(fwrite(data, size, count, f) != count) *failed = 1;
+}
+
+// Zeroes up to offset
+static void write_padding(FILE* f, u64 offset, int* failed) {
+    static const u8 zeros[4096];
+
+    if(*failed) return;
+    u64 position = ftell(f);
+    assertf(position <= offset, "mapped library: section overlap");
+    while(position < offset && !*failed) {
+        u64 length = offset - position < sizeof(zeros) ? offset - position : sizeof(zeros);
+        write_or_fail(f, zeros, 1, length, failed);
+        position += length;
+    }
+}
+
+mapped_library_status write_mapped_library(const char* filename, grid_lm* lm, size_t* file_size) {
+    assertf(lm->finalized, "only finalized libraries can be mapped");
+    assertf(lm->library == NULL, "the models of an attached library are not in memory");
+
+    feature_index_t* index = &lm->index;
+
+    mapped_library_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAPPED_LIBRARY_MAGIC;
+    header.version = MAPPED_LIBRARY_VERSION;
+    header.cell_bytes = sizeof(model_cell_t);
+    header.page_size = sysconf(_SC_PAGESIZE);
+    header.model_rows = lm->buffer.rows;
+    header.model_cols = lm->buffer.cols;
+    header.num_models = lm->num_learnt_models;
+    header.num_slots = index->num_slots;
+    header.num_postings = index->num_postings;
+
+    u64 model_bytes = (u64) header.model_rows * header.model_cols * sizeof(model_cell_t);
+    header.model_stride = align_up_u64(model_bytes, header.page_size);
+    header.models_offset = align_up_u64(sizeof(header), header.page_size);
+    header.keys_offset = align_up_u64(header.models_offset + header.num_models * header.model_stride, ARENA_ALIGNMENT);
+    header.offsets_offset = align_up_u64(header.keys_offset + header.num_slots * sizeof(u64), ARENA_ALIGNMENT);
+    header.lengths_offset = align_up_u64(header.offsets_offset + header.num_slots * sizeof(u32), ARENA_ALIGNMENT);
+    header.model_ids_offset = align_up_u64(header.lengths_offset + header.num_slots * sizeof(u32), ARENA_ALIGNMENT);
+    header.cells_offset = align_up_u64(header.model_ids_offset + header.num_postings * sizeof(u32), ARENA_ALIGNMENT);
+    header.file_size = header.cells_offset + header.num_postings * sizeof(u32);
+
+    FILE* f = fopen(filename, "wb");
+    if(f == NULL) return MAPPED_LIBRARY_IO_ERROR;
+    setvbuf(f, NULL, _IOFBF, MODEL_LIBRARY_BUFFER_SIZE);
+
+    int failed = 0;
+    write_or_fail(f, &header, sizeof(header), 1, &failed);
+
+    for(u32 m = 0; m < header.num_models; ++m) {
+        object_model_mat* model = lm->learnt_models + m;
+        write_padding(f, header.models_offset + m * header.model_stride, &failed);
+        write_or_fail(f, model->data, sizeof(model_cell_t), (size_t) model->rows * model->cols, &failed);
+    }
+
+    write_padding(f, header.keys_offset, &failed);
+    write_or_fail(f, index->keys, sizeof(u64), header.num_slots, &failed);
+    write_padding(f, header.offsets_offset, &failed);
+    write_or_fail(f, index->offsets, sizeof(u32), header.num_slots, &failed);
+    write_padding(f, header.lengths_offset, &failed);
+    write_or_fail(f, index->lengths, sizeof(u32), header.num_slots, &failed);
+    if(header.num_postings > 0) {
+        write_padding(f, header.model_ids_offset, &failed);
+        write_or_fail(f, index->model_ids, sizeof(u32), header.num_postings, &failed);
+        write_padding(f, header.cells_offset, &failed);
+        write_or_fail(f, index->cells, sizeof(u32), header.num_postings, &failed);
+    }
+    write_padding(f, header.file_size, &failed);
+
+    // buffered writes only fail for good at the flush
+    if(fclose(f) != 0) failed = 1;
+    if(failed) {
+        remove(filename);
+        return MAPPED_LIBRARY_IO_ERROR;
+    }
+
+    if(file_size != NULL) *file_size = header.file_size;
+    return MAPPED_LIBRARY_OK;
+}
+
+// Every section of the header lies in the file, in order, and is as big as its counts say
+static int is_valid_layout(const mapped_library_header_t* h, u64 actual_size) {
+    u64 model_bytes = (u64) h->model_rows * h->model_cols * h->cell_bytes;
+    // bounded first, so that the sums below cannot wrap
+    return h->file_size <= actual_size
+        && h->models_offset <= h->file_size && h->keys_offset <= h->file_size && h->offsets_offset <= h->file_size
+        && h->lengths_offset <= h->file_size && h->model_ids_offset <= h->file_size && h->cells_offset <= h->file_size
+        && h->model_stride > 0 && h->num_models <= h->file_size / h->model_stride
+        && h->model_stride >= model_bytes && h->model_stride % h->page_size == 0
+        && h->models_offset >= sizeof(*h) && h->models_offset % h->page_size == 0
+        && (h->num_slots & (h->num_slots - 1)) == 0 && h->num_slots > 0
+        && h->keys_offset >= h->models_offset + h->num_models * h->model_stride
+        && h->offsets_offset >= h->keys_offset + h->num_slots * sizeof(u64)
+        && h->lengths_offset >= h->offsets_offset + h->num_slots * sizeof(u32)
+        && h->model_ids_offset >= h->lengths_offset + h->num_slots * sizeof(u32)
+        && h->cells_offset >= h->model_ids_offset + h->num_postings * sizeof(u32)
+        && h->file_size >= h->cells_offset + h->num_postings * sizeof(u32)
+        && h->keys_offset % ARENA_ALIGNMENT == 0 && h->offsets_offset % ARENA_ALIGNMENT == 0
+        && h->lengths_offset % ARENA_ALIGNMENT == 0 && h->model_ids_offset % ARENA_ALIGNMENT == 0
+        && h->cells_offset % ARENA_ALIGNMENT == 0;
+}
+
+mapped_library_status learning_module_map_library(grid_lm* lm, const char* filename) {
+    assertf(lm->num_learnt_models == 0 && !lm->finalized, "libraries are mapped into a fresh learning module");
+
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) return errno == ENOENT ? MAPPED_LIBRARY_NO_SUCH_FILE : MAPPED_LIBRARY_IO_ERROR;
+
+    mapped_library_header_t header;
+    struct stat st;
+    mapped_library_status status = MAPPED_LIBRARY_OK;
+    if(fstat(fd, &st) != 0) status = MAPPED_LIBRARY_IO_ERROR;
+    else if((u64) st.st_size < sizeof(header)) status = MAPPED_LIBRARY_INVALID;
+    else if(pread(fd, &header, sizeof(header), 0) != sizeof(header)) status = MAPPED_LIBRARY_IO_ERROR;
+    else if(header.magic != MAPPED_LIBRARY_MAGIC || header.version != MAPPED_LIBRARY_VERSION
+        || header.cell_bytes != sizeof(model_cell_t)
+        || header.page_size == 0 || header.page_size % sysconf(_SC_PAGESIZE) != 0
+        || header.model_rows != lm->buffer.rows || header.model_cols != lm->buffer.cols
+        || header.num_models > lm->max_learnt_models
+        || !is_valid_layout(&header, st.st_size))
+        status = MAPPED_LIBRARY_INVALID;
+
+    const u8* mapping = MAP_FAILED;
+    if(status == MAPPED_LIBRARY_OK) {
+        mapping = mmap(NULL, header.file_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(mapping == MAP_FAILED) status = MAPPED_LIBRARY_IO_ERROR;
+    }
+    close(fd);
+    if(status != MAPPED_LIBRARY_OK) return status;
+
+    lm->mapping = mapping;
+    lm->mapping_size = header.file_size;
+    lm->mapped_model_stride = header.model_stride;
+    lm->release_pruned = header.file_size > (u64) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+
+    // learnt_models only gets the per-model descriptors, nothing of the file is touched here
+    for(u32 m = 0; m < header.num_models; ++m) {
+        lm->learnt_models[m] = (object_model_mat) {
+            .rows = header.model_rows,
+            .cols = header.model_cols,
+            .data = (model_cell_t*) (mapping + header.models_offset + m * header.model_stride)
+        };
+    }
+    lm->num_learnt_models = header.num_models;
+    lm->oriented_models = NULL;
+
+    lm->index = (feature_index_t) {
+        .num_slots = header.num_slots,
+        .keys = (u64*) (mapping + header.keys_offset),
+        .offsets = (u32*) (mapping + header.offsets_offset),
+        .lengths = (u32*) (mapping + header.lengths_offset),
+        .num_postings = header.num_postings,
+        .model_ids = (u32*) (mapping + header.model_ids_offset),
+        .cells = (u32*) (mapping + header.cells_offset)
+    };
+
+    lm->finalized = 1;
+    return MAPPED_LIBRARY_OK;
+}
+
+void learning_module_unmap_library(grid_lm* lm) {
+    if(lm->mapping == NULL) return;
+
+    munmap((void*) lm->mapping, lm->mapping_size);
+    lm->mapping = NULL;
+    lm->num_learnt_models = 0;
+    lm->finalized = 0;
+}
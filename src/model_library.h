@@ -0,0 +1,140 @@
+#ifndef MODEL_LIBRARY_H
+#define MODEL_LIBRARY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "arena.h"
+#include "packed_cell.h"
+#include "learning_module.h"
+
+/**
+ * Compressed on-disk library of learnt models (packed cells only).
+ *
+ * Models are mostly empty cells, and neighbouring cells of an object see similar features, so every model is stored as
+ *      alternating runs: varint number of empty cells, varint number of non-empty cells, then those cells.
+ * A non-empty cell is its fields as zigzag varint deltas from the previous non-empty cell of the model
+ *      (count and flags as they are, the reserved bytes not at all): a few bytes instead of 32.
+ * Every model starts from a zeroed previous cell, so any model can be decoded on its own.
+ *
+ * File: model_library_header_t, u64 offsets[num_models + 1] (model m is bytes [offsets[m], offsets[m + 1])
+ *      after the offsets), then the models.
+ * A library is read through mmap: only the pages of the models that are actually decoded are read and cached,
+ *      and a model is decoded on demand into a scratch buffer that is reused from one model to the next.
+ */
+
+#define MODEL_LIBRARY_MAGIC 0x424c4254 // "TBLB"
+#define MODEL_LIBRARY_VERSION 2 // 2: cells keep every depth statistic and the point normal
+
+typedef struct model_library_header_t_ {
+    u32 magic;
+    u32 version;
+    u32 model_rows;
+    u32 model_cols;
+    u32 num_models;
+    u32 reserved;
+} model_library_header_t;
+
+// Writes the learnt models of lm. Returns the size of the file
+size_t write_model_library(const char* filename, grid_lm* lm);
+
+typedef struct model_library_t_ {
+    const u8* mapping;
+    size_t size;
+
+    model_library_header_t header;
+    const u64* offsets;
+    const u8* models;
+
+    packed_cell_t* scratch; // model_rows x model_cols
+    i64 scratch_model; // model in scratch, -1 if none
+} model_library_t;
+
+void open_model_library(model_library_t* library, const char* filename, arena_t* arena);
+void close_model_library(model_library_t* library);
+
+// Decodes the model into the library's scratch buffer, valid until another model is decoded
+const packed_cell_t* model_library_get(model_library_t* library, u32 model_id);
+
+/**
+ * Turns a freshly initialized lm (same model size, room for the models) into a finalized one that matches
+ *      against the library's models, decoded on demand: the library must stay open as long as the lm matches.
+ * The library's scratch then belongs to the lm: give every lm (thread) its own open library.
+ */
+void learning_module_attach_library(grid_lm* lm, model_library_t* library);
+
+// Reopens a written library and checks that every model decodes to lm's learnt model (aborts otherwise)
+void check_model_library(const char* filename, grid_lm* lm);
+
+/**
+ * Mapped libraries: a finalized library (the learnt models and the feature index) laid out so that a
+ *      learning module can match straight from a read-only shared mapping of the file, for libraries larger than RAM.
+ *
+ * Nothing is read at load time: a serving process starts at once, pages come in as matching touches them,
+ *      and every process mapping the same file shares one page cache copy.
+ * Models are stored once, in their learnt orientation: matching orients the cells it looks up (see grid_lm.oriented_models),
+ *      so the file costs about the raw learnt models plus the index, whatever the number of orientations matched.
+ * Every model starts on a page and spans model_stride bytes, so that matching can advise the kernel per model
+ *      (see grid_lm.mapping): the models of hypotheses seeded by the feature index are paged in ahead of matching,
+ *      and when the file is larger than half the RAM, models whose hypotheses were all pruned are advised out.
+ *
+ * File: mapped_library_header_t, then (page aligned) the learnt models, then the index arrays (64 bytes aligned,
+ *      at the offsets of the header). Cells are raw model_cell_t, so the file only suits builds with the same cell layout.
+ */
+
+#define MAPPED_LIBRARY_MAGIC 0x4d4c4254 // "TBLM"
+#define MAPPED_LIBRARY_VERSION 3 // 2: learnt models only, index over the learnt cells. 3: 32 bytes cells
+
+typedef struct mapped_library_header_t_ {
+    u32 magic;
+    u32 version;
+    u32 cell_bytes;
+    u32 page_size; // of the machine that wrote the file, models are aligned to it
+
+    u32 model_rows;
+    u32 model_cols;
+    u32 num_models;
+    u32 reserved;
+    u64 model_stride;
+
+    u32 num_slots;
+    u32 num_postings;
+
+    u64 models_offset;
+    u64 keys_offset;
+    u64 offsets_offset;
+    u64 lengths_offset;
+    u64 model_ids_offset;
+    u64 cells_offset;
+    u64 file_size;
+} mapped_library_header_t;
+
+// Mapped libraries are written and mapped on behalf of hosts (see tbtc.h): their errors are returned, not asserted
+typedef enum mapped_library_status_ {
+    MAPPED_LIBRARY_OK = 0,
+    MAPPED_LIBRARY_NO_SUCH_FILE,
+    MAPPED_LIBRARY_IO_ERROR, // the file could not be created, written, read or mapped
+    MAPPED_LIBRARY_INVALID // not a mapped library, or not one of this build and model size
+} mapped_library_status;
+
+/**
+ * lm must be finalized. A file that could not be written completely is removed.
+ *
+ * @param file_size set to the size of the file written, can be NULL
+ */
+mapped_library_status write_mapped_library(const char* filename, grid_lm* lm, size_t* file_size);
+
+/**
+ * Turns a freshly initialized lm (same model size, room for the models) into a finalized one
+ *      whose learnt models and feature index are the file's mapping. It matches in its own number of orientations.
+ * The header and the layout of the sections are checked against the file, the sections themselves are not read:
+ *      they are paged in as matching touches them.
+ *
+ * @returns the lm is untouched unless MAPPED_LIBRARY_OK
+ */
+mapped_library_status learning_module_map_library(grid_lm* lm, const char* filename);
+void learning_module_unmap_library(grid_lm* lm);
+
+#endif // MODEL_LIBRARY_H
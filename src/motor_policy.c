@@ -3,14 +3,15 @@
 #include "stdlib.h"
 #include "distributions.h"
 
-void init_random_motor_policy(random_motor_policy_t* policy, vec2d start_location, bounds_t bounds, u32 steps) {
-    policy->pregenerated_movements = calloc(steps, sizeof(*policy->pregenerated_movements));
-    policy->current_step = 0;
+void init_random_motor_policy(random_motor_policy_t* policy, vec2d start_location, bounds_t bounds, u32 steps, arena_t* arena) {
+    policy->pregenerated_movements = arena_alloc(arena, steps, sizeof(*policy->pregenerated_movements));
 
     reset_random_motor_policy(policy, start_location, bounds, steps);
 }
 
 void reset_random_motor_policy(random_motor_policy_t* policy, vec2d start_location, bounds_t bounds, u32 steps) {
+    policy->current_step = 0;
+
     vec2d last_location = { .x = start_location.x, .y = start_location.y };
     vec2d next_location;
     for(u32 i = 0; i < steps; ++i) {
@@ -21,8 +22,6 @@ void reset_random_motor_policy(random_motor_policy_t* policy, vec2d start_locati
         movement.x = next_location.x - last_location.x;
         movement.y = next_location.y - last_location.y;
 
-        printf("movement %u is (%d, %d) between (%d, %d) and (%d, %d)\n", i, movement.x, movement.y, last_location.x, last_location.y, next_location.x, next_location.y);
-
         policy->pregenerated_movements[i] = movement;
 
         last_location.x = next_location.x;
@@ -30,6 +29,33 @@ void reset_random_motor_policy(random_motor_policy_t* policy, vec2d start_locati
     }
 }
 
+/**
+ * @brief Pregenerates the movements of a raster scan of the bounds, starting from start_location.
+ * The scan wraps around the bounds, so that it never runs out of locations.
+ * It shares the pregenerated representation (and hence random_motor_policy) with the random policy.
+ */
+void reset_scan_motor_policy(random_motor_policy_t* policy, vec2d start_location, bounds_t bounds, u32 steps) {
+    policy->current_step = 0;
+
+    vec2d last_location = start_location;
+    vec2d next_location = start_location;
+    for(u32 i = 0; i < steps; ++i) {
+        next_location.y += 1;
+        if(next_location.y > (i32) bounds.max_y) {
+            next_location.y = bounds.min_y;
+            next_location.x += 1;
+        }
+        if(next_location.x > (i32) bounds.max_x) next_location.x = bounds.min_x;
+
+        policy->pregenerated_movements[i] = (vec2d) {
+            .x = next_location.x - last_location.x,
+            .y = next_location.y - last_location.y
+        };
+
+        last_location = next_location;
+    }
+}
+
 /**
  * @brief 
  * 
@@ -0,0 +1,188 @@
+#include "object_generator.h"
+
+#include "assertf.h"
+#include "data_manager.h"
+
+/**
+ * Parametric objects: the depth map is a sum of quadrics centered somewhere on the object
+ *      plane:  z = a.u + b.v
+ *      sphere: z = -k (u^2 + v^2) / 2  (a cap, bulging towards the sensor)
+ *      saddle: z = k (u^2 - v^2) / 2
+ *      ridge:  z = -k u^2 / 2          (a cylinder)
+ * with (u, v) the cell coordinates relative to the center and rotated by a random angle,
+ *      so that curvature directions are not always axis-aligned.
+ * Each object is generated from its own rng stream seeded with (seed, object_id).
+ */
+
+typedef struct quadric_t_ {
+    f32 center_x;
+    f32 center_y;
+    f32 cos_angle;
+    f32 sin_angle;
+    // z = a.u + b.v + (kuu.u^2 + kvv.v^2) / 2
+    f32 a;
+    f32 b;
+    f32 kuu;
+    f32 kvv;
+} quadric_t;
+
+void default_generator_config(generator_config_t* config, u32 rows, u32 cols) {
+    config->rows = rows;
+    config->cols = cols;
+
+    config->max_depth = 255;
+    config->max_curvature = 0.5f;
+    config->noise = 1;
+
+    config->num_labels = 40;
+    config->max_label_regions = 4;
+}
+
+static f32 random_curvature(rng_t* rng, generator_config_t* config) {
+    return rng_range_f32(rng, config->max_curvature / 4, config->max_curvature);
+}
+
+static quadric_t random_quadric(rng_t* rng, generator_config_t* config, object_shape shape) {
+    f32 angle = rng_range_f32(rng, 0, (f32) M_PI);
+
+    quadric_t q = {
+        .center_x = rng_range_f32(rng, 0, config->rows - 1),
+        .center_y = rng_range_f32(rng, 0, config->cols - 1),
+        .cos_angle = cosf(angle),
+        .sin_angle = sinf(angle),
+    };
+
+    // keep tilted planes within the depth range over the whole object
+    f32 max_slope = (f32) config->max_depth / (2.0f * (config->rows + config->cols));
+
+    switch(shape) {
+        case SHAPE_PLANE:
+            q.a = rng_range_f32(rng, -max_slope, max_slope);
+            q.b = rng_range_f32(rng, -max_slope, max_slope);
+            break;
+        case SHAPE_SPHERE:
+            q.kuu = q.kvv = -random_curvature(rng, config);
+            break;
+        case SHAPE_SADDLE:
+            q.kuu = random_curvature(rng, config);
+            q.kvv = -q.kuu;
+            break;
+        case SHAPE_RIDGE:
+            q.kuu = -random_curvature(rng, config);
+            break;
+        default:
+            assertf(0, "shape %d is not a primitive", shape);
+    }
+
+    return q;
+}
+
+static inline f32 evaluate_quadric(quadric_t* q, f32 x, f32 y) {
+    f32 dx = x - q->center_x;
+    f32 dy = y - q->center_y;
+
+    f32 u = q->cos_angle * dx + q->sin_angle * dy;
+    f32 v = -q->sin_angle * dx + q->cos_angle * dy;
+
+    return q->a * u + q->b * v + (q->kuu * u * u + q->kvv * v * v) / 2;
+}
+
+static void paint_labels(grid_t* object, rng_t* rng, generator_config_t* config) {
+    u32 num_regions = rng_range_u32(rng, 1, config->max_label_regions);
+
+    u32 seed_x[MAX_LABEL_REGIONS], seed_y[MAX_LABEL_REGIONS], label[MAX_LABEL_REGIONS];
+    for(u32 r = 0; r < num_regions; ++r) {
+        seed_x[r] = rng_range_u32(rng, 0, object->rows - 1);
+        seed_y[r] = rng_range_u32(rng, 0, object->cols - 1);
+        label[r] = LABEL_BASE + rng_range_u32(rng, 0, config->num_labels - 1);
+    }
+
+    for(u32 i = 0; i < object->rows; ++i) {
+        for(u32 j = 0; j < object->cols; ++j) {
+            u32 closest = 0;
+            i64 closest_distance = INT64_MAX;
+            for(u32 r = 0; r < num_regions; ++r) {
+                i64 dx = (i64) i - seed_x[r];
+                i64 dy = (i64) j - seed_y[r];
+                i64 distance = dx * dx + dy * dy;
+                if(distance < closest_distance) {
+                    closest_distance = distance;
+                    closest = r;
+                }
+            }
+            MAT(object->values, i, j) = label[closest];
+        }
+    }
+}
+
+/**
+ * @brief Fills a pre-allocated grid (of shape (config->rows, config->cols)) with a random parametric object
+ *
+ * @returns the shape that was drawn
+ */
+object_shape generate_object(grid_t* object, generator_config_t* config, u64 seed, u32 object_id) {
+    assertf(object->rows == config->rows && object->cols == config->cols, "object not allocated with the generator's shape");
+    assertf(config->max_depth <= 255, "depths are u8");
+    assertf(config->max_label_regions >= 1 && config->max_label_regions <= MAX_LABEL_REGIONS,
+        "max_label_regions must be in [1, %d]", MAX_LABEL_REGIONS);
+
+    rng_t rng;
+    rng_seed(&rng, seed ^ ((u64) object_id * 0xd1b54a32d192ed03ULL));
+
+    object_shape shape = rng_range_u32(&rng, 0, NUM_OBJECT_SHAPES - 1);
+
+    quadric_t components[3];
+    u32 num_components = 1;
+    if(shape == SHAPE_COMPOSITE) {
+        num_components = rng_range_u32(&rng, 2, 3);
+        for(u32 c = 0; c < num_components; ++c)
+            components[c] = random_quadric(&rng, config, rng_range_u32(&rng, SHAPE_PLANE, SHAPE_RIDGE));
+    } else {
+        components[0] = random_quadric(&rng, config, shape);
+    }
+
+    f32 base_depth = config->max_depth / 2.0f;
+    for(u32 i = 0; i < object->rows; ++i) {
+        for(u32 j = 0; j < object->cols; ++j) {
+            f32 z = base_depth;
+            for(u32 c = 0; c < num_components; ++c)
+                z += evaluate_quadric(components + c, i, j);
+
+            i32 depth = (i32) lrintf(z);
+            if(config->noise > 0)
+                depth += (i32) rng_range_u32(&rng, 0, 2 * config->noise) - (i32) config->noise;
+
+            if(depth < 0) depth = 0;
+            if(depth > (i32) config->max_depth) depth = config->max_depth;
+
+            MAT(object->depths, i, j) = depth;
+        }
+    }
+
+    paint_labels(object, &rng, config);
+
+    return shape;
+}
+
+void generate_object_dataset(const char* filename, generator_config_t* config, u64 seed, u32 num_objects) {
+    memory_tag previous_tag = set_memory_tag(MEMORY_DATASET);
+
+    arena_t arena;
+    arena_init(&arena, ARENA_ALIGN_UP((size_t) config->rows * config->cols * sizeof(u8))
+        + ARENA_ALIGN_UP((size_t) config->rows * config->cols * sizeof(u32)));
+
+    grid_t object;
+    init_grid_env(&object, config->rows, config->cols, &arena);
+
+    FILE* f = open_object_dataset_writer(filename, num_objects, config->rows, config->cols);
+
+    for(u32 o = 0; o < num_objects; ++o) {
+        generate_object(&object, config, seed, o);
+        write_object(f, &object);
+    }
+
+    fclose(f);
+
+    arena_free(&arena);
+    set_memory_tag(previous_tag);
+}
@@ -0,0 +1,46 @@
+#ifndef OBJECT_GENERATOR_H
+#define OBJECT_GENERATOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "math.h"
+
+#include "types.h"
+#include "grid_environment.h"
+#include "distributions.h"
+
+typedef enum object_shape_ {
+    SHAPE_PLANE,
+    SHAPE_SPHERE,
+    SHAPE_SADDLE,
+    SHAPE_RIDGE,
+    SHAPE_COMPOSITE, // sum of two or three of the primitives above
+    NUM_OBJECT_SHAPES
+} object_shape;
+
+typedef struct generator_config_t_ {
+    u32 rows;
+    u32 cols;
+
+    u32 max_depth; // depths are clamped to [0, max_depth], at most 255
+    f32 max_curvature; // |k| in depth units per cell^2, drawn uniformly in [max_curvature / 4, max_curvature]
+    u32 noise; // uniform depth noise in [-noise, noise]
+
+    u32 num_labels; // values (feature labels) are drawn in [LABEL_BASE, LABEL_BASE + num_labels)
+    u32 max_label_regions; // labels are painted as a Voronoi partition of up to that many regions
+} generator_config_t;
+
+#define LABEL_BASE 10
+#define MAX_LABEL_REGIONS 8
+
+void default_generator_config(generator_config_t* config, u32 rows, u32 cols);
+
+// Deterministic in (seed, object_id): any object can be regenerated on its own
+object_shape generate_object(grid_t* object, generator_config_t* config, u64 seed, u32 object_id);
+
+// Streams num_objects objects to a data_manager object dataset, with a single object in memory at a time
+void generate_object_dataset(const char* filename, generator_config_t* config, u64 seed, u32 num_objects);
+
+#endif
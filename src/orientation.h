@@ -0,0 +1,70 @@
+#ifndef ORIENTATION_H
+#define ORIENTATION_H
+
+#include "types.h"
+#include "location.h"
+#include "interfaces.h"
+
+/**
+ * The 8 orientations of a grid (dihedral group of the square):
+ *      orientation o is (o & 3) quarter turns followed by a mirror when (o & 4).
+ *
+ * Locations are (x, y) = (row, col) in a grid of size (size.x, size.y), as in extract_patch.
+ * Pose vectors are computed by the sensor with x along the patch columns and y along its rows,
+ *      so they are swapped before and after being oriented.
+ */
+
+#define NUM_ORIENTATIONS 8
+
+inline static vec2d oriented_size(vec2d size, u32 o) {
+    return (o & 1) ? (vec2d) {.x = size.y, .y = size.x} : size;
+}
+
+inline static vec2d orient_location(vec2d l, vec2d size, u32 o) {
+    for(u32 t = 0; t < (o & 3); ++t) {
+        l = (vec2d) {.x = size.y - 1 - l.y, .y = l.x};
+        size = (vec2d) {.x = size.y, .y = size.x};
+    }
+    if(o & 4) l.y = size.y - 1 - l.y;
+
+    return l;
+}
+
+// Inverse of orient_location: where the location l of the oriented grid comes from in the grid of size size
+inline static vec2d unorient_location(vec2d l, vec2d size, u32 o) {
+    vec2d oriented = oriented_size(size, o);
+    if(o & 4) l.y = oriented.y - 1 - l.y;
+    for(u32 t = 0; t < (o & 3); ++t) {
+        l = (vec2d) {.x = l.y, .y = oriented.x - 1 - l.x};
+        oriented = (vec2d) {.x = oriented.y, .y = oriented.x};
+    }
+
+    return l;
+}
+
+inline static vec2d orient_direction(vec2d d, u32 o) {
+    for(u32 t = 0; t < (o & 3); ++t)
+        d = (vec2d) {.x = -d.y, .y = d.x};
+    if(o & 4) d.y = -d.y;
+
+    return d;
+}
+
+inline static vec3d orient_pose_vector(vec3d v, u32 o) {
+    vec2d d = orient_direction((vec2d) {.x = v.y, .y = v.x}, o);
+    return (vec3d) {.x = d.y, .y = d.x, .z = v.z};
+}
+
+/**
+ * @brief Same as get_direction_angle(orient_pose_vector(d, o)) on the quantized angle of d.
+ * In pose coordinates a quarter turn maps (x, y) to (y, -x), a quarter of a turn back, i.e. half a turn of the axis angle
+ *      (which is the doubled angle), and the mirror maps (x, y) to (-x, y), which negates the angle
+ */
+inline static u8 orient_direction_angle(u8 angle, u32 o) {
+    u32 a = angle + (DIRECTION_ANGLE_BINS / 2) * (o & 3);
+    if(o & 4) a = DIRECTION_ANGLE_BINS - a;
+
+    return a & (DIRECTION_ANGLE_BINS - 1);
+}
+
+#endif
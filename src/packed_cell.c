@@ -0,0 +1,73 @@
+#include "packed_cell.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "orientation.h"
+
+void encode_packed_cell(packed_cell_t* cell, u32 count, features_t features, pose_t pose) {
+    cell->value = features.value;
+    cell->count = count > UINT16_MAX ? UINT16_MAX : count;
+
+    cell->mean_depth = features.mean_depth;
+    cell->min_depth = features.min_depth;
+    cell->max_depth = features.max_depth;
+    cell->median_depth = features.median_depth;
+    cell->p10_depth = features.p10_depth;
+    cell->p90_depth = features.p90_depth;
+
+    cell->curvature_1 = clamp_i8(features.principal_curvature_1_fp >> CURVATURE_FRACTIONAL_BITS);
+    cell->curvature_2 = clamp_i8(features.principal_curvature_2_fp >> CURVATURE_FRACTIONAL_BITS);
+
+    cell->normal_x = clamp_i8(pose.point_normal.x);
+    cell->normal_y = clamp_i8(pose.point_normal.y);
+    cell->direction_1_angle = pose.curvature_direction_1_angle;
+
+    cell->flags = pose.pose_fully_defined ? PACKED_CELL_POSE_FULLY_DEFINED : 0;
+    memset(cell->reserved, 0, sizeof(cell->reserved));
+}
+
+void decode_packed_features(const packed_cell_t* cell, features_t* features) {
+    features->value = cell->value;
+
+    features->min_depth = cell->min_depth;
+    features->max_depth = cell->max_depth;
+    features->mean_depth = cell->mean_depth;
+    features->median_depth = cell->median_depth;
+    features->p10_depth = cell->p10_depth;
+    features->p90_depth = cell->p90_depth;
+
+    features->principal_curvature_1_fp = (i32) cell->curvature_1 * (1 << CURVATURE_FRACTIONAL_BITS);
+    features->principal_curvature_2_fp = (i32) cell->curvature_2 * (1 << CURVATURE_FRACTIONAL_BITS);
+
+    features->pose_fully_defined = (cell->flags & PACKED_CELL_POSE_FULLY_DEFINED) != 0;
+}
+
+void decode_packed_pose(const packed_cell_t* cell, pose_t* pose) {
+    pose->point_normal = (vec3d) {.x = cell->normal_x, .y = cell->normal_y, .z = 2};
+
+    // the angle is the axis' over a half turn
+    f64 theta = M_PI * cell->direction_1_angle / DIRECTION_ANGLE_BINS;
+    i32 x = (i32) lround(PACKED_DIRECTION_LENGTH * cos(theta));
+    i32 y = (i32) lround(PACKED_DIRECTION_LENGTH * sin(theta));
+
+    pose->curvature_direction_1 = (vec3d) {.x = x, .y = y, .z = 0};
+    pose->curvature_direction_2 = (vec3d) {.x = -y, .y = x, .z = 0};
+    pose->curvature_direction_1_angle = cell->direction_1_angle;
+    pose->curvature_direction_2_angle = (cell->direction_1_angle + DIRECTION_ANGLE_BINS / 2) & (DIRECTION_ANGLE_BINS - 1);
+
+    pose->pose_fully_defined = (cell->flags & PACKED_CELL_POSE_FULLY_DEFINED) != 0;
+}
+
+void packed_cell_add_count(packed_cell_t* cell, u32 count) {
+    u32 total = cell->count + count;
+    cell->count = total > UINT16_MAX ? UINT16_MAX : total;
+}
+
+void orient_packed_cell(packed_cell_t* cell, u32 orientation) {
+    vec3d normal = orient_pose_vector((vec3d) {.x = cell->normal_x, .y = cell->normal_y, .z = 2}, orientation);
+    cell->normal_x = clamp_i8(normal.x);
+    cell->normal_y = clamp_i8(normal.y);
+
+    cell->direction_1_angle = orient_direction_angle(cell->direction_1_angle, orientation);
+}
@@ -0,0 +1,60 @@
+#ifndef PACKED_CELL_H
+#define PACKED_CELL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "interfaces.h"
+
+/**
+ * 32 bytes record of an observation stored in an object model cell (2 per cache line, vs ~88 bytes unpacked).
+ *
+ * It keeps exactly what matching and the feature index look at:
+ *      value, mean depth and the integer parts of the curvatures (see features_distance and feature_key)
+ *      and the quantized angle of the first curvature direction (see poses_agree).
+ * Plus every depth statistic, u16 as in features_t, and the point normal, clamped to i8.
+ *
+ * What is lost: the curvatures' fractional bits, the normal's components past the i8 range (u16 depths can steepen it),
+ *      the magnitude (and z) of the curvature directions (decoded as unit-ish vectors from the angle)
+ *      and the location (implied by the cell).
+ */
+typedef struct packed_cell_t_ {
+    u32 value;
+    u16 count; // saturates at UINT16_MAX
+    u16 mean_depth;
+    u16 min_depth;
+    u16 max_depth;
+    u16 median_depth;
+    u16 p10_depth;
+    u16 p90_depth;
+    i8 curvature_1; // principal curvatures, integer part, clamped to i8
+    i8 curvature_2;
+    i8 normal_x; // point normal (x, y, 2), clamped to i8
+    i8 normal_y;
+    u8 direction_1_angle; // in [0, DIRECTION_ANGLE_BINS), direction 2 is orthogonal
+    u8 flags;
+    u8 reserved[8]; // zero, pads a cell to half a cache line
+} packed_cell_t;
+
+_Static_assert(sizeof(packed_cell_t) == 32, "packed_cell_t must stay 32 bytes");
+
+#define PACKED_CELL_POSE_FULLY_DEFINED 1
+
+// Decoded directions are that long
+#define PACKED_DIRECTION_LENGTH 64
+
+static inline i8 clamp_i8(i32 v) {
+    return v < INT8_MIN ? INT8_MIN : (v > INT8_MAX ? INT8_MAX : v);
+}
+
+void encode_packed_cell(packed_cell_t* cell, u32 count, features_t features, pose_t pose);
+void decode_packed_features(const packed_cell_t* cell, features_t* features);
+void decode_packed_pose(const packed_cell_t* cell, pose_t* pose);
+
+// Adds count to the cell's count, saturating
+void packed_cell_add_count(packed_cell_t* cell, u32 count);
+// Moves the cell's pose into one of the NUM_ORIENTATIONS orientations (see orientation.h)
+void orient_packed_cell(packed_cell_t* cell, u32 orientation);
+
+#endif // PACKED_CELL_H
@@ -0,0 +1,21 @@
+#ifndef SATURATED_H
+#define SATURATED_H
+
+#include <stdint.h>
+
+#include "types.h"
+
+/**
+ * Saturating u8 arithmetic, for permanences (spatial pooler, temporal memory):
+ *      learning pushes them against 0 and UINT8_MAX, where they stay instead of wrapping around.
+ */
+
+static inline u8 saturated_add(u8 a, u8 b) {
+    return a > UINT8_MAX - b ? UINT8_MAX : a + b;
+}
+
+static inline u8 saturated_sub(u8 a, u8 b) {
+    return a < b ? 0 : a - b;
+}
+
+#endif // SATURATED_H
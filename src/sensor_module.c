@@ -1,193 +1,480 @@
 #include "sensor_module.h"
 
+#include <string.h>
+
 #include "assertf.h"
+#include "algorithms.h"
+
+static i32 min_i32(i32 a, i32 b) { return a < b ? a : b; }
+static i32 max_i32(i32 a, i32 b) { return a > b ? a : b; }
+static u32 min_u32(u32 a, u32 b) { return a < b ? a : b; }
+static u32 max_u32(u32 a, u32 b) { return a > b ? a : b; }
+
+/**
+ * @brief min/max/percentiles all come from a single selection over the patch, mean from a plain reduction
+ */
+#define INSTANTIATE_GET_DEPTH_STATISTICS(symbol) \
+    static void get_depth_statistics_##symbol(features_t* features, MAT_TYPE(symbol) depths) { \
+        features->mean_depth = mat_##symbol##_mean(depths); \
+        \
+        if(DEPTH_PERCENTILE_FEATURES) { \
+            u32 length = depths.rows * depths.cols; \
+            u32 ranks[5] = { \
+                0, \
+                percentile_rank(10, length), \
+                percentile_rank(50, length), \
+                percentile_rank(90, length), \
+                length - 1 \
+            }; \
+            DATA_TYPE(symbol) selected[5]; \
+            select_many_##symbol(selected, depths.data, length, ranks, 5); \
+            \
+            features->min_depth = selected[0]; \
+            features->p10_depth = selected[1]; \
+            features->median_depth = selected[2]; \
+            features->p90_depth = selected[3]; \
+            features->max_depth = selected[4]; \
+        } else { \
+            features->min_depth = mat_##symbol##_min(depths); \
+            features->max_depth = mat_##symbol##_max(depths); \
+            features->p10_depth = 0; \
+            features->median_depth = 0; \
+            features->p90_depth = 0; \
+        } \
+    }
+
+INSTANTIATE_GET_DEPTH_STATISTICS(u16)
+INSTANTIATE_GET_DEPTH_STATISTICS(u8)
 
 /**
  * @brief Get features and pose from the patch observed
- * 
- * @param features 
- * @param poses 
- * @param patch 
- * @param location 
+ *
+ * @param features
+ * @param poses
+ * @param patch
+ * @param location
  */
-void sensor_module(features_t* features, pose_t* pose, grid_t patch, vec2d location) {
-    // -- Pose --
-    vec3d point_normal;
-    get_point_normal_u8(&point_normal, patch.depths, location);
-
-    i32 k1_fp, k2_fp;
-    vec3d dir1, dir2;
-    get_principal_curvatures_u8(&k1_fp, &k2_fp, &dir1, &dir2, patch.depths, location);
-
-    pose->point_normal = point_normal;
-    pose->curvature_direction_1 = dir1;
-    pose->curvature_direction_2 = dir2;
-    pose->pose_fully_defined = (u32) abs((i32) k1_fp - (i32) k2_fp) > PC1_IS_PC2_THRESHOLD_FP;
-
-    // -- Features --
-    features->value = MAT(patch.values, location.x, location.y);
-    features->principal_curvature_1_fp = k1_fp;
-    features->principal_curvature_2_fp = k2_fp;
-
-    features->min_depth = mat_u8_min(patch.depths);
-    features->max_depth = mat_u8_max(patch.depths);
-    features->mean_depth = mat_u8_mean(patch.depths);
-
-    features->pose_fully_defined = pose->pose_fully_defined;
+#define INSTANTIATE_SENSOR_MODULE(name, grid_type, symbol) \
+    void name(features_t* features, pose_t* pose, grid_type patch, vec2d location) { \
+        /* -- Pose -- */ \
+        vec3d point_normal; \
+        get_point_normal_##symbol(&point_normal, patch.depths, location); \
+        \
+        i32 k1_fp, k2_fp; \
+        vec3d dir1, dir2; \
+        get_principal_curvatures_##symbol(&k1_fp, &k2_fp, &dir1, &dir2, patch.depths, location); \
+        \
+        pose->point_normal = point_normal; \
+        pose->curvature_direction_1 = dir1; \
+        pose->curvature_direction_2 = dir2; \
+        pose->curvature_direction_1_angle = get_direction_angle(dir1); \
+        pose->curvature_direction_2_angle = get_direction_angle(dir2); \
+        pose->pose_fully_defined = (u32) abs((i32) k1_fp - (i32) k2_fp) > PC1_IS_PC2_THRESHOLD_FP; \
+        \
+        /* -- Features -- */ \
+        features->value = MAT(patch.values, location.x, location.y); \
+        features->principal_curvature_1_fp = k1_fp; \
+        features->principal_curvature_2_fp = k2_fp; \
+        \
+        get_depth_statistics_##symbol(features, patch.depths); \
+        \
+        features->pose_fully_defined = pose->pose_fully_defined; \
+    }
+
+INSTANTIATE_SENSOR_MODULE(sensor_module, grid_t, u8)
+INSTANTIATE_SENSOR_MODULE(sensor_module_u16, grid_u16_t, u16)
+
+void init_sensor_array(sensor_array_t* sensors, u32 num_sensors, u32 spacing, u32 sidelen) {
+    assertf(num_sensors >= 1 && num_sensors <= MAX_SENSORS, "between 1 and %d sensors", MAX_SENSORS);
+    assertf(sidelen % 2 != 0, "patch cannot be of even sidelength");
+
+    sensors->num_sensors = num_sensors;
+    for(u32 s = 0; s < num_sensors; ++s) {
+        sensors->offsets[s] = vec_multiplied_u32(LAYOUT_OFFSETS[s], spacing);
+        sensors->sidelens[s] = sidelen;
+    }
+}
+
+u32 sensor_array_reach(const sensor_array_t* sensors) {
+    u32 reach = 0;
+    for(u32 s = 0; s < sensors->num_sensors; ++s) {
+        u32 radius = sensors->sidelens[s] / 2;
+        reach = max_u32(reach, abs(sensors->offsets[s].x) + radius);
+        reach = max_u32(reach, abs(sensors->offsets[s].y) + radius);
+    }
+    return reach;
+}
+
+static u32 rect_area(grid_rect_t r) {
+    if(r.row_max <= r.row_min || r.col_max <= r.col_min) return 0;
+    return (r.row_max - r.row_min) * (r.col_max - r.col_min);
+}
+
+static u32 rect_overlap_area(grid_rect_t a, grid_rect_t b) {
+    grid_rect_t overlap = {
+        .row_min = max_i32(a.row_min, b.row_min), .row_max = min_i32(a.row_max, b.row_max),
+        .col_min = max_i32(a.col_min, b.col_min), .col_max = min_i32(a.col_max, b.col_max)
+    };
+    return rect_area(overlap);
 }
 
 /**
- * @brief Get the point normal object
- * 
- * @param point_normal 
- * @param depths 
- * @param loc Assumed to be not on the edge of 'depths'!
+ * @brief Adds (sign = 1) or removes (sign = -1) the depths of a rectangle to a histogram and its sum
+ */
+static void histogram_rect_u8(u32* histogram, u32* sum, mat_u8 depths, grid_rect_t r, i32 sign) {
+    for(i32 row = r.row_min; row < r.row_max; ++row) {
+        u8* depth_row = depths.data + row * depths.cols;
+        for(i32 col = r.col_min; col < r.col_max; ++col) {
+            histogram[depth_row[col]] += sign;
+            *sum += sign * depth_row[col];
+        }
+    }
+}
+
+/**
+ * @brief Applies to a histogram the pixels in a but not in b, with the given sign.
+ * a \ b is split in (at most) 4 bands: above, below, then left and right within the rows of the overlap
  */
-void get_point_normal_u8(vec3d* point_normal, mat_u8 depths, vec2d location) {
-    if(depths.rows <= 1) {
-        point_normal->x = 0;
-        point_normal->y = 0;
-        point_normal->z = 2; // Default "up" is scaled up by two to keep consistant with normal case
-        return;
+static void histogram_rect_difference_u8(u32* histogram, u32* sum, mat_u8 depths, grid_rect_t a, grid_rect_t b, i32 sign) {
+    i32 top = max_i32(a.row_min, min_i32(b.row_min, a.row_max));
+    i32 bottom = min_i32(a.row_max, max_i32(b.row_max, a.row_min));
+    i32 left = max_i32(a.col_min, min_i32(b.col_min, a.col_max));
+    i32 right = min_i32(a.col_max, max_i32(b.col_max, a.col_min));
+
+    histogram_rect_u8(histogram, sum, depths, (grid_rect_t) {a.row_min, top, a.col_min, a.col_max}, sign);
+    histogram_rect_u8(histogram, sum, depths, (grid_rect_t) {bottom, a.row_max, a.col_min, a.col_max}, sign);
+    if(top < bottom) {
+        histogram_rect_u8(histogram, sum, depths, (grid_rect_t) {top, bottom, a.col_min, left}, sign);
+        histogram_rect_u8(histogram, sum, depths, (grid_rect_t) {top, bottom, right, a.col_max}, sign);
     }
+}
 
-    u32 x = location.x;
-    u32 y = location.y;
+/**
+ * @brief Copies the (at most 3x3) neighbourhood the pose is computed from, so that pose and curvatures
+ *      can be computed by the single patch functions without extracting the whole patch
+ */
+#define INSTANTIATE_SENSE_POSE(symbol) \
+    static void sense_pose_##symbol(features_t* features, pose_t* pose, MAT_TYPE(symbol) depths, vec2d center, u32 sidelen) { \
+        u32 n = min_u32(sidelen, 3); \
+        DATA_TYPE(symbol) data[9]; \
+        MAT_TYPE(symbol) neighbourhood = {.rows = n, .cols = n, .data = data}; \
+        for(u32 i = 0; i < n; ++i) \
+            for(u32 j = 0; j < n; ++j) \
+                MAT(neighbourhood, i, j) = MAT(depths, center.x - n / 2 + i, center.y - n / 2 + j); \
+        \
+        vec2d location = {.x = n / 2, .y = n / 2}; \
+        \
+        get_point_normal_##symbol(&pose->point_normal, neighbourhood, location); \
+        \
+        i32 k1_fp, k2_fp; \
+        get_principal_curvatures_##symbol(&k1_fp, &k2_fp, &pose->curvature_direction_1, &pose->curvature_direction_2, \
+            neighbourhood, location); \
+        pose->curvature_direction_1_angle = get_direction_angle(pose->curvature_direction_1); \
+        pose->curvature_direction_2_angle = get_direction_angle(pose->curvature_direction_2); \
+        pose->pose_fully_defined = (u32) abs((i32) k1_fp - (i32) k2_fp) > PC1_IS_PC2_THRESHOLD_FP; \
+        \
+        features->principal_curvature_1_fp = k1_fp; \
+        features->principal_curvature_2_fp = k2_fp; \
+        features->pose_fully_defined = pose->pose_fully_defined; \
+    }
 
-    assertf(x != 0 && x < depths.cols - 1 && y != 0 && y < depths.rows - 1,
-        "Location cannot be on the edge of depths");
+INSTANTIATE_SENSE_POSE(u8)
+INSTANTIATE_SENSE_POSE(u16)
 
-    // The partial derivatives dz/dx and dz/dy are approximated by finite differences.
-    // dz_dx = (depth(x+1) - depth(x-1)) / 2
-    // dz_dy = (depth(y+1) - depth(y-1)) / 2
-    // The normal vector is (-dz/dx, -dz/dy, 1).
-    // To keep it integer, we can use a scaled normal (-2*dz/dx, -2*dz/dy, 2).
-    
-    i32 delta_x = (i32) MAT(depths, y, x + 1) - (i32) MAT(depths, y, x - 1);
-    i32 delta_y = (i32) MAT(depths, y + 1, x) - (i32) MAT(depths, y - 1, x);
+static void depth_statistics_from_histogram(features_t* features, u32* histogram, u32 sum, u32 length) {
+    features->mean_depth = sum / length;
 
-    point_normal->x = -delta_x;
-    point_normal->y = -delta_y;
-    point_normal->z = 2;
+#if DEPTH_PERCENTILE_FEATURES
+    u32 ranks[5] = {
+        0,
+        percentile_rank(10, length),
+        percentile_rank(50, length),
+        percentile_rank(90, length),
+        length - 1
+    };
+    u8 selected[5];
+    histogram_ranks_u8(selected, histogram, ranks, 5);
+
+    features->min_depth = selected[0];
+    features->p10_depth = selected[1];
+    features->median_depth = selected[2];
+    features->p90_depth = selected[3];
+    features->max_depth = selected[4];
+#else
+    u32 b = 0;
+    while(histogram[b] == 0) ++b;
+    features->min_depth = b;
+    b = HISTOGRAM_BINS - 1;
+    while(histogram[b] == 0) --b;
+    features->max_depth = b;
+    features->p10_depth = 0;
+    features->median_depth = 0;
+    features->p90_depth = 0;
+#endif
 }
 
 /**
- * @brief Computes the integer square root of a 32-bit unsigned integer.
- * @param n The number to find the square root of.
- * @return The floor of the square root of n.
+ * @brief Senses all the patches of the array around location.
+ *
+ * Nothing is extracted: values and poses only need the center and its 3x3 neighbourhood,
+ *      and the depth statistics come from a histogram per sensor, read in place from env.
+ * Overlapping sensors share their loads: a sensor's histogram starts from the histogram of an already
+ *      sensed one, fixed up with the pixels in one patch but not in the other, whenever that is fewer pixels
+ *      than its whole patch. Neighbouring sensors (spacing < sidelen) only read the strip that differs.
+ * Small patches go through select_many_u8, like the single sensor path.
+ *
+ * @param features one per sensor
+ * @param poses one per sensor
+ * @param location of the agent, in env
  */
-static u32 isqrt32(u32 n) {
-    if (n == 0) return 0;
-    u32 root = 0;
-    // The second-to-top bit of a 32-bit number
-    u32 bit = (1UL << 30); 
-    while (bit > n) {
-        bit >>= 2;
-    }
-    while (bit != 0) {
-        if (n >= root + bit) {
-            n -= root + bit;
-            root = (root >> 1) + bit;
+void sensor_module_batch(features_t* features, pose_t* poses, grid_t* env, vec2d location, const sensor_array_t* sensors) {
+    u32 histograms[MAX_SENSORS][HISTOGRAM_BINS];
+    u32 sums[MAX_SENSORS];
+    grid_rect_t rects[MAX_SENSORS];
+    int has_histogram[MAX_SENSORS] = {0};
+
+    for(u32 s = 0; s < sensors->num_sensors; ++s) {
+        vec2d center = vec_added(location, sensors->offsets[s]);
+        u32 sidelen = sensors->sidelens[s];
+        i32 radius = sidelen / 2;
+
+        grid_rect_t rect = {
+            .row_min = center.x - radius, .row_max = center.x + radius + 1,
+            .col_min = center.y - radius, .col_max = center.y + radius + 1
+        };
+        assertf(rect.row_min >= 0 && rect.col_min >= 0 && rect.row_max <= (i32) env->rows && rect.col_max <= (i32) env->cols,
+            "sensor %u at (%d, %d) does not fit in the environment", s, center.x, center.y);
+        rects[s] = rect;
+
+        features[s].value = MAT(env->values, center.x, center.y);
+        sense_pose_u8(features + s, poses + s, env->depths, center, sidelen);
+
+        u32 length = sidelen * sidelen;
+        if(length <= SMALL_SELECTION_LENGTH) {
+            u8 data[SMALL_SELECTION_LENGTH];
+            mat_u8 patch = {.rows = sidelen, .cols = sidelen, .data = data};
+            for(u32 i = 0; i < sidelen; ++i)
+                for(u32 j = 0; j < sidelen; ++j)
+                    MAT(patch, i, j) = MAT(env->depths, rect.row_min + i, rect.col_min + j);
+
+            get_depth_statistics_u8(features + s, patch);
+            continue;
+        }
+
+        // Cheapest starting point: an empty histogram (length loads) or an already sensed patch
+        u32 best_cost = length;
+        i32 base = -1;
+        for(u32 o = 0; o < s; ++o) {
+            if(!has_histogram[o]) continue;
+
+            u32 overlap = rect_overlap_area(rect, rects[o]);
+            u32 cost = (length - overlap) + (rect_area(rects[o]) - overlap);
+            if(cost < best_cost) {
+                best_cost = cost;
+                base = o;
+            }
+        }
+
+        if(base < 0) {
+            memset(histograms[s], 0, sizeof(histograms[s]));
+            sums[s] = 0;
+            histogram_rect_u8(histograms[s], sums + s, env->depths, rect, 1);
         } else {
-            root >>= 1;
+            memcpy(histograms[s], histograms[base], sizeof(histograms[s]));
+            sums[s] = sums[base];
+            histogram_rect_difference_u8(histograms[s], sums + s, env->depths, rects[base], rect, -1);
+            histogram_rect_difference_u8(histograms[s], sums + s, env->depths, rect, rects[base], 1);
         }
-        bit >>= 2;
+        has_histogram[s] = 1;
+
+        depth_statistics_from_histogram(features + s, histograms[s], sums[s], length);
     }
-    return root;
 }
 
 /**
- * @brief Computes un-normalized principal curvature directions for a u8 depth matrix.
- * Intermediate calculations are done with s32 to guarantee no overflow.
+ * @brief sensor_module_batch on 16 bits depths. A histogram per sensor would be 65536 bins:
+ *      every patch is copied to scratch instead, for the same selection as sensor_module_u16
+ *
+ * @param scratch room for the largest patch of the array
+ */
+void sensor_module_batch_u16(features_t* features, pose_t* poses, grid_u16_t* env, vec2d location, const sensor_array_t* sensors,
+    u16* scratch) {
+    for(u32 s = 0; s < sensors->num_sensors; ++s) {
+        vec2d center = vec_added(location, sensors->offsets[s]);
+        u32 sidelen = sensors->sidelens[s];
+        i32 radius = sidelen / 2;
+
+        i32 row_min = center.x - radius, col_min = center.y - radius;
+        assertf(row_min >= 0 && col_min >= 0 && row_min + sidelen <= env->rows && col_min + sidelen <= env->cols,
+            "sensor %u at (%d, %d) does not fit in the environment", s, center.x, center.y);
+
+        features[s].value = MAT(env->values, center.x, center.y);
+        sense_pose_u16(features + s, poses + s, env->depths, center, sidelen);
+
+        mat_u16 patch = {.rows = sidelen, .cols = sidelen, .data = scratch};
+        for(u32 i = 0; i < sidelen; ++i)
+            for(u32 j = 0; j < sidelen; ++j)
+                MAT(patch, i, j) = MAT(env->depths, row_min + i, col_min + j);
+
+        get_depth_statistics_u16(features + s, patch);
+    }
+}
+
+/**
+ * @brief Get the point normal object
+ *
+ * @param point_normal
+ * @param depths
+ * @param loc Assumed to be not on the edge of 'depths'!
+ */
+#define INSTANTIATE_GET_POINT_NORMAL(symbol) \
+    void get_point_normal_##symbol(vec3d* point_normal, MAT_TYPE(symbol) depths, vec2d location) { \
+        if(depths.rows <= 1) { \
+            point_normal->x = 0; \
+            point_normal->y = 0; \
+            point_normal->z = 2; /* Default "up" is scaled up by two to keep consistant with normal case */ \
+            return; \
+        } \
+        \
+        u32 x = location.x; \
+        u32 y = location.y; \
+        \
+        assertf(x != 0 && x < depths.cols - 1 && y != 0 && y < depths.rows - 1, \
+            "Location cannot be on the edge of depths"); \
+        \
+        /* The partial derivatives dz/dx and dz/dy are approximated by finite differences. */ \
+        /* dz_dx = (depth(x+1) - depth(x-1)) / 2 */ \
+        /* dz_dy = (depth(y+1) - depth(y-1)) / 2 */ \
+        /* The normal vector is (-dz/dx, -dz/dy, 1). */ \
+        /* To keep it integer, we can use a scaled normal (-2*dz/dx, -2*dz/dy, 2). */ \
+        i32 delta_x = (i32) MAT(depths, y, x + 1) - (i32) MAT(depths, y, x - 1); \
+        i32 delta_y = (i32) MAT(depths, y + 1, x) - (i32) MAT(depths, y - 1, x); \
+        \
+        point_normal->x = -delta_x; \
+        point_normal->y = -delta_y; \
+        point_normal->z = 2; \
+    }
+
+INSTANTIATE_GET_POINT_NORMAL(u16)
+INSTANTIATE_GET_POINT_NORMAL(u8)
+
+/**
+ * @brief The axis angle is the direction's angle doubled (which folds d and -d together), rounded to the nearest bin
+ */
+u8 get_direction_angle(vec3d direction) {
+    u16 doubled = 2 * atan2_angle_u16(direction.y, direction.x);
+    return (u16) (doubled + (1 << (15 - DIRECTION_ANGLE_BITS))) >> (16 - DIRECTION_ANGLE_BITS);
+}
+
+/**
+ * @brief Computes un-normalized principal curvature directions for a depth matrix.
+ * The Hessian, its trace and the directions fit in i32 for both u8 and u16 depths,
+ *      the discriminant (a sum of squares) needs disc_type: u32 for u8, u64 for u16 (|H_yy - H_xx| < 2^19).
+ * Before being lifted to 3D, the 2D direction is shifted down until its coordinates fit in
+ *      MAX_DIRECTION_BITS, so that the dot product with the depth differences fits in i32.
+ *      u8 directions always fit already (below 2^12) and are left exact.
  *
  * @param k1_fp !Will be returned in fixed-point format with CURVATURE_FRACTIONAL_BITS bit additional precision
  * @param k2_fp !Will be returned in fixed-point format with CURVATURE_FRACTIONAL_BITS bit additional precision
  * @param dir1 Output vector for the first principal direction.
  * @param dir2 Output vector for the second principal direction.
- * @param depths Input depth matrix of u8 values.
+ * @param depths Input depth matrix.
  * @param location The (x, y) location on the matrix.
  */
-void get_principal_curvatures_u8(i32* k1_fp, i32* k2_fp, vec3d* dir1, vec3d* dir2, mat_u8 depths, vec2d location) {
-    assertf(is_vec2d_positive(location), "location had negative coords");
-    u32 x = location.x;
-    u32 y = location.y;
-
-    if (x < 1 || x >= depths.cols - 1 ||
-        y < 1 || y >= depths.rows - 1) {
-        *k1_fp = 0; *k2_fp = 0;
-        dir1->x = 1; dir1->y = 0; dir1->z = 0;
-        dir2->x = 0; dir2->y = 1; dir2->z = 0;
-        return;
-    }
+#define MAX_DIRECTION_BITS 12
 
-    // --- Hessian elements (using i32 for safety) ---
-    i32 z_c = MAT(depths, y, x);
-    i32 H_xx = (i32) MAT(depths, y, x + 1) - 2 * z_c + (i32) MAT(depths, y, x - 1);
-    i32 H_yy = (i32) MAT(depths, y + 1, x) - 2 * z_c + (i32) MAT(depths, y - 1, x);
-    i32 H_xy = ((i32) MAT(depths, y + 1, x + 1) - (i32) MAT(depths, y + 1, x - 1) -
-                (i32) MAT(depths, y - 1, x + 1) + (i32) MAT(depths, y - 1, x - 1)) / 4;
-
-    // --- Eigenvector Calculation ---
-    i32 trace = H_xx + H_yy;
-    i32 diff = H_yy - H_xx;
-    i32 two_H_xy = 2 * H_xy;
-
-    vec2d dir1_xy;
-
-    // Check for a flat or perfectly spherical (umbilic) point.
-    // In this case, curvature is the same in all directions, so the
-    // principal directions are undefined. We assign a stable default.
-    if (diff == 0 && two_H_xy == 0) {
-        // Curvatures are equal (equal to H_xx and H_yy).
-        *k1_fp = H_xx << CURVATURE_FRACTIONAL_BITS;
-        *k2_fp = H_xx << CURVATURE_FRACTIONAL_BITS;
-
-        // Assign arbitrary orthogonal vectors for the directions.
-        dir1_xy.x = 1;
-        dir1_xy.y = 0;
-    } else {
-        // Standard case: the surface has distinct principal curvatures.
-        u32 discriminant_sq = (u32) (diff * diff) + (u32) (two_H_xy * two_H_xy);
-        i32 sqrt_disc = (i32) isqrt32(discriminant_sq);
-
-        // Curvatures are the eigenvalues (Tr +/- sqrt(disc))/2
-        *k1_fp = ((trace + sqrt_disc) << CURVATURE_FRACTIONAL_BITS) / 2;
-        *k2_fp = ((trace - sqrt_disc) << CURVATURE_FRACTIONAL_BITS) / 2;
-
-        // Use the robust method to find a non-zero eigenvector.
-        dir1_xy.x = two_H_xy;
-        dir1_xy.y = diff + sqrt_disc;
-
-        // If that resulted in a zero vector, use the other valid eigenvector formula.
-        if (dir1_xy.x == 0 && dir1_xy.y == 0) {
-            dir1_xy.x = diff - sqrt_disc;
-            dir1_xy.y = -two_H_xy;
-        }
+#define INSTANTIATE_GET_PRINCIPAL_CURVATURES(symbol, disc_type, isqrt) \
+    void get_principal_curvatures_##symbol(i32* k1_fp, i32* k2_fp, vec3d* dir1, vec3d* dir2, MAT_TYPE(symbol) depths, vec2d location) { \
+        assertf(is_vec2d_positive(location), "location had negative coords"); \
+        u32 x = location.x; \
+        u32 y = location.y; \
+        \
+        if (x < 1 || x >= depths.cols - 1 || \
+            y < 1 || y >= depths.rows - 1) { \
+            *k1_fp = 0; *k2_fp = 0; \
+            dir1->x = 1; dir1->y = 0; dir1->z = 0; \
+            dir2->x = 0; dir2->y = 1; dir2->z = 0; \
+            return; \
+        } \
+        \
+        /* --- Hessian elements --- */ \
+        i32 z_c = MAT(depths, y, x); \
+        i32 H_xx = (i32) MAT(depths, y, x + 1) - 2 * z_c + (i32) MAT(depths, y, x - 1); \
+        i32 H_yy = (i32) MAT(depths, y + 1, x) - 2 * z_c + (i32) MAT(depths, y - 1, x); \
+        i32 H_xy = ((i32) MAT(depths, y + 1, x + 1) - (i32) MAT(depths, y + 1, x - 1) - \
+                    (i32) MAT(depths, y - 1, x + 1) + (i32) MAT(depths, y - 1, x - 1)) / 4; \
+        \
+        /* --- Eigenvector Calculation --- */ \
+        i32 trace = H_xx + H_yy; \
+        i32 diff = H_yy - H_xx; \
+        i32 two_H_xy = 2 * H_xy; \
+        \
+        vec2d dir1_xy; \
+        \
+        /* Check for a flat or perfectly spherical (umbilic) point. */ \
+        /* In this case, curvature is the same in all directions, so the */ \
+        /* principal directions are undefined. We assign a stable default. */ \
+        if (diff == 0 && two_H_xy == 0) { \
+            /* Curvatures are equal (equal to H_xx and H_yy). */ \
+            *k1_fp = H_xx * (1 << CURVATURE_FRACTIONAL_BITS); \
+            *k2_fp = H_xx * (1 << CURVATURE_FRACTIONAL_BITS); \
+            \
+            /* Assign arbitrary orthogonal vectors for the directions. */ \
+            dir1_xy.x = 1; \
+            dir1_xy.y = 0; \
+        } else { \
+            /* Standard case: the surface has distinct principal curvatures. */ \
+            disc_type discriminant_sq = (disc_type) ((i64) diff * diff) + (disc_type) ((i64) two_H_xy * two_H_xy); \
+            i32 sqrt_disc = (i32) isqrt(discriminant_sq); \
+            \
+            /* Curvatures are the eigenvalues (Tr +/- sqrt(disc))/2 */ \
+            *k1_fp = ((trace + sqrt_disc) * (1 << CURVATURE_FRACTIONAL_BITS)) / 2; \
+            *k2_fp = ((trace - sqrt_disc) * (1 << CURVATURE_FRACTIONAL_BITS)) / 2; \
+            \
+            /* Use the robust method to find a non-zero eigenvector. */ \
+            dir1_xy.x = two_H_xy; \
+            dir1_xy.y = diff + sqrt_disc; \
+            \
+            /* If that resulted in a zero vector, use the other valid eigenvector formula. */ \
+            if (dir1_xy.x == 0 && dir1_xy.y == 0) { \
+                dir1_xy.x = diff - sqrt_disc; \
+                dir1_xy.y = -two_H_xy; \
+            } \
+            \
+            while(abs(dir1_xy.x) >= (1 << MAX_DIRECTION_BITS) || abs(dir1_xy.y) >= (1 << MAX_DIRECTION_BITS)) { \
+                dir1_xy.x /= 2; \
+                dir1_xy.y /= 2; \
+            } \
+        } \
+        \
+        /* The other eigenvector is orthogonal */ \
+        vec2d dir2_xy = { -dir1_xy.y, dir1_xy.x }; \
+        \
+        /* --- Lift 2D direction vectors to the 3D tangent plane --- */ \
+        i32 delta_x = (i32) MAT(depths, y, x + 1) - (i32) MAT(depths, y, x - 1); \
+        i32 delta_y = (i32) MAT(depths, y + 1, x) - (i32) MAT(depths, y - 1, x); \
+        \
+        dir1->x = dir1_xy.x; \
+        dir1->y = dir1_xy.y; \
+        dir1->z = (dir1_xy.x * delta_x + dir1_xy.y * delta_y) / 2; \
+        \
+        dir2->x = dir2_xy.x; \
+        dir2->y = dir2_xy.y; \
+        dir2->z = (dir2_xy.x * delta_x + dir2_xy.y * delta_y) / 2; \
     }
-    
-    // The other eigenvector is orthogonal
-    vec2d dir2_xy = { -dir1_xy.y, dir1_xy.x };
-
-    // --- Lift 2D direction vectors to the 3D tangent plane ---
-    // First-order differences fit in i16, but use i32 for consistency
-    i32 delta_x = (i32) MAT(depths, y, x + 1) - (i32) MAT(depths, y, x - 1);
-    i32 delta_y = (i32) MAT(depths, y + 1, x) - (i32) MAT(depths, y - 1, x);
-
-    dir1->x = dir1_xy.x;
-    dir1->y = dir1_xy.y;
-    dir1->z = (dir1_xy.x * delta_x + dir1_xy.y * delta_y) / 2;
-
-    dir2->x = dir2_xy.x;
-    dir2->y = dir2_xy.y;
-    dir2->z = (dir2_xy.x * delta_x + dir2_xy.y * delta_y) / 2;
-}
+
+INSTANTIATE_GET_PRINCIPAL_CURVATURES(u16, u64, isqrt_u64)
+INSTANTIATE_GET_PRINCIPAL_CURVATURES(u8, u32, isqrt_u32)
 
 void print_features(features_t f) {
-    printf("features: value=%u min_depth=%u max_depth=%u mean_depth=%u principal_curvature_1=%d(%d) principal_curvature_2=%d(%d) pose_fully_defined=%d\n",
+    printf("features: value=%u min_depth=%u max_depth=%u mean_depth=%u p10_depth=%u median_depth=%u p90_depth=%u principal_curvature_1=%d(%d) principal_curvature_2=%d(%d) pose_fully_defined=%d\n",
         f.value,
         f.min_depth,
         f.max_depth,
         f.mean_depth,
+        f.p10_depth,
+        f.median_depth,
+        f.p90_depth,
         f.principal_curvature_1_fp >> CURVATURE_FRACTIONAL_BITS, f.principal_curvature_1_fp,
         f.principal_curvature_2_fp >> CURVATURE_FRACTIONAL_BITS, f.principal_curvature_2_fp,
         f.pose_fully_defined
@@ -202,5 +489,7 @@ void print_pose(pose_t p) {
         (int)p.curvature_direction_1.x, (int)p.curvature_direction_1.y, (int)p.curvature_direction_1.z);
     printf("  curvature_direction_2: x=%d y=%d z=%d\n",
         (int)p.curvature_direction_2.x, (int)p.curvature_direction_2.y, (int)p.curvature_direction_2.z);
+    printf("  curvature_direction_angles: %u %u (/%d)\n",
+        p.curvature_direction_1_angle, p.curvature_direction_2_angle, DIRECTION_ANGLE_BINS);
     printf("  pose_fully_defined: %d\n", p.pose_fully_defined);
 }
@@ -13,11 +13,49 @@
 #include "grid_environment.h"
 #include "location.h"
 #include "interfaces.h"
+#include "integer_math.h"
 
 void sensor_module(features_t* features, pose_t* pose, grid_t patch, vec2d location);
+// Same on 16 bits depths: curvatures and depth statistics keep the full depth resolution
+void sensor_module_u16(features_t* features, pose_t* pose, grid_u16_t patch, vec2d location);
 
-void get_point_normal_u8(vec3d* point_normal, mat_u8 depths, vec2d location);
-void get_principal_curvatures_u8(i32* k1_fp, i32* k2_fp, vec3d* dir1, vec3d* dir2, mat_u8 depths, vec2d location);
+#define MAX_SENSORS 8
+
+/**
+ * Patches carried by the agent, sensed together at every step.
+ * Sensor i is centered on the agent's location + offsets[i], and sees a (sidelens[i], sidelens[i]) patch
+ */
+typedef struct sensor_array_t_ {
+    u32 num_sensors;
+    vec2d offsets[MAX_SENSORS];
+    u32 sidelens[MAX_SENSORS];
+} sensor_array_t;
+
+// Places the sensors on LAYOUT_OFFSETS, spacing apart, all with the same patch sidelen
+void init_sensor_array(sensor_array_t* sensors, u32 num_sensors, u32 spacing, u32 sidelen);
+// Distance the furthest sensor's patch reaches from the agent's location, along either axis
+u32 sensor_array_reach(const sensor_array_t* sensors);
+
+// Same features and poses as extract_patch + sensor_module for every sensor, read directly from env
+void sensor_module_batch(features_t* features, pose_t* poses, grid_t* env, vec2d location, const sensor_array_t* sensors);
+// Same on 16 bits depths. scratch must have room for the largest patch
+void sensor_module_batch_u16(features_t* features, pose_t* poses, grid_u16_t* env, vec2d location, const sensor_array_t* sensors,
+    u16* scratch);
+
+#define DEFINE_GET_POINT_NORMAL(symbol) \
+    void get_point_normal_##symbol(vec3d* point_normal, MAT_TYPE(symbol) depths, vec2d location)
+
+DEFINE_GET_POINT_NORMAL(u16);
+DEFINE_GET_POINT_NORMAL(u8);
+
+// Quantized angle of the axis of a (tangent plane) direction, see DIRECTION_ANGLE_BINS
+u8 get_direction_angle(vec3d direction);
+
+#define DEFINE_GET_PRINCIPAL_CURVATURES(symbol) \
+    void get_principal_curvatures_##symbol(i32* k1_fp, i32* k2_fp, vec3d* dir1, vec3d* dir2, MAT_TYPE(symbol) depths, vec2d location)
+
+DEFINE_GET_PRINCIPAL_CURVATURES(u16);
+DEFINE_GET_PRINCIPAL_CURVATURES(u8);
 
 void print_features(features_t f);
 void print_pose(pose_t p);
@@ -33,6 +33,11 @@ typedef struct spvec_u1_ {
         u16* indices;
 } spvec_u1;
 
+/* COMPRESSED SPARSE ROWS
+    the entries of row r are [rows[r], rows[r + 1]): cols[e] is the column of entry e and data[e] its value,
+    rows has num_rows + 1 offsets and length is the number of entries (rows[num_rows])
+*/
+
 #define CSR_TYPE_(symbol) csr_##symbol##_
 #define CSR_TYPE(symbol) csr_##symbol
 
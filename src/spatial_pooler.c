@@ -0,0 +1,218 @@
+#include "spatial_pooler.h"
+
+#include <string.h>
+
+#include "assertf.h"
+#include "algorithms.h"
+#include "bitset.h"
+#include "distributions.h"
+#include "memory_accounting.h"
+#include "saturated.h"
+
+void default_spatial_pooler_config(spatial_pooler_config_t* config, u32 input_bits, u32 num_columns) {
+    config->input_bits = input_bits;
+    config->num_columns = num_columns;
+    config->num_active_columns = num_columns / 50; // 2% sparsity
+    config->pool_size = input_bits / 2;
+
+    config->stimulus_threshold = 1;
+
+    config->connected_permanence = 128;
+    config->permanence_increment = 12;
+    config->permanence_decrement = 4;
+    config->initial_spread = 24;
+}
+
+static size_t pool_entries(const spatial_pooler_config_t* config) {
+    return (size_t) config->num_columns * config->pool_size;
+}
+
+size_t spatial_pooler_arena_bytes(const spatial_pooler_config_t* config) {
+    size_t entries = pool_entries(config);
+
+    return ARENA_ALIGN_UP((config->num_columns + 1) * sizeof(u32)) + ARENA_ALIGN_UP((config->input_bits + 1) * sizeof(u32))
+        + 3 * ARENA_ALIGN_UP(entries * sizeof(u32)) + 2 * ARENA_ALIGN_UP(entries * sizeof(u8))
+        + 2 * ARENA_ALIGN_UP(config->num_columns * sizeof(u16)) + ARENA_ALIGN_UP(config->num_columns * sizeof(u32))
+        + ARENA_ALIGN_UP(BITSET_WORDS(config->num_columns) * sizeof(u64))
+        + ARENA_ALIGN_UP(BITSET_WORDS(config->input_bits) * sizeof(u64));
+}
+
+/**
+ * @brief Column c's pool: pool_size distinct input bits drawn with Floyd's algorithm, marked in scratch
+ *      (a cleared set over the input bits, cleared again on return) and read back in order
+ */
+static void draw_pool(spatial_pooler_t* sp, u32 c, u64* scratch) {
+    spatial_pooler_config_t* config = &sp->config;
+
+    for(u32 j = config->input_bits - config->pool_size; j < config->input_bits; ++j) {
+        u32 t = unif_rand_u32(j);
+        bitset_set(scratch, bitset_test(scratch, t) ? j : t);
+    }
+
+    u32 e = sp->pools.rows[c];
+    for(u32 w = 0; w < BITSET_WORDS(config->input_bits); ++w) {
+        for(u64 word = scratch[w]; word != 0; word &= word - 1) {
+            i32 permanence = (i32) unif_rand_range_u32(config->connected_permanence - config->initial_spread,
+                config->connected_permanence + config->initial_spread);
+
+            sp->pools.cols[e] = w * 64 + __builtin_ctzll(word);
+            sp->pools.data[e] = permanence < 1 ? 1 : permanence > UINT8_MAX ? UINT8_MAX : permanence;
+            e += 1;
+        }
+        scratch[w] = 0;
+    }
+}
+
+/**
+ * @brief Transposes the pools into fan_out: counts per input bit, offsets, then every entry at its input's cursor
+ *      (the offsets serve as cursors and are shifted back into place at the end)
+ */
+static void build_fan_out(spatial_pooler_t* sp) {
+    u32 input_bits = sp->config.input_bits;
+    csr_u32* pools = &sp->pools;
+    csr_u32* fan_out = &sp->fan_out;
+
+    memset(fan_out->rows, 0, (input_bits + 1) * sizeof(u32));
+    for(u32 e = 0; e < pools->length; ++e)
+        fan_out->rows[pools->cols[e] + 1] += 1;
+    for(u32 i = 0; i < input_bits; ++i)
+        fan_out->rows[i + 1] += fan_out->rows[i];
+
+    for(u32 c = 0; c < sp->config.num_columns; ++c) {
+        for(u32 e = pools->rows[c]; e < pools->rows[c + 1]; ++e) {
+            u32 f = fan_out->rows[pools->cols[e]]++;
+            fan_out->cols[f] = c;
+            fan_out->data[f] = pools->data[e];
+            sp->mirror[e] = f;
+        }
+    }
+
+    for(u32 i = input_bits; i > 0; --i)
+        fan_out->rows[i] = fan_out->rows[i - 1];
+    fan_out->rows[0] = 0;
+    fan_out->length = pools->length;
+}
+
+void init_spatial_pooler(spatial_pooler_t* sp, spatial_pooler_config_t config, arena_t* arena) {
+    assertf(config.input_bits >= 1 && config.input_bits <= UINT16_MAX + 1, "between 1 and %d input bits", UINT16_MAX + 1);
+    assertf(config.num_columns >= 1 && config.num_columns <= UINT16_MAX, "between 1 and %d columns", UINT16_MAX);
+    assertf(config.num_active_columns >= 1 && config.num_active_columns <= config.num_columns,
+        "between 1 and %u active columns", config.num_columns);
+    assertf(config.pool_size >= 1 && config.pool_size <= config.input_bits, "pools of 1 to %u input bits", config.input_bits);
+    assertf(config.initial_spread < config.connected_permanence, "initial permanences have to stay above 0");
+    assertf(pool_entries(&config) <= UINT32_MAX, "at most %u pool entries", UINT32_MAX);
+
+    sp->config = config;
+    size_t entries = pool_entries(&config);
+
+    memory_tag previous_tag = set_memory_tag(MEMORY_LIBRARY);
+    sp->pools.rows = arena_alloc(arena, config.num_columns + 1, sizeof(u32));
+    sp->pools.cols = arena_alloc(arena, entries, sizeof(u32));
+    sp->pools.data = arena_alloc(arena, entries, sizeof(u8));
+    sp->pools.length = entries;
+
+    sp->fan_out.rows = arena_alloc(arena, config.input_bits + 1, sizeof(u32));
+    sp->fan_out.cols = arena_alloc(arena, entries, sizeof(u32));
+    sp->fan_out.data = arena_alloc(arena, entries, sizeof(u8));
+    sp->mirror = arena_alloc(arena, entries, sizeof(u32));
+
+    sp->overlaps = arena_calloc(arena, config.num_columns, sizeof(*sp->overlaps));
+    sp->touched = arena_calloc(arena, BITSET_WORDS(config.num_columns), sizeof(*sp->touched));
+    sp->active_inputs = arena_calloc(arena, BITSET_WORDS(config.input_bits), sizeof(*sp->active_inputs));
+    sp->candidates = arena_alloc(arena, config.num_columns, sizeof(*sp->candidates));
+    sp->candidate_overlaps = arena_alloc(arena, config.num_columns, sizeof(*sp->candidate_overlaps));
+    set_memory_tag(previous_tag);
+
+    for(u32 c = 0; c <= config.num_columns; ++c)
+        sp->pools.rows[c] = c * config.pool_size;
+    for(u32 c = 0; c < config.num_columns; ++c)
+        draw_pool(sp, c, sp->active_inputs);
+
+    build_fan_out(sp);
+    sp->steps = 0;
+}
+
+// Walks the winner's pool (sp->active_inputs holds the input), writing both copies of every permanence
+static void learn_column(spatial_pooler_t* sp, u32 c) {
+    spatial_pooler_config_t* config = &sp->config;
+    csr_u32* pools = &sp->pools;
+
+    for(u32 e = pools->rows[c]; e < pools->rows[c + 1]; ++e) {
+        u8 permanence = bitset_test(sp->active_inputs, pools->cols[e])
+            ? saturated_add(pools->data[e], config->permanence_increment)
+            : saturated_sub(pools->data[e], config->permanence_decrement);
+
+        pools->data[e] = permanence;
+        sp->fan_out.data[sp->mirror[e]] = permanence;
+    }
+}
+
+/**
+ * @brief Overlaps through fan_out, candidates from the touched set (in column order, the overlaps are reset on the way),
+ *      then the num_active_columns-th highest overlap by counting selection:
+ *      columns above it win, and so do the first ones that equal it, up to num_active_columns
+ */
+void spatial_pooler_compute(spatial_pooler_t* sp, const spvec_u1* input, int learning, spvec_u1* active_columns) {
+    spatial_pooler_config_t* config = &sp->config;
+    csr_u32* fan_out = &sp->fan_out;
+    assertf(input->length == config->input_bits, "input of %u bits, expected %u", input->length, config->input_bits);
+
+    for(u32 i = 0; i < input->non_null_count; ++i) {
+        u32 bit = input->indices[i];
+        for(u32 f = fan_out->rows[bit]; f < fan_out->rows[bit + 1]; ++f) {
+            u32 c = fan_out->cols[f];
+            u32 connected = fan_out->data[f] >= config->connected_permanence;
+
+            sp->overlaps[c] += connected;
+            sp->touched[c >> 6] |= (u64) connected << (c & 63);
+        }
+    }
+
+    u32 num_candidates = 0;
+    for(u32 w = 0; w < BITSET_WORDS(config->num_columns); ++w) {
+        for(u64 word = sp->touched[w]; word != 0; word &= word - 1) {
+            u32 c = w * 64 + __builtin_ctzll(word);
+            if(sp->overlaps[c] >= config->stimulus_threshold) {
+                sp->candidates[num_candidates] = c;
+                sp->candidate_overlaps[num_candidates] = sp->overlaps[c];
+                num_candidates += 1;
+            }
+            sp->overlaps[c] = 0;
+        }
+        sp->touched[w] = 0;
+    }
+
+    u32 k = config->num_active_columns;
+    u16 threshold = 0;
+    u32 ties = num_candidates;
+    if(num_candidates > k) {
+        u32 rank = num_candidates - k;
+        select_many_u16(&threshold, sp->candidate_overlaps, num_candidates, &rank, 1);
+
+        u32 above = 0;
+        for(u32 i = 0; i < num_candidates; ++i)
+            above += sp->candidate_overlaps[i] > threshold;
+        ties = k - above;
+    }
+
+    u32 count = 0;
+    for(u32 i = 0; i < num_candidates; ++i) {
+        u16 overlap = sp->candidate_overlaps[i];
+        if(overlap < threshold || (overlap == threshold && ties == 0)) continue;
+
+        ties -= overlap == threshold;
+        active_columns->indices[count++] = sp->candidates[i];
+    }
+    active_columns->length = config->num_columns;
+    active_columns->non_null_count = count;
+
+    if(learning) {
+        bitset_set_sdr(sp->active_inputs, input, 0);
+        for(u32 i = 0; i < count; ++i)
+            learn_column(sp, active_columns->indices[i]);
+        for(u32 i = 0; i < input->non_null_count; ++i)
+            sp->active_inputs[input->indices[i] >> 6] = 0;
+    }
+
+    sp->steps += 1;
+}
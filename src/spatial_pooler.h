@@ -0,0 +1,76 @@
+#ifndef SPATIAL_POOLER_H
+#define SPATIAL_POOLER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "arena.h"
+#include "sparse.h"
+
+/**
+ * Spatial pooler: turns an encoded input (e.g. encode_features) into a stable sparse code of num_active_columns
+ *      out of num_columns columns.
+ *
+ * Every column has a potential pool of pool_size input bits, with a u8 permanence each: its overlap with an input
+ *      is the number of active input bits it is connected to (permanence >= connected_permanence).
+ * The num_active_columns columns of highest overlap win (global inhibition), and when learning, only the winners
+ *      learn: permanences to active input bits go up, the others go down.
+ *
+ * The pools are stored twice, as CSR (see sparse.h) with the same permanences:
+ *      - by column (pools): what a winner walks to learn
+ *      - by input bit (fan_out): what the overlaps are computed from, sparse input times sparse matrix, walking only
+ *        the entries of the active input bits. With a few dozen active bits out of hundreds, and thousands of columns,
+ *        that is a few percents of the pools, instead of testing every pool entry against the input.
+ * mirror[e] is where pool entry e is in fan_out, so that learning keeps both copies in sync.
+ *
+ * Winners come from a counting selection (select_many_u16) of the overlaps of the touched columns: linear time.
+ * Columns reached by the input are marked in a bit-packed set, walked in order, so winners come out sorted.
+ */
+
+typedef struct spatial_pooler_config_t_ {
+    u32 input_bits;
+    u32 num_columns;
+    u32 num_active_columns;
+    u32 pool_size; // input bits in a column's potential pool
+
+    u32 stimulus_threshold; // a column needs at least that overlap to win
+
+    u8 connected_permanence;
+    u8 permanence_increment;
+    u8 permanence_decrement;
+    u8 initial_spread; // initial permanences are drawn in connected_permanence +- initial_spread
+} spatial_pooler_config_t;
+
+typedef struct spatial_pooler_t_ {
+    spatial_pooler_config_t config;
+
+    csr_u32 pools; // rows are columns, cols are input bits
+    csr_u32 fan_out; // rows are input bits, cols are columns
+    u32* mirror;
+
+    u16* overlaps; // per column, 0 outside of the touched ones
+    u64* touched; // bit-packed, over the columns
+    u64* active_inputs; // bit-packed, over the input bits
+    u32* candidates; // touched columns, in order
+    u16* candidate_overlaps;
+
+    u64 steps;
+} spatial_pooler_t;
+
+void default_spatial_pooler_config(spatial_pooler_config_t* config, u32 input_bits, u32 num_columns);
+
+// Upper bound of what init_spatial_pooler takes from the arena
+size_t spatial_pooler_arena_bytes(const spatial_pooler_config_t* config);
+// Draws the potential pools and their permanences from the uniform random stream
+void init_spatial_pooler(spatial_pooler_t* sp, spatial_pooler_config_t config, arena_t* arena);
+
+/**
+ * @param input sorted or not
+ * @param active_columns its indices must have room for num_active_columns indices. They come out sorted,
+ *      fewer than num_active_columns when not enough columns reach the stimulus threshold
+ */
+void spatial_pooler_compute(spatial_pooler_t* sp, const spvec_u1* input, int learning, spvec_u1* active_columns);
+
+#endif // SPATIAL_POOLER_H
@@ -0,0 +1,46 @@
+#include "spsc_ring.h"
+
+#include <string.h>
+
+#include "assertf.h"
+
+void spsc_ring_init(spsc_ring_t* ring, u32 capacity, u32 element_size, arena_t* arena) {
+    assertf(capacity != 0 && (capacity & (capacity - 1)) == 0, "ring capacity %u is not a power of two", capacity);
+
+    ring->capacity = capacity;
+    ring->element_size = element_size;
+    ring->data = arena_alloc(arena, capacity, element_size);
+
+    spsc_ring_reset(ring);
+}
+
+void spsc_ring_reset(spsc_ring_t* ring) {
+    atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, 0, memory_order_relaxed);
+}
+
+int spsc_ring_try_push(spsc_ring_t* ring, const void* element) {
+    u32 tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    u32 head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if(tail - head == ring->capacity) return 0;
+
+    memcpy(ring->data + (size_t) (tail & (ring->capacity - 1)) * ring->element_size, element, ring->element_size);
+    // the element must be visible before the new tail
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return 1;
+}
+
+int spsc_ring_try_pop(spsc_ring_t* ring, void* element) {
+    u32 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    u32 tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if(head == tail) return 0;
+
+    memcpy(element, ring->data + (size_t) (head & (ring->capacity - 1)) * ring->element_size, ring->element_size);
+    // the slot can only be reused once it has been read
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return 1;
+}
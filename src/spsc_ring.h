@@ -0,0 +1,37 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "types.h"
+#include "arena.h"
+
+/**
+ * Bounded lock-free single-producer/single-consumer ring of fixed-size elements.
+ *
+ * The producer only writes tail, the consumer only writes head, each on its own cache line.
+ * head and tail run freely and are wrapped with (capacity - 1): capacity must be a power of two.
+ * Neither side ever waits: try_push fails when the ring is full, try_pop when it is empty,
+ *      the caller decides whether to drop, or to sleep until the other side moved (back-pressure, see wakeup.h).
+ */
+typedef struct spsc_ring_t_ {
+    _Alignas(64) _Atomic u32 head; // next element to pop, written by the consumer
+    _Alignas(64) _Atomic u32 tail; // next element to push, written by the producer
+
+    _Alignas(64) u32 capacity;
+    u32 element_size;
+    u8* data;
+} spsc_ring_t;
+
+void spsc_ring_init(spsc_ring_t* ring, u32 capacity, u32 element_size, arena_t* arena);
+// Only when neither side is running
+void spsc_ring_reset(spsc_ring_t* ring);
+
+// Returns 0 when full
+int spsc_ring_try_push(spsc_ring_t* ring, const void* element);
+// Returns 0 when empty
+int spsc_ring_try_pop(spsc_ring_t* ring, void* element);
+
+#endif
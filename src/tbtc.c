@@ -0,0 +1,286 @@
+#include "tbtc.h"
+
+#include "types.h"
+#include "arena.h"
+#include "grid_environment.h"
+#include "sensor_module.h"
+#include "learning_module.h"
+#include "model_library.h"
+#include "integer_math.h"
+
+struct tbtc_context_t_ {
+    tbtc_config_t config;
+
+    arena_t arena;
+    arena_t episode_arena;
+
+    sensor_array_t sensors;
+    u32 reach; // of the sensors around a location
+    u16* patch_scratch; // for u16 frames, see sensor_module_batch_u16
+    grid_lm lm;
+};
+
+TBTC_API void tbtc_default_config(tbtc_config_t* config) {
+    *config = (tbtc_config_t) {
+        .rows = 0,
+        .cols = 0,
+        .model_scale = 1,
+        .max_objects = 0,
+        .num_orientations = 1,
+        .patch_sidelen = 3,
+        .num_sensors = 1,
+        .sensor_spacing = 2
+    };
+}
+
+static int is_valid_config(const tbtc_config_t* c) {
+    return c->rows > 0 && c->cols > 0 && c->max_objects > 0
+        && c->model_scale > 0 && c->rows % c->model_scale == 0 && c->cols % c->model_scale == 0
+        && (c->num_orientations == 1 || c->num_orientations == NUM_ORIENTATIONS)
+        && c->patch_sidelen % 2 == 1
+        && c->num_sensors >= 1 && c->num_sensors <= MAX_SENSORS
+        // oriented model cells are counted in u32
+        && (u64) c->max_objects * c->num_orientations * (c->rows / c->model_scale) * (c->cols / c->model_scale) <= UINT32_MAX;
+}
+
+TBTC_API tbtc_context_t* tbtc_create(const tbtc_config_t* config) {
+    if(config == NULL || !is_valid_config(config)) return NULL;
+
+    tbtc_context_t* context = calloc(1, sizeof(*context));
+    if(context == NULL) return NULL;
+    context->config = *config;
+
+    init_integer_math();
+
+    vec2d world_size = {.x = config->rows, .y = config->cols};
+    vec2d model_size = vec_divided_u32(world_size, config->model_scale);
+
+    // the host process is not ours to abort: no memory is a NULL context
+    size_t scratch_bytes = ARENA_ALIGN_UP((size_t) config->patch_sidelen * config->patch_sidelen * sizeof(u16));
+    size_t arena_bytes = learning_module_arena_bytes(model_size, config->max_objects, config->num_orientations) + scratch_bytes;
+    if(!arena_try_init(&context->arena, arena_bytes + (1 << 16))) {
+        free(context);
+        return NULL;
+    }
+    if(!arena_try_init(&context->episode_arena, learning_module_episode_bytes(model_size) + (1 << 16))) {
+        arena_free(&context->arena);
+        free(context);
+        return NULL;
+    }
+
+    init_sensor_array(&context->sensors, config->num_sensors, config->sensor_spacing, config->patch_sidelen);
+    context->reach = sensor_array_reach(&context->sensors);
+
+    memory_tag previous_tag = set_memory_tag(MEMORY_PATCHES);
+    context->patch_scratch = arena_alloc(&context->arena, (size_t) config->patch_sidelen * config->patch_sidelen, sizeof(u16));
+    set_memory_tag(previous_tag);
+
+    init_learning_module(&context->lm, model_size, world_size, config->max_objects, config->num_orientations,
+        &context->arena, &context->episode_arena);
+
+    return context;
+}
+
+TBTC_API void tbtc_destroy(tbtc_context_t* context) {
+    if(context == NULL) return;
+
+    learning_module_unmap_library(&context->lm);
+    arena_free(&context->episode_arena);
+    arena_free(&context->arena);
+    free(context);
+}
+
+// The caller's frame, seen as a grid of its depth type
+typedef struct frame_view_t_ {
+    u32 depth_bytes;
+    grid_t u8;
+    grid_u16_t u16;
+} frame_view_t;
+
+/**
+ * @brief Wraps the caller's frame in a grid view: no copy, and the buffers are only ever read
+ */
+static tbtc_status view_frame(tbtc_context_t* context, const tbtc_frame_t* frame, frame_view_t* view) {
+    if(frame == NULL || frame->depths == NULL || frame->values == NULL) return TBTC_INVALID_ARGUMENT;
+
+    u32 depth_bytes = frame->depth_bytes == 0 ? 1 : frame->depth_bytes;
+    if(depth_bytes != sizeof(u8) && depth_bytes != sizeof(u16)) return TBTC_INVALID_ARGUMENT;
+    if(frame->depth_stride % depth_bytes != 0 || frame->value_stride % sizeof(u32) != 0) return TBTC_INVALID_ARGUMENT;
+    if(frame->depth_stride < context->config.cols * depth_bytes || frame->value_stride < context->config.cols * sizeof(u32))
+        return TBTC_INVALID_ARGUMENT;
+
+    view->depth_bytes = depth_bytes;
+    if(depth_bytes == sizeof(u16)) {
+        view_grid_env_u16(&view->u16, (u16*) frame->depths, frame->depth_stride / sizeof(u16),
+            (u32*) frame->values, frame->value_stride / sizeof(u32), context->config.rows, context->config.cols);
+    } else {
+        view_grid_env(&view->u8, (u8*) frame->depths, frame->depth_stride,
+            (u32*) frame->values, frame->value_stride / sizeof(u32), context->config.rows, context->config.cols);
+    }
+    return TBTC_OK;
+}
+
+// Every sensor of the array around location, with the kernels of the frame's depth type
+static void sense_frame(tbtc_context_t* context, frame_view_t* view, vec2d location, features_t* f, pose_t* p) {
+    if(view->depth_bytes == sizeof(u16))
+        sensor_module_batch_u16(f, p, &view->u16, location, &context->sensors, context->patch_scratch);
+    else
+        sensor_module_batch(f, p, &view->u8, location, &context->sensors);
+}
+
+static int fits(tbtc_context_t* context, tbtc_location_t l) {
+    i64 reach = context->reach;
+    return l.row >= reach && l.col >= reach
+        && l.row + reach < context->config.rows && l.col + reach < context->config.cols;
+}
+
+static tbtc_status check_locations(tbtc_context_t* context, const tbtc_location_t* locations, u32 num_locations) {
+    if(locations == NULL && num_locations > 0) return TBTC_INVALID_ARGUMENT;
+
+    for(u32 i = 0; i < num_locations; ++i)
+        if(!fits(context, locations[i])) return TBTC_OUT_OF_BOUNDS;
+    return TBTC_OK;
+}
+
+static void to_observation(tbtc_observation_t* o, features_t* f, pose_t* p) {
+    *o = (tbtc_observation_t) {
+        .value = f->value,
+        .min_depth = f->min_depth,
+        .max_depth = f->max_depth,
+        .mean_depth = f->mean_depth,
+        .median_depth = f->median_depth,
+        .principal_curvature_1_fp = f->principal_curvature_1_fp,
+        .principal_curvature_2_fp = f->principal_curvature_2_fp,
+        .point_normal = {p->point_normal.x, p->point_normal.y, p->point_normal.z},
+        .curvature_direction_1_angle = p->curvature_direction_1_angle,
+        .pose_fully_defined = p->pose_fully_defined != 0
+    };
+}
+
+TBTC_API tbtc_status tbtc_sense(tbtc_context_t* context, const tbtc_frame_t* frame,
+    const tbtc_location_t* locations, uint32_t num_locations, tbtc_observation_t* observations) {
+    if(context == NULL || (observations == NULL && num_locations > 0)) return TBTC_INVALID_ARGUMENT;
+
+    frame_view_t view;
+    tbtc_status status = view_frame(context, frame, &view);
+    if(status == TBTC_OK) status = check_locations(context, locations, num_locations);
+    if(status != TBTC_OK) return status;
+
+    u32 num_sensors = context->sensors.num_sensors;
+    features_t f[MAX_SENSORS];
+    pose_t p[MAX_SENSORS];
+
+    for(u32 i = 0; i < num_locations; ++i) {
+        vec2d location = {.x = locations[i].row, .y = locations[i].col};
+        sense_frame(context, &view, location, f, p);
+
+        for(u32 s = 0; s < num_sensors; ++s)
+            to_observation(observations + i * num_sensors + s, f + s, p + s);
+    }
+
+    return TBTC_OK;
+}
+
+TBTC_API tbtc_status tbtc_begin_episode(tbtc_context_t* context) {
+    if(context == NULL) return TBTC_INVALID_ARGUMENT;
+
+    arena_reset(&context->episode_arena);
+    learning_module_new_episode(&context->lm, &context->episode_arena);
+    return TBTC_OK;
+}
+
+TBTC_API tbtc_status tbtc_explore(tbtc_context_t* context, const tbtc_frame_t* frame,
+    const tbtc_location_t* locations, uint32_t num_locations) {
+    if(context == NULL) return TBTC_INVALID_ARGUMENT;
+    if(context->lm.finalized) return TBTC_FINALIZED;
+
+    frame_view_t view;
+    tbtc_status status = view_frame(context, frame, &view);
+    if(status == TBTC_OK) status = check_locations(context, locations, num_locations);
+    if(status != TBTC_OK) return status;
+
+    features_t f[MAX_SENSORS];
+    pose_t p[MAX_SENSORS];
+
+    for(u32 i = 0; i < num_locations; ++i) {
+        vec2d location = {.x = locations[i].row, .y = locations[i].col};
+        sense_frame(context, &view, location, f, p);
+
+        for(u32 s = 0; s < context->sensors.num_sensors; ++s)
+            learning_module_explore(&context->lm, f[s], p[s], vec_added(location, context->sensors.offsets[s]));
+    }
+
+    return TBTC_OK;
+}
+
+TBTC_API tbtc_status tbtc_store_object(tbtc_context_t* context, uint32_t object_id) {
+    if(context == NULL || object_id > context->lm.num_learnt_models) return TBTC_INVALID_ARGUMENT;
+    if(context->lm.finalized) return TBTC_FINALIZED;
+    if(object_id == context->lm.max_learnt_models) return TBTC_LIBRARY_FULL;
+
+    learning_module_store_model(&context->lm, object_id);
+    return TBTC_OK;
+}
+
+TBTC_API tbtc_status tbtc_finalize(tbtc_context_t* context) {
+    if(context == NULL) return TBTC_INVALID_ARGUMENT;
+    if(context->lm.finalized) return TBTC_FINALIZED;
+
+    learning_module_finalize(&context->lm);
+    return TBTC_OK;
+}
+
+TBTC_API tbtc_status tbtc_save_library(tbtc_context_t* context, const char* filename) {
+    if(context == NULL || filename == NULL) return TBTC_INVALID_ARGUMENT;
+    if(!context->lm.finalized) return TBTC_NOT_FINALIZED;
+
+    return write_mapped_library(filename, &context->lm, NULL) == MAPPED_LIBRARY_OK ? TBTC_OK : TBTC_IO_ERROR;
+}
+
+TBTC_API tbtc_status tbtc_map_library(tbtc_context_t* context, const char* filename) {
+    if(context == NULL || filename == NULL || context->lm.num_learnt_models > 0) return TBTC_INVALID_ARGUMENT;
+    if(context->lm.finalized) return TBTC_FINALIZED;
+
+    switch(learning_module_map_library(&context->lm, filename)) {
+        case MAPPED_LIBRARY_OK: return TBTC_OK;
+        case MAPPED_LIBRARY_NO_SUCH_FILE: return TBTC_NO_SUCH_FILE;
+        case MAPPED_LIBRARY_IO_ERROR: return TBTC_IO_ERROR;
+        case MAPPED_LIBRARY_INVALID: return TBTC_INVALID_LIBRARY;
+    }
+    return TBTC_INVALID_LIBRARY;
+}
+
+TBTC_API tbtc_status tbtc_match(tbtc_context_t* context, const tbtc_frame_t* frame,
+    const tbtc_location_t* locations, uint32_t num_locations, tbtc_match_result_t* results, uint32_t* num_matched) {
+    if(context == NULL || num_matched == NULL || (results == NULL && num_locations > 0)) return TBTC_INVALID_ARGUMENT;
+    *num_matched = 0;
+    if(!context->lm.finalized) return TBTC_NOT_FINALIZED;
+
+    frame_view_t view;
+    tbtc_status status = view_frame(context, frame, &view);
+    if(status == TBTC_OK) status = check_locations(context, locations, num_locations);
+    if(status != TBTC_OK) return status;
+
+    features_t f[MAX_SENSORS];
+    pose_t p[MAX_SENSORS];
+
+    for(u32 i = 0; i < num_locations; ++i) {
+        vec2d location = {.x = locations[i].row, .y = locations[i].col};
+        sense_frame(context, &view, location, f, p);
+
+        for(u32 s = 0; s < context->sensors.num_sensors; ++s)
+            learning_module_match(&context->lm, f[s], p[s], vec_added(location, context->sensors.offsets[s]));
+
+        i32 recognized_id = learning_module_recognized(&context->lm);
+        results[i] = (tbtc_match_result_t) {
+            .recognized_id = recognized_id,
+            .orientation = context->lm.recognized_orientation,
+            .num_hypotheses = context->lm.num_hypotheses
+        };
+        *num_matched = i + 1;
+
+        if(recognized_id != NOT_RECOGNIZED) break;
+    }
+
+    return TBTC_OK;
+}
@@ -0,0 +1,135 @@
+#ifndef TBTC_H
+#define TBTC_H
+
+/**
+ * Public C API of tbtc.so.
+ *
+ * Frames stay in the caller's memory: depths (u8 or u16) and values (u32) are read in place through explicit row strides,
+ *      and results are written to caller-provided arrays.
+ * Everything is allocated once by tbtc_create. After that, no call copies a frame nor allocates:
+ *      learnt models come from memory reserved at creation for max_objects.
+ *
+ * Locations are (row, col) of the agent in the frame. Each location is observed by every sensor of the agent,
+ *      at (row, col) + the sensor's offset (see tbtc_config_t).
+ *
+ * A context is not thread-safe: use one per thread.
+ *
+ * Typical use:
+ *      tbtc_create
+ *      for every object: tbtc_begin_episode, tbtc_explore (any number of times), tbtc_store_object
+ *      tbtc_finalize
+ *      for every episode: tbtc_begin_episode, tbtc_match until recognized
+ *      tbtc_destroy
+ *
+ * Serving processes learn once and save the finalized library (tbtc_save_library), then every worker
+ *      tbtc_create + tbtc_map_library instead of learning: they start at once and share the file's page cache.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TBTC_API __attribute__((visibility("default")))
+
+#define TBTC_VERSION 4 // 4: library errors are returned (TBTC_IO_ERROR, TBTC_INVALID_LIBRARY)
+
+typedef enum tbtc_status_ {
+    TBTC_OK = 0,
+    TBTC_INVALID_ARGUMENT = -1,
+    TBTC_OUT_OF_BOUNDS = -2, // a sensor's patch does not fit in the frame
+    TBTC_NOT_FINALIZED = -3, // matching before tbtc_finalize
+    TBTC_FINALIZED = -4, // learning after tbtc_finalize
+    TBTC_LIBRARY_FULL = -5, // more than max_objects objects
+    TBTC_NO_SUCH_FILE = -6,
+    TBTC_IO_ERROR = -7, // a library file could not be created, written, read or mapped
+    TBTC_INVALID_LIBRARY = -8 // not a library saved by tbtc_save_library, or not for this config
+} tbtc_status;
+
+#define TBTC_NOT_RECOGNIZED -1
+
+typedef struct tbtc_config_t_ {
+    uint32_t rows; // of every frame
+    uint32_t cols;
+    uint32_t model_scale; // frame cells per model cell, must divide rows and cols
+    uint32_t max_objects;
+    uint32_t num_orientations; // 1, or 8 to recognize objects in any of the 8 grid orientations
+    uint32_t patch_sidelen; // odd
+    uint32_t num_sensors; // 1 to 8
+    uint32_t sensor_spacing;
+} tbtc_config_t;
+
+/**
+ * A frame in the caller's memory. Strides are in bytes and may be larger than a row (padding, sub-frames).
+ * Depths are uint8_t, or uint16_t (e.g. millimetres from a depth camera) with depth_bytes = 2:
+ *      those are sensed at their full resolution. Depths of the frames learnt and matched should be of the same kind.
+ */
+typedef struct tbtc_frame_t_ {
+    const void* depths;
+    size_t depth_stride; // multiple of depth_bytes
+    const uint32_t* values;
+    size_t value_stride; // multiple of 4
+    uint32_t depth_bytes; // 1 (or 0) for uint8_t depths, 2 for uint16_t
+} tbtc_frame_t;
+
+typedef struct tbtc_location_t_ {
+    int32_t row;
+    int32_t col;
+} tbtc_location_t;
+
+// What a sensor observes at one location
+typedef struct tbtc_observation_t_ {
+    uint32_t value;
+    uint16_t min_depth;
+    uint16_t max_depth;
+    uint16_t mean_depth;
+    uint16_t median_depth;
+    int32_t principal_curvature_1_fp; // fixed point, 8 fractional bits
+    int32_t principal_curvature_2_fp;
+    int32_t point_normal[3];
+    uint8_t curvature_direction_1_angle; // axis angle, 256 bins over a half turn by default
+    uint8_t pose_fully_defined;
+} tbtc_observation_t;
+
+typedef struct tbtc_match_result_t_ {
+    int32_t recognized_id; // TBTC_NOT_RECOGNIZED until recognition
+    uint32_t orientation; // of the recognized object
+    uint32_t num_hypotheses; // still alive
+} tbtc_match_result_t;
+
+typedef struct tbtc_context_t_ tbtc_context_t;
+
+TBTC_API void tbtc_default_config(tbtc_config_t* config);
+// Returns NULL when the config is invalid or memory cannot be reserved
+TBTC_API tbtc_context_t* tbtc_create(const tbtc_config_t* config);
+TBTC_API void tbtc_destroy(tbtc_context_t* context);
+
+// observations: num_locations * num_sensors, location-major
+TBTC_API tbtc_status tbtc_sense(tbtc_context_t* context, const tbtc_frame_t* frame,
+    const tbtc_location_t* locations, uint32_t num_locations, tbtc_observation_t* observations);
+
+// Starts an episode: clears the working memory (exploration) or the hypotheses (matching)
+TBTC_API tbtc_status tbtc_begin_episode(tbtc_context_t* context);
+TBTC_API tbtc_status tbtc_explore(tbtc_context_t* context, const tbtc_frame_t* frame,
+    const tbtc_location_t* locations, uint32_t num_locations);
+// Commits the episode's exploration to object_id (a new object when object_id == number of objects stored so far)
+TBTC_API tbtc_status tbtc_store_object(tbtc_context_t* context, uint32_t object_id);
+TBTC_API tbtc_status tbtc_finalize(tbtc_context_t* context);
+
+// Writes the finalized library to a file that tbtc_map_library can map (TBTC_IO_ERROR leaves no file)
+TBTC_API tbtc_status tbtc_save_library(tbtc_context_t* context, const char* filename);
+/**
+ * Matches against a library saved by tbtc_save_library, read-only and paged in on demand, instead of learning one:
+ *      the context is finalized on return. Its config must be the one the library was saved with:
+ *      any other file is TBTC_INVALID_LIBRARY, and the context is left as it was.
+ */
+TBTC_API tbtc_status tbtc_map_library(tbtc_context_t* context, const char* filename);
+
+/**
+ * Matches the locations in order, one result per location, and stops at the first recognition.
+ * The evidence carries over between calls of the same episode.
+ *
+ * @param num_matched set to the number of locations matched (and results written)
+ */
+TBTC_API tbtc_status tbtc_match(tbtc_context_t* context, const tbtc_frame_t* frame,
+    const tbtc_location_t* locations, uint32_t num_locations, tbtc_match_result_t* results, uint32_t* num_matched);
+
+#endif // TBTC_H
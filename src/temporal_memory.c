@@ -0,0 +1,499 @@
+#include "temporal_memory.h"
+
+#include <string.h>
+
+#include "assertf.h"
+#include "bitset.h"
+#include "distributions.h"
+#include "memory_accounting.h"
+#include "saturated.h"
+
+void default_htm_lm_config(htm_lm_config_t* config, u32 num_columns, u32 location_bits) {
+    config->num_columns = num_columns;
+    config->cells_per_column = 16;
+    config->location_bits = location_bits;
+
+    config->segments_per_cell = 8;
+    config->synapses_per_segment = 32;
+
+    config->activation_threshold = 10;
+    config->learning_threshold = 8;
+    config->max_new_synapses = 20;
+
+    // new synapses start connected: an object is seen a few times only, a transition has to be learnt at once
+    config->initial_permanence = 140;
+    config->connected_permanence = 128;
+    config->permanence_increment = 20;
+    config->permanence_decrement = 8;
+    config->predicted_decrement = 4;
+}
+
+static size_t segment_slots(const htm_lm_config_t* config) {
+    return (size_t) config->num_columns * config->cells_per_column * config->segments_per_cell;
+}
+
+// Every chunk but the head of each list is full
+static size_t max_chunks(const htm_lm_config_t* config) {
+    size_t num_inputs = config->location_bits + (size_t) config->num_columns * config->cells_per_column;
+    return segment_slots(config) * config->synapses_per_segment / HTM_CHUNK_SYNAPSES + num_inputs;
+}
+
+size_t htm_lm_arena_bytes(const htm_lm_config_t* config) {
+    size_t num_cells = (size_t) config->num_columns * config->cells_per_column;
+    size_t num_inputs = config->location_bits + num_cells;
+    size_t segments = segment_slots(config);
+    size_t synapses = segments * config->synapses_per_segment;
+
+    return ARENA_ALIGN_UP(synapses * sizeof(u16)) + ARENA_ALIGN_UP(synapses * sizeof(u8))
+        + 2 * ARENA_ALIGN_UP(segments * sizeof(u64)) + 2 * ARENA_ALIGN_UP(segments * sizeof(u8))
+        + 3 * ARENA_ALIGN_UP(segments * sizeof(u32)) + ARENA_ALIGN_UP(BITSET_WORDS(segments) * sizeof(u64))
+        + 2 * ARENA_ALIGN_UP(num_inputs * sizeof(u32)) + ARENA_ALIGN_UP(max_chunks(config) * sizeof(htm_chunk_t))
+        + ARENA_ALIGN_UP(num_cells * sizeof(u8)) + 2 * ARENA_ALIGN_UP(num_cells * sizeof(u32))
+        + ARENA_ALIGN_UP(BITSET_WORDS(num_inputs) * sizeof(u64)) + 2 * ARENA_ALIGN_UP(num_inputs * sizeof(u16));
+}
+
+void init_htm_lm(htm_lm* lm, htm_lm_config_t config, arena_t* arena) {
+    assertf(config.cells_per_column >= 1 && config.segments_per_cell >= 1, "columns need cells, cells need segments");
+    assertf(config.segments_per_cell <= UINT8_MAX, "at most %d segments per cell", UINT8_MAX);
+    assertf(config.synapses_per_segment >= 1 && config.synapses_per_segment <= 64, "between 1 and 64 synapses per segment");
+    assertf(config.learning_threshold >= 1 && config.learning_threshold <= config.activation_threshold,
+        "the learning threshold (%u) is at least 1 and at most the activation threshold (%u)", config.learning_threshold, config.activation_threshold);
+    assertf(config.activation_threshold <= config.synapses_per_segment, "segments of %u synapses never reach %u active synapses",
+        config.synapses_per_segment, config.activation_threshold);
+
+    lm->config = config;
+    lm->num_cells = config.num_columns * config.cells_per_column;
+    lm->num_inputs = config.location_bits + lm->num_cells;
+    assertf((u64) config.location_bits + (u64) config.num_columns * config.cells_per_column <= UINT16_MAX + 1,
+        "at most %d location bits and cells (u16 presynaptic inputs)", UINT16_MAX + 1);
+
+    size_t segments = segment_slots(&config);
+    size_t synapses = segments * config.synapses_per_segment;
+    assertf(segments <= (1u << 26), "at most %u segments (synapse ids are segment << 6 | slot)", 1u << 26);
+
+    memory_tag previous_tag = set_memory_tag(MEMORY_LIBRARY);
+    lm->presynaptic = arena_alloc(arena, synapses, sizeof(*lm->presynaptic));
+    lm->permanences = arena_alloc(arena, synapses, sizeof(*lm->permanences));
+    lm->used = arena_calloc(arena, segments, sizeof(*lm->used));
+    lm->connected = arena_calloc(arena, segments, sizeof(*lm->connected));
+    lm->num_segments = arena_calloc(arena, lm->num_cells, sizeof(*lm->num_segments));
+    lm->last_used = arena_calloc(arena, segments, sizeof(*lm->last_used));
+
+    lm->list_heads = arena_alloc(arena, lm->num_inputs, sizeof(*lm->list_heads));
+    lm->list_lengths = arena_calloc(arena, lm->num_inputs, sizeof(*lm->list_lengths));
+    for(u32 i = 0; i < lm->num_inputs; ++i) lm->list_heads[i] = HTM_NO_CHUNK;
+    lm->chunks = arena_alloc(arena, max_chunks(&config), sizeof(*lm->chunks));
+    lm->num_chunks = 0;
+    lm->free_chunks = HTM_NO_CHUNK;
+
+    lm->connected_overlaps = arena_calloc(arena, segments, sizeof(*lm->connected_overlaps));
+    lm->potential_overlaps = arena_calloc(arena, segments, sizeof(*lm->potential_overlaps));
+    lm->touched = arena_calloc(arena, BITSET_WORDS(segments), sizeof(*lm->touched));
+    lm->active_segments = arena_alloc(arena, segments, sizeof(*lm->active_segments));
+    lm->matching_segments = arena_alloc(arena, segments, sizeof(*lm->matching_segments));
+    lm->num_active_segments = 0;
+    lm->num_matching_segments = 0;
+
+    lm->inputs = arena_calloc(arena, BITSET_WORDS(lm->num_inputs), sizeof(*lm->inputs));
+    lm->growth_inputs = arena_alloc(arena, lm->num_inputs, sizeof(*lm->growth_inputs));
+    lm->sample = arena_alloc(arena, lm->num_inputs, sizeof(*lm->sample));
+    lm->num_growth_inputs = 0;
+
+    lm->active_cells = arena_alloc(arena, lm->num_cells, sizeof(*lm->active_cells));
+    lm->winner_cells = arena_alloc(arena, lm->num_cells, sizeof(*lm->winner_cells));
+    set_memory_tag(previous_tag);
+
+    lm->num_active_cells = 0;
+    lm->num_winner_cells = 0;
+    lm->num_predicted_columns = 0;
+    lm->predicting = 0;
+
+    lm->time = 0;
+    memset(&lm->stats, 0, sizeof(lm->stats));
+}
+
+void htm_lm_new_episode(htm_lm* lm) {
+    lm->num_active_cells = 0;
+    lm->num_winner_cells = 0;
+}
+
+static u32 segment_column(const htm_lm* lm, u32 segment) {
+    return segment / (lm->config.segments_per_cell * lm->config.cells_per_column);
+}
+
+static u32 synapse_id(u32 segment, u32 slot) {
+    return segment << 6 | slot;
+}
+
+// Synapses of the input's list that are in its head chunk
+static u32 head_length(u32 length) {
+    return (length - 1) % HTM_CHUNK_SYNAPSES + 1;
+}
+
+static void list_append(htm_lm* lm, u32 input, u32 synapse) {
+    u32 length = lm->list_lengths[input];
+
+    if(length % HTM_CHUNK_SYNAPSES == 0) {
+        u32 chunk = lm->free_chunks;
+        if(chunk != HTM_NO_CHUNK) lm->free_chunks = lm->chunks[chunk].next;
+        else chunk = lm->num_chunks++;
+
+        lm->chunks[chunk].next = lm->list_heads[input];
+        lm->list_heads[input] = chunk;
+    }
+
+    lm->chunks[lm->list_heads[input]].synapses[length % HTM_CHUNK_SYNAPSES] = synapse;
+    lm->list_lengths[input] = length + 1;
+}
+
+// The last synapse of the list takes the place of the removed one
+static void list_remove(htm_lm* lm, u32 input, u32 synapse) {
+    u32 head = lm->list_heads[input];
+    u32 last = head_length(lm->list_lengths[input]) - 1;
+
+    for(u32 chunk = head; chunk != HTM_NO_CHUNK; chunk = lm->chunks[chunk].next) {
+        u32 length = chunk == head ? last + 1 : HTM_CHUNK_SYNAPSES;
+        for(u32 k = 0; k < length; ++k) {
+            if(lm->chunks[chunk].synapses[k] != synapse) continue;
+
+            lm->chunks[chunk].synapses[k] = lm->chunks[head].synapses[last];
+            lm->list_lengths[input] -= 1;
+            if(last == 0) {
+                lm->list_heads[input] = lm->chunks[head].next;
+                lm->chunks[head].next = lm->free_chunks;
+                lm->free_chunks = head;
+            }
+            return;
+        }
+    }
+
+    assertf(0, "synapse %u is not in the list of input %u", synapse, input);
+}
+
+// Counts the synapse of every segment on the input's list, marking the segments as touched
+static void count_input(htm_lm* lm, u32 input) {
+    u32 length = lm->list_lengths[input];
+    if(length == 0) return;
+
+    u32 head = lm->list_heads[input];
+    for(u32 chunk = head; chunk != HTM_NO_CHUNK; chunk = lm->chunks[chunk].next) {
+        const u32* synapses = lm->chunks[chunk].synapses;
+        u32 n = chunk == head ? head_length(length) : HTM_CHUNK_SYNAPSES;
+        if(lm->chunks[chunk].next != HTM_NO_CHUNK) __builtin_prefetch(lm->chunks + lm->chunks[chunk].next);
+
+        for(u32 k = 0; k < n; ++k) {
+            u32 segment = synapses[k] >> 6, slot = synapses[k] & 63;
+            lm->potential_overlaps[segment] += 1;
+            lm->connected_overlaps[segment] += (lm->connected[segment] >> slot) & 1;
+            bitset_set(lm->touched, segment);
+        }
+    }
+}
+
+/**
+ * @brief Sets the inputs (location bits and active cells) and the growth inputs (location bits and winner cells),
+ *      counts the overlaps through the synapse lists of the active inputs,
+ *      then walks the touched segments in order to list the active and matching ones
+ */
+u32 htm_lm_predict(htm_lm* lm, const spvec_u1* location) {
+    htm_lm_config_t* config = &lm->config;
+    assertf(location->length == config->location_bits, "location SDR of %u bits, expected %u", location->length, config->location_bits);
+
+    u32 num_words = BITSET_WORDS(segment_slots(config));
+    for(u32 w = 0; w < num_words; ++w) {
+        for(u64 word = lm->touched[w]; word != 0; word &= word - 1) {
+            u32 segment = w * 64 + __builtin_ctzll(word);
+            lm->potential_overlaps[segment] = 0;
+            lm->connected_overlaps[segment] = 0;
+        }
+        lm->touched[w] = 0;
+    }
+
+    bitset_clear(lm->inputs, lm->num_inputs);
+    bitset_set_sdr(lm->inputs, location, 0);
+    for(u32 i = 0; i < location->non_null_count; ++i)
+        count_input(lm, location->indices[i]);
+    for(u32 i = 0; i < lm->num_active_cells; ++i) {
+        bitset_set(lm->inputs, config->location_bits + lm->active_cells[i]);
+        count_input(lm, config->location_bits + lm->active_cells[i]);
+    }
+
+    memcpy(lm->growth_inputs, location->indices, location->non_null_count * sizeof(u16));
+    lm->num_growth_inputs = location->non_null_count;
+    for(u32 i = 0; i < lm->num_winner_cells; ++i)
+        lm->growth_inputs[lm->num_growth_inputs++] = config->location_bits + lm->winner_cells[i];
+
+    u32 num_active = 0, num_matching = 0, num_predicted_columns = 0;
+    i64 last_predicted_column = -1;
+
+    for(u32 w = 0; w < num_words; ++w) {
+        for(u64 word = lm->touched[w]; word != 0; word &= word - 1) {
+            u32 segment = w * 64 + __builtin_ctzll(word);
+
+            if(lm->connected_overlaps[segment] >= config->activation_threshold) {
+                lm->active_segments[num_active++] = segment;
+
+                u32 column = segment_column(lm, segment);
+                num_predicted_columns += column != last_predicted_column;
+                last_predicted_column = column;
+            }
+            if(lm->potential_overlaps[segment] >= config->learning_threshold)
+                lm->matching_segments[num_matching++] = segment;
+        }
+    }
+
+    lm->num_active_segments = num_active;
+    lm->num_matching_segments = num_matching;
+    lm->num_predicted_columns = num_predicted_columns;
+    lm->predicting = 1;
+
+    return num_predicted_columns;
+}
+
+void htm_lm_predicted_columns(htm_lm* lm, spvec_u1* predicted) {
+    u32 count = 0;
+    for(u32 i = 0; i < lm->num_active_segments; ++i) {
+        u32 column = segment_column(lm, lm->active_segments[i]);
+        if(count == 0 || predicted->indices[count - 1] != column)
+            predicted->indices[count++] = column;
+    }
+
+    predicted->length = lm->config.num_columns;
+    predicted->non_null_count = count;
+}
+
+static void set_permanence(htm_lm* lm, u32 segment, u32 slot, u8 permanence) {
+    lm->permanences[(size_t) segment * lm->config.synapses_per_segment + slot] = permanence;
+
+    u64 bit = (u64) 1 << slot;
+    if(permanence >= lm->config.connected_permanence) lm->connected[segment] |= bit;
+    else lm->connected[segment] &= ~bit;
+}
+
+static void destroy_synapse(htm_lm* lm, u32 segment, u32 slot) {
+    u32 input = lm->presynaptic[(size_t) segment * lm->config.synapses_per_segment + slot];
+    list_remove(lm, input, synapse_id(segment, slot));
+
+    u64 bit = (u64) 1 << slot;
+    lm->used[segment] &= ~bit;
+    lm->connected[segment] &= ~bit;
+}
+
+/**
+ * @brief Reinforces the synapses of the segment to active inputs and weakens the others,
+ *      destroying the ones that reach 0
+ */
+static void adapt_segment(htm_lm* lm, u32 segment) {
+    htm_lm_config_t* config = &lm->config;
+    size_t synapses = (size_t) segment * config->synapses_per_segment;
+
+    for(u64 used = lm->used[segment]; used != 0; used &= used - 1) {
+        u32 slot = __builtin_ctzll(used);
+        u8 permanence = lm->permanences[synapses + slot];
+
+        permanence = bitset_test(lm->inputs, lm->presynaptic[synapses + slot])
+            ? saturated_add(permanence, config->permanence_increment)
+            : saturated_sub(permanence, config->permanence_decrement);
+
+        if(permanence == 0) destroy_synapse(lm, segment, slot);
+        else set_permanence(lm, segment, slot, permanence);
+    }
+
+    lm->last_used[segment] = lm->time;
+}
+
+static void punish_segment(htm_lm* lm, u32 segment) {
+    size_t synapses = (size_t) segment * lm->config.synapses_per_segment;
+
+    for(u64 used = lm->used[segment]; used != 0; used &= used - 1) {
+        u32 slot = __builtin_ctzll(used);
+        if(!bitset_test(lm->inputs, lm->presynaptic[synapses + slot])) continue;
+
+        u8 permanence = saturated_sub(lm->permanences[synapses + slot], lm->config.predicted_decrement);
+        if(permanence == 0) destroy_synapse(lm, segment, slot);
+        else set_permanence(lm, segment, slot, permanence);
+    }
+}
+
+/**
+ * @brief Grows up to count synapses from the segment to growth inputs it is not connected to yet, drawn at random
+ *      (partial Fisher-Yates shuffle of the growth inputs), in its free slots
+ */
+static void grow_synapses(htm_lm* lm, u32 segment, u32 count) {
+    htm_lm_config_t* config = &lm->config;
+    size_t synapses = (size_t) segment * config->synapses_per_segment;
+    u64 all_slots = config->synapses_per_segment == 64 ? UINT64_MAX : ((u64) 1 << config->synapses_per_segment) - 1;
+
+    u32 num_candidates = lm->num_growth_inputs;
+    memcpy(lm->sample, lm->growth_inputs, num_candidates * sizeof(u16));
+
+    for(u32 i = 0; i < num_candidates && count > 0 && lm->used[segment] != all_slots; ++i) {
+        u32 j = unif_rand_range_u32(i, num_candidates - 1);
+        u16 candidate = lm->sample[j];
+        lm->sample[j] = lm->sample[i];
+
+        u32 known = 0;
+        for(u64 used = lm->used[segment]; used != 0; used &= used - 1)
+            known |= lm->presynaptic[synapses + __builtin_ctzll(used)] == candidate;
+        if(known) continue;
+
+        u32 slot = __builtin_ctzll(~lm->used[segment]);
+        lm->presynaptic[synapses + slot] = candidate;
+        lm->used[segment] |= (u64) 1 << slot;
+        set_permanence(lm, segment, slot, config->initial_permanence);
+        list_append(lm, candidate, synapse_id(segment, slot));
+        count -= 1;
+    }
+}
+
+// Reinforces a segment that was right (active) or nearly (best matching one of a bursting column) and tops it up
+static void learn_on_segment(htm_lm* lm, u32 segment) {
+    adapt_segment(lm, segment);
+
+    u32 potential = lm->potential_overlaps[segment];
+    if(potential < lm->config.max_new_synapses)
+        grow_synapses(lm, segment, lm->config.max_new_synapses - potential);
+}
+
+/**
+ * @brief New segment on the cell: a fresh slot, or the slot that is empty or has learnt the least recently
+ */
+static u32 create_segment(htm_lm* lm, u32 cell) {
+    u32 first = cell * lm->config.segments_per_cell;
+
+    u32 segment;
+    if(lm->num_segments[cell] < lm->config.segments_per_cell) {
+        segment = first + lm->num_segments[cell];
+        lm->num_segments[cell] += 1;
+    } else {
+        segment = first;
+        for(u32 s = first; s < first + lm->config.segments_per_cell; ++s) {
+            u64 age = lm->used[s] == 0 ? 0 : (u64) lm->last_used[s] + 1;
+            u64 best_age = lm->used[segment] == 0 ? 0 : (u64) lm->last_used[segment] + 1;
+            if(age < best_age) segment = s;
+        }
+
+        for(u64 used = lm->used[segment]; used != 0; used &= used - 1)
+            destroy_synapse(lm, segment, __builtin_ctzll(used));
+    }
+
+    lm->potential_overlaps[segment] = 0;
+    lm->connected_overlaps[segment] = 0;
+    lm->last_used[segment] = lm->time;
+    return segment;
+}
+
+// The cell of the column with the fewest segments, ties broken at random
+static u32 least_used_cell(htm_lm* lm, u32 column) {
+    u32 first = column * lm->config.cells_per_column;
+
+    u32 best = first, ties = 0;
+    for(u32 cell = first; cell < first + lm->config.cells_per_column; ++cell) {
+        if(lm->num_segments[cell] < lm->num_segments[best]) {
+            best = cell;
+            ties = 1;
+        } else if(lm->num_segments[cell] == lm->num_segments[best]) {
+            ties += 1;
+            if(unif_rand_u32(ties - 1) == 0) best = cell;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief Active columns (sorted) are walked together with the active and matching segments (sorted by column):
+ *      segments of the columns skipped over predicted or matched a column that did not activate
+ */
+void htm_lm_observe(htm_lm* lm, const spvec_u1* features, int learning) {
+    htm_lm_config_t* config = &lm->config;
+    assertf(features->length == config->num_columns, "feature SDR of %u bits, expected %u", features->length, config->num_columns);
+    assertf(lm->predicting, "every observation follows a prediction (htm_lm_predict)");
+
+    u32 segments_per_column = config->cells_per_column * config->segments_per_cell;
+    u32 a = 0, m = 0;
+
+    lm->num_active_cells = 0;
+    lm->num_winner_cells = 0;
+    u32 correct = 0;
+
+    for(u32 i = 0; i < features->non_null_count; ++i) {
+        u32 column = features->indices[i];
+        assertf(i == 0 || column > features->indices[i - 1], "feature SDR indices are sorted");
+        u32 start = column * segments_per_column, end = start + segments_per_column;
+
+        for(; m < lm->num_matching_segments && lm->matching_segments[m] < start; ++m) {
+            if(learning) punish_segment(lm, lm->matching_segments[m]);
+        }
+        for(; a < lm->num_active_segments && lm->active_segments[a] < start; ++a);
+
+        if(a < lm->num_active_segments && lm->active_segments[a] < end) {
+            correct += 1;
+
+            for(; a < lm->num_active_segments && lm->active_segments[a] < end; ++a) {
+                u32 segment = lm->active_segments[a];
+                u32 cell = segment / config->segments_per_cell;
+                if(lm->num_active_cells == 0 || lm->active_cells[lm->num_active_cells - 1] != cell) {
+                    lm->active_cells[lm->num_active_cells++] = cell;
+                    lm->winner_cells[lm->num_winner_cells++] = cell;
+                }
+                if(learning) learn_on_segment(lm, segment);
+            }
+        } else {
+            for(u32 c = 0; c < config->cells_per_column; ++c)
+                lm->active_cells[lm->num_active_cells++] = column * config->cells_per_column + c;
+
+            i64 best = -1;
+            for(u32 k = m; k < lm->num_matching_segments && lm->matching_segments[k] < end; ++k) {
+                u32 segment = lm->matching_segments[k];
+                if(best < 0 || lm->potential_overlaps[segment] > lm->potential_overlaps[best]) best = segment;
+            }
+
+            u32 winner;
+            if(best >= 0) {
+                winner = best / config->segments_per_cell;
+                if(learning) learn_on_segment(lm, best);
+            } else {
+                winner = least_used_cell(lm, column);
+                if(learning) learn_on_segment(lm, create_segment(lm, winner));
+            }
+            lm->winner_cells[lm->num_winner_cells++] = winner;
+        }
+
+        for(; m < lm->num_matching_segments && lm->matching_segments[m] < end; ++m);
+    }
+
+    for(; m < lm->num_matching_segments; ++m) {
+        if(learning) punish_segment(lm, lm->matching_segments[m]);
+    }
+
+    lm->stats.observations += 1;
+    lm->stats.active_columns += features->non_null_count;
+    lm->stats.predicted_columns += lm->num_predicted_columns;
+    lm->stats.correct_columns += correct;
+    lm->stats.bursting_columns += features->non_null_count - correct;
+
+    lm->predicting = 0;
+    lm->time += 1;
+}
+
+void htm_lm_step(htm_lm* lm, const spvec_u1* location, const spvec_u1* features, int learning) {
+    htm_lm_predict(lm, location);
+    htm_lm_observe(lm, features, learning);
+}
+
+u64 htm_lm_num_synapses(const htm_lm* lm) {
+    u64 count = 0;
+    for(u32 i = 0; i < lm->num_inputs; ++i)
+        count += lm->list_lengths[i];
+    return count;
+}
+
+void print_htm_lm_stats(const char* name, htm_lm_stats_t stats) {
+    f64 active = stats.active_columns > 0 ? (f64) stats.active_columns : 1;
+    f64 predicted = stats.predicted_columns > 0 ? (f64) stats.predicted_columns : 1;
+
+    printf("%s: observations=%llu recall=%.3f precision=%.3f bursting=%.3f\n", name,
+        (unsigned long long) stats.observations,
+        stats.correct_columns / active, stats.correct_columns / predicted, stats.bursting_columns / active);
+}
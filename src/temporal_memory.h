@@ -0,0 +1,149 @@
+#ifndef TEMPORAL_MEMORY_H
+#define TEMPORAL_MEMORY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "arena.h"
+#include "sparse.h"
+
+/**
+ * HTM-style learning module: the alternative to grid_lm sketched in learning_module.c.
+ * Given a movement (the new location SDR) and the cells active after the previous observation,
+ *      it predicts the next feature SDR, then learns from how wrong that prediction was.
+ *
+ * Every bit of the feature SDR is a column of cells_per_column cells. Cells have dendritic segments,
+ *      and a segment is a list of synapses to presynaptic inputs: the location bits, then every cell
+ *      (presynaptic input location_bits + cell).
+ * A segment with at least activation_threshold connected synapses (permanence >= connected_permanence) to active inputs
+ *      puts its cell in the predictive state; at least learning_threshold synapses of any permanence make it a match.
+ * On the observation, the active columns activate their predicted cells, or burst (all their cells) when none was:
+ *      predicted cells reinforce their active segments, bursting columns their best matching segment
+ *      or a new one on their least used cell, and matching segments of inactive columns are punished.
+ *
+ * Storage is sized for millions of synapses at interactive step rates:
+ *      - every cell has segments_per_cell segment slots and every segment synapses_per_segment (at most 64) synapse slots,
+ *        as contiguous arrays of u16 presynaptic inputs and u8 permanences (3 bytes per synapse), plus two bit-packed
+ *        masks per segment: the slots in use and the connected synapses. Slots are not compacted, so a synapse keeps its id
+ *      - a step only touches the synapses of the active inputs, a few percents of them: every input has the list
+ *        of its synapses (in chunks of HTM_CHUNK_SYNAPSES), and overlaps are counted by walking the lists of the active inputs
+ *      - touched segments are marked in a bit-packed set over the segment slots, which is walked in order:
+ *        segment lists (active, matching) come out sorted by segment, hence by column,
+ *        and are merged with the sorted active columns instead of being searched
+ *      - the active inputs are a bit-packed set too (at most 8 KB), for learning to test synapses against
+ */
+
+typedef struct htm_lm_config_t_ {
+    u32 num_columns; // length of the feature SDR
+    u32 cells_per_column;
+    u32 location_bits; // length of the location SDR
+
+    u32 segments_per_cell;
+    u32 synapses_per_segment; // at most 64
+
+    u32 activation_threshold;
+    u32 learning_threshold;
+    u32 max_new_synapses; // grown per learning segment and observation
+
+    u8 initial_permanence;
+    u8 connected_permanence;
+    u8 permanence_increment;
+    u8 permanence_decrement;
+    u8 predicted_decrement; // punishment of the segments that predicted a column that did not activate
+} htm_lm_config_t;
+
+// Prediction quality, summed over the observations
+typedef struct htm_lm_stats_t_ {
+    u64 observations;
+    u64 active_columns;
+    u64 predicted_columns; // columns that had a predicted cell
+    u64 correct_columns; // active columns that had a predicted cell
+    u64 bursting_columns; // active columns that had none
+} htm_lm_stats_t;
+
+// 256 bytes chunk of an input's synapse list
+#define HTM_CHUNK_SYNAPSES 63
+#define HTM_NO_CHUNK UINT32_MAX
+
+typedef struct htm_chunk_t_ {
+    u32 next;
+    u32 synapses[HTM_CHUNK_SYNAPSES]; // segment << 6 | slot
+} htm_chunk_t;
+
+typedef struct htm_lm_ {
+    htm_lm_config_t config;
+    u32 num_cells;
+    u32 num_inputs; // location_bits + num_cells
+
+    // synapse k of segment s (= cell * segments_per_cell + j) is slot s * synapses_per_segment + k, in use if bit k of used[s]
+    u16* presynaptic;
+    u8* permanences;
+    u64* used;
+    u64* connected;
+    u8* num_segments; // per cell, its segments are the first ones of its slots
+    u32* last_used; // per segment, observation it last learnt at (oldest ones are recycled)
+
+    // synapses of every input: list_heads[input] is the chunk holding the last ones (a partial chunk),
+    //      the others are full and follow through next
+    u32* list_heads;
+    u32* list_lengths;
+    htm_chunk_t* chunks;
+    u32 num_chunks;
+    u32 free_chunks; // list of released chunks, through next
+
+    // overlaps of the touched segments with the current inputs (0 for the others)
+    u8* connected_overlaps;
+    u8* potential_overlaps;
+    u64* touched; // bit-packed, over the segment slots
+    u32* active_segments;
+    u32 num_active_segments;
+    u32* matching_segments;
+    u32 num_matching_segments;
+
+    u64* inputs; // bit-packed active inputs of the prediction
+    u16* growth_inputs; // inputs new synapses are grown to: the location bits and the previous winner cells
+    u32 num_growth_inputs;
+    u16* sample; // scratch for sampling growth inputs
+
+    u32* active_cells;
+    u32 num_active_cells;
+    u32* winner_cells;
+    u32 num_winner_cells;
+
+    u32 num_predicted_columns;
+    u32 predicting; // htm_lm_predict was called since the last observation
+
+    u32 time;
+    htm_lm_stats_t stats;
+} htm_lm;
+
+void default_htm_lm_config(htm_lm_config_t* config, u32 num_columns, u32 location_bits);
+
+// Upper bound of what init_htm_lm takes from the arena
+size_t htm_lm_arena_bytes(const htm_lm_config_t* config);
+void init_htm_lm(htm_lm* lm, htm_lm_config_t config, arena_t* arena);
+
+// Forgets the sequence so far (not what was learnt): the next observation is not predicted from the previous one
+void htm_lm_new_episode(htm_lm* lm);
+
+/**
+ * Predicts the feature SDR at location, from it and the cells active after the previous observation.
+ *
+ * @returns the number of predicted columns
+ */
+u32 htm_lm_predict(htm_lm* lm, const spvec_u1* location);
+// Writes the predicted columns (sorted): predicted->indices must have room for num_columns indices
+void htm_lm_predicted_columns(htm_lm* lm, spvec_u1* predicted);
+
+// Activates the cells of the observed features (predicted by the last htm_lm_predict) and, when learning, learns from them
+void htm_lm_observe(htm_lm* lm, const spvec_u1* features, int learning);
+
+// htm_lm_predict then htm_lm_observe
+void htm_lm_step(htm_lm* lm, const spvec_u1* location, const spvec_u1* features, int learning);
+
+u64 htm_lm_num_synapses(const htm_lm* lm);
+void print_htm_lm_stats(const char* name, htm_lm_stats_t stats);
+
+#endif // TEMPORAL_MEMORY_H
@@ -1,49 +1,75 @@
 #include "tensor.h"
 
 #define INSTANTIATE_TENSOR_INIT(symbol) \
-    void tensor_##symbol##_init(TENSOR_TYPE(symbol)* t, u32 shape1, u32 shape2, u32 shape3) { \
-        TENSOR_INIT(t, shape1, shape2, shape3, DATA_TYPE(symbol)); \
+    void tensor_##symbol##_init(TENSOR_TYPE(symbol)* t, u32 shape1, u32 shape2, u32 shape3, arena_t* arena) { \
+        TENSOR_INIT(t, shape1, shape2, shape3, DATA_TYPE(symbol), arena); \
     }
 
+INSTANTIATE_TENSOR_INIT(u32)
 INSTANTIATE_TENSOR_INIT(u16)
 INSTANTIATE_TENSOR_INIT(u8)
 
 #define INSTANTIATE_MATRIX_INIT(symbol) \
-    void matrix_##symbol##_init(MAT_TYPE(symbol)* m, u32 rows, u32 cols) { \
-        MATRIX_INIT(m, rows, cols, DATA_TYPE(symbol)); \
+    void matrix_##symbol##_init(MAT_TYPE(symbol)* m, u32 rows, u32 cols, arena_t* arena) { \
+        MATRIX_INIT(m, rows, cols, DATA_TYPE(symbol), arena); \
     }
 
 INSTANTIATE_MATRIX_INIT(u32)
 INSTANTIATE_MATRIX_INIT(u16)
 INSTANTIATE_MATRIX_INIT(u8)
 
-u8 mat_u8_min(mat_u8 m) {
-    u8 min = 255;
-    for(u32 i = 0; i < m.rows; ++i) {
-        for(u32 j = 0; j < m.cols; ++j) {
-            if(MAT(m, i, j) < min) min = MAT(m, i, j);
-        }
+/**
+ * Reductions over the whole matrix (rows * cols elements).
+ * Four independent lanes break the dependency on a single min/max/sum, so that the loop can be vectorized
+ *      at the type's own width (32 u8 or 16 u16 per 256 bits register).
+ * The mean accumulates in acc_type, wide enough for any matrix of that type:
+ *      u32 for u8 (up to 2^24 elements), u64 for u16 (u32 would overflow past 65537 elements)
+ */
+#define INSTANTIATE_MATRIX_REDUCTIONS(symbol, max_value, acc_type) \
+    DATA_TYPE(symbol) mat_##symbol##_min(MAT_TYPE(symbol) m) { \
+        const DATA_TYPE(symbol)* data = m.data; \
+        u32 length = m.rows * m.cols; \
+        DATA_TYPE(symbol) lanes[4] = {max_value, max_value, max_value, max_value}; \
+        u32 i = 0; \
+        for(; i + 4 <= length; i += 4) \
+            for(u32 l = 0; l < 4; ++l) \
+                if(data[i + l] < lanes[l]) lanes[l] = data[i + l]; \
+        for(; i < length; ++i) \
+            if(data[i] < lanes[0]) lanes[0] = data[i]; \
+        DATA_TYPE(symbol) min = lanes[0]; \
+        for(u32 l = 1; l < 4; ++l) \
+            if(lanes[l] < min) min = lanes[l]; \
+        return min; \
+    } \
+    \
+    DATA_TYPE(symbol) mat_##symbol##_max(MAT_TYPE(symbol) m) { \
+        const DATA_TYPE(symbol)* data = m.data; \
+        u32 length = m.rows * m.cols; \
+        DATA_TYPE(symbol) lanes[4] = {0, 0, 0, 0}; \
+        u32 i = 0; \
+        for(; i + 4 <= length; i += 4) \
+            for(u32 l = 0; l < 4; ++l) \
+                if(data[i + l] > lanes[l]) lanes[l] = data[i + l]; \
+        for(; i < length; ++i) \
+            if(data[i] > lanes[0]) lanes[0] = data[i]; \
+        DATA_TYPE(symbol) max = lanes[0]; \
+        for(u32 l = 1; l < 4; ++l) \
+            if(lanes[l] > max) max = lanes[l]; \
+        return max; \
+    } \
+    \
+    DATA_TYPE(symbol) mat_##symbol##_mean(MAT_TYPE(symbol) m) { \
+        const DATA_TYPE(symbol)* data = m.data; \
+        u32 length = m.rows * m.cols; \
+        acc_type lanes[4] = {0, 0, 0, 0}; \
+        u32 i = 0; \
+        for(; i + 4 <= length; i += 4) \
+            for(u32 l = 0; l < 4; ++l) \
+                lanes[l] += data[i + l]; \
+        for(; i < length; ++i) \
+            lanes[0] += data[i]; \
+        return (lanes[0] + lanes[1] + lanes[2] + lanes[3]) / length; \
     }
-    return min;
-}
 
-u8 mat_u8_max(mat_u8 m) {
-    u8 max = 0;
-    for(u32 i = 0; i < m.rows; ++i) {
-        for(u32 j = 0; j < m.cols; ++j) {
-            if(MAT(m, i, j) > max) max = MAT(m, i, j);
-        }
-    }
-    return max;
-}
-
-u8 mat_u8_mean(mat_u8 m) {
-    u32 acc = 0;
-    for(u32 i = 0; i < m.rows; ++i) {
-        for(u32 j = 0; j < m.cols; ++j) {
-            acc += MAT(m, i, j);
-        }
-    }
-    u32 num_elems = m.rows * m.cols;
-    return acc / num_elems;
-}
+INSTANTIATE_MATRIX_REDUCTIONS(u16, UINT16_MAX, u64)
+INSTANTIATE_MATRIX_REDUCTIONS(u8, UINT8_MAX, u32)
@@ -8,6 +8,7 @@
 #include "math.h"
 
 #include "types.h"
+#include "arena.h"
 
 #define DATA_TYPE(symbol) symbol
 
@@ -32,13 +33,14 @@ DEFINE_TENSOR_STRUCT(u8);
 #define TENSOR3D_AXIS2(t, i, j) (TENSOR3D_AXIS1(t, i) + j * (t).shape3)
 #define TENSOR3D(t, i, j, k) (TENSOR3D_AXIS2(t, i, j) + k)
 
-#define TENSOR_INIT(t, shape1, shape2, shape3, type) \
+// arena can be NULL, in which case the data is calloc-ed
+#define TENSOR_INIT(t, shape1, shape2, shape3, type, arena) \
     do { \
         t->stride1 = shape2 * shape3; \
         t->shape1 = shape1; \
         t->shape2 = shape2; \
         t->shape3 = shape3; \
-        t->data = (type*) calloc(shape1 * shape2 * shape3, sizeof(*t->data)); \
+        t->data = (type*) arena_calloc(arena, shape1 * shape2 * shape3, sizeof(*t->data)); \
     } while(0)
 
 #define BUFFER_TO_TENSOR(type, buffer, shape1, shape2, shape3) \
@@ -72,7 +74,7 @@ DEFINE_TENSOR_STRUCT(u8);
     } while(0)
 
 #define DEFINE_TENSOR_INIT(symbol) \
-    void tensor_##symbol##_init(TENSOR_TYPE(symbol)* t, u32 shape1, u32 shape2, u32 shape3);
+    void tensor_##symbol##_init(TENSOR_TYPE(symbol)* t, u32 shape1, u32 shape2, u32 shape3, arena_t* arena);
 
 DEFINE_TENSOR_INIT(u32);
 DEFINE_TENSOR_INIT(u16);
@@ -96,11 +98,12 @@ DEFINE_MATRIX_STRUCT(u8);
 #define MAT(t, i, j) ((t).data[((i) * (t).cols) + (j)])
 #define MATP(t, i, j) ((t).data + ((i) * (t).cols) + (j))
 
-#define MATRIX_INIT(m, rows, cols, type) \
+// arena can be NULL, in which case the data is calloc-ed
+#define MATRIX_INIT(m, rows, cols, type, arena) \
     do { \
         (m)->rows = rows; \
         (m)->cols = cols; \
-        (m)->data = (type*) calloc(rows * cols, sizeof(*(m)->data)); \
+        (m)->data = (type*) arena_calloc(arena, rows * cols, sizeof(*(m)->data)); \
     } while(0)
 
 #define MATRIX_PRINT(m, rows, cols) \
@@ -113,14 +116,19 @@ DEFINE_MATRIX_STRUCT(u8);
     } while(0)
 
 #define DEFINE_MATRIX_INIT(symbol) \
-    void matrix_##symbol##_init(MAT_TYPE(symbol)* m, u32 rows, u32 cols)
+    void matrix_##symbol##_init(MAT_TYPE(symbol)* m, u32 rows, u32 cols, arena_t* arena)
 
 DEFINE_MATRIX_INIT(u32);
 DEFINE_MATRIX_INIT(u16);
 DEFINE_MATRIX_INIT(u8);
 
-u8 mat_u8_min(mat_u8 m);
-u8 mat_u8_max(mat_u8 m);
-u8 mat_u8_mean(mat_u8 m); 
+// min, max and (floored) mean of all the elements, see INSTANTIATE_MATRIX_REDUCTIONS for the accumulator widths
+#define DEFINE_MATRIX_REDUCTIONS(symbol) \
+    DATA_TYPE(symbol) mat_##symbol##_min(MAT_TYPE(symbol) m); \
+    DATA_TYPE(symbol) mat_##symbol##_max(MAT_TYPE(symbol) m); \
+    DATA_TYPE(symbol) mat_##symbol##_mean(MAT_TYPE(symbol) m)
+
+DEFINE_MATRIX_REDUCTIONS(u16);
+DEFINE_MATRIX_REDUCTIONS(u8);
 
 #endif
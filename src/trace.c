@@ -0,0 +1,157 @@
+#include "trace.h"
+
+#include "assertf.h"
+#include "io.h"
+
+// Traces are written and read in big sequential chunks
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+static FILE* open_trace(const char* filename, const char* mode) {
+    FILE* f = fopen(filename, mode);
+    assertf(f != NULL, "could not open trace %s", filename);
+
+    setvbuf(f, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+    return f;
+}
+
+static void write_kind(FILE* f, trace_record_kind kind) {
+    u8 k = kind;
+    FWRITE_CHECK(&k, sizeof(k), 1, f);
+}
+
+FILE* open_trace_writer(const char* filename, trace_header_t header) {
+    FILE* f = open_trace(filename, "wb");
+
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    FWRITE_CHECK(&header, sizeof(header), 1, f);
+
+    return f;
+}
+
+void trace_write_episode_begin(FILE* f, u32 object_id, int learning) {
+    u32 payload[2] = {object_id, learning != 0};
+
+    write_kind(f, TRACE_EPISODE_BEGIN);
+    FWRITE_CHECK(payload, sizeof(*payload), 2, f);
+}
+
+void trace_write_observation(FILE* f, u32 step, u32 sensor, int end_of_step, vec2d location, vec2d movement, features_t features, pose_t pose) {
+    trace_observation_t o = {
+        .location_x = location.x, .location_y = location.y,
+        .movement_x = movement.x, .movement_y = movement.y,
+
+        .value = features.value,
+        .min_depth = features.min_depth,
+        .max_depth = features.max_depth,
+        .mean_depth = features.mean_depth,
+        .p10_depth = features.p10_depth,
+        .median_depth = features.median_depth,
+        .p90_depth = features.p90_depth,
+        .direction_1_angle = pose.curvature_direction_1_angle,
+        .direction_2_angle = pose.curvature_direction_2_angle,
+        .principal_curvature_1_fp = features.principal_curvature_1_fp,
+        .principal_curvature_2_fp = features.principal_curvature_2_fp,
+
+        .normal_x = pose.point_normal.x,
+        .normal_y = pose.point_normal.y,
+        .direction_1 = {pose.curvature_direction_1.x, pose.curvature_direction_1.y, pose.curvature_direction_1.z},
+        .direction_2 = {pose.curvature_direction_2.x, pose.curvature_direction_2.y, pose.curvature_direction_2.z},
+
+        .step = step,
+        .sensor = sensor,
+        .flags = (pose.pose_fully_defined ? TRACE_POSE_FULLY_DEFINED : 0) | (end_of_step ? TRACE_END_OF_STEP : 0)
+    };
+
+    write_kind(f, TRACE_OBSERVATION);
+    FWRITE_CHECK(&o, sizeof(o), 1, f);
+}
+
+void trace_write_episode_end(FILE* f, u32 steps, i32 recognized_id) {
+    u32 payload[2] = {steps, (u32) recognized_id};
+
+    write_kind(f, TRACE_EPISODE_END);
+    FWRITE_CHECK(payload, sizeof(*payload), 2, f);
+}
+
+void trace_write_finalize(FILE* f) {
+    write_kind(f, TRACE_FINALIZE);
+}
+
+void close_trace(FILE* f) {
+    fclose(f);
+}
+
+FILE* open_trace_reader(const char* filename, trace_header_t* header) {
+    FILE* f = open_trace(filename, "rb");
+
+    FREAD_CHECK(header, sizeof(*header), 1, f);
+    assertf(header->magic == TRACE_MAGIC, "%s is not a trace", filename);
+    assertf(header->version == TRACE_VERSION, "trace %s has version %u, expected %d", filename, header->version, TRACE_VERSION);
+
+    return f;
+}
+
+static void decode_observation(trace_record_t* record, trace_observation_t* o) {
+    record->step = o->step;
+    record->sensor = o->sensor;
+    record->end_of_step = (o->flags & TRACE_END_OF_STEP) != 0;
+    record->location = (vec2d) {.x = o->location_x, .y = o->location_y};
+    record->movement = (vec2d) {.x = o->movement_x, .y = o->movement_y};
+
+    int pose_fully_defined = (o->flags & TRACE_POSE_FULLY_DEFINED) != 0;
+
+    record->features = (features_t) {
+        .value = o->value,
+        .min_depth = o->min_depth,
+        .max_depth = o->max_depth,
+        .mean_depth = o->mean_depth,
+        .p10_depth = o->p10_depth,
+        .median_depth = o->median_depth,
+        .p90_depth = o->p90_depth,
+        .principal_curvature_1_fp = o->principal_curvature_1_fp,
+        .principal_curvature_2_fp = o->principal_curvature_2_fp,
+        .pose_fully_defined = pose_fully_defined
+    };
+
+    record->pose = (pose_t) {
+        .point_normal = {.x = o->normal_x, .y = o->normal_y, .z = 2},
+        .curvature_direction_1 = {.x = o->direction_1[0], .y = o->direction_1[1], .z = o->direction_1[2]},
+        .curvature_direction_2 = {.x = o->direction_2[0], .y = o->direction_2[1], .z = o->direction_2[2]},
+        .curvature_direction_1_angle = o->direction_1_angle,
+        .curvature_direction_2_angle = o->direction_2_angle,
+        .pose_fully_defined = pose_fully_defined
+    };
+}
+
+int trace_read_record(FILE* f, trace_record_t* record) {
+    u8 kind;
+    if(fread(&kind, sizeof(kind), 1, f) != 1) return 0;
+    record->kind = kind;
+
+    u32 payload[2];
+    trace_observation_t o;
+
+    switch(record->kind) {
+        case TRACE_EPISODE_BEGIN:
+            FREAD_CHECK(payload, sizeof(*payload), 2, f);
+            record->object_id = payload[0];
+            record->learning = payload[1];
+            break;
+        case TRACE_OBSERVATION:
+            FREAD_CHECK(&o, sizeof(o), 1, f);
+            decode_observation(record, &o);
+            break;
+        case TRACE_EPISODE_END:
+            FREAD_CHECK(payload, sizeof(*payload), 2, f);
+            record->steps = payload[0];
+            record->recognized_id = (i32) payload[1];
+            break;
+        case TRACE_FINALIZE:
+            break;
+        default:
+            assertf(0, "unknown trace record kind %u", kind);
+    }
+
+    return 1;
+}
@@ -0,0 +1,107 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "location.h"
+#include "interfaces.h"
+
+/**
+ * Binary traces of what the learning module sees, to replay it without an environment or a sensor.
+ *
+ * A trace is a trace_header_t followed by records, each one a u8 trace_record_kind and its payload:
+ *      TRACE_EPISODE_BEGIN     u32 object_id, u32 learning
+ *      TRACE_OBSERVATION       trace_observation_t, one per sensor and step
+ *      TRACE_EPISODE_END       u32 steps, i32 recognized_id (as recorded, NOT_RECOGNIZED when learning)
+ *      TRACE_FINALIZE          nothing: the learning phase is over
+ * Everything is written sequentially through a large stdio buffer.
+ */
+
+#define TRACE_MAGIC 0x52544254 // "TBTR"
+#define TRACE_VERSION 2 // 2: u16 depth statistics
+
+typedef struct trace_header_t_ {
+    u32 magic;
+    u32 version;
+    u32 env_rows;
+    u32 env_cols;
+    u32 model_scale;
+    u32 num_objects;
+    u32 num_orientations;
+} trace_header_t;
+
+typedef enum trace_record_kind_ {
+    TRACE_EPISODE_BEGIN = 1,
+    TRACE_OBSERVATION,
+    TRACE_EPISODE_END,
+    TRACE_FINALIZE
+} trace_record_kind;
+
+#define TRACE_POSE_FULLY_DEFINED 1
+#define TRACE_END_OF_STEP 2 // last observation (sensor) of its step
+
+// On-disk observation: fixed-width fields, no padding
+typedef struct trace_observation_t_ {
+    i16 location_x; // of the sensor
+    i16 location_y;
+    i16 movement_x; // of the agent, after the step
+    i16 movement_y;
+
+    u32 value;
+    u16 min_depth;
+    u16 max_depth;
+    u16 mean_depth;
+    u16 p10_depth;
+    u16 median_depth;
+    u16 p90_depth;
+    i32 principal_curvature_1_fp;
+    i32 principal_curvature_2_fp;
+
+    i16 normal_x; // the normal's z is always 2
+    i16 normal_y;
+    i32 direction_1[3];
+    i32 direction_2[3];
+
+    u32 step;
+    u8 sensor;
+    u8 flags;
+    u8 direction_1_angle;
+    u8 direction_2_angle;
+} trace_observation_t;
+
+_Static_assert(sizeof(trace_observation_t) == 68, "trace_observation_t must not be padded");
+
+// A decoded record
+typedef struct trace_record_t_ {
+    trace_record_kind kind;
+
+    u32 object_id; // TRACE_EPISODE_BEGIN
+    u32 learning;
+
+    u32 steps; // TRACE_EPISODE_END
+    i32 recognized_id;
+
+    u32 step; // TRACE_OBSERVATION
+    u32 sensor;
+    int end_of_step;
+    vec2d location;
+    vec2d movement;
+    features_t features;
+    pose_t pose;
+} trace_record_t;
+
+FILE* open_trace_writer(const char* filename, trace_header_t header);
+void trace_write_episode_begin(FILE* f, u32 object_id, int learning);
+void trace_write_observation(FILE* f, u32 step, u32 sensor, int end_of_step, vec2d location, vec2d movement, features_t features, pose_t pose);
+void trace_write_episode_end(FILE* f, u32 steps, i32 recognized_id);
+void trace_write_finalize(FILE* f);
+void close_trace(FILE* f);
+
+FILE* open_trace_reader(const char* filename, trace_header_t* header);
+// Returns 0 at the end of the trace
+int trace_read_record(FILE* f, trace_record_t* record);
+
+#endif // TRACE_H
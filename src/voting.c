@@ -0,0 +1,99 @@
+#include "voting.h"
+
+#include "assertf.h"
+
+/**
+ * @brief Top VOTE_TOP_K models among the lm's hypotheses, by insertion in a small sorted array
+ */
+void learning_module_vote(grid_lm* lm, u32 step, lm_vote_t* vote) {
+    vote->step = step;
+    vote->num_models = 0;
+    vote->truncated = 0;
+
+    for(u32 i = 0; i < lm->num_hypotheses; ++i) {
+        u32 h = lm->hypotheses[i];
+        u32 model = h / lm->num_orientations;
+        i32 evidence = lm->evidence[h];
+
+        // a model appears once, with its best orientation
+        u32 slot = 0;
+        while(slot < vote->num_models && vote->model_ids[slot] != model) ++slot;
+
+        if(slot < vote->num_models) {
+            if(evidence <= vote->evidence[slot]) continue;
+        } else if(vote->num_models < VOTE_TOP_K) {
+            slot = vote->num_models++;
+        } else {
+            vote->truncated = 1;
+            if(evidence <= vote->evidence[VOTE_TOP_K - 1]) continue;
+            slot = VOTE_TOP_K - 1;
+        }
+
+        // bubble up to keep the array sorted by decreasing evidence
+        while(slot > 0 && vote->evidence[slot - 1] < evidence) {
+            vote->model_ids[slot] = vote->model_ids[slot - 1];
+            vote->evidence[slot] = vote->evidence[slot - 1];
+            --slot;
+        }
+        vote->model_ids[slot] = model;
+        vote->evidence[slot] = evidence;
+    }
+}
+
+static inline int find_in_vote(lm_vote_t* vote, u32 model) {
+    for(u32 i = 0; i < vote->num_models; ++i)
+        if(vote->model_ids[i] == model) return i;
+    return -1;
+}
+
+/**
+ * @brief Scores every model present in at least one vote.
+ * A model missing from a truncated vote is considered tied with the last reported one: ties carry no information.
+ * Recognition needs a positive summed evidence and a lead of RECOGNITION_MARGIN over every other candidate.
+ */
+i32 combine_votes(lm_vote_t* votes, u32 num_votes) {
+    i32 best_model = NOT_RECOGNIZED;
+    i32 best_score = INT32_MIN, second_score = INT32_MIN;
+    i32 best_total = 0;
+
+    for(u32 v = 0; v < num_votes; ++v) {
+        for(u32 c = 0; c < votes[v].num_models; ++c) {
+            u32 model = votes[v].model_ids[c];
+
+            // only score a candidate the first time it appears
+            int seen = 0;
+            for(u32 w = 0; w < v && !seen; ++w) seen = find_in_vote(votes + w, model) >= 0;
+            if(seen) continue;
+
+            i32 score = 0, total = 0;
+            for(u32 w = 0; w < num_votes; ++w) {
+                lm_vote_t* vote = votes + w;
+                if(vote->num_models == 0) continue;
+
+                int i = find_in_vote(vote, model);
+                if(i >= 0) {
+                    score += vote->evidence[i] - vote->evidence[0];
+                    total += vote->evidence[i];
+                } else if(vote->truncated) {
+                    score += vote->evidence[vote->num_models - 1] - vote->evidence[0];
+                } else {
+                    score -= VOTE_MISSING_PENALTY;
+                }
+            }
+
+            if(score > best_score) {
+                second_score = best_score;
+                best_score = score;
+                best_model = model;
+                best_total = total;
+            } else if(score > second_score) {
+                second_score = score;
+            }
+        }
+    }
+
+    if(best_model == NOT_RECOGNIZED || best_total <= 0) return NOT_RECOGNIZED;
+    if(second_score == INT32_MIN || best_score - second_score >= RECOGNITION_MARGIN) return best_model;
+
+    return NOT_RECOGNIZED;
+}
@@ -0,0 +1,35 @@
+#ifndef VOTING_H
+#define VOTING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "learning_module.h"
+
+/**
+ * Learning modules publish, every step, their best models with their evidence (one vote).
+ * The voting stage sums, for every model that appears in any vote, how far behind each module's best it is:
+ *      the true model is near the top of every module, while a wrong one rarely is everywhere at once,
+ *      so agreement builds up a margin faster than any single module's evidence does.
+ */
+#define VOTE_TOP_K 8
+
+typedef struct lm_vote_t_ {
+    u32 step;
+    u32 num_models;
+    int truncated; // more models were alive than reported
+    u32 model_ids[VOTE_TOP_K];
+    i32 evidence[VOTE_TOP_K]; // best first, the best of the model's orientations
+} lm_vote_t;
+
+// A model that is not in a complete vote has been pruned: it is at least that far behind
+#define VOTE_MISSING_PENALTY (PRUNE_MARGIN + 1)
+
+void learning_module_vote(grid_lm* lm, u32 step, lm_vote_t* vote);
+
+// Returns the recognized model or NOT_RECOGNIZED
+i32 combine_votes(lm_vote_t* votes, u32 num_votes);
+
+#endif
@@ -0,0 +1,269 @@
+#include "voxel_environment.h"
+
+#include <string.h>
+#include <math.h>
+
+#include "assertf.h"
+
+static i32 min_i32(i32 a, i32 b) { return a < b ? a : b; }
+static i32 max_i32(i32 a, i32 b) { return a > b ? a : b; }
+
+static inline u64 brick_key(i32 bx, i32 by, i32 bz) {
+    return ((u64) bx << 42) | ((u64) by << 21) | (u64) bz;
+}
+
+// splitmix64 finalizer
+static inline u32 hash_brick_key(u64 key) {
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return (u32) (key ^ (key >> 31));
+}
+
+static u32 num_slots_for(u32 max_bricks) {
+    u32 num_slots = 16;
+    while(num_slots < 2 * max_bricks) num_slots <<= 1;
+    return num_slots;
+}
+
+size_t voxel_env_bytes(u32 max_bricks) {
+    u32 num_slots = num_slots_for(max_bricks);
+    return ARENA_ALIGN_UP(num_slots * sizeof(u64))
+        + ARENA_ALIGN_UP(num_slots * sizeof(u32))
+        + ARENA_ALIGN_UP((size_t) max_bricks * sizeof(voxel_brick_t));
+}
+
+void init_voxel_env(voxel_env_t* env, u32 size_x, u32 size_y, u32 size_z, u32 max_bricks, arena_t* arena) {
+    assertf(size_x <= VOXEL_MAX_SIZE && size_y <= VOXEL_MAX_SIZE && size_z <= VOXEL_MAX_SIZE,
+        "voxel environments are at most %d voxels along every axis", VOXEL_MAX_SIZE);
+
+    env->size_x = size_x;
+    env->size_y = size_y;
+    env->size_z = size_z;
+
+    env->num_slots = num_slots_for(max_bricks);
+    env->keys = arena_alloc(arena, env->num_slots, sizeof(*env->keys));
+    memset(env->keys, 0xff, env->num_slots * sizeof(*env->keys)); // EMPTY_BRICK_KEY
+    env->slot_bricks = arena_alloc(arena, env->num_slots, sizeof(*env->slot_bricks));
+
+    env->num_bricks = 0;
+    env->max_bricks = max_bricks;
+    env->bricks = arena_calloc(arena, max_bricks, sizeof(*env->bricks));
+}
+
+// Returns the slot of key, or the empty slot where it should be inserted
+static inline u32 find_slot(const voxel_env_t* env, u64 key) {
+    u32 mask = env->num_slots - 1;
+    u32 slot = hash_brick_key(key) & mask;
+    while(env->keys[slot] != key && env->keys[slot] != EMPTY_BRICK_KEY)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+static inline const voxel_brick_t* find_brick(const voxel_env_t* env, u64 key) {
+    u32 slot = find_slot(env, key);
+    return env->keys[slot] == EMPTY_BRICK_KEY ? NULL : env->bricks + env->slot_bricks[slot];
+}
+
+static inline int is_inside(const voxel_env_t* env, vec3d p) {
+    return p.x >= 0 && p.y >= 0 && p.z >= 0
+        && (u32) p.x < env->size_x && (u32) p.y < env->size_y && (u32) p.z < env->size_z;
+}
+
+// Bit of the voxel in its brick's occupancy[z], and index of its value
+#define VOXEL_BIT(p) (((p).y & (VOXEL_BRICK_SIDE - 1)) * VOXEL_BRICK_SIDE + ((p).x & (VOXEL_BRICK_SIDE - 1)))
+#define VOXEL_INDEX(p) (((p).z & (VOXEL_BRICK_SIDE - 1)) * VOXEL_BRICK_SIDE * VOXEL_BRICK_SIDE + VOXEL_BIT(p))
+
+static inline int brick_voxel(const voxel_brick_t* brick, vec3d p, u32* value) {
+    if(!(brick->occupancy[p.z & (VOXEL_BRICK_SIDE - 1)] >> VOXEL_BIT(p) & 1)) return 0;
+    if(value != NULL) *value = brick->values[VOXEL_INDEX(p)];
+    return 1;
+}
+
+void set_voxel(voxel_env_t* env, vec3d p, u32 value) {
+    assertf(is_inside(env, p), "voxel (%d, %d, %d) out of the environment", p.x, p.y, p.z);
+
+    u64 key = brick_key(p.x >> VOXEL_BRICK_BITS, p.y >> VOXEL_BRICK_BITS, p.z >> VOXEL_BRICK_BITS);
+    u32 slot = find_slot(env, key);
+    if(env->keys[slot] == EMPTY_BRICK_KEY) {
+        assertf(env->num_bricks < env->max_bricks, "voxel environment is full (%u bricks)", env->max_bricks);
+        env->keys[slot] = key;
+        env->slot_bricks[slot] = env->num_bricks++;
+    }
+
+    voxel_brick_t* brick = env->bricks + env->slot_bricks[slot];
+    brick->occupancy[p.z & (VOXEL_BRICK_SIDE - 1)] |= (u64) 1 << VOXEL_BIT(p);
+    brick->values[VOXEL_INDEX(p)] = value;
+}
+
+int get_voxel(const voxel_env_t* env, vec3d p, u32* value) {
+    if(!is_inside(env, p)) return 0;
+
+    const voxel_brick_t* brick = find_brick(env, brick_key(p.x >> VOXEL_BRICK_BITS, p.y >> VOXEL_BRICK_BITS, p.z >> VOXEL_BRICK_BITS));
+    return brick != NULL && brick_voxel(brick, p, value);
+}
+
+void voxelize_grid_surface(voxel_env_t* env, grid_t* grid, u32 z_offset) {
+    static const vec2d neighbours[4] = {{0, 1}, {1, 0}, {0, -1}, {-1, 0}};
+
+    for(i32 i = 0; i < (i32) grid->rows; ++i) {
+        for(i32 j = 0; j < (i32) grid->cols; ++j) {
+            i32 top = MAT(grid->depths, i, j) + z_offset;
+
+            i32 bottom = top;
+            for(u32 n = 0; n < 4; ++n) {
+                i32 ni = i + neighbours[n].x, nj = j + neighbours[n].y;
+                if(ni < 0 || nj < 0 || ni >= (i32) grid->rows || nj >= (i32) grid->cols) continue;
+                bottom = min_i32(bottom, MAT(grid->depths, ni, nj) + z_offset + 1);
+            }
+
+            for(i32 z = bottom; z <= top; ++z)
+                set_voxel(env, (vec3d) {.x = i, .y = j, .z = z}, MAT(grid->values, i, j));
+        }
+    }
+}
+
+/**
+ * @brief Every column of bricks spans from the lowest cell of its block and the block's border
+ *      (what a bottom reaches down to) to the highest cell of its block
+ */
+u32 grid_surface_bricks(grid_t* grid, u32 z_offset) {
+    u32 num_bricks = 0;
+
+    for(i32 bi = 0; bi < (i32) grid->rows; bi += VOXEL_BRICK_SIDE) {
+        for(i32 bj = 0; bj < (i32) grid->cols; bj += VOXEL_BRICK_SIDE) {
+            i32 bottom = INT32_MAX, top = 0;
+            for(i32 i = max_i32(bi - 1, 0); i < min_i32(bi + VOXEL_BRICK_SIDE + 1, grid->rows); ++i) {
+                for(i32 j = max_i32(bj - 1, 0); j < min_i32(bj + VOXEL_BRICK_SIDE + 1, grid->cols); ++j) {
+                    i32 z = MAT(grid->depths, i, j) + z_offset;
+                    bottom = min_i32(bottom, z);
+                    top = max_i32(top, z);
+                }
+            }
+
+            num_bricks += (top >> VOXEL_BRICK_BITS) - (bottom >> VOXEL_BRICK_BITS) + 1;
+        }
+    }
+
+    return num_bricks;
+}
+
+static void normalize3(f32 v[3]) {
+    f32 norm = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    assertf(norm > 0, "null vector");
+    for(u32 a = 0; a < 3; ++a) v[a] /= norm;
+}
+
+/**
+ * @brief u is the first axis (x, or y when looking along x) made orthogonal to w, and v = u x w:
+ *      looking straight down -z, rows go along x and cols along y, like the grid a surface was voxelized from.
+ */
+void voxel_view_basis(f32 u[3], f32 v[3], f32 w[3], voxel_view_t view) {
+    memcpy(w, view.direction, 3 * sizeof(f32));
+    normalize3(w);
+
+    f32 helper[3] = {1, 0, 0};
+    if(fabsf(w[0]) > 0.9f) {
+        helper[0] = 0;
+        helper[1] = 1;
+    }
+
+    f32 dot = helper[0] * w[0] + helper[1] * w[1] + helper[2] * w[2];
+    for(u32 a = 0; a < 3; ++a) u[a] = helper[a] - dot * w[a];
+    normalize3(u);
+
+    v[0] = u[1] * w[2] - u[2] * w[1];
+    v[1] = u[2] * w[0] - u[0] * w[2];
+    v[2] = u[0] * w[1] - u[1] * w[0];
+}
+
+/**
+ * @brief Walks the voxels the ray goes through, in order (Amanatides & Woo).
+ * The brick of the current voxel is only looked up when the ray enters a new brick,
+ *      so crossing empty space costs a hash lookup per brick, not per voxel.
+ *
+ * @returns 1 on a hit, with t (distance along the normalized direction) and the voxel's value
+ */
+static int cast_ray(f32* t_hit, u32* value, const voxel_env_t* env, const f32 start[3], const f32 w[3], f32 max_t) {
+    i32 voxel[3], step[3], size[3] = {env->size_x, env->size_y, env->size_z};
+    f32 t_max[3], t_delta[3];
+
+    for(u32 a = 0; a < 3; ++a) {
+        voxel[a] = (i32) floorf(start[a]);
+        if(w[a] > 0) {
+            step[a] = 1;
+            t_max[a] = (voxel[a] + 1 - start[a]) / w[a];
+            t_delta[a] = 1 / w[a];
+        } else if(w[a] < 0) {
+            step[a] = -1;
+            t_max[a] = (start[a] - voxel[a]) / -w[a];
+            t_delta[a] = -1 / w[a];
+        } else {
+            step[a] = 0;
+            t_max[a] = INFINITY;
+            t_delta[a] = INFINITY;
+        }
+    }
+
+    u64 cached_key = EMPTY_BRICK_KEY;
+    const voxel_brick_t* brick = NULL;
+
+    f32 t = 0;
+    while(t <= max_t) {
+        int inside = 1;
+        for(u32 a = 0; a < 3; ++a) {
+            if(voxel[a] >= 0 && voxel[a] < size[a]) continue;
+            // never coming back in along that axis
+            if((voxel[a] < 0 && step[a] <= 0) || (voxel[a] >= size[a] && step[a] >= 0)) return 0;
+            inside = 0;
+        }
+
+        if(inside) {
+            u64 key = brick_key(voxel[0] >> VOXEL_BRICK_BITS, voxel[1] >> VOXEL_BRICK_BITS, voxel[2] >> VOXEL_BRICK_BITS);
+            if(key != cached_key) {
+                brick = find_brick(env, key);
+                cached_key = key;
+            }
+
+            vec3d p = {.x = voxel[0], .y = voxel[1], .z = voxel[2]};
+            if(brick != NULL && brick_voxel(brick, p, value)) {
+                *t_hit = t;
+                return 1;
+            }
+        }
+
+        u32 a = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+        t = t_max[a];
+        voxel[a] += step[a];
+        t_max[a] += t_delta[a];
+    }
+
+    return 0;
+}
+
+void sense_voxel_patch(grid_u16_t* patch, const voxel_env_t* env, voxel_view_t view) {
+    assertf(patch->rows == patch->cols && patch->rows % 2 != 0, "patch must be square, of odd sidelength");
+    assertf(view.max_range <= VOXEL_DEPTH_MISS / VOXEL_DEPTH_SUBDIVISIONS, "max_range above %d voxels",
+        VOXEL_DEPTH_MISS / VOXEL_DEPTH_SUBDIVISIONS);
+
+    f32 u[3], v[3], w[3];
+    voxel_view_basis(u, v, w, view);
+
+    i32 radius = patch->rows / 2;
+    for(i32 i = 0; i < (i32) patch->rows; ++i) {
+        for(i32 j = 0; j < (i32) patch->cols; ++j) {
+            f32 start[3];
+            for(u32 a = 0; a < 3; ++a)
+                start[a] = view.origin[a] + view.spacing * ((i - radius) * u[a] + (j - radius) * v[a]);
+
+            f32 t;
+            u32 value;
+            if(cast_ray(&t, &value, env, start, w, view.max_range)) {
+                MAT(patch->depths, i, j) = (u16) lrintf(t * VOXEL_DEPTH_SUBDIVISIONS);
+                MAT(patch->values, i, j) = value;
+            } else {
+                MAT(patch->depths, i, j) = VOXEL_DEPTH_MISS;
+                MAT(patch->values, i, j) = 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef VOXEL_ENVIRONMENT_H
+#define VOXEL_ENVIRONMENT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "location.h"
+#include "arena.h"
+#include "grid_environment.h"
+
+/**
+ * Sparse 3D environment: a hashed brick map.
+ *
+ * Space is cut in (VOXEL_BRICK_SIDE)^3 bricks and only the bricks that hold at least one occupied voxel
+ *      are allocated, so memory follows the surface of the objects rather than the volume of the world
+ *      (a 1024^3 dense grid of u32 would be 4GB, its surface a few thousand bricks).
+ * Bricks are found through an open-addressed table (linear probing) keyed by their packed coordinates.
+ * Inside a brick, occupancy is a bitset (one u64 per z slice) and every voxel has a u32 value, like grid_t cells.
+ *
+ * Voxel (x, y, z) covers [x, x + 1) x [y, y + 1) x [z, z + 1).
+ */
+
+#define VOXEL_BRICK_BITS 3
+#define VOXEL_BRICK_SIDE (1 << VOXEL_BRICK_BITS)
+#define VOXEL_BRICK_VOXELS (VOXEL_BRICK_SIDE * VOXEL_BRICK_SIDE * VOXEL_BRICK_SIDE)
+
+// Brick coordinates are packed on 21 bits each
+#define VOXEL_MAX_SIZE (1 << (21 + VOXEL_BRICK_BITS))
+
+#define EMPTY_BRICK_KEY UINT64_MAX
+
+typedef struct voxel_brick_t_ {
+    u64 occupancy[VOXEL_BRICK_SIDE]; // bit (y * VOXEL_BRICK_SIDE + x) of occupancy[z]
+    u32 values[VOXEL_BRICK_VOXELS]; // (z, y, x) order
+} voxel_brick_t;
+
+typedef struct voxel_env_t_ {
+    u32 size_x;
+    u32 size_y;
+    u32 size_z;
+
+    u32 num_slots; // power of two
+    u64* keys;
+    u32* slot_bricks; // index of the slot's brick in bricks
+
+    u32 num_bricks;
+    u32 max_bricks;
+    voxel_brick_t* bricks;
+} voxel_env_t;
+
+// Upper bound of the memory taken by an environment of at most max_bricks bricks (for arena sizing)
+size_t voxel_env_bytes(u32 max_bricks);
+void init_voxel_env(voxel_env_t* env, u32 size_x, u32 size_y, u32 size_z, u32 max_bricks, arena_t* arena);
+
+// Marks the voxel as occupied, with that value. Allocates its brick if needed
+void set_voxel(voxel_env_t* env, vec3d p, u32 value);
+// Returns 1 if the voxel is occupied (and then sets value, when not NULL), 0 if it is empty or out of the environment
+int get_voxel(const voxel_env_t* env, vec3d p, u32* value);
+
+/**
+ * Turns a 2.5D grid into a closed surface: every cell (i, j) becomes the voxel (i, j, depth + z_offset),
+ *      with the column below it filled down to its lowest neighbour, so that steep walls have no holes.
+ */
+void voxelize_grid_surface(voxel_env_t* env, grid_t* grid, u32 z_offset);
+// Upper bound of the bricks voxelize_grid_surface allocates for grid (max_bricks of the environment it goes in)
+u32 grid_surface_bricks(grid_t* grid, u32 z_offset);
+
+// Depths of sensed patches are in 1/VOXEL_DEPTH_SUBDIVISIONS of a voxel
+#define VOXEL_DEPTH_SUBDIVISIONS 16
+// What a ray that hits nothing sees
+#define VOXEL_DEPTH_MISS UINT16_MAX
+
+/**
+ * A patch sensed in a voxel environment: parallel rays (orthographic projection) along direction,
+ *      starting on the plane through origin perpendicular to it, spacing voxels apart.
+ */
+typedef struct voxel_view_t_ {
+    f32 origin[3]; // center of the patch, in voxels
+    f32 direction[3]; // need not be normalized
+    f32 spacing;
+    u32 max_range; // in voxels, at most VOXEL_DEPTH_MISS / VOXEL_DEPTH_SUBDIVISIONS
+} voxel_view_t;
+
+/**
+ * Casts one ray per patch cell and writes the distance to the first occupied voxel as its depth
+ *      (VOXEL_DEPTH_MISS if there is none within max_range) and that voxel's value.
+ * The patch is a grid_u16_t, ready for sensor_module_u16. Its rows follow one tangent axis of the view,
+ *      its cols the other (see voxel_view_basis).
+ *
+ * @param patch pre-allocated, square and of odd sidelength
+ */
+void sense_voxel_patch(grid_u16_t* patch, const voxel_env_t* env, voxel_view_t view);
+
+// Orthonormal (u, v, w) with w the normalized view direction, rows of the patch go along u and cols along v
+void voxel_view_basis(f32 u[3], f32 v[3], f32 w[3], voxel_view_t view);
+
+#endif // VOXEL_ENVIRONMENT_H
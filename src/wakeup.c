@@ -0,0 +1,25 @@
+#include "wakeup.h"
+
+void wakeup_init(wakeup_t* wakeup) {
+    atomic_store(&wakeup->epoch, 0);
+    atomic_store(&wakeup->sleeping, 0);
+    pthread_mutex_init(&wakeup->mutex, NULL);
+    pthread_cond_init(&wakeup->changed, NULL);
+}
+
+void wakeup_destroy(wakeup_t* wakeup) {
+    pthread_cond_destroy(&wakeup->changed);
+    pthread_mutex_destroy(&wakeup->mutex);
+}
+
+void wakeup_wait(wakeup_t* wakeup, u32 epoch) {
+    pthread_mutex_lock(&wakeup->mutex);
+    for(;;) {
+        // raised before the epoch is checked, and again after every wakeup (a notifier may have cleared it
+        //      for another sleeper): a notifier that bumps the epoch after that check sees the flag
+        atomic_store(&wakeup->sleeping, 1);
+        if(atomic_load(&wakeup->epoch) != epoch) break;
+        pthread_cond_wait(&wakeup->changed, &wakeup->mutex);
+    }
+    pthread_mutex_unlock(&wakeup->mutex);
+}
@@ -0,0 +1,49 @@
+#ifndef WAKEUP_H
+#define WAKEUP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "types.h"
+
+/**
+ * Lets a thread sleep until another one changed something it waits for (e.g. an spsc_ring became non-empty or non-full),
+ *      without taking a lock on the fast path.
+ *
+ * The waiter reads the epoch with wakeup_prepare, then checks its condition, and only if it does not hold
+ *      calls wakeup_wait with that epoch: it sleeps unless the epoch moved in between.
+ * The notifier makes its change visible, then calls wakeup_notify: it bumps the epoch and only takes the mutex
+ *      when it is the first to clear the sleeping flag (the flag and the epoch are sequentially consistent, so either
+ *      the notifier sees the flag, or the sleeper sees the new epoch and does not sleep).
+ *      A burst of notifications to a sleeper that has not run yet thus costs one broadcast, not one per notification.
+ * Any number of waiters and notifiers can share one wakeup: a waiter re-checks its condition after every wakeup.
+ */
+typedef struct wakeup_t_ {
+    _Alignas(64) _Atomic u32 epoch;
+    _Atomic u32 sleeping;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+} wakeup_t;
+
+void wakeup_init(wakeup_t* wakeup);
+void wakeup_destroy(wakeup_t* wakeup);
+
+static inline u32 wakeup_prepare(wakeup_t* wakeup) {
+    return atomic_load(&wakeup->epoch);
+}
+
+// Sleeps until the epoch is no longer the prepared one
+void wakeup_wait(wakeup_t* wakeup, u32 epoch);
+
+static inline void wakeup_notify(wakeup_t* wakeup) {
+    atomic_fetch_add(&wakeup->epoch, 1);
+    if(atomic_load(&wakeup->sleeping) == 0 || atomic_exchange(&wakeup->sleeping, 0) == 0) return;
+
+    pthread_mutex_lock(&wakeup->mutex);
+    pthread_cond_broadcast(&wakeup->changed);
+    pthread_mutex_unlock(&wakeup->mutex);
+}
+
+#endif